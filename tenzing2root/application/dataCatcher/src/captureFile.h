@@ -0,0 +1,50 @@
+/*
+  captureFile.h
+
+  Definitions for the capture files which dataCatcher writes when
+  /global/configFiles/dataCatcherCapture names a directory to put them
+  in, and which dataCatcherReplay feeds back into dataCatcher.
+
+  A capture file starts with one captureFileHeader.   Each RPC call
+  dataCatcher received follows, as a captureRecordHeader and then
+  header.length bytes holding the call's argument, XDR encoded exactly
+  as it came over the wire, so the rpcgen xdr_ routines decode it.
+  Each frame received on the SWARM stream (see swarmStream.h) is
+  recorded the same way, as a CAPTURE_SWARM_STREAM record whose bytes
+  are the frame exactly as it was read - its swarmStreamHeader, baseline
+  table and payload, in the sender's byte order, which dataCatcher
+  checked was its own.   arrival is the time the call or frame reached
+  dataCatcher, in seconds since 1970.   The headers are written in the writer's native byte order, and
+  a reader should reject a file or record whose magic number does not
+  match.   A record cut short by dataCatcher stopping ends the file.
+*/
+
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdint.h>
+
+#define CAPTURE_FILE_MAGIC   (0x44434346) /* "DCCF" */
+#define CAPTURE_RECORD_MAGIC (0x44434352) /* "DCCR" */
+#define CAPTURE_VERSION      (1)
+
+#define CAPTURE_VISIBILITIES (1) /* dCrateUVBlock, for catch_visibilities_1 */
+#define CAPTURE_POWERS       (2) /* dPowerSet, for catch_powers_1           */
+#define CAPTURE_SWARM_DATA   (3) /* dSWARMUVBlock, for catch_swarm_data_1   */
+#define CAPTURE_SWARM_STREAM (4) /* A frame from the SWARM stream, not XDR  */
+
+typedef struct captureFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  double   startTime;  /* When capturing began, in seconds since 1970 */
+} captureFileHeader;
+
+typedef struct captureRecordHeader {
+  uint32_t magic;
+  uint32_t procedure;  /* One of the CAPTURE_ codes above */
+  double   arrival;
+  uint32_t length;     /* Bytes of argument or frame      */
+  uint32_t spare;
+} captureRecordHeader;
+
+#endif
@@ -0,0 +1,73 @@
+/*
+  congestion.h
+
+  Congestion codes which dataCatcher puts in the rt_code of its replies
+  - the dStatusStructure returned by catch_visibilities_1 and
+  catch_swarm_data_1, and the swarmStreamReply on the SWARM stream - to
+  warn its senders that it is falling behind, before it has to drop
+  scans.   They are positive, and mean that the data were accepted, so
+  any rt_code >= 0 is a success.   dataCatcher only sends them if the
+  configuration file dataCatcherCongestion exists, because older senders
+  treat any rt_code other than 0 as an error.
+
+  DATACATCHER_BUSY      - Completed scans are queueing up for the WRITER,
+                          or have waited a long time for it.   Senders
+                          should slow down.
+  DATACATCHER_CONGESTED - The next new scan would force dataCatcher to
+                          drop the oldest pending one, or to stall until
+                          a scan slot is free.   Senders should hold
+                          their data back until the congestion clears.
+
+  congestionDelay() and congestionBackoff() are how the senders in
+  sendIntegration slow down.   They are applied once per integration,
+  using the worst code returned for any part of it - backing off after
+  each baseline and chunk would stretch a single integration out, rather
+  than spacing the integrations.   corrSaver does not pass the codes on,
+  so sendIntegration() never sees them.
+*/
+
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include <unistd.h>
+
+#define DATACATCHER_BUSY      (1)
+#define DATACATCHER_CONGESTED (2)
+
+#define CONGESTION_BACKOFF_MIN   (10000) /* Microseconds */
+#define CONGESTION_BACKOFF_MAX (1000000)
+
+/*
+  congestionDelay returns how many microseconds to hold off the next
+  integration after one whose worst reply was rtCode.   The delay starts
+  at CONGESTION_BACKOFF_MIN, doubles with each congested integration up
+  to CONGESTION_BACKOFF_MAX, and is twice as long for
+  DATACATCHER_CONGESTED.   *backoff holds the current delay for one
+  sender, and is reset by the first integration without congestion.
+*/
+static inline int congestionDelay(int rtCode, int *backoff)
+{
+  if (rtCode <= 0) {
+    *backoff = 0;
+    return(0);
+  }
+  if (*backoff == 0)
+    *backoff = CONGESTION_BACKOFF_MIN;
+  else if (*backoff < CONGESTION_BACKOFF_MAX)
+    *backoff *= 2;
+  if (*backoff > CONGESTION_BACKOFF_MAX)
+    *backoff = CONGESTION_BACKOFF_MAX;
+  return((rtCode == DATACATCHER_CONGESTED) ? 2*(*backoff) : *backoff);
+}
+
+/* congestionBackoff sleeps for the congestionDelay */
+static inline void congestionBackoff(int rtCode, int *backoff)
+{
+  int delay;
+
+  delay = congestionDelay(rtCode, backoff);
+  if (delay > 0)
+    usleep(delay);
+}
+
+#endif
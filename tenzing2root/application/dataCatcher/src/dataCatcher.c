@@ -25,6 +25,7 @@
 #include <rpc/rpc.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -35,6 +36,15 @@
 #include <string.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 #include "/global/include/astrophys.h"
 #include "/global/include/scanFlags.h"
@@ -48,15 +58,35 @@
 #include "setLO.h"
 #include "dataDirectoryCodes.h"
 #include "blocks.h"
-
-#define N_SWARM_CHUNK_POINTS (16384)
+#include "swarmStream.h"
+#include "mirIndex.h"
+#include "schCodec.h"
+#include "swarmKernels.h"
+#include "packKernels.h"
+#include "latencyStats.h"
+#include "ringLog.h"
+#include "captureFile.h"
+#include "congestion.h"
+
+#define MAX_SWARM_CHUNK_POINTS (16384) /* The MIR autoCorrDef record holds no more */
 #define MAX_SWARM_CHUNK (2)
+#define DEFAULT_SWARM_ANTENNAS (8)     /* Defaults for the swarmGeometry, which can */
+#define DEFAULT_SWARM_CHUNKS (2)       /* be overridden by the file                 */
+#define DEFAULT_SWARM_CHANNELS (16384) /* dataCatcherSWARMGeometry                  */
+#define SWARM_SLOTS (4)                /* SWARM integrations assembled at once      */
+#define SWARM_SLOP (1.0)               /* SWARM data with times this close are from */
+                                       /* the same integration                      */
+#define SWARM_FLUSHED_MEMORY (8)       /* Flushed SWARM integrations remembered, */
+                                       /* so late data for them are discarded    */
+#define SWARM_FLUSH_DELAY (5.0)        /* Seconds past its duration a partial SWARM */
+                                       /* integration is held before being flushed  */
+#define MAX_POOLED_SWARM_BUFFERS (8)
 #define SWARM_CHUNK_WIDTH (2.0)
 #define SWARM_IF_MIDPOINT (9.0)
 #define SWARM_CRATE (13)
 #define SWARM_BLOCK (7)
 
-#define dprintf if (debugMessagesOn) printf /* Print IFF debugging          */
+#define dprintf(...) do { if (debugMessagesOn) ringLog(LOG_DEBUG, __VA_ARGS__); } while (0) /* Print IFF debugging */
 #define MAX_RX              (2)
 #define MAX_CRATE          (13)
 #define MAX_ANT            (10)
@@ -64,12 +94,23 @@
 #define MAX_BLOCK           (6)
 #define MAX_INTERIM_CHUNK   (2)
 #define MAX_SB              (2) /* Two sidebands */
-#define MAX_PENDING_SCANS   (3)
+#define DEFAULT_PENDING_SCANS (3) /* Overridden by dataCatcherPendingScans file */
+#define MAX_PENDING_SCANS  (64)
+#define SLOT_WAIT       (50000000) /* Nanoseconds a new scan waits for a free slot */
 #define MAX_PAD            (26)
 #define MAX_SPACELIKE_COORD (3)
 #define MAX_POLARIZATION    (4)
-#define MAX_SOURCES     (10000) /* I should make this dynamic */
+#define SOURCE_NAME_MATCH (25) /* Characters which must match for two sources to be the same */
 #define UNINITIALIZED      (-1) /* Flags an uninitialized array element */
+#define ARENA_ALIGNMENT    (64) /* Byte alignment of arena allocations  */
+#define ARENA_POOL_SIZE     (8) /* Max # of released arena regions kept  */
+#define HUGE_PAGE_SIZE (2*1024*1024)
+#define MAX_SITE_ROOT      (64) /* Longest siteRoot - see sitePath()    */
+#define CAPTURE_BUFFER_SIZE (4*1024*1024) /* stdio buffer for the capture file */
+#define CAPTURE_QUEUE_BYTES (256*1024*1024) /* Most data waiting for the CAPTURER */
+#define CONGESTION_BACKLOG  (2) /* Completed scans queued before senders are told */
+#define CONGESTION_LAG   (10.0) /* dataCatcher is BUSY, or seconds the oldest one */
+                                /* may wait for the WRITER before they are told   */
 #define MIDPOINT_SLOP 1.0       /* Bundles differing by less than this amount are
 			           considered to be part of the same scan. */
 
@@ -92,11 +133,27 @@
 /* processBundle error codes */
 #define UNEXPECTED_BUNDLE      (-2)
 #define REDUNDANT_BUNDLE       (-3)
+#define NO_SCAN_SLOT           (-4)
 
 #define SERVER_PRIORITY (20)
 #define HEADER_PRIORITY (19)
+#define FETCHER_PRIORITY (19)
 #define WRITER_PRIORITY (18)
 #define COPIER_PRIORITY (17)
+#define STREAM_PRIORITY (20)
+#define OUTPUT_PRIORITY (18)
+#define PACKER_PRIORITY (18)
+#define PREPARER_PRIORITY (17)
+#define LATENCY_PRIORITY (16)
+#define MAX_STREAM_CONNECTIONS (16) /* Simultaneous SWARM stream senders allowed */
+#define OUTPUT_THREADS      (4) /* Threads copying finished scans to the MIR files */
+#define OUTPUT_QUEUE_DEPTH  (4) /* Scans which may be waiting for the OUTPUT threads */
+#define MAX_OUTPUT_STREAMS (MAX_RX+10) /* MIR files written for each scan        */
+#define MAX_OUTPUT_FILES (2*MAX_OUTPUT_STREAMS) /* MIR files open at once        */
+#define OUTPUT_WRITE_RETRIES (8) /* Tries at a write which fails transiently    */
+#define OUTPUT_RETRY_DELAY (100000) /* Microseconds before the first retry      */
+#define PACKER_THREADS      (4) /* Threads helping the WRITER run packData()       */
+#define PACK_GRAIN         (16) /* Spectra a PACKER claims at once                 */
 
 #define POL_STATE_UNKNOWN (0)
 #define POL_STATE_RR      (1)
@@ -124,15 +181,69 @@ typedef struct dSMInfo {
   char polarStates[12];
 } dSMInfo;
 
+/*
+  A visBuffer is a reference counted block of spectral data.   It allows
+  the SWARM data to be written into memory once, when it arrives, and then
+  be handed down to the pending scan list and the WRITER thread without
+  being copied again.   The memory is freed when the last user releases it.
+*/
+typedef struct visBuffer {
+  int    refCount;
+  size_t size;                         /* Size of data, in bytes                 */
+  int    pooled;                       /* TRUE if returned to sWARMBufferPool,   */
+                                       /* rather than freed, when released       */
+  char   *data;
+  struct visBuffer *next;              /* Link in sWARMBufferPool                */
+} visBuffer;
+
+/*
+  A scanArena is one region of the memory arena which holds all the bundles
+  of a pending scan.   Regions are chained through next, newest first.
+*/
+typedef struct scanArena {
+  size_t size;                         /* Size of the region, in bytes           */
+  size_t used;                         /* Bytes handed out so far                */
+  int    mapped;                       /* TRUE if base was obtained from mmap    */
+  char   *base;
+  struct scanArena *next;
+} scanArena;
+
+/*
+  A pCPartial holds one chunk and sideband's contribution to the
+  pseudo-continuum sums.   They are computed as each bundle arrives, so
+  the WRITER only has to add them up.
+*/
+typedef struct pCPartial {
+  float  realSum, imagSum, ampSum;     /* Channel weighted sums                  */
+  float  channelWeight;
+  short  startChannel, endChannel;     /* Channels outside the edges are ignored */
+  int    sawNaN;                       /* TRUE if a real part was a NaN          */
+} pCPartial;
+
+/*
+  A headerExtra holds what headerFetchStatusServer() finds out about an
+  integration besides the statusServer header.   It travels with the
+  header, so that a header fetched in advance does not change the values
+  used for the scan being processed now.
+*/
+typedef struct headerExtra {
+  double        sWARMCenterFrequency;  /* Sky frequency at the SWARM IF center  */
+  char          sourceName[35];        /* Source name read before the fetch     */
+  int           spoilScan;             /* TRUE if the source changed during it  */
+} headerExtra;
+
 typedef struct pendingScan {
   int           expected[MAX_CRATE+1]; /* List of crates expected to report      */
   int           received[MAX_CRATE+1]; /* List of crates that have been received */
   double        firstTime;             /* Time stamp of first bundle             */
   double        intTime;               /* Length of the scan in seconds          */
-  double        birthTime;
+  double        birthTime;             /* When the first bundle arrived          */
+  double        arrivalTime[MAX_CRATE+1]; /* When each crate's bundle arrived    */
+  double        headerTime;            /* When the header info was stored        */
   int           number;
   int           gotHeaderInfo;         /* Flag we've got data from statusServer  */
   info          header;                /* Stuff from statusServer                */
+  headerExtra   extra;                 /* Fetched along with header              */
   dSMInfo       dSMStuff;
   double        chunkFreq[MAX_RX][MAX_SB][(2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK)+1];
   double        chunkVelo[MAX_RX][MAX_SB][(2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK)+1];
@@ -148,10 +259,243 @@ typedef struct pendingScan {
   int           nDaisyChained[MAX_CRATE+1];
   int           nInDaisyChain[MAX_CRATE+1];
   dCrateUVBlock *data[MAX_CRATE+1];    /* Cached copy of UV data bundles         */
-  char *last;
+  visBuffer     *shared[MAX_CRATE+1];  /* If not NULL, the spectra in data[] are */
+                                       /* borrowed from this buffer              */
+  pCPartial     *pCSums[MAX_CRATE+1];  /* Pseudo-continuum sums for each bundle, */
+                                       /* by set*MAX_SB + sb, or NULL            */
+  scanArena     *arena;                /* Memory holding the data[] bundles      */
+  int           copiesInFlight;        /* Bundles being copied in, outside of    */
+                                       /* the scanMutex                          */
+  int           dropped;               /* TRUE if the scan was dropped while     */
+                                       /* copies were in flight                  */
+  int           completed;             /* TRUE once handed to the WRITER         */
+  unsigned int  serial;                /* Unique, increasing, creation number    */
+  long          key;                   /* Quantized firstTime, for scanIndex     */
+  char *last;                          /* Pending scans, in order of creation    */
   char *next;
 } pendingScan;
 
+/*
+  The scanTable holds all the pending scans.   Their storage is allocated
+  once, at startup, and the scans are indexed by their quantized midpoint
+  times, so that finding, adding and dropping scans are all O(1) operations.
+  There are twice depth slots, plus one, so that completed scans waiting
+  for the WRITER, and the scan being written, don't normally take slots
+  from the pending scans.
+*/
+typedef struct scanTable {
+  int         depth;                   /* Maximum number of pending scans        */
+  int         count;                   /* Number of scans now pending            */
+  unsigned int nextSerial;
+  pendingScan *slots;                  /* depth preallocated scans               */
+  int         *freeSlots;              /* Stack of unused entries in slots       */
+  int         nFree;
+  int         indexSize;               /* Size of scanIndex, a power of 2        */
+  int         nDeleted;                /* Deleted markers in scanIndex           */
+  int         *scanIndex;              /* Open addressed hash of slots by key    */
+} scanTable;
+
+/*
+  The swarmGeometry describes the SWARM correlator dataCatcher is receiving
+  data from.   The SWARM buffers are sized from it when a scan is started,
+  so only the baselines and chunks actually in use take up memory.
+*/
+typedef struct swarmGeometry {
+  int nAntennas;                       /* SWARM antennas are 1..nAntennas        */
+  int nChunks;                         /* Chunks per baseline                    */
+  int nChannels;                       /* Channels per chunk and sideband        */
+} swarmGeometry;
+
+/*
+  The scanQueue holds completed scans waiting for the WRITER.   A scan
+  is taken out of the scan table's index when it is queued, but keeps
+  its slot, which the WRITER returns when it has written the scan.
+  It is protected by the writeScanMutex.   The queue depth and the time
+  scans spend in it are tracked, to show how far the WRITER is behind.
+*/
+typedef struct scanQueue {
+  int         size;                    /* Capacity of entries                    */
+  int         head;                    /* Index of the oldest entry              */
+  int         count;                   /* Number of scans now queued             */
+  pendingScan **entries;
+  double      *queueTime;              /* When each entry was queued             */
+  int         maxCount;                /* Deepest the queue has been             */
+  long        nQueued;                 /* Total scans passed through the queue   */
+  double      waitSum;                 /* Total and longest time scans have      */
+  double      waitMax;                 /* waited in the queue, in seconds        */
+} scanQueue;
+
+/*
+  An outputFile is a MIR file the OUTPUT threads write to.   The WRITER
+  opens the files with stdio, but once a file has been handed to OUTPUT
+  it is written only by its owner, with pwritev() (or io_uring), at
+  offset, which only the owner advances.
+*/
+typedef struct outputFile {
+  FILE        *file;                   /* NULL if this entry is unused           */
+  int         fd;
+  int         owner;                   /* The OUTPUT thread which writes it      */
+  off_t       offset;                  /* Where the next data go in the file     */
+  off_t       queued;                  /* Where the WRITER's next batch will go  */
+  int         dirty;                   /* TRUE if written since last synced      */
+} outputFile;
+
+/*
+  An outputBatch holds everything the WRITER produces for one scan, for
+  all of the MIR files.   The WRITER fills it through stdio memory
+  streams, then hands it to the OUTPUT threads, which copy it into the
+  files while the WRITER goes on to the next scan.   Any one file is
+  always written by the same OUTPUT thread, and batches are written in
+  the order they were submitted, so the files come out exactly as they
+  would if the WRITER had written them itself.   A trailer stream is
+  written only after every OUTPUT thread has written the rest of its
+  batch.
+*/
+typedef struct outputStream {
+  outputFile  *file;                   /* MIR file the data belong in            */
+  FILE        *stream;                 /* Memory stream the WRITER fills         */
+  char        *buffer;                 /* Contents of stream, once closed        */
+  size_t      size;
+  int         trailer;                 /* TRUE if written after the rest         */
+} outputStream;
+
+typedef struct outputBatch {
+  int          scanNumber;
+  int          nStreams;
+  int          nWriters;               /* OUTPUT threads yet to finish with it   */
+  int          nDataWriters;           /* and yet to write all but the trailers  */
+  double       birthTime;              /* When the scan's first bundle arrived   */
+  double       submitTime;             /* When the WRITER submitted the batch    */
+  outputStream streams[MAX_OUTPUT_STREAMS];
+} outputBatch;
+
+/*
+  Each OUTPUT thread has its own outputQueue, so a slow disk only holds
+  up the thread writing to it.   The queues are protected by outputMutex.
+*/
+typedef struct outputQueue {
+  int         head;                    /* Index of the oldest entry              */
+  int         count;                   /* Number of batches now queued           */
+  outputBatch *entries[OUTPUT_QUEUE_DEPTH];
+} outputQueue;
+
+/*
+  A packJob describes one call to packData().   The WRITER lists them as
+  it builds the spectrum headers, then runs them all at once, along with
+  the PACKER threads.   Each job fills its own part of sch.packdata, so
+  the result does not depend upon which thread ran which job.
+*/
+typedef struct packJob {
+  int         nChan;
+  float       intTime;
+  float       *real;                   /* NULL for the pseudo continuum channel, */
+  float       *imag;                   /* which is held in contReal and contImag */
+  float       contReal, contImag;
+  short       *slot;
+  short       rx, sb, bl, band, set, crate; /* For error messages                */
+} packJob;
+
+/*
+  A captureItem is one record waiting for the CAPTURER thread to append
+  it to the capture file.
+*/
+typedef struct captureItem {
+  captureRecordHeader record;
+  char               *data;            /* record.length bytes, from malloc()     */
+  struct captureItem *next;
+} captureItem;
+
+/*
+  A dataFileSet is a directory of freshly opened MIR files, made ready by
+  the PREPARER thread under a staging name.   The WRITER renames the
+  directory when it starts using the files.
+*/
+typedef struct dataFileSet {
+  int         ready;                   /* TRUE once the files are all open       */
+  char        directory[50];           /* Directory under /data                  */
+  char        stagingPath[80+MAX_SITE_ROOT];
+  FILE        *plotFile[MAX_RX], *baselineFile, *weFile, *tsysFile, *codesFile,
+    *engFile, *inFile, *spFile, *schFile, *indexFile, *dataoffFile;
+} dataFileSet;
+
+/*
+  A chunkTable holds the chunk frequencies and velocities for one tuning,
+  along with everything they were computed from.   sWARMDoppler is the
+  part of the SWARM chunk velocities which does not depend upon the
+  source's velocity.
+*/
+typedef struct chunkTable {
+  int           valid;
+  unsigned char frequencies[sizeof(((pendingScan *)0)->header.loData.frequencies)];
+  double        restFrequency[sizeof(((pendingScan *)0)->header.loData.restFrequency)/sizeof(double)];
+  int           doubleBandwidth, doubleBandwidthRx;
+  double        bDAIFSep, sWARMCenterFrequency;
+  double        chunkFreq[MAX_RX][MAX_SB][(2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK)+1];
+  double        chunkVelo[MAX_RX][MAX_SB][(2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK)+1];
+  double        sWARMFreq[MAX_SB][MAX_SWARM_CHUNK], sWARMDoppler[MAX_SB][MAX_SWARM_CHUNK];
+} chunkTable;
+
+/*
+  The stages whose latencies are kept in stageLatency.   Every scan is
+  time stamped when its first and last bundles arrive, when its header
+  is stored, when the WRITER takes it, when its spectra have been packed
+  and when the OUTPUT threads have written it.
+*/
+#define LATENCY_ARRIVAL (0)     /* First bundle to last bundle                  */
+#define LATENCY_HEADER  (1)     /* First bundle to header stored                */
+#define LATENCY_QUEUE   (2)     /* Last of those two to WRITER dequeue          */
+#define LATENCY_PACK    (3)     /* WRITER dequeue to packing done               */
+#define LATENCY_IO      (4)     /* Batch submitted to batch written             */
+#define LATENCY_TOTAL   (5)     /* First bundle to batch written                */
+#define LATENCY_STAGES  (6)
+#define LATENCY_SOCKET  "/tmp/dataCatcherLatency" /* Connect here for a dump    */
+
+/*
+  The HEADER thread gets scans' header information from statusServer
+  through the FETCHER thread, which also fetches each integration's
+  header in advance.   A headerRequestEntry lists a scan waiting for its
+  header, and a headerFetch holds the result of one statusServer call.
+*/
+#define HEADER_FETCHED  (4)     /* Results kept by the FETCHER                  */
+#define HEADER_DEADLINE (3)     /* Seconds to wait for statusServer             */
+#define HEADER_NONE     (0)     /* headerAwait() return values                  */
+#define HEADER_FRESH    (1)
+#define HEADER_STALE    (2)
+#define HEADER_WARN_INTERVAL (60) /* Seconds between missing header warnings   */
+
+typedef struct headerRequestEntry {
+  pendingScan  *scan;
+  unsigned int serial;                 /* scan's serial, to spot reused slots    */
+} headerRequestEntry;
+
+typedef struct headerFetch {
+  double      utsec, interval;         /* The integration the header is for      */
+  int         ok;                      /* TRUE if statusServer supplied it       */
+  info        header;
+  headerExtra extra;                   /* Found whether or not ok is TRUE        */
+} headerFetch;
+
+/*
+  The sourceCatalog lists the sources whose names have been written to
+  the codes file, in the order they were first seen, so a source's id is
+  its index plus one.   The entries are found through a hash table of
+  chains, which is rebuilt whenever the entry list grows.   The catalog
+  also counts the velocity ("vrad") codes written.
+*/
+typedef struct catalogEntry {
+  char        name[34];
+  unsigned int hash;
+  int         next;                    /* Next entry in the chain, or -1         */
+} catalogEntry;
+
+typedef struct sourceCatalog {
+  int          nEntries, maxEntries;
+  catalogEntry *entries;
+  int          nBuckets;
+  int          *buckets;               /* First entry in each chain, or -1       */
+  int          nVRad;                  /* vrad codes written so far              */
+} sourceCatalog;
+
 typedef struct crateSetIndex {
   short crate;
   short set;
@@ -173,15 +517,14 @@ typedef struct sWARMAutoRec {
 } sWARMAutoRec;
 sWARMAutoRec *sWARMAutoRoot = NULL;
 
-double sWARMCenterFrequency;
 short goodChunk[MAX_RX+1][MAX_ANT+1][MAX_ANT+1][(2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK)+1];
 int antennaInArrayInitialized = FALSE;
 int antennaInArray[11];
 int activeCrates[MAX_CRATE+1];
 int abortOnMinorErrors = FALSE; /* Abort on detection of errors even if recoverable */
 int debugMessagesOn = FALSE;
-int needHeader      = FALSE; /* Used with condition variable to activate header thread */
-int needWrite       = FALSE; /* Used with condition variable to activate writer thread */
+int nHeaderRequests = 0;     /* Number of scans waiting for the HEADER thread */
+int headerRequestHead = 0;   /* Oldest entry in headerRequests */
 int doDSMWrite      = FALSE;  /* Turn on or off the writing of DSM variables            */
 int needNewDataFile = TRUE;
 int safeRestarts    = TRUE;  /* If TRUE, abort on HUP signal rather than trying to     */
@@ -201,23 +544,60 @@ int globalScanNumber = 0;
 int foundAntennaList[MAX_ANT+1];
 int receiverActive[MAX_RX+1] = {FALSE, FALSE, FALSE};
 int chunkCodes[MAX_RX+1][2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK+1];
-int nSources = 0;
+sourceCatalog sources;            /* Sources written to the codes file, owned by the WRITER */
 int nChunkCodes = 1;
 long refJD = 0;
 int nBaselineCodes = 0;
 int nAntennas = 0;
 int iRefTime = -1;
 int store = TRUE;
-char pathName[80];          /* path for directory where data is stored      */
-char globalSourceName[35];
-int spoilScanFlag = FALSE;
+char pathName[80+MAX_SITE_ROOT]; /* path for directory where data is stored */
 double globalSkyFrequency[2];
 struct frequenciesDef globalFrequencies;
 
 blhDef blh[MAX_RX][MAX_SB][2*MAX_BASELINE];
-pendingScan *scanRoot = NULL;
-pendingScan *headerScan = NULL; /* Points to scan needing header info */
-pendingScan *writableScan = NULL; /* Points to completed scan */
+scanArena *arenaPool = NULL; /* Released arena regions, available for reuse */
+visBuffer *sWARMBufferPool = NULL; /* Released SWARM scan buffers, available for reuse */
+int nPooledSWARMBuffers = 0;
+int nPooledArenas = 0;
+int useHugePages = FALSE;    /* Back scan arenas with huge pages if possible */
+int congestionCodes = FALSE; /* Warn senders of congestion through rt_code   */
+int nStreamConnections = 0;  /* Number of STREAM worker threads running */
+swarmGeometry swarm = {DEFAULT_SWARM_ANTENNAS, DEFAULT_SWARM_CHUNKS, DEFAULT_SWARM_CHANNELS};
+scanTable pending;
+latencyHistogram stageLatency[LATENCY_STAGES]; /* Indexed by LATENCY_ stage     */
+latencyHistogram crateLatency[MAX_CRATE+1];    /* First bundle to each crate's  */
+char *stageNames[LATENCY_STAGES] = {"arrival", "header", "queue", "pack", "io", "total"};
+pendingScan *scanRoot = NULL;   /* Oldest pending scan */
+pendingScan *scanTail = NULL;   /* Newest pending scan */
+headerRequestEntry headerRequests[MAX_PENDING_SCANS]; /* Scans needing header info */
+headerFetch fetchedHeaders[HEADER_FETCHED]; /* The FETCHER's latest results */
+headerFetch lastGoodHeader;       /* The last header statusServer supplied */
+int haveLastGoodHeader = FALSE;
+int nFetchedHeaders = 0;          /* Total results put into fetchedHeaders */
+unsigned int fetchRequested = 0;  /* Number of the last fetch the HEADER asked for */
+unsigned int fetchStarted = 0;    /* and of the last one the FETCHER started */
+double fetchUtsec, fetchInterval; /* The integration fetchRequested is for */
+double fetchSpacing = 0.0;        /* Time between the starts of recent integrations */
+scanQueue completedScans;         /* Completed scans, waiting for the WRITER */
+outputQueue outputQueues[OUTPUT_THREADS];
+outputFile outputFiles[MAX_OUTPUT_FILES];
+dataFileSet spareFileSet;         /* The next data set, prepared by the PREPARER */
+int outputSyncEvery = 0;          /* fdatasync() the MIR files every this many scans - 0 for never */
+int schCodec = 0;                 /* SCH_CODEC_ for writing sch_read.z, or 0 to write sch_read */
+char siteRoot[MAX_SITE_ROOT] = ""; /* Prefixed to /global, /common, /data and /tmp paths */
+FILE *captureFile = NULL;         /* Incoming RPC calls are recorded here, if not NULL */
+captureItem *captureHead = NULL;  /* Records waiting for the CAPTURER, oldest first */
+captureItem *captureTail = NULL;
+size_t captureQueuedBytes = 0;    /* Bytes of records in the capture queue */
+unsigned long captureDropped = 0; /* Records dropped because the capture queue was full */
+int nOutputBatches = 0;           /* Batches submitted but not yet completely written */
+packJob *packJobs = NULL;
+int nPackJobs = 0;
+int maxPackJobs = 0;
+int nextPackJob = 0;              /* Next job for a PACKER or the WRITER to claim     */
+int nPackJobsDone = 0;
+int packing = FALSE;              /* TRUE while the jobs in packJobs are being run    */
 crateSetIndex cSIndx[MAX_RX+1][MAX_ANT+1][MAX_ANT+1][MAX_POLARIZATION][2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK + 1];
 baselineIndex bslnIndx[MAX_SIDEBAND*MAX_BASELINE];
 /*
@@ -234,24 +614,51 @@ int chunkSNameInitialized = FALSE;
 
 /*   T H R E A D   S T U F F */
 
-pthread_t headerTId, writerTId, copierTId;
+pthread_t headerTId, fetcherTId, writerTId, copierTId, streamTId, latencyTId, loggerTId, capturerTId;
+pthread_t outputTId[OUTPUT_THREADS], packerTId[PACKER_THREADS], preparerTId;
 
 /*   M U T E X E S   */
 
 pthread_mutex_t scanMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects the linked list of scans */
 pthread_mutex_t needHeaderMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t fetchMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects the fetch variables */
 pthread_mutex_t writeScanMutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t autoMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects linked list of autocorrelations */
+pthread_mutex_t visBufferMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects visBuffer reference counts */
+pthread_mutex_t arenaMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects the pool of arena regions */
+pthread_mutex_t sWARMMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects the SWARM scan being assembled */
+pthread_mutex_t sWARMFlushMutex = PTHREAD_MUTEX_INITIALIZER; /* Keeps SWARM bundles in order, protects sWARMBundle */
+pthread_mutex_t startMutex = PTHREAD_MUTEX_INITIALIZER; /* Makes startThreads() safe to call from any thread */
+pthread_mutex_t streamMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects nStreamConnections */
+pthread_mutex_t outputMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects outputQueues and nOutputBatches */
+pthread_mutex_t packMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects the packJobs counters */
+pthread_mutex_t prepareMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects spareFileSet */
+pthread_mutex_t captureMutex = PTHREAD_MUTEX_INITIALIZER; /* Protects captureFile and the capture queue */
 
 /*   C O N D I T I O N   V A R I A B L E S   */
 
 pthread_cond_t needHeaderCond = PTHREAD_COND_INITIALIZER;
-pthread_cond_t writeScanCond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t fetchCond = PTHREAD_COND_INITIALIZER;   /* Signalled when the HEADER wants a header */
+pthread_cond_t fetchedCond = PTHREAD_COND_INITIALIZER; /* Signalled when the FETCHER has one */
+pthread_cond_t writeScanCond = PTHREAD_COND_INITIALIZER; /* Signalled when a scan is queued for the WRITER */
+pthread_cond_t copyDoneCond = PTHREAD_COND_INITIALIZER; /* Signalled, with scanMutex, when a bundle copy finishes */
+pthread_cond_t captureCond = PTHREAD_COND_INITIALIZER; /* Signalled when a record is queued for the CAPTURER */
+pthread_cond_t outputCond = PTHREAD_COND_INITIALIZER; /* Signalled when a batch is queued for OUTPUT */
+pthread_cond_t outputDoneCond = PTHREAD_COND_INITIALIZER; /* Signalled when an OUTPUT thread finishes a batch */
+pthread_cond_t packCond = PTHREAD_COND_INITIALIZER; /* Signalled when packJobs are ready to run */
+pthread_cond_t packDoneCond = PTHREAD_COND_INITIALIZER; /* Signalled when the last packJob is done */
+pthread_cond_t prepareCond = PTHREAD_COND_INITIALIZER; /* Signalled when spareFileSet is taken */
+pthread_cond_t preparedCond = PTHREAD_COND_INITIALIZER; /* Signalled when spareFileSet is ready */
+pthread_cond_t sWARMSlotFreeCond = PTHREAD_COND_INITIALIZER; /* Signalled, with sWARMMutex, when a SWARM slot is freed */
 
 /*   F U N C T I O N   P R O T O T Y P E S   */
 
 extern int getCrateList(int *members);
 extern int getAntennaList(int *members);
+void *streamServer(void *arg);
+void flushStaleSWARMScans(void);
+void sourceCatalogReset(sourceCatalog *catalog);
+outputFile *outputFileGet(FILE *file);
 
 /* Prototypes for functions in novas.c */
 void sidereal_time (double jd_high, double jd_low, double ee,
@@ -279,7 +686,8 @@ void initializeArrays(void)
   int i, ant1, ant2, band, rx, pol;
 
   iRefTime = -1;
-  globalScanNumber = nSources = nBaselineCodes = nAntennas = refJD = 0;
+  globalScanNumber = nBaselineCodes = nAntennas = refJD = 0;
+  sourceCatalogReset(&sources);
   nChunkCodes = 1;
   for (rx = 0; rx < MAX_RX+1; rx++)
     for (ant1 = 0; ant1 < MAX_ANT+1; ant1++)
@@ -374,29 +782,274 @@ void flagChunkBad(int block, int chunk)
 }
 
 /*
-  B U N D L E   C O P Y
+  V I S   B U F F E R   C R E A T E
 
-  bundleCopy makes a copy of the portions of a bundle we actually need
+  visBufferCreate allocates a new visBuffer large enough to hold size
+  bytes of data.   The caller holds the only reference to it.
 */
-void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int interpret,
-		int *hiRes, int *nDaisyChained, int *nInDaisyChain)
+visBuffer *visBufferCreate(size_t size)
 {
-  int set, hiResCount, hiResPtr, nSets;
+  visBuffer *buffer;
 
-  *hiRes = *nDaisyChained = *nInDaisyChain = 0;
-  (*dest) = (dCrateUVBlock *)malloc(sizeof(*((*dest))));
-  if ((*dest) == NULL) {
-    perror("processScan - first bundle copy malloc");
+  buffer = (visBuffer *)malloc(sizeof(*buffer));
+  if (buffer == NULL) {
+    perror("visBufferCreate - malloc of buffer");
     exit(ERROR);
   }
-  (*dest)->crateNumber = source->crateNumber;
-  (*dest)->blockNumber = source->blockNumber;
-  (*dest)->scanType    = source->scanType;
-  (*dest)->scanNumber  = source->scanNumber;
-  (*dest)->UTCtime     = source->UTCtime;
-  (*dest)->intTime     = source->intTime;
-  (*dest)->set.set_len = source->set.set_len;
-  strcpy((*dest)->sourceName, source->sourceName);
+  buffer->data = (char *)malloc((size > 0) ? size : 1);
+  if (buffer->data == NULL) {
+    perror("visBufferCreate - malloc of data");
+    exit(ERROR);
+  }
+  buffer->size = size;
+  buffer->refCount = 1;
+  buffer->pooled = FALSE;
+  buffer->next = NULL;
+  return(buffer);
+} /* End of visBufferCreate */
+
+/*
+  V I S   B U F F E R   R E T A I N
+
+  visBufferRetain adds a reference to a visBuffer.
+*/
+visBuffer *visBufferRetain(visBuffer *buffer)
+{
+  pthread_mutex_lock(&visBufferMutex);
+  buffer->refCount++;
+  pthread_mutex_unlock(&visBufferMutex);
+  return(buffer);
+} /* End of visBufferRetain */
+
+/*
+  V I S   B U F F E R   R E L E A S E
+
+  visBufferRelease drops a reference to a visBuffer, and frees it
+  if that was the last one.   Pooled buffers are put back in the
+  sWARMBufferPool instead, if it has room.
+*/
+void visBufferRelease(visBuffer *buffer)
+{
+  int remaining;
+
+  pthread_mutex_lock(&visBufferMutex);
+  remaining = --buffer->refCount;
+  if ((remaining == 0) && buffer->pooled && (nPooledSWARMBuffers < MAX_POOLED_SWARM_BUFFERS)) {
+    buffer->next = sWARMBufferPool;
+    sWARMBufferPool = buffer;
+    nPooledSWARMBuffers++;
+    buffer = NULL;
+  }
+  pthread_mutex_unlock(&visBufferMutex);
+  if ((remaining == 0) && (buffer != NULL)) {
+    free(buffer->data);
+    free(buffer);
+  }
+} /* End of visBufferRelease */
+
+/*
+  S W A R M   B U F F E R   G E T
+
+  sWARMBufferGet returns a pooled visBuffer of at least size bytes,
+  taking one from the sWARMBufferPool if one is available there.
+*/
+visBuffer *sWARMBufferGet(size_t size)
+{
+  visBuffer *buffer, **ptr;
+
+  pthread_mutex_lock(&visBufferMutex);
+  for (ptr = &sWARMBufferPool; (*ptr != NULL) && ((*ptr)->size < size); ptr = &((*ptr)->next));
+  buffer = *ptr;
+  if (buffer != NULL) {
+    *ptr = buffer->next;
+    nPooledSWARMBuffers--;
+    buffer->refCount = 1;
+    buffer->next = NULL;
+  }
+  pthread_mutex_unlock(&visBufferMutex);
+  if (buffer == NULL) {
+    buffer = visBufferCreate(size);
+    buffer->pooled = TRUE;
+  }
+  return(buffer);
+} /* End of sWARMBufferGet */
+
+/*
+  A R E N A   C R E A T E
+
+  arenaCreate returns an empty arena region with room for at least size
+  bytes.   Regions released by earlier scans are reused if one is big
+  enough, so in steady state no memory is allocated or freed for scans.
+  If huge pages have been requested, the region is backed by them when
+  the kernel can supply them.
+*/
+scanArena *arenaCreate(size_t size)
+{
+  scanArena *region, *last;
+
+  pthread_mutex_lock(&arenaMutex);
+  last = NULL;
+  region = arenaPool;
+  while ((region != NULL) && (region->size < size)) {
+    last = region;
+    region = region->next;
+  }
+  if (region != NULL) {
+    if (last == NULL)
+      arenaPool = region->next;
+    else
+      last->next = region->next;
+    nPooledArenas--;
+  }
+  pthread_mutex_unlock(&arenaMutex);
+  if (region != NULL) {
+    region->used = 0;
+    region->next = NULL;
+    return(region);
+  }
+
+  region = (scanArena *)malloc(sizeof(*region));
+  if (region == NULL) {
+    perror("arenaCreate - malloc of region");
+    exit(ERROR);
+  }
+  region->mapped = FALSE;
+  region->base = NULL;
+  if (useHugePages) {
+    size = ((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+    region->base = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region->base == (char *)MAP_FAILED)
+      region->base = NULL;
+    else
+      region->mapped = TRUE;
+#endif
+    if (region->base == NULL) {
+      /* No huge pages reserved - ask for transparent huge pages instead */
+      if (posix_memalign((void **)&(region->base), HUGE_PAGE_SIZE, size) == 0) {
+#ifdef MADV_HUGEPAGE
+	madvise(region->base, size, MADV_HUGEPAGE);
+#endif
+      } else
+	region->base = NULL;
+    }
+  } else
+    region->base = (char *)malloc(size);
+  if (region->base == NULL) {
+    perror("arenaCreate - allocation of region");
+    exit(ERROR);
+  }
+  region->size = size;
+  region->used = 0;
+  region->next = NULL;
+  return(region);
+} /* End of arenaCreate */
+
+/*
+  A R E N A   A L L O C
+
+  arenaAlloc hands out size bytes from the newest region of an arena,
+  adding a new region if the newest one is too full.   Nothing
+  allocated this way is ever freed individually - the whole arena is
+  released at once by arenaRelease().
+*/
+void *arenaAlloc(scanArena **arena, size_t size)
+{
+  void *ptr;
+
+  size = (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+  if ((*arena == NULL) || (((*arena)->used + size) > (*arena)->size)) {
+    scanArena *region;
+
+    if ((*arena != NULL) && ((*arena)->size > size))
+      region = arenaCreate((*arena)->size);
+    else
+      region = arenaCreate(size);
+    region->next = *arena;
+    *arena = region;
+  }
+  ptr = (void *)((*arena)->base + (*arena)->used);
+  (*arena)->used += size;
+  return(ptr);
+} /* End of arenaAlloc */
+
+/*
+  A R E N A   R E L E A S E
+
+  arenaRelease resets all the regions of an arena, and returns them
+  to the pool for reuse by later scans.
+*/
+void arenaRelease(scanArena *arena)
+{
+  scanArena *next;
+
+  while (arena != NULL) {
+    next = arena->next;
+    pthread_mutex_lock(&arenaMutex);
+    if (nPooledArenas < ARENA_POOL_SIZE) {
+      arena->used = 0;
+      arena->next = arenaPool;
+      arenaPool = arena;
+      nPooledArenas++;
+      arena = NULL;
+    }
+    pthread_mutex_unlock(&arenaMutex);
+    if (arena != NULL) {
+      if (arena->mapped)
+	munmap(arena->base, arena->size);
+      else
+	free(arena->base);
+      free(arena);
+    }
+    arena = next;
+  }
+} /* End of arenaRelease */
+
+#define ARENA_SIZE(n) ((((size_t)(n)) + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1))
+
+/*
+  B U N D L E   C O P Y   S I Z E
+
+  bundleCopySize returns the number of arena bytes bundleCopy() will
+  need to copy a bundle.
+*/
+size_t bundleCopySize(dCrateUVBlock *source, int hiResCount, int shared)
+{
+  int set, len;
+  size_t size;
+
+  size = ARENA_SIZE(sizeof(dCrateUVBlock)) +
+    ARENA_SIZE(hiResCount * source->set.set_len * sizeof(dVisibilitySet));
+  for (set = 0; set < source->set.set_len; set++) {
+    size += hiResCount * (ARENA_SIZE(source->set.set_val[set].real.real_len * sizeof(dVarArray)) +
+			  ARENA_SIZE(source->set.set_val[set].imag.imag_len * sizeof(dVarArray)));
+    if (!shared) {
+      for (len = 0; len < source->set.set_val[set].real.real_len; len++)
+	size += hiResCount *
+	  ARENA_SIZE(source->set.set_val[set].real.real_val[len].channel.channel_len * sizeof(float));
+      for (len = 0; len < source->set.set_val[set].imag.imag_len; len++)
+	size += hiResCount *
+	  ARENA_SIZE(source->set.set_val[set].imag.imag_val[len].channel.channel_len * sizeof(float));
+    }
+  }
+  return(size);
+} /* End of bundleCopySize */
+
+/*
+  B U N D L E   H I   R E S   C O U N T
+
+  bundleHiResCount checks whether a bundle was sent by a crate in Hi-Res
+  mode, and returns the number of copies of each of its sets bundleCopy()
+  will make (2 if the bundle must be expanded for Hi-Res, otherwise 1).
+  It may flag chunks bad, so the scanMutex must be held.
+*/
+int bundleHiResCount(dCrateUVBlock *source, int interpret,
+		     int *hiRes, int *nDaisyChained, int *nInDaisyChain)
+{
+  int hiResCount;
+
+  *hiRes = *nDaisyChained = *nInDaisyChain = 0;
   hiResCount = 1;
   /*
     Since the source name in the bundle of data from the crate actually does not have the
@@ -407,12 +1060,16 @@ void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int interpret,
   if (strstr(source->sourceName, "Hi-Res") != NULL) {
     int nRead;
     
-    printf("**** Saw the Hi-Res switch! ****\n");
+    dprintf("**** Saw the Hi-Res switch! ****\n");
     nRead = sscanf(source->sourceName, "Hi-Res %d %d", nDaisyChained, nInDaisyChain);
     if (nRead == 2) {
       *hiRes = TRUE;
       if ((*nInDaisyChain == 1) && interpret) {
 	hiResCount = 2;
+	dprintf("The bundle from crate %d needs an additional chunk added for Hi-Res\n",
+		source->crateNumber);
+	dprintf("Flagging chunk s%02d bad\n", sChunk(source->blockNumber, 2));
+	flagChunkBad(source->blockNumber, 2);
       } else if (*nInDaisyChain > 1) {
 	/*
 	  Flag the chunks containing partial Hi-Res products bad, for purposes
@@ -424,21 +1081,44 @@ void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int interpret,
     } else
       *hiRes = *nDaisyChained = *nInDaisyChain = 0;
   }
-  if (*hiRes && interpret && (*nInDaisyChain == 1)) {
-    printf("The bundle from crate %d needs an additional chunk added for Hi-Res\n",
-	    source->crateNumber);
-    printf("Flagging chunk s%02d bad\n", sChunk(source->blockNumber, 2));
-    flagChunkBad(source->blockNumber, 2);
-    (*dest)->set.set_len = 2 * source->set.set_len;
-    (*dest)->set.set_val =
-      (dVisibilitySet *)malloc((source->set.set_len * 2) * sizeof(dVisibilitySet));
-  } else
-    (*dest)->set.set_val =
-      (dVisibilitySet *)malloc(source->set.set_len * sizeof(dVisibilitySet));
-  if ((*dest)->set.set_val == NULL) {
-    perror("processScan - second bundle copy malloc");
-    exit(ERROR);
-  }
+  return(hiResCount);
+} /* End of bundleHiResCount */
+
+/*
+  B U N D L E   C O P Y
+
+  bundleCopy makes a copy of the portions of a bundle we actually need,
+  in the bundleCopySize() bytes at space, which the caller has reserved
+  from the scan's arena.   hiResCount is the value returned by
+  bundleHiResCount().   If shared is not NULL, the bundle's spectra live
+  in a visBuffer, and rather than copying them the new bundle points at
+  them - the caller must hold a reference to that buffer.   shared must
+  be NULL if the bundle needs to be expanded for Hi-Res mode, because the
+  WRITER sums into those spectra.
+  bundleCopy touches nothing but source and space, so it is called without
+  the scanMutex held.
+*/
+void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int hiRes, int interpret,
+		int hiResCount, visBuffer *shared, char *space)
+{
+  int set, hiResPtr, nSets;
+  char *next;
+
+  next = space;
+  (*dest) = (dCrateUVBlock *)next;
+  next += ARENA_SIZE(sizeof(dCrateUVBlock));
+  (*dest)->crateNumber = source->crateNumber;
+  (*dest)->blockNumber = source->blockNumber;
+  (*dest)->scanType    = source->scanType;
+  (*dest)->scanNumber  = source->scanNumber;
+  (*dest)->UTCtime     = source->UTCtime;
+  (*dest)->intTime     = source->intTime;
+  (*dest)->set.set_len = source->set.set_len;
+  strcpy((*dest)->sourceName, source->sourceName);
+  if (hiResCount > 1)
+    (*dest)->set.set_len = hiResCount * source->set.set_len;
+  (*dest)->set.set_val = (dVisibilitySet *)next;
+  next += ARENA_SIZE((*dest)->set.set_len * sizeof(dVisibilitySet));
 
   hiResPtr = 0;
   nSets = source->set.set_len;
@@ -453,11 +1133,11 @@ void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int interpret,
 	  source->set.set_val[set].antennaNumber[ii];
 	(*dest)->set.set_val[hiResPtr*nSets + set].antPolState[ii] =
 	  source->set.set_val[set].antPolState[ii];
-	if (*hiRes && interpret && (ii == 1))
+	if (hiRes && interpret && (ii == 1))
 	  dprintf("hiResPtr %d, set %d\t(*dest)->set.set_val[%d].chunkNumber = %d\n",
 		  hiResPtr, set, hiResPtr*nSets,
 		  (*dest)->set.set_val[hiResPtr*nSets + set].chunkNumber);
-	if (*hiRes && interpret && (ii != 0))
+	if (hiRes && interpret && (ii != 0))
 	  dprintf("hiResPtr %d, set %d\t(*dest)->set.set_val[%d].antennaNumber[%d] = %d\n",
 		  hiResPtr, set, hiResPtr*nSets, ii,
 		  (*dest)->set.set_val[hiResPtr*nSets + set].antennaNumber[ii]);
@@ -465,24 +1145,21 @@ void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int interpret,
       (*dest)->set.set_val[hiResPtr*nSets + set].rxBoardHalf = source->set.set_val[set].rxBoardHalf;
       /*   R E A L    P A R T   */
       (*dest)->set.set_val[hiResPtr*nSets + set].real.real_len = source->set.set_val[set].real.real_len;
-      (*dest)->set.set_val[hiResPtr*nSets + set].real.real_val =
-	(dVarArray *)malloc(source->set.set_val[set].real.real_len * sizeof(dVarArray));
-      if ((*dest)->set.set_val[hiResPtr*nSets + set].real.real_val == NULL) {
-	perror("processScan - third bundle copy malloc");
-	exit(ERROR);
-      }
+      (*dest)->set.set_val[hiResPtr*nSets + set].real.real_val = (dVarArray *)next;
+      next += ARENA_SIZE(source->set.set_val[set].real.real_len * sizeof(dVarArray));
       /* real_len = number of sidebands (usually 2) */
       for (len = 0; len < source->set.set_val[set].real.real_len; len++) {
 	(*dest)->set.set_val[hiResPtr*nSets + set].real.real_val[len].channel.channel_len =
 	  source->set.set_val[set].real.real_val[len].channel.channel_len;
-	if (*hiRes && interpret)
+	if (hiRes && interpret)
 	  dprintf("Chunk size: %d\n", source->set.set_val[set].real.real_val[len].channel.channel_len);
-	(*dest)->set.set_val[hiResPtr*nSets + set].real.real_val[len].channel.channel_val =
-	  (float *)malloc(source->set.set_val[set].real.real_val[len].channel.channel_len * sizeof(float));
-	if ((*dest)->set.set_val[hiResPtr*nSets + set].real.real_val[len].channel.channel_val == NULL) {
-	  perror("processScan - fourth bundle copy malloc");
-	  exit(ERROR);
+	if (shared != NULL) {
+	  (*dest)->set.set_val[hiResPtr*nSets + set].real.real_val[len].channel.channel_val =
+	    source->set.set_val[set].real.real_val[len].channel.channel_val;
+	  continue;
 	}
+	(*dest)->set.set_val[hiResPtr*nSets + set].real.real_val[len].channel.channel_val = (float *)next;
+	next += ARENA_SIZE(source->set.set_val[set].real.real_val[len].channel.channel_len * sizeof(float));
 	/* channel_len = number of points in spectrum */
 	bcopy((char *)source->set.set_val[set].real.real_val[len].channel.channel_val,
 	      (char *)(*dest)->set.set_val[hiResPtr*nSets + set].real.real_val[len].channel.channel_val,
@@ -491,22 +1168,19 @@ void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int interpret,
       
       /*   I M A G I N A R Y    P A R T   */
       (*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_len = source->set.set_val[set].imag.imag_len;
-      (*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val =
-	(dVarArray *)malloc(source->set.set_val[set].imag.imag_len * sizeof(dVarArray));
-      if ((*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val == NULL) {
-	perror("processScan - fifth bundle copy malloc");
-	exit(ERROR);
-      }
+      (*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val = (dVarArray *)next;
+      next += ARENA_SIZE(source->set.set_val[set].imag.imag_len * sizeof(dVarArray));
       /* imag_len = number of sidebands (usually 2) */
       for (len = 0; len < source->set.set_val[set].imag.imag_len; len++) {
 	(*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val[len].channel.channel_len =
 	  source->set.set_val[set].imag.imag_val[len].channel.channel_len;
-	(*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val[len].channel.channel_val =
-	  (float *)malloc(source->set.set_val[set].imag.imag_val[len].channel.channel_len * sizeof(float));
-	if ((*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val[len].channel.channel_val == NULL) {
-	  perror("processScan - sixth bundle copy malloc");
-	  exit(ERROR);
+	if (shared != NULL) {
+	  (*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val[len].channel.channel_val =
+	    source->set.set_val[set].imag.imag_val[len].channel.channel_val;
+	  continue;
 	}
+	(*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val[len].channel.channel_val = (float *)next;
+	next += ARENA_SIZE(source->set.set_val[set].imag.imag_val[len].channel.channel_len * sizeof(float));
 	/* channel_len = number of points in spectrum */
 	bcopy((char *)source->set.set_val[set].imag.imag_val[len].channel.channel_val,
 	      (char *)(*dest)->set.set_val[hiResPtr*nSets + set].imag.imag_val[len].channel.channel_val,
@@ -517,81 +1191,368 @@ void bundleCopy(dCrateUVBlock *source, dCrateUVBlock **dest, int interpret,
   } while (hiResPtr < hiResCount);
 } /* End of bundleCopy */
 
+#define INDEX_EMPTY   (-1)
+#define INDEX_DELETED (-2)
+
 /*
+  S C A N   K E Y
 
-  D E L E T E  S C A N
+  scanKey quantizes a midpoint time into the key used to index the
+  pending scans.   Bundles which belong in the same scan have keys
+  which differ by at most one.
+*/
+long scanKey(double uT)
+{
+  return((long)floor(uT / MIDPOINT_SLOP));
+} /* End of scanKey */
+
+int scanIndexHash(long key)
+{
+  return((int)((((unsigned long)key) * 2654435761UL) & (pending.indexSize - 1)));
+} /* End of scanIndexHash */
 
-  deleteScan removes a scan from the scan list, and frees up
-  its resources (malloc'd memory).
+/*
+  S C A N   I N D E X   I N S E R T
 */
-void deleteScan(pendingScan *victim, int pointer)
+void scanIndexInsert(pendingScan *scan)
 {
-  int i;
-  struct timespec now;
+  int h;
 
-  clock_gettime(CLOCK_REALTIME, &now);
-  if (pointer) {
-    if (victim->last != NULL)
-      ((pendingScan *)victim->last)->next = victim->next;
-    else
-      scanRoot = (pendingScan *)victim->next;
-    if (victim->next != NULL)
-      ((pendingScan *)victim->next)->last = victim->last;
+  h = scanIndexHash(scan->key);
+  while (pending.scanIndex[h] >= 0)
+    h = (h + 1) & (pending.indexSize - 1);
+  if (pending.scanIndex[h] == INDEX_DELETED)
+    pending.nDeleted--;
+  pending.scanIndex[h] = scan - pending.slots;
+} /* End of scanIndexInsert */
+
+/*
+  S C A N   I N D E X   R E M O V E
+
+  scanIndexRemove takes a scan out of the index.   When too many
+  deleted markers have built up, the index is rebuilt from scratch.
+*/
+void scanIndexRemove(pendingScan *scan)
+{
+  int h, slot;
+  pendingScan *ptr;
+
+  slot = scan - pending.slots;
+  h = scanIndexHash(scan->key);
+  while (pending.scanIndex[h] != slot)
+    h = (h + 1) & (pending.indexSize - 1);
+  pending.scanIndex[h] = INDEX_DELETED;
+  pending.nDeleted++;
+  if (pending.nDeleted > pending.indexSize/4) {
+    for (h = 0; h < pending.indexSize; h++)
+      pending.scanIndex[h] = INDEX_EMPTY;
+    pending.nDeleted = 0;
+    for (ptr = scanRoot; ptr != NULL; ptr = (pendingScan *)ptr->next)
+      if (ptr != scan)
+	scanIndexInsert(ptr);
   }
-  for (i = 0; i <= MAX_CRATE; i++)
-    if (victim->data[i] != NULL) {
-      int set;
-
-      for (set = 0; set < victim->data[i]->set.set_len; set++) {
-	int len;
-
-	for (len = 0; len < victim->data[i]->set.set_val[set].real.real_len; len++)
-	  free(victim->data[i]->set.set_val[set].real.real_val[len].channel.channel_val);
-	for (len = 0; len < victim->data[i]->set.set_val[set].imag.imag_len; len++)
-	  free(victim->data[i]->set.set_val[set].imag.imag_val[len].channel.channel_val);
-	free(victim->data[i]->set.set_val[set].real.real_val);
-	free(victim->data[i]->set.set_val[set].imag.imag_val);
-      }
-      free(victim->data[i]->set.set_val);
-      free(victim->data[i]);
+} /* End of scanIndexRemove */
+
+/*
+  S I T E   P A T H
+
+  dataCatcher normally finds its configuration files under /global and
+  /common, and writes its data under /data.   sitePath puts siteRoot in
+  front of such a path, so that dataCatcherReplay can run dataCatcher
+  against a copy of those directories elsewhere.   siteRoot is "" except
+  in dataCatcherReplay.   buffer must hold MAX_SITE_ROOT more characters
+  than path.
+*/
+char *sitePath(const char *path, char *buffer)
+{
+  sprintf(buffer, "%s%s", siteRoot, path);
+  return(buffer);
+} /* End of sitePath */
+
+/* siteFopen is fopen() for a path under siteRoot */
+FILE *siteFopen(const char *path, const char *mode)
+{
+  char name[200+MAX_SITE_ROOT];
+
+  return(fopen(sitePath(path, name), mode));
+} /* End of siteFopen */
+
+/*
+  setSiteRoot sets siteRoot to root, which must be called before the
+  first RPC call arrives.   It returns ERROR if root is too long.
+*/
+int setSiteRoot(const char *root)
+{
+  if (strlen(root) >= MAX_SITE_ROOT)
+    return(ERROR);
+  strcpy(siteRoot, root);
+  return(OK);
+} /* End of setSiteRoot */
+
+/*
+  S C A N   T A B L E   I N I T
+
+  scanTableInit allocates the pending scan table.   The number of scans
+  which may be pending at once is normally DEFAULT_PENDING_SCANS, but that
+  can be changed by putting a number in the configuration file
+  dataCatcherPendingScans.
+*/
+void scanTableInit(void)
+{
+  int i, depth, nSlots;
+  FILE *depthFile;
+
+  depth = DEFAULT_PENDING_SCANS;
+  depthFile = siteFopen("/global/configFiles/dataCatcherPendingScans", "r");
+  if (depthFile != NULL) {
+    if ((fscanf(depthFile, "%d", &depth) != 1) || (depth < 1) || (depth > MAX_PENDING_SCANS)) {
+      fprintf(stderr, "scanTableInit: Illegal pending scan count in dataCatcherPendingScans - using %d\n",
+	      DEFAULT_PENDING_SCANS);
+      depth = DEFAULT_PENDING_SCANS;
+    }
+    fclose(depthFile);
+  }
+  printf("scanTableInit: up to %d scans may be pending\n", depth);
+  pending.depth = depth;
+  pending.count = 0;
+  pending.nextSerial = 0;
+  nSlots = 2*depth + 1;
+  pending.slots = (pendingScan *)malloc(nSlots*sizeof(pendingScan));
+  pending.freeSlots = (int *)malloc(nSlots*sizeof(int));
+  for (pending.indexSize = 8; pending.indexSize < 4*depth; pending.indexSize *= 2);
+  pending.scanIndex = (int *)malloc(pending.indexSize*sizeof(int));
+  completedScans.size = nSlots;
+  completedScans.head = completedScans.count = 0;
+  completedScans.entries = (pendingScan **)malloc(nSlots*sizeof(pendingScan *));
+  completedScans.queueTime = (double *)malloc(nSlots*sizeof(double));
+  completedScans.maxCount = 0;
+  completedScans.nQueued = 0;
+  completedScans.waitSum = completedScans.waitMax = 0.0;
+  if ((pending.slots == NULL) || (pending.freeSlots == NULL) || (pending.scanIndex == NULL) ||
+      (completedScans.entries == NULL) || (completedScans.queueTime == NULL)) {
+    perror("scanTableInit: malloc");
+    exit(ERROR);
+  }
+  for (i = 0; i < nSlots; i++)
+    pending.freeSlots[i] = nSlots - 1 - i;
+  pending.nFree = nSlots;
+  for (i = 0; i < pending.indexSize; i++)
+    pending.scanIndex[i] = INDEX_EMPTY;
+  pending.nDeleted = 0;
+} /* End of scanTableInit */
+
+/*
+  S W A R M   G E O M E T R Y   I N I T
+
+  swarmGeometryInit sets the SWARM geometry from the configuration file
+  dataCatcherSWARMGeometry, which holds the number of antennas, chunks
+  and channels per chunk, if that file exists.   Otherwise the defaults
+  are used.
+*/
+void swarmGeometryInit(void)
+{
+  int nAntennas, nChunks, nChannels;
+  FILE *geometryFile;
+
+  geometryFile = siteFopen("/global/configFiles/dataCatcherSWARMGeometry", "r");
+  if (geometryFile != NULL) {
+    if (fscanf(geometryFile, "%d %d %d", &nAntennas, &nChunks, &nChannels) != 3)
+      fprintf(stderr, "swarmGeometryInit: could not parse dataCatcherSWARMGeometry - using defaults\n");
+    else if ((nAntennas < 2) || (nAntennas > MAX_ANT))
+      fprintf(stderr, "swarmGeometryInit: Illegal antenna count (%d) - using defaults\n", nAntennas);
+    else if ((nChunks < 1) || (nChunks > MAX_SWARM_CHUNK))
+      fprintf(stderr, "swarmGeometryInit: Illegal chunk count (%d) - using defaults\n", nChunks);
+    else if ((nChannels < SWARM_FID_BLOCK) || (nChannels > MAX_SWARM_CHUNK_POINTS) ||
+	     (nChannels % SWARM_FID_BLOCK))
+      fprintf(stderr, "swarmGeometryInit: Illegal channel count (%d) - using defaults\n", nChannels);
+    else {
+      swarm.nAntennas = nAntennas;
+      swarm.nChunks = nChunks;
+      swarm.nChannels = nChannels;
     }
+    fclose(geometryFile);
+  }
+  printf("swarmGeometryInit: SWARM has %d antennas, %d chunks of %d channels\n",
+	 swarm.nAntennas, swarm.nChunks, swarm.nChannels);
+} /* End of swarmGeometryInit */
+
+/*
+  F I N D   S C A N
+
+  findScan returns the oldest pending scan whose midpoint is within
+  MIDPOINT_SLOP of uT, or NULL if there is none.
+*/
+pendingScan *findScan(double uT)
+{
+  int h;
+  long key, k;
+  pendingScan *ptr, *found = NULL;
+
+  key = scanKey(uT);
+  for (k = key-1; k <= key+1; k++)
+    for (h = scanIndexHash(k); pending.scanIndex[h] != INDEX_EMPTY; h = (h + 1) & (pending.indexSize - 1))
+      if (pending.scanIndex[h] >= 0) {
+	ptr = &pending.slots[pending.scanIndex[h]];
+	if ((ptr->key == k) && (fabs(ptr->firstTime - uT) <= MIDPOINT_SLOP))
+	  if ((found == NULL) || (ptr->serial < found->serial))
+	    found = ptr;
+      }
+  return(found);
+} /* End of findScan */
+
+/*
+  R E L E A S E   S C A N
+
+  releaseScan frees up a scan's resources.   All the bundles live in
+  the scan's arena, so they're released in one go.   If pointer is TRUE
+  the scan's slot is also returned to the scan table.
+*/
+void releaseScan(pendingScan *victim, int pointer)
+{
+  int i;
+
+  for (i = 0; i <= MAX_CRATE; i++)
+    if (victim->shared[i] != NULL)
+      visBufferRelease(victim->shared[i]);
+  arenaRelease(victim->arena);
   if (pointer)
-    free(victim);
+    pending.freeSlots[pending.nFree++] = victim - pending.slots;
+} /* End of releaseScan */
+
+/*
+  U N L I N K   S C A N
+
+  unlinkScan takes a scan out of the scan table's index and its list
+  of pending scans, leaving its slot and resources alone.
+  The scanMutex must be held.
+*/
+void unlinkScan(pendingScan *victim)
+{
+  scanIndexRemove(victim);
+  if (victim->last != NULL)
+    ((pendingScan *)victim->last)->next = victim->next;
+  else
+    scanRoot = (pendingScan *)victim->next;
+  if (victim->next != NULL)
+    ((pendingScan *)victim->next)->last = victim->last;
+  else
+    scanTail = (pendingScan *)victim->last;
+  pending.count--;
+} /* End of unlinkScan */
+
+/*
+
+  D E L E T E  S C A N
+
+  deleteScan removes a scan from the scan table, and frees up
+  its resources.   If bundles are still being copied into the scan,
+  it is only taken out of the table here, and its resources are
+  freed by the last of those copies to finish.
+
+  The scanMutex must be held when pointer is TRUE.
+*/
+void deleteScan(pendingScan *victim, int pointer)
+{
+  if (pointer) {
+    unlinkScan(victim);
+    if (victim->copiesInFlight > 0) {
+      victim->dropped = TRUE;
+      return;
+    }
+  }
+  releaseScan(victim, pointer);
 } /* End of deleteScan */
 
 /*
 
   M A K E   S C A N
 
-  makeScan creates a new scan list entry, initializes it,
-  trims the scan list if there are too many pending scans,
-  and inserts the new scan into the queue.
+  makeScan creates a new scan table entry, initializes it,
+  and appends the new scan to the list of pending scans.
+  If there are already too many pending scans, the oldest one is
+  dropped at once.   The caller is usually the RPC dispatcher, which
+  also receives the bundles that would complete the pending scans, so
+  it must not be held up waiting for them - the senders are slowed
+  down by the congestion codes instead (see congestionCode()).
 
   The scanMutex must be acquired before this function is called.
+  makeScan returns TRUE, having released the scanMutex, when it has
+  made a new scan.   Otherwise it returns FALSE, with the scanMutex
+  still held, and in *newEntry either the scan another thread made for
+  the bundle's time while it waited, or NULL if no slot came free
+  within SLOT_WAIT.
 */
 
-void makeScan(pendingScan **newEntry, dCrateUVBlock *bundle)
+int makeScan(pendingScan **newEntry, dCrateUVBlock *bundle, visBuffer *shared)
 {
-  int i, scanCount;
-  double oldestScanTime;
-  struct timespec birthTime;
-  pendingScan *pointer, *lastScan;
-  pendingScan *oldestScan = NULL;
+  int i, nExpected, rCode = 0;
+  char expectedCrates[3*MAX_CRATE+1], receivedCrates[3*MAX_CRATE+1];
+  struct timespec birthTime, slotWaitEnd;
+  pendingScan *oldestScan;
 
   clock_gettime(CLOCK_REALTIME, &birthTime);
-  /* Make new entry */
-  *newEntry = (pendingScan *)malloc(sizeof(**newEntry));
-  if (*newEntry == NULL) {
-    fprintf(stderr, "makeScan: malloc failure for newEntry - will abort\n");
-    perror("makeScan, newEntry");
-    exit(ERROR);
+  /*
+    Delete any really old pending scans.   The list is in order of creation,
+    so they're all at its head.
+  */
+  while ((scanRoot != NULL) && ((globalScanNumber - scanRoot->number) > 10)) {
+    ringLog(LOG_INFO, "Dropping ancient scan %d\n", scanRoot->number);
+    deleteScan(scanRoot, TRUE);
+  }
+  if (pending.count >= pending.depth) {
+    oldestScan = scanRoot;
+    expectedCrates[0] = receivedCrates[0] = (char)0;
+    for (i = 1; i <= MAX_CRATE; i++) {
+      if (oldestScan->expected[i])
+	sprintf(&expectedCrates[strlen(expectedCrates)], "%2d ", i);
+      if (oldestScan->received[i])
+	sprintf(&receivedCrates[strlen(receivedCrates)], "%2d ", i);
+    }
+    ringLog(LOG_ERROR, "makeScan: Too many pending scans (%d), will drop oldest\n"
+	    "\tOldest time: %f\n\tExpected crates: %s\n\tReceived crates: %s\n",
+	    pending.depth, oldestScan->firstTime, expectedCrates, receivedCrates);
+    deleteScan(oldestScan, TRUE);
+    if (abortOnMinorErrors)
+      if (globalScanNumber > 100)
+	exit(-1);
+  }
+  /*
+    A dropped scan's slot stays in use until the bundle copies into it
+    have finished, and a completed scan's until the WRITER is done with
+    it, so wait a little for one of those if no slot is free.   If none
+    comes free in SLOT_WAIT, the bundle is discarded rather than holding
+    up the dispatcher any longer.
+  */
+  if (pending.nFree == 0) {
+    slotWaitEnd = birthTime;
+    slotWaitEnd.tv_nsec += SLOT_WAIT;
+    if (slotWaitEnd.tv_nsec >= 1000000000) {
+      slotWaitEnd.tv_sec++;
+      slotWaitEnd.tv_nsec -= 1000000000;
+    }
+    while ((pending.nFree == 0) && (rCode != ETIMEDOUT))
+      rCode = pthread_cond_timedwait(&copyDoneCond, &scanMutex, &slotWaitEnd);
+    /* The scanMutex was released while waiting, so another bundle may have made the scan */
+    if ((*newEntry = findScan(bundle->UTCtime)) != NULL)
+      return(FALSE);
+    if (pending.nFree == 0) {
+      ringLog(LOG_ERROR, "makeScan: No free scan slot - discarding the bundle at %f\n",
+	      bundle->UTCtime);
+      return(FALSE);
+    }
   }
+
+  /* Take an entry from the table */
+  *newEntry = &pending.slots[pending.freeSlots[--pending.nFree]];
+  pending.count++;
   
   /* Initialize new entry */
   dprintf("makeScan:\tInitializing the new entry\n");
   (*newEntry)->firstTime = bundle->UTCtime;
   (*newEntry)->birthTime = ((double)birthTime.tv_sec) + ((birthTime.tv_nsec))*1.0e-9;
   (*newEntry)->number = globalScanNumber;
+  (*newEntry)->serial = pending.nextSerial++;
+  (*newEntry)->key = scanKey(bundle->UTCtime);
   (*newEntry)->intTime = bundle->intTime;
   for (i = 0; i <= MAX_CRATE; i++) {
     if (activeCrates[i])
@@ -600,92 +1561,172 @@ void makeScan(pendingScan **newEntry, dCrateUVBlock *bundle)
       (*newEntry)->expected[i] = FALSE;
     (*newEntry)->received[i] = FALSE;
     (*newEntry)->data[i] = NULL;
+    (*newEntry)->shared[i] = NULL;
+    (*newEntry)->pCSums[i] = NULL;
   }
-  (*newEntry)->gotHeaderInfo = FALSE;
-  (*newEntry)->next = NULL; /* We'll put it at the end of the list */
-
-  /*
-    Let's count the number of pending scans, note the oldest,
-    and delete it if too many scans are pending.
-  */
-  scanCount = 0;
-  pointer = scanRoot;
+  (*newEntry)->copiesInFlight = 0;
+  (*newEntry)->dropped = FALSE;
+  (*newEntry)->completed = FALSE;
   /*
-    Delete any really old pending scans
+    Size the arena on the assumption that the other crates will send bundles
+    about as large as this one, so that normally the whole scan fits in one region.
   */
-  while (pointer != NULL) {
-    if ((globalScanNumber - pointer->number) > 10) {
-      printf("Dropping ancient scan %d\n", pointer->number);
-      deleteScan(pointer, TRUE);
-      pointer = NULL;
-    } else
-      pointer = (pendingScan *)pointer->next;
-  }
-  pointer = scanRoot;
-  oldestScanTime = 1.0e30;
-  while (pointer != NULL) {
-    scanCount++;
-    if (pointer->firstTime < oldestScanTime) {
-      oldestScan = pointer;
-      oldestScanTime = pointer->firstTime;
-    }
-    pointer = (pendingScan *)pointer->next;
-  }
-  if (scanCount >= MAX_PENDING_SCANS) {
-    fprintf(stderr, "makeScan: Too many pending scans (%d), will drop oldest\n",
-	    MAX_PENDING_SCANS);
-    fprintf(stderr, "\tOldest time: %f\n", oldestScanTime);
-    fprintf(stderr, "\tExpected crates: ");
-    for (i = 1; i <= MAX_CRATE; i++)
-      if (oldestScan->expected[i])
-	fprintf(stderr, "%2d ", i);
-    fprintf(stderr, "\n");
-    fprintf(stderr, "\tReceived crates: ");
-    for (i = 1; i <= MAX_CRATE; i++)
-      if (oldestScan->received[i])
-	fprintf(stderr, "%2d ", i);
-    fprintf(stderr, "\n");
-    deleteScan(oldestScan, TRUE);
-    if (abortOnMinorErrors)
-      if (globalScanNumber > 100)
-	exit(-1);
-  }
+  nExpected = 0;
+  for (i = 0; i <= MAX_CRATE; i++)
+    if ((*newEntry)->expected[i])
+      nExpected++;
+  if (nExpected < 1)
+    nExpected = 1;
+  (*newEntry)->arena = arenaCreate(nExpected*bundleCopySize(bundle, 1, shared != NULL));
+  (*newEntry)->gotHeaderInfo = FALSE;
 
-  /* Now insert the new entry into the doubly linked list */
-  pointer = lastScan = scanRoot;
-  while (pointer != NULL) {
-    lastScan = pointer;
-    pointer = (pendingScan *)pointer->next;
-  }
-  if (lastScan == NULL) {
-    dprintf("Inserting new scan with time %f at list root\n",
-	    (*newEntry)->firstTime);
+  /* Now index the new entry, and put it at the end of the list */
+  scanIndexInsert(*newEntry);
+  (*newEntry)->next = NULL;
+  (*newEntry)->last = (char *)scanTail;
+  if (scanTail == NULL)
     scanRoot = *newEntry;
-    (*newEntry)->last = NULL;
-  } else {
-    dprintf("Inserting new scan with time %f at list end.  %d scans now pending\n",
-	    (*newEntry)->firstTime, scanCount+1);
-    lastScan->next = (char *)*newEntry;
-    (*newEntry)->last = (char *)lastScan;
-  }
+  else
+    scanTail->next = (char *)*newEntry;
+  scanTail = *newEntry;
+  dprintf("Inserting new scan with time %f at list end.  %d scans now pending\n",
+	  (*newEntry)->firstTime, pending.count);
   /*
     Now signal the HEADER thread that we need a header for this new scan
   */
   pthread_mutex_unlock(&scanMutex);
   pthread_mutex_lock(&needHeaderMutex);
-  needHeader = TRUE;
-  headerScan = *newEntry;
+  if (nHeaderRequests >= MAX_PENDING_SCANS) {
+    ringLog(LOG_WARN, "makeScan: HEADER has fallen %d scans behind - dropping oldest request\n",
+	      nHeaderRequests);
+    headerRequestHead = (headerRequestHead + 1) % MAX_PENDING_SCANS;
+    nHeaderRequests--;
+  }
+  headerRequests[(headerRequestHead + nHeaderRequests) % MAX_PENDING_SCANS].scan = *newEntry;
+  headerRequests[(headerRequestHead + nHeaderRequests) % MAX_PENDING_SCANS].serial = (*newEntry)->serial;
+  nHeaderRequests++;
   pthread_cond_signal(&needHeaderCond);
   pthread_mutex_unlock(&needHeaderMutex);
+  return(TRUE);
 } /* End of makeScan */
 
+/*
+  S C A N   Q U E U E   P U T
+
+  scanQueuePut hands a completed scan over to the WRITER.   The queue
+  has room for every slot in the scan table, so it can never overflow -
+  if the WRITER falls behind, makeScan() runs out of free slots instead.
+*/
+void scanQueuePut(pendingScan *scan)
+{
+  struct timespec now;
+
+  pthread_mutex_lock(&writeScanMutex);
+  clock_gettime(CLOCK_REALTIME, &now);
+  completedScans.entries[(completedScans.head + completedScans.count) % completedScans.size] = scan;
+  completedScans.queueTime[(completedScans.head + completedScans.count) % completedScans.size] =
+    ((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9;
+  completedScans.count++;
+  if (completedScans.count > completedScans.maxCount)
+    completedScans.maxCount = completedScans.count;
+  pthread_cond_signal(&writeScanCond);
+  pthread_mutex_unlock(&writeScanMutex);
+} /* End of scanQueuePut */
+
+/*
+  S C A N   Q U E U E   G E T
+
+  scanQueueGet waits for a completed scan, and takes it off the queue.
+  The WRITER then owns the scan, until it returns it with releaseScan().
+*/
+pendingScan *scanQueueGet(void)
+{
+  int rCode;
+  double wait;
+  struct timespec now;
+  pendingScan *scan;
+
+  pthread_mutex_lock(&writeScanMutex);
+  while (completedScans.count == 0) {
+    dprintf("writer thread sleeping, awaiting a signal\n");
+    rCode = pthread_cond_wait(&writeScanCond, &writeScanMutex);
+    if (rCode) {
+      fprintf(stderr,
+	      "writer: Error %d returned by pthread_cond_wait\n",
+	      rCode);
+      perror("pthread_cond_wait");
+    }
+    dprintf("writer thread re-awakened\n");
+  }
+  clock_gettime(CLOCK_REALTIME, &now);
+  scan = completedScans.entries[completedScans.head];
+  wait = ((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9 -
+    completedScans.queueTime[completedScans.head];
+  completedScans.head = (completedScans.head + 1) % completedScans.size;
+  completedScans.count--;
+  completedScans.nQueued++;
+  completedScans.waitSum += wait;
+  if (wait > completedScans.waitMax)
+    completedScans.waitMax = wait;
+  dprintf("scanQueueGet: scan waited %f seconds, %d still queued (max %d, mean wait %f, max wait %f)\n",
+	  wait, completedScans.count, completedScans.maxCount,
+	  completedScans.waitSum/(double)completedScans.nQueued, completedScans.waitMax);
+  pthread_mutex_unlock(&writeScanMutex);
+  return(scan);
+} /* End of scanQueueGet */
+
+/*
+  C O N G E S T I O N   C O D E
+
+  congestionCode returns the rt_code to reply to a sender with, given
+  status, the result of handling its data.   If congestion codes are
+  turned on, and the data were accepted, the reply carries one of the
+  congestion codes in congestion.h when the WRITER is falling behind or
+  the scan table is filling up, so that the senders can slow down before
+  scans have to be dropped.   The scan table counts are read without the
+  scanMutex, so a sender may be told of a change one reply late.
+*/
+int congestionCode(int status)
+{
+  static int lastLevel = OK;
+  int level = OK, backlog, previous;
+  double lag = 0.0;
+  struct timespec now;
+
+  if (!congestionCodes || (status != OK))
+    return(status);
+  pthread_mutex_lock(&writeScanMutex);
+  backlog = completedScans.count;
+  if (backlog > 0) {
+    clock_gettime(CLOCK_REALTIME, &now);
+    lag = ((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9 -
+      completedScans.queueTime[completedScans.head];
+  }
+  pthread_mutex_unlock(&writeScanMutex);
+  if ((pending.count >= pending.depth) || (pending.nFree == 0))
+    level = DATACATCHER_CONGESTED;
+  else if ((backlog >= CONGESTION_BACKLOG) || (lag > CONGESTION_LAG) || (pending.nFree == 1))
+    level = DATACATCHER_BUSY;
+  previous = __atomic_exchange_n(&lastLevel, level, __ATOMIC_RELAXED);
+  if (level != previous)
+    ringLog((level > previous) ? LOG_WARN : LOG_INFO,
+	    "congestionCode: now %s (%d scans pending, %d waiting for the WRITER, oldest for %.1f s)\n",
+	    (level == DATACATCHER_CONGESTED) ? "congested" : ((level == DATACATCHER_BUSY) ? "busy" : "clear"),
+	    pending.count, backlog, lag);
+  return(level);
+} /* End of congestionCode */
+
 /*
 
    S C A N   C O M P L E T E   C H E C K
 
    This function checks to see if the scan it has been passed is
    complete, meaning that it contains all the required visibility
-   bundles, and the header information.
+   bundles, and the header information.   A bundle still being copied
+   in doesn't count as received yet.
+
+   A complete scan is taken out of the list of pending scans, and
+   queued for the WRITER.   The scanMutex must be held.
 */
 void scanCompleteCheck(pendingScan *current)
 {
@@ -700,20 +1741,18 @@ void scanCompleteCheck(pendingScan *current)
       missingCrate = i;
     }
   }
-  printf("missingScan = %d, crate = %d, gotHeader = %d\n", missingScan, missingCrate, current->gotHeaderInfo);
+  dprintf("missingScan = %d, crate = %d, gotHeader = %d\n", missingScan, missingCrate, current->gotHeaderInfo);
 
   /*
     If there are no missing scans, and the header info
-    is present, then signal the WRITER
-    thread that there is a scan waiting for processing
+    is present, then pass the scan to the WRITER thread
   */
   dprintf("In scanCompleteCheck, missing = %d, gotHeader = %d\n", missingScan, current->gotHeaderInfo);
-  if ((!missingScan) && current->gotHeaderInfo) {
-    pthread_mutex_lock(&writeScanMutex);
-    needWrite = TRUE;
-    writableScan = current;
-    pthread_cond_signal(&writeScanCond);
-    pthread_mutex_unlock(&writeScanMutex);
+  if ((!missingScan) && current->gotHeaderInfo && (current->copiesInFlight == 0) &&
+      (!current->dropped) && (!current->completed)) {
+    current->completed = TRUE;
+    unlinkScan(current);
+    scanQueuePut(current);
   }
 } /* End of scanCompleteCheck */
 
@@ -726,32 +1765,113 @@ void printBundleInfo(dCrateUVBlock *bundle)
 {
   int set;
 
-  printf("Bundle Crate%d block %d, source \"%s\", type %d, #%d, UTC %f int %f\n",
-	 bundle->crateNumber, bundle->blockNumber, bundle->sourceName,
-	 bundle->scanType, bundle->scanNumber, bundle->UTCtime, bundle->intTime);
-  printf("set_len = %d\n", bundle->set.set_len);
+  dprintf("Bundle Crate%d block %d, source \"%s\", type %d, #%d, UTC %f int %f\n",
+	  bundle->crateNumber, bundle->blockNumber, bundle->sourceName,
+	  bundle->scanType, bundle->scanNumber, bundle->UTCtime, bundle->intTime);
+  dprintf("set_len = %d\n", bundle->set.set_len);
   for (set = 0; set < bundle->set.set_len; set++) {
-    printf("set %d, real_len: %d, imag_len: %d, half: %d chunk: %d %d-%d\n", set,
-	   bundle->set.set_val[set].real.real_len,
-	   bundle->set.set_val[set].imag.imag_len,
-	   bundle->set.set_val[set].rxBoardHalf,
-	   bundle->set.set_val[set].chunkNumber,
-	   bundle->set.set_val[set].antennaNumber[1],
-	   bundle->set.set_val[set].antennaNumber[2]
-	   );
+    dprintf("set %d, real_len: %d, imag_len: %d, half: %d chunk: %d %d-%d\n", set,
+	    bundle->set.set_val[set].real.real_len,
+	    bundle->set.set_val[set].imag.imag_len,
+	    bundle->set.set_val[set].rxBoardHalf,
+	    bundle->set.set_val[set].chunkNumber,
+	    bundle->set.set_val[set].antennaNumber[1],
+	    bundle->set.set_val[set].antennaNumber[2]
+	    );
   }
 } /* End of printBundleInfo */
 
+/*
+
+  P C  C H U N K  S U M
+
+  pCChunkSum sums one chunk's spectrum, between the chunk edges, for the
+  pseudo-continuum channel.   Each channel is weighted so that every chunk
+  counts equally, whatever its number of channels.
+*/
+void pCChunkSum(float *real, float *imag, int nChannels, int sChunkNumber, pCPartial *sum)
+{
+  int channel;
+  float edgeWidth, channelWeight;
+
+  if (sChunkNumber < 49)
+    edgeWidth = (CHUNK_FULL_BANDWIDTH - CHUNK_USABLE_BANDWIDTH) / (2.0 * CHUNK_FULL_BANDWIDTH);
+  else
+    edgeWidth = (SWARM_CHUNK_FULL_BANDWIDTH - SWARM_CHUNK_USABLE_BANDWIDTH) / (2.0 * SWARM_CHUNK_FULL_BANDWIDTH);
+  sum->startChannel = (int)((float)nChannels * edgeWidth);
+  sum->endChannel   = (int)((float)nChannels * (1.0 - edgeWidth));
+  /*
+    Calculate the weight each channel should have, to account
+    for differing numbers of channels in different chunks.
+  */
+  channelWeight = (float)(1 + sum->endChannel - sum->startChannel);
+  if (channelWeight < 1.0)
+    channelWeight = 1.0;
+  channelWeight = 1.0 / channelWeight;
+  sum->channelWeight = channelWeight;
+  sum->realSum = sum->imagSum = sum->ampSum = 0.0;
+  sum->sawNaN = FALSE;
+  for (channel = sum->startChannel; channel <= sum->endChannel; channel++) {
+    float amp;
+
+    if (isnan(real[channel])) {
+      sum->sawNaN = TRUE;
+      return;
+    }
+    sum->realSum += real[channel] * channelWeight;
+    sum->imagSum += imag[channel] * channelWeight;
+    amp = sqrt(real[channel]*real[channel] + imag[channel]*imag[channel]) * channelWeight;
+    sum->ampSum += amp;
+  }
+} /* End of pCChunkSum */
+
+/*
+  pCBundleSums fills sums with the pCChunkSum of every set and sideband
+  in bundle.   It returns FALSE, having done nothing, if the bundle has
+  more sidebands than sums can hold.
+*/
+int pCBundleSums(dCrateUVBlock *bundle, pCPartial *sums)
+{
+  int set, sb;
+
+  for (set = 0; set < bundle->set.set_len; set++)
+    if (bundle->set.set_val[set].real.real_len > MAX_SB)
+      return(FALSE);
+  for (set = 0; set < bundle->set.set_len; set++)
+    for (sb = 0; sb < bundle->set.set_val[set].real.real_len; sb++)
+      pCChunkSum(bundle->set.set_val[set].real.real_val[sb].channel.channel_val,
+		 bundle->set.set_val[set].imag.imag_val[sb].channel.channel_val,
+		 bundle->set.set_val[set].real.real_val[sb].channel.channel_len,
+		 sChunk(bundle->blockNumber, bundle->set.set_val[set].chunkNumber),
+		 &sums[set*MAX_SB + sb]);
+  return(TRUE);
+} /* End of pCBundleSums */
+
 /*
 
   P R O C E S S   B U N D L E
 
-  processBundle is the main function for the SERVER thread
+  processBundle is the main function for the SERVER thread.
+  shared should be NULL unless the bundle's spectra live in a visBuffer,
+  in which case the pending scan will keep a reference to that buffer
+  rather than copying the spectra.
+
+  processBundle may be called by several threads at once.   The scanMutex
+  is only held while the bundle's place in a scan is claimed and its arena
+  space reserved, and again when the copy is done.   The copy itself is made
+  without the lock, so one crate's bundle doesn't hold up the others.
+  The bundle's pseudo-continuum sums are calculated along with the copy,
+  except for the first crate of a Hi-Res daisy chain, whose spectra the
+  WRITER changes before it uses them.
 */
-int  processBundle(dCrateUVBlock *bundle)
+int  processBundle(dCrateUVBlock *bundle, visBuffer *shared)
 {
-  int crate;
+  int crate, hiRes, nDaisyChained, nInDaisyChain, hiResCount;
+  size_t size;
+  char *space;
+  dCrateUVBlock *copy;
   pendingScan *current;
+  pCPartial *sums = NULL;
 
   getCrateList(&activeCrates[0]);
 
@@ -759,68 +1879,89 @@ int  processBundle(dCrateUVBlock *bundle)
     printBundleInfo(bundle);
 
   crate = bundle->crateNumber;
+  /* bundleHiResCount() may flag chunks bad, so it needs the scanMutex too */
   pthread_mutex_lock(&scanMutex);
-  if (scanRoot == NULL) {
-    makeScan(&current, bundle);
-    pthread_mutex_lock(&scanMutex);
-  } else {
-    int foundMatch = FALSE;
-
+  hiResCount = bundleHiResCount(bundle, TRUE, &hiRes, &nDaisyChained, &nInDaisyChain);
+  if (hiResCount > 1)
+    shared = NULL;
+  size = bundleCopySize(bundle, hiResCount, shared != NULL);
+  /*
+    Find out if the midpoint time for this scan matches any
+    of the pending scans.   SWARM bundles are matched the same
+    way, so that overlapping SWARM integrations each find their
+    own scan.
+  */
+  current = findScan(bundle->UTCtime);
+  if ((current == NULL) && makeScan(&current, bundle, shared)) {
     /*
-      Find out if the midpoint time for this scan matches any
-      of the pending scans.
+      None of the pending scans had a matching midpoint time,
+      so makeScan() made a new scan.
     */
-    current = scanRoot;
-    while ((current != NULL) && (!foundMatch)) {
-      if ((fabs(current->firstTime - bundle->UTCtime) > MIDPOINT_SLOP) && (crate != SWARM_CRATE)) {
-	current = (pendingScan *)current->next;
-      } else {
-	/* This bundle belongs in a currently pending scan */
-	if (!(current->expected[crate])) {
-	  fprintf(stderr,
-		  "processBundle: Got a bundle from crate %d, but no scan from\n",
-		  bundle->crateNumber);
-	  fprintf(stderr,
-		  "               that crate was expected - will discard this bundle.\n");
-	  fprintf(stderr,
-		  "               First time = %f, bundle time = %f\n",
-		  current->firstTime, bundle->UTCtime);
-	  pthread_mutex_unlock(&scanMutex);
-	  return(UNEXPECTED_BUNDLE);
-	} else if (current->received[crate]) {
-	  fprintf(stderr,
-		  "processBundle: Got a bundle from crate %d, but the current scan\n",
-		  bundle->crateNumber);
-	  fprintf(stderr,
-		  "               already has a bundle from that crate - will discard\n");
-	  fprintf(stderr,
-		  "               this bundle.   First time = %f, bundle time = %f\n",
-		  current->firstTime, bundle->UTCtime);
-	  pthread_mutex_unlock(&scanMutex);
-	  return(REDUNDANT_BUNDLE);
-	}
-	foundMatch = TRUE;
-      }
-    }
-    if (!foundMatch) {
-      /*
-	We went through the entire list of scans, but didn't find one with a
-	matching midpoint time.   Must make a new scan.
-      */
-      makeScan(&current, bundle);
-      pthread_mutex_lock(&scanMutex);
+    pthread_mutex_lock(&scanMutex);
+  } else if (current == NULL) {
+    /* makeScan() found no free slot for a new scan */
+    pthread_mutex_unlock(&scanMutex);
+    return(NO_SCAN_SLOT);
+  } else {
+    /* This bundle belongs in a currently pending scan */
+    if (!(current->expected[crate])) {
+      fprintf(stderr,
+	      "processBundle: Got a bundle from crate %d, but no scan from\n",
+	      bundle->crateNumber);
+      fprintf(stderr,
+	      "               that crate was expected - will discard this bundle.\n");
+      fprintf(stderr,
+	      "               First time = %f, bundle time = %f\n",
+	      current->firstTime, bundle->UTCtime);
+      pthread_mutex_unlock(&scanMutex);
+      return(UNEXPECTED_BUNDLE);
+    } else if (current->received[crate]) {
+      fprintf(stderr,
+	      "processBundle: Got a bundle from crate %d, but the current scan\n",
+	      bundle->crateNumber);
+      fprintf(stderr,
+	      "               already has a bundle from that crate - will discard\n");
+      fprintf(stderr,
+	      "               this bundle.   First time = %f, bundle time = %f\n",
+	      current->firstTime, bundle->UTCtime);
+      pthread_mutex_unlock(&scanMutex);
+      return(REDUNDANT_BUNDLE);
     }
   }
 
   /*
     At this point "current" should point to a valid scan, which needs the
-    current bundle's data. So, copy the data into the proper slot.
+    current bundle's data.   Claim the crate's slot in it, and reserve the
+    arena space for the copy.
   */
   current->received[crate] = TRUE;
-  bundleCopy(bundle, &(current->data[crate]), TRUE,
-	     &(current->hiRes[crate]), &(current->nDaisyChained[crate]),
-	     &(current->nInDaisyChain[crate]));
-  scanCompleteCheck(current);
+  current->arrivalTime[crate] = latencyNow();
+  current->hiRes[crate] = hiRes;
+  current->nDaisyChained[crate] = nDaisyChained;
+  current->nInDaisyChain[crate] = nInDaisyChain;
+  if (shared != NULL)
+    current->shared[crate] = visBufferRetain(shared);
+  space = (char *)arenaAlloc(&(current->arena), size);
+  if (!(hiRes && (nInDaisyChain == 1)) && (bundle->set.set_len > 0))
+    sums = (pCPartial *)arenaAlloc(&(current->arena),
+				   bundle->set.set_len*MAX_SB*sizeof(pCPartial));
+  current->copiesInFlight++;
+  pthread_mutex_unlock(&scanMutex);
+
+  bundleCopy(bundle, &copy, hiRes, TRUE, hiResCount, shared, space);
+  if ((sums != NULL) && !pCBundleSums(copy, sums))
+    sums = NULL;
+
+  pthread_mutex_lock(&scanMutex);
+  current->data[crate] = copy;
+  current->pCSums[crate] = sums;
+  current->copiesInFlight--;
+  if (current->dropped) {
+    if (current->copiesInFlight == 0)
+      releaseScan(current, TRUE);
+  } else
+    scanCompleteCheck(current);
+  pthread_cond_broadcast(&copyDoneCond);
   pthread_mutex_unlock(&scanMutex);
   return(OK);
 } /* End of processBundle */
@@ -831,17 +1972,26 @@ int  processBundle(dCrateUVBlock *bundle)
 
   uT2LST calculates the LST from the julian day number and
   the number of seconds past 00:00:00
+
+  earthtilt() is only ever called for the start of the day, and the
+  nutation calculation it does is expensive, so the equation of the
+  equinoxes is remembered until the day changes.   Only the WRITER
+  calls this function.
 */
 void uT2LST(long julianday, double secs, double *lst)
 {
-  
-  double tjd_upper, tjd_lower, dpsi, deps, tobl, equinoxes;
+  static long tiltDay = -1;
+  static double equinoxes;
+  double tjd_upper, tjd_lower, dpsi, deps, tobl;
   double d1, mobl, gst, lst_radian;
   
   tjd_lower = secs/24.0/3600.0;
   tjd_upper = julianday - 0.5; 
   
-  earthtilt(tjd_upper, &mobl, &tobl, &equinoxes, &dpsi, &deps);
+  if (julianday != tiltDay) {
+    earthtilt(tjd_upper, &mobl, &tobl, &equinoxes, &dpsi, &deps);
+    tiltDay = julianday;
+  }
   sidereal_time(tjd_upper, tjd_lower, equinoxes, &gst);
   d1 = gst * TWO_PI / 24.0 + LONGRAD;
   lst_radian = fmod(d1, TWO_PI);
@@ -859,6 +2009,10 @@ void uT2LST(long julianday, double secs, double *lst)
   time of the scan.   Also calculate the pad coordinates in the
   local frame, for use by mir.
 
+  The projection is linear, so each antenna's position is projected
+  once, and a baseline's U, V and W are just the difference between
+  those of its antennas.
+
   Returns the hour angle at the scan midpoint.
 */
 double calculateUVW(pendingScan *scan, double mPTime, long jD)
@@ -866,6 +2020,7 @@ double calculateUVW(pendingScan *scan, double mPTime, long jD)
   int ant1, ant2;
   double sHA, cHA, sDec, cDec, sLat, cLat;
   double hourAngle, lST;
+  double antU[MAX_ANT+1], antV[MAX_ANT+1], antW[MAX_ANT+1];
 
   uT2LST(jD, mPTime * 3600.0, &lST);
   hourAngle = lST - scan->header.DDSdata.ra;
@@ -882,42 +2037,42 @@ double calculateUVW(pendingScan *scan, double mPTime, long jD)
   dprintf("LST = %f, RA = %f, HA = %f\n",
 	  lST, scan->header.DDSdata.ra, hourAngle);
   for (ant1 = 1; ant1 < MAX_ANT+1; ant1++) {
-    scan->padE[ant1] =  scan->header.DDSdata.y[ant1];
-    scan->padN[ant1] = -sLat*scan->header.DDSdata.x[ant1] + cLat*scan->header.DDSdata.z[ant1];
-    scan->padU[ant1] =  cLat*scan->header.DDSdata.x[ant1] + sLat*scan->header.DDSdata.z[ant1];
-    for (ant2 = 1; ant2 < MAX_ANT+1; ant2++)
-      if (ant2 > ant1) {
-	double X, Y, Z;
-
-	X = scan->header.DDSdata.x[ant1] - scan->header.DDSdata.x[ant2];
-	Y = scan->header.DDSdata.y[ant1] - scan->header.DDSdata.y[ant2];
-	Z = scan->header.DDSdata.z[ant1] - scan->header.DDSdata.z[ant2];
-	scan->u[ant1][ant2] =       sHA*X +      cHA*Y;
-	scan->v[ant1][ant2] = -cHA*sDec*X + sHA*sDec*Y + cDec*Z;
-	scan->w[ant1][ant2] =  cHA*cDec*X - sHA*cDec*Y + sDec*Z;
-	scan->u[ant2][ant1] = scan->u[ant1][ant2];
-	scan->v[ant2][ant1] = scan->v[ant1][ant2];
-	scan->w[ant2][ant1] = scan->w[ant1][ant2];
-      }
+    double X, Y, Z;
+
+    X = scan->header.DDSdata.x[ant1];
+    Y = scan->header.DDSdata.y[ant1];
+    Z = scan->header.DDSdata.z[ant1];
+    scan->padE[ant1] =  Y;
+    scan->padN[ant1] = -sLat*X + cLat*Z;
+    scan->padU[ant1] =  cLat*X + sLat*Z;
+    antU[ant1] =       sHA*X +      cHA*Y;
+    antV[ant1] = -cHA*sDec*X + sHA*sDec*Y + cDec*Z;
+    antW[ant1] =  cHA*cDec*X - sHA*cDec*Y + sDec*Z;
   }
+  for (ant1 = 1; ant1 < MAX_ANT+1; ant1++)
+    for (ant2 = ant1+1; ant2 < MAX_ANT+1; ant2++) {
+      scan->u[ant1][ant2] = scan->u[ant2][ant1] = antU[ant1] - antU[ant2];
+      scan->v[ant1][ant2] = scan->v[ant2][ant1] = antV[ant1] - antV[ant2];
+      scan->w[ant1][ant2] = scan->w[ant2][ant1] = antW[ant1] - antW[ant2];
+    }
   return(hourAngle);
 } /* End of calculateUVW */
 
 /*
 
-  C A L C U L A T E  C H U N K  F R E Q U E N C I E S
+  C H U N K  T A B L E  C O M P U T E
 
-  calculateChunkFrequencies calculates the center frequency and velocity
-  for each chunk.
+  chunkTableCompute fills table with the chunk center frequencies and
+  velocities for the tuning described by scan's header, leaving out the
+  part of the SWARM chunk velocities which depends upon the source's
+  velocity.
 
 */
-void calculateChunkFrequencies(pendingScan **scan)
+void chunkTableCompute(pendingScan **scan, chunkTable *table)
 {
   int rx, sb, block, chunk, chunkIndex, effectiveRx;
-  double alpha, beta, vRadial, fRest, vCatalog;
+  double alpha, beta, fRest;
 
-  vRadial = (*scan)->header.loData.vRadial;
-  vCatalog = (*scan)->header.loData.vCatalog;
   for (rx = 0; rx < MAX_RX; rx++) {
     if (doubleBandwidth)
       effectiveRx = doubleBandwidthRx;
@@ -932,10 +2087,10 @@ void calculateChunkFrequencies(pendingScan **scan)
 	  /* First, calculate the chunk center frequencies */
 	  if ((rx == 0) || (!doubleBandwidth)) {
 	    if (sb == 0) /* LSB */
-	      (*scan)->chunkFreq[rx][sb][sChunk(block,chunkIndex)] =
+	      table->chunkFreq[rx][sb][sChunk(block,chunkIndex)] =
 		(*scan)->header.loData.frequencies.receiver[effectiveRx].sideband[sb].block[block-1].chunk[chunk-1].centerfreq;
 	    else         /* USB */
-	      (*scan)->chunkFreq[rx][sb][sChunk(block,chunkIndex)] =
+	      table->chunkFreq[rx][sb][sChunk(block,chunkIndex)] =
 		(*scan)->header.loData.frequencies.receiver[effectiveRx].sideband[sb].block[block-1].chunk[chunk-1].centerfreq;
 	    /* Next, calculate the chunk center velocities */
 	    {
@@ -949,52 +2104,52 @@ void calculateChunkFrequencies(pendingScan **scan)
 		  else
 		    sign = 1.0;
 		  for (kk = 0; kk < 2; kk++) {
-		    (*scan)->chunkFreq[ii][jj][ 1] = 230.538e9 + sign*4057.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 2] = 230.538e9 + sign*4139.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 3] = 230.538e9 + sign*4221.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 4] = 230.538e9 + sign*4303.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 5] = 230.538e9 + sign*4385.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 6] = 230.538e9 + sign*4467.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 7] = 230.538e9 + sign*4549.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 8] = 230.538e9 + sign*4631.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 9] = 230.538e9 + sign*4713.0e6;
-		    (*scan)->chunkFreq[ii][jj][10] = 230.538e9 + sign*4795.0e6;
-		    (*scan)->chunkFreq[ii][jj][11] = 230.538e9 + sign*4877.0e6;
-		    (*scan)->chunkFreq[ii][jj][12] = 230.538e9 + sign*4959.0e6;
-		    (*scan)->chunkFreq[ii][jj][13] = 230.538e9 + sign*5041.0e6;
-		    (*scan)->chunkFreq[ii][jj][14] = 230.538e9 + sign*5123.0e6;
-		    (*scan)->chunkFreq[ii][jj][15] = 230.538e9 + sign*5205.0e6;
-		    (*scan)->chunkFreq[ii][jj][16] = 230.538e9 + sign*5287.0e6;
-		    (*scan)->chunkFreq[ii][jj][17] = 230.538e9 + sign*5369.0e6;
-		    (*scan)->chunkFreq[ii][jj][18] = 230.538e9 + sign*5451.0e6;
-		    (*scan)->chunkFreq[ii][jj][19] = 230.538e9 + sign*5533.0e6;
-		    (*scan)->chunkFreq[ii][jj][20] = 230.538e9 + sign*5615.0e6;
-		    (*scan)->chunkFreq[ii][jj][21] = 230.538e9 + sign*5697.0e6;
-		    (*scan)->chunkFreq[ii][jj][22] = 230.538e9 + sign*5779.0e6;
-		    (*scan)->chunkFreq[ii][jj][23] = 230.538e9 + sign*5861.0e6;
-		    (*scan)->chunkFreq[ii][jj][24] = 230.538e9 + sign*5943.0e6;
+		    table->chunkFreq[ii][jj][ 1] = 230.538e9 + sign*4057.0e6;
+		    table->chunkFreq[ii][jj][ 2] = 230.538e9 + sign*4139.0e6;
+		    table->chunkFreq[ii][jj][ 3] = 230.538e9 + sign*4221.0e6;
+		    table->chunkFreq[ii][jj][ 4] = 230.538e9 + sign*4303.0e6;
+		    table->chunkFreq[ii][jj][ 5] = 230.538e9 + sign*4385.0e6;
+		    table->chunkFreq[ii][jj][ 6] = 230.538e9 + sign*4467.0e6;
+		    table->chunkFreq[ii][jj][ 7] = 230.538e9 + sign*4549.0e6;
+		    table->chunkFreq[ii][jj][ 8] = 230.538e9 + sign*4631.0e6;
+		    table->chunkFreq[ii][jj][ 9] = 230.538e9 + sign*4713.0e6;
+		    table->chunkFreq[ii][jj][10] = 230.538e9 + sign*4795.0e6;
+		    table->chunkFreq[ii][jj][11] = 230.538e9 + sign*4877.0e6;
+		    table->chunkFreq[ii][jj][12] = 230.538e9 + sign*4959.0e6;
+		    table->chunkFreq[ii][jj][13] = 230.538e9 + sign*5041.0e6;
+		    table->chunkFreq[ii][jj][14] = 230.538e9 + sign*5123.0e6;
+		    table->chunkFreq[ii][jj][15] = 230.538e9 + sign*5205.0e6;
+		    table->chunkFreq[ii][jj][16] = 230.538e9 + sign*5287.0e6;
+		    table->chunkFreq[ii][jj][17] = 230.538e9 + sign*5369.0e6;
+		    table->chunkFreq[ii][jj][18] = 230.538e9 + sign*5451.0e6;
+		    table->chunkFreq[ii][jj][19] = 230.538e9 + sign*5533.0e6;
+		    table->chunkFreq[ii][jj][20] = 230.538e9 + sign*5615.0e6;
+		    table->chunkFreq[ii][jj][21] = 230.538e9 + sign*5697.0e6;
+		    table->chunkFreq[ii][jj][22] = 230.538e9 + sign*5779.0e6;
+		    table->chunkFreq[ii][jj][23] = 230.538e9 + sign*5861.0e6;
+		    table->chunkFreq[ii][jj][24] = 230.538e9 + sign*5943.0e6;
 		  }
-		  (*scan)->chunkFreq[ii][jj][49] = 230.538e9 + sign*9.0e9;
-		  (*scan)->chunkFreq[ii][jj][50] = 230.538e9 + sign*11.0e9;
+		  table->chunkFreq[ii][jj][49] = 230.538e9 + sign*9.0e9;
+		  table->chunkFreq[ii][jj][50] = 230.538e9 + sign*11.0e9;
 		}
 	      }
 	    }
 	    
-	    alpha =  (*scan)->chunkFreq[rx][sb][sChunk(block,chunk)] /
+	    alpha =  table->chunkFreq[rx][sb][sChunk(block,chunk)] /
 	      (*scan)->header.loData.restFrequency[effectiveRx];
 	    alpha *= alpha;
 	    beta = (1.0 - alpha)/(1.0 + alpha);
-	    (*scan)->chunkVelo[rx][sb][sChunk(block,chunk)] = 0.0;
+	    table->chunkVelo[rx][sb][sChunk(block,chunk)] = 0.0;
 	  } else {
 	    int uChunk;
 
 	    uChunk = 25-sChunk(block, chunkIndex);
 	    if (sb == 0) /* LSB */
-	      (*scan)->chunkFreq[rx][sb][uChunk] =
+	      table->chunkFreq[rx][sb][uChunk] =
 		(*scan)->header.loData.frequencies.receiver[effectiveRx].sideband[sb].block[block-1].chunk[chunk-1].centerfreq -
 		bDAIFSep;
 	    else         /* USB */
-	      (*scan)->chunkFreq[rx][sb][uChunk] =
+	      table->chunkFreq[rx][sb][uChunk] =
 		(*scan)->header.loData.frequencies.receiver[effectiveRx].sideband[sb].block[block-1].chunk[chunk-1].centerfreq +
 	        bDAIFSep;
 	    /* Next, calculate the chunk center velocities */
@@ -1009,56 +2164,109 @@ void calculateChunkFrequencies(pendingScan **scan)
 		  else
 		    sign = 1.0;
 		  for (kk = 0; kk < 2; kk++) {
-		    (*scan)->chunkFreq[ii][jj][ 1] = 230.538e9 + sign*4057.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 2] = 230.538e9 + sign*4139.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 3] = 230.538e9 + sign*4221.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 4] = 230.538e9 + sign*4303.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 5] = 230.538e9 + sign*4385.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 6] = 230.538e9 + sign*4467.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 7] = 230.538e9 + sign*4549.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 8] = 230.538e9 + sign*4631.0e6;
-		    (*scan)->chunkFreq[ii][jj][ 9] = 230.538e9 + sign*4713.0e6;
-		    (*scan)->chunkFreq[ii][jj][10] = 230.538e9 + sign*4795.0e6;
-		    (*scan)->chunkFreq[ii][jj][11] = 230.538e9 + sign*4877.0e6;
-		    (*scan)->chunkFreq[ii][jj][12] = 230.538e9 + sign*4959.0e6;
-		    (*scan)->chunkFreq[ii][jj][13] = 230.538e9 + sign*5041.0e6;
-		    (*scan)->chunkFreq[ii][jj][14] = 230.538e9 + sign*5123.0e6;
-		    (*scan)->chunkFreq[ii][jj][15] = 230.538e9 + sign*5205.0e6;
-		    (*scan)->chunkFreq[ii][jj][16] = 230.538e9 + sign*5287.0e6;
-		    (*scan)->chunkFreq[ii][jj][17] = 230.538e9 + sign*5369.0e6;
-		    (*scan)->chunkFreq[ii][jj][18] = 230.538e9 + sign*5451.0e6;
-		    (*scan)->chunkFreq[ii][jj][19] = 230.538e9 + sign*5533.0e6;
-		    (*scan)->chunkFreq[ii][jj][20] = 230.538e9 + sign*5615.0e6;
-		    (*scan)->chunkFreq[ii][jj][21] = 230.538e9 + sign*5697.0e6;
-		    (*scan)->chunkFreq[ii][jj][22] = 230.538e9 + sign*5779.0e6;
-		    (*scan)->chunkFreq[ii][jj][23] = 230.538e9 + sign*5861.0e6;
-		    (*scan)->chunkFreq[ii][jj][24] = 230.538e9 + sign*5943.0e6;
+		    table->chunkFreq[ii][jj][ 1] = 230.538e9 + sign*4057.0e6;
+		    table->chunkFreq[ii][jj][ 2] = 230.538e9 + sign*4139.0e6;
+		    table->chunkFreq[ii][jj][ 3] = 230.538e9 + sign*4221.0e6;
+		    table->chunkFreq[ii][jj][ 4] = 230.538e9 + sign*4303.0e6;
+		    table->chunkFreq[ii][jj][ 5] = 230.538e9 + sign*4385.0e6;
+		    table->chunkFreq[ii][jj][ 6] = 230.538e9 + sign*4467.0e6;
+		    table->chunkFreq[ii][jj][ 7] = 230.538e9 + sign*4549.0e6;
+		    table->chunkFreq[ii][jj][ 8] = 230.538e9 + sign*4631.0e6;
+		    table->chunkFreq[ii][jj][ 9] = 230.538e9 + sign*4713.0e6;
+		    table->chunkFreq[ii][jj][10] = 230.538e9 + sign*4795.0e6;
+		    table->chunkFreq[ii][jj][11] = 230.538e9 + sign*4877.0e6;
+		    table->chunkFreq[ii][jj][12] = 230.538e9 + sign*4959.0e6;
+		    table->chunkFreq[ii][jj][13] = 230.538e9 + sign*5041.0e6;
+		    table->chunkFreq[ii][jj][14] = 230.538e9 + sign*5123.0e6;
+		    table->chunkFreq[ii][jj][15] = 230.538e9 + sign*5205.0e6;
+		    table->chunkFreq[ii][jj][16] = 230.538e9 + sign*5287.0e6;
+		    table->chunkFreq[ii][jj][17] = 230.538e9 + sign*5369.0e6;
+		    table->chunkFreq[ii][jj][18] = 230.538e9 + sign*5451.0e6;
+		    table->chunkFreq[ii][jj][19] = 230.538e9 + sign*5533.0e6;
+		    table->chunkFreq[ii][jj][20] = 230.538e9 + sign*5615.0e6;
+		    table->chunkFreq[ii][jj][21] = 230.538e9 + sign*5697.0e6;
+		    table->chunkFreq[ii][jj][22] = 230.538e9 + sign*5779.0e6;
+		    table->chunkFreq[ii][jj][23] = 230.538e9 + sign*5861.0e6;
+		    table->chunkFreq[ii][jj][24] = 230.538e9 + sign*5943.0e6;
 		  }
-		  (*scan)->chunkFreq[ii][jj][49] = 230.538e9 + sign*9.0e9;
-		  (*scan)->chunkFreq[ii][jj][50] = 230.538e9 + sign*11.0e9;
+		  table->chunkFreq[ii][jj][49] = 230.538e9 + sign*9.0e9;
+		  table->chunkFreq[ii][jj][50] = 230.538e9 + sign*11.0e9;
 		}
 	      }
 	    }
-	    alpha =  (*scan)->chunkFreq[rx][sb][uChunk] /
+	    alpha =  table->chunkFreq[rx][sb][uChunk] /
 	      (*scan)->header.loData.restFrequency[effectiveRx];
 	    alpha *= alpha;
 	    beta = (1.0 - alpha)/(1.0 + alpha);
-	    (*scan)->chunkVelo[rx][sb][uChunk] = 0.0;
+	    table->chunkVelo[rx][sb][uChunk] = 0.0;
 	  }
 	}
       /* Now do the SWARM chunks */
       for (chunk = 0; chunk < MAX_SWARM_CHUNK; chunk++) {
 	if (sb == 0)
-	  (*scan)->sWARMFreq[sb][chunk] = sWARMCenterFrequency/1.0e9 - SWARM_IF_MIDPOINT - chunk*SWARM_CHUNK_WIDTH;
+	  table->sWARMFreq[sb][chunk] = (*scan)->extra.sWARMCenterFrequency/1.0e9 - SWARM_IF_MIDPOINT - chunk*SWARM_CHUNK_WIDTH;
 	else
-	  (*scan)->sWARMFreq[sb][chunk] = sWARMCenterFrequency/1.0e9 + SWARM_IF_MIDPOINT + chunk*SWARM_CHUNK_WIDTH;
-	alpha = 1.0e9*((*scan)->sWARMFreq[rx][chunk])/fRest;
+	  table->sWARMFreq[sb][chunk] = (*scan)->extra.sWARMCenterFrequency/1.0e9 + SWARM_IF_MIDPOINT + chunk*SWARM_CHUNK_WIDTH;
+	alpha = 1.0e9*(table->sWARMFreq[rx][chunk])/fRest;
 	alpha *= alpha;
 	beta = (1.0 - alpha)/(1.0 + alpha);
-	(*scan)->sWARMVelo[rx][chunk] = (SPEED_OF_LIGHT*beta - vRadial - vCatalog)/1.0e3;
+	table->sWARMDoppler[rx][chunk] = SPEED_OF_LIGHT*beta;
       }
     } /* for (sb ... */
   }
+} /* End of chunkTableCompute */
+
+/*
+
+  C A L C U L A T E  C H U N K  F R E Q U E N C I E S
+
+  calculateChunkFrequencies calculates the center frequency and velocity
+  for each chunk.
+
+  The chunk frequencies only change when the receivers are retuned, so
+  the table computed for the last tuning is kept, and reused as long as
+  the tuning stays the same.   Only the source's velocity needs to be
+  applied to each scan.   Only the HEADER thread calls this function.
+
+*/
+void calculateChunkFrequencies(pendingScan **scan)
+{
+  static chunkTable *table = NULL;
+  int rx, chunk;
+  double vRadial, vCatalog;
+
+  if (table == NULL) {
+    table = (chunkTable *)calloc(1, sizeof(chunkTable));
+    if (table == NULL) {
+      perror("calculateChunkFrequencies: calloc of table");
+      exit(ERROR);
+    }
+  }
+  if (!table->valid ||
+      memcmp(table->frequencies, &(*scan)->header.loData.frequencies, sizeof(table->frequencies)) ||
+      memcmp(table->restFrequency, (*scan)->header.loData.restFrequency, sizeof(table->restFrequency)) ||
+      (table->doubleBandwidth != doubleBandwidth) ||
+      (table->doubleBandwidthRx != doubleBandwidthRx) ||
+      (table->bDAIFSep != bDAIFSep) ||
+      (table->sWARMCenterFrequency != (*scan)->extra.sWARMCenterFrequency)) {
+    dprintf("calculateChunkFrequencies: New tuning - recomputing the chunk table\n");
+    chunkTableCompute(scan, table);
+    memcpy(table->frequencies, &(*scan)->header.loData.frequencies, sizeof(table->frequencies));
+    memcpy(table->restFrequency, (*scan)->header.loData.restFrequency, sizeof(table->restFrequency));
+    table->doubleBandwidth = doubleBandwidth;
+    table->doubleBandwidthRx = doubleBandwidthRx;
+    table->bDAIFSep = bDAIFSep;
+    table->sWARMCenterFrequency = (*scan)->extra.sWARMCenterFrequency;
+    table->valid = TRUE;
+  }
+  memcpy((*scan)->chunkFreq, table->chunkFreq, sizeof(table->chunkFreq));
+  memcpy((*scan)->chunkVelo, table->chunkVelo, sizeof(table->chunkVelo));
+  memcpy((*scan)->sWARMFreq, table->sWARMFreq, sizeof(table->sWARMFreq));
+  vRadial = (*scan)->header.loData.vRadial;
+  vCatalog = (*scan)->header.loData.vCatalog;
+  for (rx = 0; rx < MAX_RX; rx++)
+    for (chunk = 0; chunk < MAX_SWARM_CHUNK; chunk++)
+      (*scan)->sWARMVelo[rx][chunk] = (table->sWARMDoppler[rx][chunk] - vRadial - vCatalog)/1.0e3;
 } /* End of calculateChunkFrequencies */
 
 /*
@@ -1068,14 +2276,28 @@ void calculateChunkFrequencies(pendingScan **scan)
   makePadList determines which pad each antenna is on.   This info
   probably should be passed by statusServer, instead of being calculated
   here.   I'll fix it later...
+
+  Antennas move rarely, so the pad found for each antenna is kept, and
+  only looked up again when the antenna's position changes.   Only the
+  HEADER thread calls this function.
 */
 void makePadList(pendingScan **scan)
 {
+  static int knownPad[MAX_ANT+1];
+  static double knownX[MAX_ANT+1], knownY[MAX_ANT+1], knownZ[MAX_ANT+1];
+  static int known = FALSE;
   int ant, pad;
   double deltaX, deltaY, deltaZ, distance, minDistance;
 
   minDistance = 1.0e38;
-  for (ant = 1; ant < MAX_ANT+1; ant++)
+  for (ant = 1; ant < MAX_ANT+1; ant++) {
+    if (known &&
+	(knownX[ant] == (*scan)->header.DDSdata.x[ant]) &&
+	(knownY[ant] == (*scan)->header.DDSdata.y[ant]) &&
+	(knownZ[ant] == (*scan)->header.DDSdata.z[ant])) {
+      (*scan)->padList[ant] = knownPad[ant];
+      continue;
+    }
     for (pad = 1; pad <= MAX_PAD; pad++) {
       deltaX = (*scan)->header.DDSdata.x[ant] - nominalPadX[pad];
       deltaY = (*scan)->header.DDSdata.y[ant] - nominalPadY[pad];
@@ -1090,6 +2312,12 @@ void makePadList(pendingScan **scan)
 	(*scan)->padList[ant] = 0;
       }
     }
+    knownPad[ant] = (*scan)->padList[ant];
+    knownX[ant] = (*scan)->header.DDSdata.x[ant];
+    knownY[ant] = (*scan)->header.DDSdata.y[ant];
+    knownZ[ant] = (*scan)->header.DDSdata.z[ant];
+  }
+  known = TRUE;
 } /* End of makePadList */
 
 /*
@@ -1149,27 +2377,335 @@ void getDSMInfo(pendingScan **scan)
     (*scan)->dSMStuff.polarStates[i] = 0;
 } /* End of getDSMInfo */
 
+/*
+
+   H E A D E R  F E T C H  S T A T U S  S E R V E R
+
+   headerFetchStatusServer asks statusServer for the header information for
+   the integration starting at utsec, interval seconds long.   It returns
+   TRUE, with the information in mirHeader, if statusServer supplied it.
+   The SWARM center frequency and source name are put in extra, whether
+   statusServer supplied the header or not.
+
+*/
+int headerFetchStatusServer(double utsec, double interval, info *mirHeader, headerExtra *extra)
+{
+  int i, mirOK;
+  requestCodes statusRequest;
+  info *mirInfo = NULL;
+  static int statusServerConnectionOK = FALSE;
+  /* static CLIENT *statusServerCl, *setLOCl = NULL; */
+
+  mirOK = FALSE;
+  i = 0;
+  do {
+    /* int dSMStatus; */
+    /* static int badSetLOCall = FALSE; */
+    /* time_t timeStamp; */
+    char checkSourceName[35];
+    /* struct timeval timeout; */
+
+    /*
+    if ((setLOCl == NULL) || badSetLOCall)
+      setLOCl = clnt_create("hal9000", SETLOPROG, SETLOVERS, "tcp");
+    */
+    if (TRUE) {
+      /* genericRequest request; */
+      skyFrequencyInfo *info;
+
+      /* get the information about sky frequencies needed for SWARM */
+      /* info = getsky_1(&request, setLOCl); */
+      if (FALSE) {
+	double skyFrequency;
+
+	if (info->sideband[0])
+	  skyFrequency = info->frequency[0] + 5.0e9;
+	  else
+	  skyFrequency = info->frequency[0] - 5.0e9;
+	extra->sWARMCenterFrequency = skyFrequency;
+	/* badSetLOCall = FALSE; */
+      } else {
+	extra->sWARMCenterFrequency = 2.3e11;
+	/* badSetLOCall = TRUE; */
+      }
+    }
+    /* Try to connect to the statusServer - allow up to 8 retries before giving up */
+    mirOK = TRUE;
+    /*
+    if ((!statusServerConnectionOK) || (statusServerCl == NULL)) {
+      dprintf("Attempting to connect to statusServer on hal\n");
+      statusServerCl = clnt_create("hal9000", STATUSSERVERPROG, STATUSSERVERVERS, "tcp");
+    }
+    */
+    if (TRUE) {
+      mirOK = FALSE;
+      statusServerConnectionOK = FALSE;
+      strcpy(extra->sourceName, "LabAntennaSimulator");
+      if (FALSE) {
+	clnt_pcreateerror("hal9000");
+	fprintf(stderr, "header: WARNING: Could not connect to statusServer.\n");
+      }
+    } else {
+      statusServerConnectionOK = TRUE;
+      /* timeout.tv_sec = 500.0; */
+      /* timeout.tv_usec = 0.0; */
+      /*
+      if (clnt_control(statusServerCl, CLSET_TIMEOUT, (char *)&timeout) == FALSE) {
+	fprintf(stderr, "header: Could not set hal9000 timeout to %d secs.\n", (int)timeout.tv_sec);
+      }
+      */
+      /*                                                                                                                                                            I must fetch the source name here, because the next operation will be to send                                                                              a request for header information to statusServer.   statusServer keeps track of the                                                                        scan count, so we may go to a new source immediately after that call, and then                                                                             the source name info might be wrong.                                                                                                             	*/
+      /*
+      dSMStatus = dsm_read("hal9000", "DSM_AS_SOURCE_C34", extra->sourceName, &timeStamp);
+      if (dSMStatus == DSM_SUCCESS)
+	extra->sourceName[25] = (char)0;
+      else
+	dsm_error_message(dSMStatus, "DSM_AS_SOURCE_C34");
+      */
+      strcpy(extra->sourceName, "LabAntennaSimulator");
+      statusRequest.utsec = utsec;
+      statusRequest.interval = interval;
+      dprintf("header:\tmaking call to statusServer (%f, %f)\n",
+	      statusRequest.utsec, statusRequest.interval);
+      /* mirInfo = statusrequest_1(&statusRequest, statusServerCl); */
+      if (FALSE) {
+	struct rpc_err halerr;         /* RPC error structure */
+
+	mirOK = statusServerConnectionOK = FALSE;
+	fprintf(stderr, "header: WARNING: Opened connection to hal9000, but could not get mir data.\n");
+	/* clnt_geterr(statusServerCl, &halerr); */
+	fprintf(stderr, "header: RPC Error:  %s\n", clnt_sperrno(halerr.re_status));
+	/*
+	if (halerr.re_status == RPC_TIMEDOUT) {
+	  if (clnt_control(statusServerCl, CLGET_TIMEOUT, (char *)&timeout) == FALSE) {
+	    fprintf(stderr, "header: Could not get hal9000 timeout\n");
+	  } else {
+	    fprintf(stderr, "header: timeout was set at %d secs.  %d\n",
+		    (int)timeout.tv_sec, (int)timeout.tv_usec);
+	  }
+	}
+	auth_destroy(statusServerCl->cl_auth);
+	clnt_destroy(statusServerCl);
+	*/
+      }
+      /*
+      dSMStatus = dsm_read("hal9000", "DSM_AS_SOURCE_C34", checkSourceName, &timeStamp);
+      if (dSMStatus == DSM_SUCCESS)
+	checkSourceName[25] = (char)0;
+      else
+	dsm_error_message(dSMStatus, "DSM_AS_SOURCE_C34 (check read)");
+      */
+      strcpy(checkSourceName, "LabAntennaSimulator");
+      if (mirInfo) {
+	int i;
+
+	 for (i = 1; i < 9; i++) {
+	  if ((mirInfo->antavg[i].isvalid[0] == 1) && (mirInfo->antavg[i].isvalid[1] == 1024))
+	    mirInfo->antavg[i].isvalid[0] = 0;
+	 }
+       } else
+	fprintf(stderr, "Skipping 1 && 1024 test, because of NULL pointer\n");
+      if (strcmp(extra->sourceName, checkSourceName)) {
+	extra->spoilScan = TRUE;
+      } else {
+	static char lastSourceName[50];
+
+	if (!strcmp(checkSourceName, lastSourceName))
+	  extra->spoilScan = FALSE;
+	else {
+	  extra->spoilScan = TRUE;
+	}
+	strcpy(lastSourceName, checkSourceName);
+      }
+    }
+  } while ((mirOK == FALSE) && (i++ < 1));
+  if (mirOK && (mirInfo != NULL))
+    bcopy((char *)mirInfo, (char *)mirHeader, sizeof(info));
+  return(mirOK && (mirInfo != NULL));
+} /* End of headerFetchStatusServer */
+
+/*
+
+   H E A D E R  F E T C H E R
+
+   This function executes as the FETCHER thread.   It makes the calls to
+   statusServer which the HEADER thread asks for, one at a time, so that
+   the HEADER thread can give up on a slow call.   If it is asked for
+   another header while busy, it fetches only the latest one asked for
+   once it is free.   Each result is kept in the fetchedHeaders ring.
+
+*/
+void *headerFetcher(void *arg)
+{
+  unsigned int serial;
+  headerFetch *result;
+  void *returnValue = NULL;
+
+  result = (headerFetch *)malloc(sizeof(headerFetch));
+  if (result == NULL) {
+    perror("headerFetcher: malloc of result");
+    exit(ERROR);
+  }
+  printf("Thread FETCHER starting\n");
+  while (TRUE) {
+    pthread_mutex_lock(&fetchMutex);
+    while (fetchRequested == fetchStarted)
+      pthread_cond_wait(&fetchCond, &fetchMutex);
+    serial = fetchStarted = fetchRequested;
+    result->utsec = fetchUtsec;
+    result->interval = fetchInterval;
+    pthread_mutex_unlock(&fetchMutex);
+
+    dprintf("headerFetcher: fetch %u, for %f\n", serial, result->utsec);
+    memset(&result->extra, 0, sizeof(result->extra));
+    result->ok = headerFetchStatusServer(result->utsec, result->interval, &result->header,
+					 &result->extra);
+
+    pthread_mutex_lock(&fetchMutex);
+    fetchedHeaders[nFetchedHeaders % HEADER_FETCHED] = *result;
+    nFetchedHeaders++;
+    if (result->ok) {
+      lastGoodHeader = *result;
+      haveLastGoodHeader = TRUE;
+    }
+    pthread_cond_broadcast(&fetchedCond);
+    pthread_mutex_unlock(&fetchMutex);
+  }
+  return(returnValue); /* Never Executed */
+} /* End of headerFetcher */
+
+/*
+  headerFetchMatch returns the entry in fetchedHeaders for the integration
+  starting at utsec, or NULL if it is not there.   Entries within half an
+  integration spacing of utsec match, and the closest is returned.
+  fetchMutex must be held.
+*/
+headerFetch *headerFetchMatch(double utsec)
+{
+  int i, first;
+  double diff, best = 0.0;
+  headerFetch *found = NULL;
+
+  first = (nFetchedHeaders > HEADER_FETCHED) ? nFetchedHeaders - HEADER_FETCHED : 0;
+  for (i = first; i < nFetchedHeaders; i++) {
+    diff = fabs(fetchedHeaders[i % HEADER_FETCHED].utsec - utsec);
+    if (((diff == 0.0) || (diff < 0.5*fetchSpacing)) && ((found == NULL) || (diff < best))) {
+      found = &fetchedHeaders[i % HEADER_FETCHED];
+      best = diff;
+    }
+  }
+  return(found);
+} /* End of headerFetchMatch */
+
+/*
+
+   H E A D E R  R E Q U E S T
+
+   headerRequest asks the FETCHER thread to get the header for the
+   integration starting at utsec, unless it already has it, or is already
+   fetching it.   It does not wait for the header to arrive.
+
+*/
+void headerRequest(double utsec, double interval)
+{
+  pthread_mutex_lock(&fetchMutex);
+  if ((headerFetchMatch(utsec) == NULL) &&
+      !((fetchRequested != 0) && (fetchUtsec == utsec))) {
+    fetchUtsec = utsec;
+    fetchInterval = interval;
+    fetchRequested++;
+    pthread_cond_signal(&fetchCond);
+  }
+  pthread_mutex_unlock(&fetchMutex);
+} /* End of headerRequest */
+
+/*
+
+   H E A D E R  A W A I T
+
+   headerAwait gets the header for the integration starting at utsec,
+   waiting no longer than HEADER_DEADLINE seconds for it.   If
+   statusServer does not supply the header by then, or fails to supply
+   it at all, the last good header is used instead.   It returns HEADER_FRESH or HEADER_STALE, with the
+   header in mirHeader, or HEADER_NONE if there is no header to use.
+   extra is taken from the integration's own fetch if there was one,
+   otherwise from the latest fetch.   Only the HEADER thread calls this.
+
+*/
+int headerAwait(double utsec, double interval, info *mirHeader, headerExtra *extra)
+{
+  static time_t lastWarning = 0;
+  static int nUnwarned = 0;
+  int status, rCode = 0;
+  struct timespec deadline;
+  headerFetch *found;
+
+  headerRequest(utsec, interval);
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += (time_t)HEADER_DEADLINE;
+  pthread_mutex_lock(&fetchMutex);
+  while (((found = headerFetchMatch(utsec)) == NULL) && (rCode == 0))
+    rCode = pthread_cond_timedwait(&fetchedCond, &fetchMutex, &deadline);
+  if ((found != NULL) && found->ok) {
+    bcopy((char *)&found->header, (char *)mirHeader, sizeof(info));
+    status = HEADER_FRESH;
+  } else if (haveLastGoodHeader) {
+    bcopy((char *)&lastGoodHeader.header, (char *)mirHeader, sizeof(info));
+    status = HEADER_STALE;
+  } else
+    status = HEADER_NONE;
+  if (found != NULL)
+    *extra = found->extra;
+  else if (nFetchedHeaders > 0)
+    *extra = fetchedHeaders[(nFetchedHeaders - 1) % HEADER_FETCHED].extra;
+  else
+    memset(extra, 0, sizeof(*extra));
+  pthread_mutex_unlock(&fetchMutex);
+  if (status != HEADER_FRESH) {
+    /* statusServer may be down for hours, so warn only every HEADER_WARN_INTERVAL seconds */
+    if (deadline.tv_sec - lastWarning >= HEADER_WARN_INTERVAL) {
+      ringLog(LOG_WARN, "headerAwait: No header from statusServer for %f %s - %s (%d more since the last warning)\n",
+	      utsec, (found == NULL) ? "before the deadline" : "at all",
+	      (status == HEADER_STALE) ? "using the last good one" : "none to use", nUnwarned);
+      lastWarning = deadline.tv_sec;
+      nUnwarned = 0;
+    } else
+      nUnwarned++;
+  }
+  return(status);
+} /* End of headerAwait */
+
 /*                                                                                                                                                             H E A D E R                                                                                                                                              
   This function executes as a separate thread, it waits until a                                                                                              condition variable is signalled.   This signal indicates that                                                                                              the first visibility bundle for a new scan has arrived.   Once                                                                                             signalled, this function gets the header information from                                                                                                  hal9000, and stores it in the scan structure.                                                                                                            */
 void *header(void *arg)
 {
-  int rCode, i, mirOK;
-  requestCodes statusRequest;
-  info *mirInfo = NULL;
+  int rCode, valid;
+  double utsec, interval;
+  headerRequestEntry request;
+  pendingScan *work;
   int nTimes = 0;
   double startTimeDouble, stopTimeDouble, thisTime;
   double timeSum = 0.0;
   double maxTime = -1.0e30;
   double minTime = 1.0e30;
+  double lastUtsec = 0.0;
   struct timespec startTime, stopTime;
-  static int statusServerConnectionOK = FALSE;
-  /* static CLIENT *statusServerCl, *setLOCl = NULL; */
   void *returnValue = NULL;
 
+  /*
+    The header information is assembled in work, and only copied into the
+    scan, with scanMutex held, once it is complete - the scan may be
+    completed, dropped or reused in the meantime.
+  */
+  work = (pendingScan *)calloc(1, sizeof(pendingScan));
+  if (work == NULL) {
+    perror("header: calloc of work");
+    exit(ERROR);
+  }
   printf("Thread HEADER starting\n");
   while (TRUE) {
     pthread_mutex_lock(&needHeaderMutex);
-    while (!needHeader) {
+    while (nHeaderRequests == 0) {
       dprintf("header thread sleeping, awaiting a signal\n");
       rCode = pthread_cond_wait(&needHeaderCond, &needHeaderMutex);
       if (rCode) {
@@ -1179,133 +2715,31 @@ void *header(void *arg)
         perror("pthread_cond_wait");
       }
     }
-    printf("header thread re-awakened\n");
+    request = headerRequests[headerRequestHead];
+    headerRequestHead = (headerRequestHead + 1) % MAX_PENDING_SCANS;
+    nHeaderRequests--;
+    pthread_mutex_unlock(&needHeaderMutex);
+    dprintf("header thread re-awakened\n");
     clock_gettime(CLOCK_REALTIME, &startTime);
     startTimeDouble = ((double)startTime.tv_sec) + ((double)startTime.tv_nsec)*1.0e-9;
-    /*                                                                                                                                                            Get the data from statusServer                                                                                                                          */
-    mirOK = FALSE;
-    i = 0;
-    do {
-      /* int dSMStatus; */
-      /* static int badSetLOCall = FALSE; */
-      /* time_t timeStamp; */
-      char checkSourceName[35];
-      /* struct timeval timeout; */
-
-      /*
-      if ((setLOCl == NULL) || badSetLOCall)
-	setLOCl = clnt_create("hal9000", SETLOPROG, SETLOVERS, "tcp");
-      */
-      if (TRUE) {
-	/* genericRequest request; */
-	skyFrequencyInfo *info;
-
-	/* get the information about sky frequencies needed for SWARM */
-	/* info = getsky_1(&request, setLOCl); */
-	if (FALSE) {
-	  double skyFrequency;
-
-	  if (info->sideband[0])
-	    skyFrequency = info->frequency[0] + 5.0e9;
-	    else
-	    skyFrequency = info->frequency[0] - 5.0e9;
-	  sWARMCenterFrequency = skyFrequency;
-	  /* badSetLOCall = FALSE; */
-	} else {
-	  sWARMCenterFrequency = 2.3e11;
-	  /* badSetLOCall = TRUE; */
-	}
-      }
-      /* Try to connect to the statusServer - allow up to 8 retries before giving up */
-      mirOK = TRUE;
-      /*
-      if ((!statusServerConnectionOK) || (statusServerCl == NULL)) {
-        dprintf("Attempting to connect to statusServer on hal\n");
-        statusServerCl = clnt_create("hal9000", STATUSSERVERPROG, STATUSSERVERVERS, "tcp");
-      }
-      */
-      if (TRUE) {
-        mirOK = FALSE;
-        statusServerConnectionOK = FALSE;
-	strcpy(globalSourceName, "LabAntennaSimulator");
-        if (FALSE) {
-          clnt_pcreateerror("hal9000");
-          fprintf(stderr, "header: WARNING: Could not connect to statusServer.\n");
-        }
-      } else {
-        statusServerConnectionOK = TRUE;
-        /* timeout.tv_sec = 500.0; */
-        /* timeout.tv_usec = 0.0; */
-	/*
-        if (clnt_control(statusServerCl, CLSET_TIMEOUT, (char *)&timeout) == FALSE) {
-          fprintf(stderr, "header: Could not set hal9000 timeout to %d secs.\n", (int)timeout.tv_sec);
-        }
-	*/
-        /*                                                                                                                                                            I must fetch the source name here, because the next operation will be to send                                                                              a request for header information to statusServer.   statusServer keeps track of the                                                                        scan count, so we may go to a new source immediately after that call, and then                                                                             the source name info might be wrong.                                                                                                             	*/
-        /*
-	dSMStatus = dsm_read("hal9000", "DSM_AS_SOURCE_C34", globalSourceName, &timeStamp);
-        if (dSMStatus == DSM_SUCCESS)
-          globalSourceName[25] = (char)0;
-        else
-	  dsm_error_message(dSMStatus, "DSM_AS_SOURCE_C34");
-	*/
-	strcpy(globalSourceName, "LabAntennaSimulator");
-        statusRequest.utsec = headerScan->firstTime;
-        statusRequest.interval = headerScan->intTime;
-        dprintf("header:\tmaking call to statusServer (%f, %f)\n",
-                statusRequest.utsec, statusRequest.interval);
-        /* mirInfo = statusrequest_1(&statusRequest, statusServerCl); */
-        if (FALSE) {
-          struct rpc_err halerr;         /* RPC error structure */
-
-          mirOK = statusServerConnectionOK = FALSE;
-          fprintf(stderr, "header: WARNING: Opened connection to hal9000, but could not get mir data.\n");
-          /* clnt_geterr(statusServerCl, &halerr); */
-          fprintf(stderr, "header: RPC Error:  %s\n", clnt_sperrno(halerr.re_status));
-	  /*
-          if (halerr.re_status == RPC_TIMEDOUT) {
-            if (clnt_control(statusServerCl, CLGET_TIMEOUT, (char *)&timeout) == FALSE) {
-              fprintf(stderr, "header: Could not get hal9000 timeout\n");
-            } else {
-              fprintf(stderr, "header: timeout was set at %d secs.  %d\n",
-                      (int)timeout.tv_sec, (int)timeout.tv_usec);
-            }
-          }
-          auth_destroy(statusServerCl->cl_auth);
-          clnt_destroy(statusServerCl);
-	  */
-        }
-	/*
-        dSMStatus = dsm_read("hal9000", "DSM_AS_SOURCE_C34", checkSourceName, &timeStamp);
-        if (dSMStatus == DSM_SUCCESS)
-          checkSourceName[25] = (char)0;
-        else
-          dsm_error_message(dSMStatus, "DSM_AS_SOURCE_C34 (check read)");
-	*/
-	strcpy(checkSourceName, "LabAntennaSimulator");
-        if (mirInfo) {
-          int i;
-
-           for (i = 1; i < 9; i++) {
-            if ((mirInfo->antavg[i].isvalid[0] == 1) && (mirInfo->antavg[i].isvalid[1] == 1024))
-              mirInfo->antavg[i].isvalid[0] = 0;
-           }
-         } else
-	  fprintf(stderr, "Skipping 1 && 1024 test, because of NULL pointer\n");
-        if (strcmp(globalSourceName, checkSourceName)) {
-          spoilScanFlag = TRUE;
-        } else {
-          static char lastSourceName[50];
-
-          if (!strcmp(checkSourceName, lastSourceName))
-            spoilScanFlag = FALSE;
-          else {
-            spoilScanFlag = TRUE;
-          }
-          strcpy(lastSourceName, checkSourceName);
-        }
-      }
-    } while ((mirOK == FALSE) && (i++ < 1));
+    pthread_mutex_lock(&scanMutex);
+    valid = (request.scan->serial == request.serial) &&
+      (findScan(request.scan->firstTime) == request.scan);
+    utsec = request.scan->firstTime;
+    interval = request.scan->intTime;
+    if (valid)
+      bcopy((char *)&request.scan->header, (char *)&work->header, sizeof(work->header));
+    pthread_mutex_unlock(&scanMutex);
+    if (!valid) {
+      dprintf("header: scan %u was dropped before its header was fetched\n", request.serial);
+      continue;
+    }
+    /*
+      Get the data from statusServer, through the FETCHER.   It has probably
+      been fetched already, while the integration was in progress.   If
+      there is no header to use, the scan keeps the one it has.
+    */
+    headerAwait(utsec, interval, &work->header, &work->extra);
     /*
     if (mirOK && (!haveLOData)) {
       globalSkyFrequency[0] = mirInfo->loData.skyFrequency[0];
@@ -1324,19 +2758,18 @@ void *header(void *arg)
 	    for (ch = 0; ch < 4; ch++)
 	      globalFrequencies.receiver[rx].sideband[sb].block[bl].chunk[ch].centerfreq = 1.0e9;
     }
-    printf("Done setting globalFrequencies\n");
-    /* bcopy((char *)mirInfo, (char *)&(headerScan->header), sizeof(headerScan->header)); */
+    dprintf("Done setting globalFrequencies\n");
     {
       int ii;
 
       for (ii = 0; ii < 11; ii++) {
-	headerScan->header.DDSdata.x[ii] = 1.0*ii;
-	headerScan->header.DDSdata.y[ii] = 2.0*ii;
-	headerScan->header.DDSdata.z[ii] = 3.0*ii;
+	work->header.DDSdata.x[ii] = 1.0*ii;
+	work->header.DDSdata.y[ii] = 2.0*ii;
+	work->header.DDSdata.z[ii] = 3.0*ii;
       }
     }
-    printf("header:\tDone with statusServer stuff\n");
-    getDSMInfo(&headerScan);
+    dprintf("header:\tDone with statusServer stuff\n");
+    getDSMInfo(&work);
     if (doDSMWrite && FALSE) {
       /* int dSMStatus; */
 
@@ -1350,15 +2783,41 @@ void *header(void *arg)
       }
       */
     }
-    makePadList(&headerScan);
-    calculateChunkFrequencies(&headerScan);
-    /* Stuff the header information from statusServer into the scan. */
+    makePadList(&work);
+    calculateChunkFrequencies(&work);
+    /*
+      Stuff the header information into the scan, unless it was dropped
+      or reused while the information was gathered.
+    */
     pthread_mutex_lock(&scanMutex);
-    headerScan->gotHeaderInfo = TRUE;
-    scanCompleteCheck(headerScan);
+    if ((request.scan->serial == request.serial) && (findScan(utsec) == request.scan)) {
+      pendingScan *scan = request.scan;
+
+      bcopy((char *)&work->header, (char *)&scan->header, sizeof(scan->header));
+      scan->extra = work->extra;
+      scan->dSMStuff = work->dSMStuff;
+      memcpy(scan->chunkFreq, work->chunkFreq, sizeof(scan->chunkFreq));
+      memcpy(scan->chunkVelo, work->chunkVelo, sizeof(scan->chunkVelo));
+      memcpy(scan->sWARMFreq, work->sWARMFreq, sizeof(scan->sWARMFreq));
+      memcpy(scan->sWARMVelo, work->sWARMVelo, sizeof(scan->sWARMVelo));
+      memcpy(scan->padList, work->padList, sizeof(scan->padList));
+      scan->headerTime = latencyNow();
+      scan->gotHeaderInfo = TRUE;
+      scanCompleteCheck(scan);
+    } else
+      dprintf("header: scan %u was dropped while its header was fetched\n", request.serial);
     pthread_mutex_unlock(&scanMutex);
-    needHeader = FALSE;
-    pthread_mutex_unlock(&needHeaderMutex);
+    /*
+      Ask for the next integration's header now, so that it will be waiting
+      when that integration's data arrive.
+    */
+    if ((lastUtsec != 0.0) && (utsec > lastUtsec)) {
+      pthread_mutex_lock(&fetchMutex);
+      fetchSpacing = utsec - lastUtsec;
+      pthread_mutex_unlock(&fetchMutex);
+      headerRequest(utsec + fetchSpacing, interval);
+    }
+    lastUtsec = utsec;
     clock_gettime(CLOCK_REALTIME, &stopTime);
     stopTimeDouble = ((double)stopTime.tv_sec) + ((double)stopTime.tv_nsec)*1.0e-9;
     thisTime = stopTimeDouble-startTimeDouble;
@@ -1369,8 +2828,8 @@ void *header(void *arg)
     timeSum += thisTime;
     nTimes++;
     if (thisTime > 0.25)
-      printf("\t\t%%%% Header fetch took %f seconds (%f, %f, %f)\n",
-             thisTime, timeSum/((double)nTimes), maxTime, minTime);
+      ringLog(LOG_INFO, "\t\t%%%% Header fetch took %f seconds (%f, %f, %f)\n",
+	      thisTime, timeSum/((double)nTimes), maxTime, minTime);
   } /* End of while (TRUE) */
   return(returnValue); /* Never Executed */
 } /* End of header */
@@ -2013,6 +3472,36 @@ int schWrite(schDef *sch, FILE *fpsch)
   return nbytes;  
 } /* end of schWrite */
 
+/*
+  schWriteFrame is used instead of schWrite when compression is turned on.
+  It writes sch's packed data as one schCodec frame (see schCodec.h).
+*/
+int schWriteFrame(schDef *sch, FILE *fpsch)
+{
+  static int frameMax = 0;
+  static char *frame = NULL;
+  int nbytes;
+  int size = sch->nbyt;
+  int inhid = sch->inhid;
+
+  if (schFrameBound(size) > frameMax) {
+    frameMax = schFrameBound(size);
+    frame = (char *)realloc(frame, frameMax);
+    if (frame == NULL) {
+      perror("schWriteFrame: realloc of frame");
+      exit(ERROR);
+    }
+  }
+  nbytes = schFrameEncode(sch->packdata, size, inhid, schCodec, frame);
+  if (nbytes < 0) {
+    fprintf(stderr, "schWriteFrame: Could not compress scan %d\n", inhid);
+    exit(ERROR);
+  }
+  dprintf("Writing %d bytes of packed data as a %d byte frame\n", size, nbytes);
+  fwrite_unlocked(frame, nbytes, 1, fpsch);
+  return nbytes;
+} /* end of schWriteFrame */
+
 /*
 
   P A C K  D A T A
@@ -2024,41 +3513,51 @@ int schWrite(schDef *sch, FILE *fpsch)
 int packData(int nChan, float intTime, float *real, float *imag, short *slot)
 {
   short scaleExp;
-  short	visRealS; /* real part of complex visibility scaled to short	   */
-  short	visImagS; /* imaginary part of complex visibility scaled to short */
-  int i, status;
-  float delta, scale;
+  int i, status, exponent;
+  float delta, scale, mantissa;
   float dataMax = -1.0e38;
   float dataMin = 1.0e38;
 
   status = -1;
   /* Find range of values in this set */
-  for (i = 0; i < nChan; i++) {
-    if (real[i] < dataMin)
-      dataMin = real[i];
-    if (real[i] > dataMax)
-      dataMax = real[i];
-    if (imag[i] < dataMin)
-      dataMin = imag[i];
-    if (imag[i] > dataMax)
-      dataMax = imag[i];
-  }
+  packRange(real, imag, nChan, &dataMin, &dataMax);
+  /* A spectrum of nothing but NaNs is packed like one of zeros */
+  if (dataMin > dataMax)
+    dataMin = dataMax = 0.0;
   if ((dataMax != 0.0) || (dataMin != 0.0))
     status = 0;
   if (fabs(dataMin) > dataMax)
     dataMax = fabs(dataMin);
   delta = dataMax/32767.0;
-  scaleExp = log(delta)/log(2.0);
-  if (scaleExp > 0)
-    scaleExp++;
-  scale = pow(2.0, (float)scaleExp);
+  /*
+    scaleExp is log2(delta), truncated toward 0, plus 1 if it is positive.
+    Unless delta is an exact power of 2 (or 0 or infinite) log2(delta) lies
+    strictly between exponent-1 and exponent, so scaleExp can be read
+    straight from delta's binary exponent.   The other cases keep the old
+    log() arithmetic, so that its rounding is reproduced exactly.
+  */
+  mantissa = frexpf(delta, &exponent);
+  if ((mantissa > 0.5) && isfinite(delta)) {
+    if ((exponent >= 2) || (exponent <= -1))
+      scaleExp = exponent;
+    else
+      scaleExp = 0;
+  } else {
+    scaleExp = log(delta)/log(2.0);
+    if (scaleExp > 0)
+      scaleExp++;
+  }
 
   slot[0] = scaleExp;
-  for (i = 0; i < nChan; i++) {
-    visRealS = real[i]/scale;
-    visImagS = imag[i]/scale;
-    slot[1 + 2*i] = visRealS;
-    slot[2 + 2*i] = visImagS;
+  if ((scaleExp >= -126) && (scaleExp <= 126))
+    /* 1/scale is exact, so multiplying by it is the same as dividing */
+    packScale(real, imag, nChan, ldexpf(1.0, -scaleExp), &slot[1]);
+  else {
+    scale = pow(2.0, (float)scaleExp);
+    for (i = 0; i < nChan; i++) {
+      slot[1 + 2*i] = real[i]/scale;
+      slot[2 + 2*i] = imag[i]/scale;
+    }
   }
   return(status);
 } /* End of packData */
@@ -2372,30 +3871,1153 @@ int polarStateCode(int pol, dSMInfo info, int ant1, int ant2)
 	returnVal      = 0;
     }
   }
-  return(returnVal);
-} /* End of polarStateCode */
+  return(returnVal);
+} /* End of polarStateCode */
+
+void *copier(void *arg) {
+  /* int dSMStatus; */
+  /* long scansRemaining, lastScansRemaining = 0; */
+  /* time_t timestamp; */
+
+  while (TRUE) {
+    /*
+    dSMStatus = dsm_read("hal9000", "DSM_AS_SCANS_REMAINING_L", (char *)&scansRemaining,
+                         &timestamp);
+    if (dSMStatus != DSM_SUCCESS)
+      dsm_error_message(dSMStatus, "dsm_read (copier)");
+    if (scansRemaining != lastScansRemaining) {
+      dSMStatus = dsm_write("obscon", "DSM_AS_SCANS_REMAINING_L", (char *)&scansRemaining);
+      if (dSMStatus != DSM_SUCCESS)
+        dsm_error_message(dSMStatus, "dsm_write_notify (copier)");
+      lastScansRemaining = scansRemaining;
+    }
+    */
+    sleep(1);
+    flushStaleSWARMScans();
+  }
+}
+
+/*
+
+   O U T P U T  B A T C H  N E W
+
+   outputBatchNew allocates an empty batch, to hold the output from one scan.
+
+*/
+outputBatch *outputBatchNew(int scanNumber)
+{
+  outputBatch *batch;
+
+  batch = (outputBatch *)calloc(1, sizeof(outputBatch));
+  if (batch == NULL) {
+    perror("outputBatchNew: calloc");
+    exit(ERROR);
+  }
+  batch->scanNumber = scanNumber;
+  return(batch);
+} /* End of outputBatchNew */
+
+/*
+
+   O U T P U T  B A T C H  S T R E A M
+
+   outputBatchStream adds a memory stream to batch, which will be copied into
+   file when the batch is written, and returns it.   The stream may be used
+   exactly as file would have been.
+
+*/
+FILE *outputBatchStream(outputBatch *batch, FILE *file)
+{
+  outputStream *stream;
+  outputFile *output;
+
+  if (batch->nStreams >= MAX_OUTPUT_STREAMS) {
+    fprintf(stderr, "outputBatchStream: More than %d streams in scan %d\n",
+	    MAX_OUTPUT_STREAMS, batch->scanNumber);
+    exit(ERROR);
+  }
+  output = outputFileGet(file);
+  stream = &batch->streams[batch->nStreams];
+  stream->file = output;
+  stream->stream = open_memstream(&stream->buffer, &stream->size);
+  if (stream->stream == NULL) {
+    perror("outputBatchStream: open_memstream");
+    exit(ERROR);
+  }
+  batch->nStreams++;
+  return(stream->stream);
+} /* End of outputBatchStream */
+
+/*
+
+   O U T P U T  B A T C H  T R A I L E R
+
+   outputBatchTrailer is just like outputBatchStream, except that the
+   stream's contents are not written to file until all the other streams
+   in the batch are in their files.   It is used for the index, so that
+   the index never refers to data which have not been written.
+
+*/
+FILE *outputBatchTrailer(outputBatch *batch, FILE *file)
+{
+  FILE *stream;
+
+  stream = outputBatchStream(batch, file);
+  batch->streams[batch->nStreams-1].trailer = TRUE;
+  return(stream);
+} /* End of outputBatchTrailer */
+
+/*
+
+   O U T P U T  B A T C H  S U B M I T
+
+   outputBatchSubmit closes the batch's memory streams, and queues it for every
+   OUTPUT thread.   If the OUTPUT threads have fallen OUTPUT_QUEUE_DEPTH scans
+   behind, it waits for them to catch up.   The batch belongs to the OUTPUT
+   threads once it has been submitted.
+
+*/
+void outputBatchSubmit(outputBatch *batch)
+{
+  int i, full;
+
+  for (i = 0; i < batch->nStreams; i++) {
+    if (fclose(batch->streams[i].stream) != 0) {
+      perror("outputBatchSubmit: fclose");
+      exit(ERROR);
+    }
+    batch->streams[i].file->queued += batch->streams[i].size;
+  }
+  pthread_mutex_lock(&outputMutex);
+  do {
+    full = FALSE;
+    for (i = 0; i < OUTPUT_THREADS; i++)
+      if (outputQueues[i].count >= OUTPUT_QUEUE_DEPTH)
+	full = TRUE;
+    if (full) {
+      dprintf("outputBatchSubmit: Waiting for OUTPUT before queuing scan %d\n", batch->scanNumber);
+      pthread_cond_wait(&outputDoneCond, &outputMutex);
+    }
+  } while (full);
+  batch->nWriters = batch->nDataWriters = OUTPUT_THREADS;
+  batch->submitTime = latencyNow();
+  for (i = 0; i < OUTPUT_THREADS; i++) {
+    outputQueue *queue = &outputQueues[i];
+
+    queue->entries[(queue->head + queue->count) % OUTPUT_QUEUE_DEPTH] = batch;
+    queue->count++;
+  }
+  nOutputBatches++;
+  pthread_cond_broadcast(&outputCond);
+  pthread_mutex_unlock(&outputMutex);
+} /* End of outputBatchSubmit */
+
+/*
+
+   O U T P U T  D R A I N
+
+   outputDrain waits until every submitted batch has been written.   It must be
+   called before any of the MIR files are closed.
+
+*/
+void outputDrain(void)
+{
+  pthread_mutex_lock(&outputMutex);
+  while (nOutputBatches > 0)
+    pthread_cond_wait(&outputDoneCond, &outputMutex);
+  pthread_mutex_unlock(&outputMutex);
+} /* End of outputDrain */
+
+/*
+
+   O U T P U T  F I L E  G E T
+
+   outputFileGet returns the outputFile for file, which must have been
+   opened by the WRITER, handing it to an OUTPUT thread if this is the
+   first time it has been seen.   Anything the WRITER has written to file
+   with stdio is flushed first.   From then on the WRITER must not write
+   to file itself.
+
+*/
+outputFile *outputFileGet(FILE *file)
+{
+  static int nextOwner = 0;
+  int i, unused = -1;
+  outputFile *output;
+
+  for (i = 0; i < MAX_OUTPUT_FILES; i++)
+    if (outputFiles[i].file == file)
+      return(&outputFiles[i]);
+    else if ((outputFiles[i].file == NULL) && (unused < 0))
+      unused = i;
+  if (unused < 0) {
+    fprintf(stderr, "outputFileGet: More than %d MIR files open\n", MAX_OUTPUT_FILES);
+    exit(ERROR);
+  }
+  if (fflush(file) != 0)
+    perror("outputFileGet: fflush");
+  output = &outputFiles[unused];
+  output->fd = fileno(file);
+  output->offset = output->queued = ftello(file);
+  output->owner = nextOwner++ % OUTPUT_THREADS;
+  output->dirty = FALSE;
+  output->file = file;
+  return(output);
+} /* End of outputFileGet */
+
+/*
+
+   O U T P U T  F I L E  Q U E U E D
+
+   outputFileQueued returns the offset in file at which the next batch
+   submitted by the WRITER will be written.
+
+*/
+off_t outputFileQueued(FILE *file)
+{
+  return(outputFileGet(file)->queued);
+} /* End of outputFileQueued */
+
+/*
+
+   O U T P U T  F I L E  C L O S E
+
+   outputFileClose closes a MIR file which may have been handed to OUTPUT.
+   outputDrain() must be called first.   If the durability policy calls
+   for it, the file's last scans are synced before it is closed.
+
+*/
+void outputFileClose(FILE *file)
+{
+  int i;
+
+  for (i = 0; i < MAX_OUTPUT_FILES; i++)
+    if (outputFiles[i].file == file) {
+      if (outputFiles[i].dirty && (fdatasync(outputFiles[i].fd) != 0))
+	perror("outputFileClose: fdatasync");
+      outputFiles[i].dirty = FALSE;
+      outputFiles[i].file = NULL;
+    }
+  fclose(file);
+} /* End of outputFileClose */
+
+/*
+
+   O U T P U T  D U R A B I L I T Y  I N I T
+
+   outputDurabilityInit reads the durability policy for the MIR files from
+   the configuration file dataCatcherDurability, if it exists.   It holds
+   "none" (the default) to leave the syncing to the kernel, "scan" to
+   fdatasync() each file after every scan, or a number N, to sync the
+   files every N scans.
+
+*/
+void outputDurabilityInit(void)
+{
+  char policy[80];
+  int every;
+  FILE *durabilityFile;
+
+  durabilityFile = siteFopen("/global/configFiles/dataCatcherDurability", "r");
+  if (durabilityFile != NULL) {
+    if (fscanf(durabilityFile, "%79s", policy) != 1)
+      fprintf(stderr, "outputDurabilityInit: could not parse dataCatcherDurability - using \"none\"\n");
+    else if (!strcmp(policy, "none"))
+      outputSyncEvery = 0;
+    else if (!strcmp(policy, "scan"))
+      outputSyncEvery = 1;
+    else if ((sscanf(policy, "%d", &every) == 1) && (every >= 0))
+      outputSyncEvery = every;
+    else
+      fprintf(stderr, "outputDurabilityInit: Illegal policy \"%s\" - using \"none\"\n", policy);
+    fclose(durabilityFile);
+  }
+  if (outputSyncEvery == 0)
+    printf("outputDurabilityInit: MIR files will not be synced\n");
+  else
+    printf("outputDurabilityInit: MIR files will be synced every %d scan(s)\n", outputSyncEvery);
+} /* End of outputDurabilityInit */
+
+/*
+
+   S C H  C O M P R E S S I O N  I N I T
+
+   schCompressionInit reads the configuration file dataCatcherCompression,
+   if it exists, to see whether the packed spectra should be compressed.
+   It holds "none" (the default) to write sch_read as usual, or the name of
+   a codec - "zrle" or "lz4" - to write compressed frames to sch_read.z.
+
+*/
+void schCompressionInit(void)
+{
+  char codec[80];
+  FILE *compressionFile;
+
+  compressionFile = siteFopen("/global/configFiles/dataCatcherCompression", "r");
+  if (compressionFile != NULL) {
+    if (fscanf(compressionFile, "%79s", codec) != 1)
+      fprintf(stderr, "schCompressionInit: could not parse dataCatcherCompression - using \"none\"\n");
+    else if (!strcmp(codec, "none"))
+      schCodec = 0;
+    else if (!strcmp(codec, "zrle"))
+      schCodec = SCH_CODEC_ZRLE;
+    else if (!strcmp(codec, "lz4"))
+      schCodec = SCH_CODEC_LZ4;
+    else
+      fprintf(stderr, "schCompressionInit: Illegal codec \"%s\" - using \"none\"\n", codec);
+    fclose(compressionFile);
+  }
+  if ((schCodec != 0) && !schCodecAvailable(schCodec)) {
+    fprintf(stderr, "schCompressionInit: dataCatcher was built without %s - using \"zrle\"\n", codec);
+    schCodec = SCH_CODEC_ZRLE;
+  }
+  if (schCodec == 0)
+    printf("schCompressionInit: Packed spectra will not be compressed\n");
+  else
+    printf("schCompressionInit: Packed spectra will be compressed with %s\n",
+	   (schCodec == SCH_CODEC_LZ4) ? "lz4" : "zrle");
+} /* End of schCompressionInit */
+
+/*
+
+   C A P T U R E  I N I T
+
+   captureInit reads the configuration file dataCatcherCapture, if it
+   exists.   It holds the name of a directory, and every RPC call and
+   SWARM stream frame which arrives from then on is recorded, for
+   dataCatcherReplay, in a new capture file there named for the time
+   capturing started.   See
+   captureFile.h for the file's layout.
+
+*/
+void captureInit(void)
+{
+  char directory[100], fileName[200];
+  time_t now;
+  struct tm *nowValues;
+  captureFileHeader header;
+  FILE *configFile, *file;
+
+  configFile = siteFopen("/global/configFiles/dataCatcherCapture", "r");
+  if (configFile == NULL)
+    return;
+  if (fscanf(configFile, "%99s", directory) != 1) {
+    fprintf(stderr, "captureInit: could not parse dataCatcherCapture - calls will not be captured\n");
+    fclose(configFile);
+    return;
+  }
+  fclose(configFile);
+  time(&now);
+  nowValues = gmtime(&now);
+  sprintf(fileName, "%s/capture_%02d%02d%02d_%02d%02d%02d.dcc", directory,
+	  nowValues->tm_year - 100, nowValues->tm_mon + 1, nowValues->tm_mday,
+	  nowValues->tm_hour, nowValues->tm_min, nowValues->tm_sec);
+  file = fopen(fileName, "w");
+  if (file == NULL) {
+    perror("captureInit: fopen");
+    fprintf(stderr, "captureInit: could not create \"%s\" - calls will not be captured\n", fileName);
+    return;
+  }
+  setvbuf(file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+  header.magic = CAPTURE_FILE_MAGIC;
+  header.version = CAPTURE_VERSION;
+  header.startTime = latencyNow();
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    perror("captureInit: fwrite");
+    fclose(file);
+    return;
+  }
+  printf("captureInit: Incoming calls will be captured in %s\n", fileName);
+  pthread_mutex_lock(&captureMutex);
+  captureFile = file;
+  pthread_mutex_unlock(&captureMutex);
+} /* End of captureInit */
+
+/*
+
+   C A P T U R E  Q U E U E
+
+   captureQueue hands length bytes of data, which it takes over and will
+   free(), to the CAPTURER thread, to be appended to the capture file as
+   a record of type procedure.   So that capturing can never hold up the
+   calls being captured, the record is dropped, and counted, if
+   CAPTURE_QUEUE_BYTES are already waiting.
+
+*/
+void captureQueue(int procedure, double arrival, char *data, uint32_t length)
+{
+  captureItem *item;
+
+  item = (captureItem *)malloc(sizeof(captureItem));
+  if (item == NULL) {
+    perror("captureQueue: malloc");
+    free(data);
+    return;
+  }
+  item->record.magic = CAPTURE_RECORD_MAGIC;
+  item->record.procedure = procedure;
+  item->record.arrival = arrival;
+  item->record.length = length;
+  item->record.spare = 0;
+  item->data = data;
+  item->next = NULL;
+  pthread_mutex_lock(&captureMutex);
+  if ((captureFile == NULL) || (captureQueuedBytes + length > CAPTURE_QUEUE_BYTES)) {
+    if (captureFile != NULL)
+      captureDropped++;
+    pthread_mutex_unlock(&captureMutex);
+    free(data);
+    free(item);
+    return;
+  }
+  if (captureTail == NULL)
+    captureHead = item;
+  else
+    captureTail->next = item;
+  captureTail = item;
+  captureQueuedBytes += length;
+  pthread_cond_signal(&captureCond);
+  pthread_mutex_unlock(&captureMutex);
+} /* End of captureQueue */
+
+/*
+
+   C A P T U R E  P A Y L O A D
+
+   capturePayload queues an RPC call's argument, which encode turns into
+   XDR, for the capture file, if calls are being captured.   The argument
+   is freed when the call returns, so it must be encoded here, but the
+   writing is left to the CAPTURER thread.
+
+*/
+void capturePayload(int procedure, xdrproc_t encode, void *argument)
+{
+  char *buffer;
+  double arrival;
+  uint32_t length;
+  XDR xdrs;
+
+  if (captureFile == NULL)
+    return;
+  arrival = latencyNow();
+  length = xdr_sizeof(encode, argument);
+  buffer = (char *)malloc(length);
+  if (buffer == NULL) {
+    perror("capturePayload: malloc");
+    return;
+  }
+  xdrmem_create(&xdrs, buffer, length, XDR_ENCODE);
+  if (!encode(&xdrs, argument)) {
+    ringLog(LOG_ERROR, "capturePayload: could not encode a call of type %d - skipping it\n", procedure);
+    free(buffer);
+  } else
+    captureQueue(procedure, arrival, buffer, length);
+  xdr_destroy(&xdrs);
+} /* End of capturePayload */
+
+/*
+
+   C A P T U R E  S T R E A M  F R A M E
+
+   captureStreamFrame queues a copy of a frame from the SWARM stream for
+   the capture file, if calls are being captured.
+
+*/
+void captureStreamFrame(swarmStreamHeader *header, swarmStreamRecord *table,
+			float *payload, size_t payloadSize)
+{
+  char *buffer;
+  double arrival;
+  size_t tableSize, length;
+
+  if (captureFile == NULL)
+    return;
+  arrival = latencyNow();
+  tableSize = header->nRecords*sizeof(swarmStreamRecord);
+  length = sizeof(swarmStreamHeader) + tableSize + payloadSize;
+  buffer = (char *)malloc(length);
+  if (buffer == NULL) {
+    perror("captureStreamFrame: malloc");
+    return;
+  }
+  memcpy(buffer, header, sizeof(swarmStreamHeader));
+  memcpy(buffer + sizeof(swarmStreamHeader), table, tableSize);
+  memcpy(buffer + sizeof(swarmStreamHeader) + tableSize, payload, payloadSize);
+  captureQueue(CAPTURE_SWARM_STREAM, arrival, buffer, (uint32_t)length);
+} /* End of captureStreamFrame */
+
+/*
+
+   C A P T U R E R
+
+   This function executes as the CAPTURER thread, which appends the
+   records queued by captureQueue() to the capture file.   If the file
+   cannot be written, capturing stops, but dataCatcher carries on.
+
+*/
+void *capturer(void *arg)
+{
+  unsigned long dropped, reported = 0;
+  captureItem *item;
+  FILE *file;
+
+  printf("Thread CAPTURER starting\n");
+  while (TRUE) {
+    pthread_mutex_lock(&captureMutex);
+    while (captureHead == NULL)
+      pthread_cond_wait(&captureCond, &captureMutex);
+    item = captureHead;
+    captureHead = item->next;
+    if (captureHead == NULL)
+      captureTail = NULL;
+    captureQueuedBytes -= item->record.length;
+    file = captureFile;
+    dropped = captureDropped;
+    pthread_mutex_unlock(&captureMutex);
+    if (dropped != reported) {
+      ringLog(LOG_WARN, "capturer: %lu records dropped because the capture queue was full\n",
+	      dropped - reported);
+      reported = dropped;
+    }
+    if ((file != NULL) &&
+	((fwrite(&item->record, sizeof(item->record), 1, file) != 1) ||
+	 (fwrite(item->data, 1, item->record.length, file) != item->record.length))) {
+      perror("capturer: fwrite");
+      ringLog(LOG_ERROR, "capturer: could not write the capture file - capturing stopped\n");
+      pthread_mutex_lock(&captureMutex);
+      fclose(captureFile);
+      captureFile = NULL;
+      pthread_mutex_unlock(&captureMutex);
+    }
+    free(item->data);
+    free(item);
+  }
+  return(NULL); /* Never Executed */
+} /* End of capturer */
+
+/*
+  outputIovecAdvance moves *iov and *nIov past written bytes, which have
+  just been written to file.
+*/
+void outputIovecAdvance(outputFile *file, struct iovec **iov, int *nIov, ssize_t written)
+{
+  file->offset += written;
+  while ((*nIov > 0) && (written >= (ssize_t)(*iov)->iov_len)) {
+    written -= (*iov)->iov_len;
+    (*iov)++;
+    (*nIov)--;
+  }
+  if (*nIov > 0) {
+    (*iov)->iov_base = (char *)(*iov)->iov_base + written;
+    (*iov)->iov_len -= written;
+  }
+} /* End of outputIovecAdvance */
+
+/*
+  outputWriteFailed is called when a write to file has failed with error.
+  If the error may clear (a full disk, or a shortage of memory) and the
+  write has not yet been tried OUTPUT_WRITE_RETRIES times, it waits, twice
+  as long as for the previous retry, and returns so that the write can be
+  tried again.   Otherwise the MIR files can not be completed, and
+  dataCatcher exits.
+*/
+void outputWriteFailed(outputFile *file, int error, int *nRetries)
+{
+  if (((error == EAGAIN) || (error == ENOMEM) || (error == ENOSPC) || (error == EDQUOT)) &&
+      (*nRetries < OUTPUT_WRITE_RETRIES)) {
+    ringLog(LOG_WARN, "outputWriteFailed: write to fd %d failed (%s) - retry %d\n",
+	    file->fd, strerror(error), *nRetries + 1);
+    usleep(OUTPUT_RETRY_DELAY << *nRetries);
+    (*nRetries)++;
+    return;
+  }
+  ringLog(LOG_ERROR, "outputWriteFailed: write to fd %d failed (%s) - giving up\n",
+	  file->fd, strerror(error));
+  exit(ERROR);
+} /* End of outputWriteFailed */
+
+/*
+  outputPWrite writes all of iov to file, at its offset, with pwritev(),
+  carrying on after short writes, and retrying failed writes as
+  outputWriteFailed() allows.
+*/
+void outputPWrite(outputFile *file, struct iovec *iov, int nIov)
+{
+  int nRetries = 0;
+  ssize_t written;
+
+  while (nIov > 0) {
+    written = pwritev(file->fd, iov, nIov, file->offset);
+    if (written < 0) {
+      if (errno != EINTR)
+	outputWriteFailed(file, errno, &nRetries);
+      continue;
+    }
+    if (written == 0) {
+      /* Nothing written, but no error - treat it like a full disk */
+      outputWriteFailed(file, ENOSPC, &nRetries);
+      continue;
+    }
+    nRetries = 0;
+    outputIovecAdvance(file, &iov, &nIov, written);
+  }
+} /* End of outputPWrite */
+
+/*
+
+   O U T P U T  W R I T E R
+
+   This function executes as OUTPUT_THREADS separate threads.   Each one
+   takes all the batches waiting in its own queue, gathers the streams for
+   the files it owns into one vector per file, in scan order, and writes
+   each vector with a single call.   With io_uring, the writes to all of a
+   thread's files are submitted at once.   The files are then synced as the
+   durability policy requires.   Any trailer streams are written once every
+   OUTPUT thread has got that far with the batches, and then the batches
+   are released.
+
+*/
+void *outputWriter(void *arg)
+{
+  int me = (int)((long)arg);
+  int i, j, k, nBatches, nFiles, nTrailerFiles, scansSinceSync = 0;
+  int nIov[MAX_OUTPUT_FILES], nTrailerIov[MAX_OUTPUT_FILES];
+  outputQueue *queue = &outputQueues[me];
+  outputBatch *batches[OUTPUT_QUEUE_DEPTH], *batch;
+  outputFile *files[MAX_OUTPUT_FILES], *trailerFiles[MAX_OUTPUT_FILES];
+  struct iovec iov[MAX_OUTPUT_FILES][OUTPUT_QUEUE_DEPTH];
+  struct iovec trailerIov[MAX_OUTPUT_FILES][OUTPUT_QUEUE_DEPTH];
+#ifdef HAVE_LIBURING
+  int rCode, nSubmitted;
+  struct io_uring ring;
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+
+  rCode = io_uring_queue_init(MAX_OUTPUT_FILES, &ring, 0);
+  if (rCode < 0) {
+    fprintf(stderr, "outputWriter: io_uring_queue_init: %s\n", strerror(-rCode));
+    exit(ERROR);
+  }
+  printf("Thread OUTPUT %d starting, using io_uring\n", me);
+#else
+  printf("Thread OUTPUT %d starting\n", me);
+#endif
+  while (TRUE) {
+    pthread_mutex_lock(&outputMutex);
+    while (queue->count == 0)
+      pthread_cond_wait(&outputCond, &outputMutex);
+    nBatches = queue->count;
+    for (i = 0; i < nBatches; i++)
+      batches[i] = queue->entries[(queue->head + i) % OUTPUT_QUEUE_DEPTH];
+    pthread_mutex_unlock(&outputMutex);
+
+    nFiles = nTrailerFiles = 0;
+    for (i = 0; i < nBatches; i++)
+      for (j = 0; j < batches[i]->nStreams; j++) {
+	outputStream *stream = &batches[i]->streams[j];
+
+	if (stream->file->owner != me)
+	  continue;
+	if (stream->trailer) {
+	  for (k = 0; (k < nTrailerFiles) && (trailerFiles[k] != stream->file); k++);
+	  if (k == nTrailerFiles) {
+	    trailerFiles[nTrailerFiles] = stream->file;
+	    nTrailerIov[nTrailerFiles++] = 0;
+	  }
+	  if (stream->size > 0) {
+	    trailerIov[k][nTrailerIov[k]].iov_base = stream->buffer;
+	    trailerIov[k][nTrailerIov[k]].iov_len = stream->size;
+	    nTrailerIov[k]++;
+	  }
+	  continue;
+	}
+	for (k = 0; (k < nFiles) && (files[k] != stream->file); k++);
+	if (k == nFiles) {
+	  files[nFiles] = stream->file;
+	  nIov[nFiles++] = 0;
+	}
+	if (stream->size > 0) {
+	  iov[k][nIov[k]].iov_base = stream->buffer;
+	  iov[k][nIov[k]].iov_len = stream->size;
+	  nIov[k]++;
+	}
+      }
+#ifdef HAVE_LIBURING
+    nSubmitted = 0;
+    for (k = 0; k < nFiles; k++)
+      if (nIov[k] > 0) {
+	sqe = io_uring_get_sqe(&ring);
+	io_uring_prep_writev(sqe, files[k]->fd, iov[k], nIov[k], files[k]->offset);
+	io_uring_sqe_set_data(sqe, (void *)((long)k));
+	nSubmitted++;
+      }
+    if (nSubmitted > 0) {
+      rCode = io_uring_submit(&ring);
+      if (rCode < 0) {
+	fprintf(stderr, "outputWriter: io_uring_submit: %s\n", strerror(-rCode));
+	exit(ERROR);
+      }
+    }
+    while (nSubmitted > 0) {
+      rCode = io_uring_wait_cqe(&ring, &cqe);
+      if (rCode == -EINTR)
+	continue;
+      if (rCode < 0) {
+	fprintf(stderr, "outputWriter: io_uring_wait_cqe: %s\n", strerror(-rCode));
+	exit(ERROR);
+      }
+      k = (int)((long)io_uring_cqe_get_data(cqe));
+      if (cqe->res < 0) {
+	/* Retry a failed write synchronously, or give up if the error will not clear */
+	int nRetries = 0;
+
+	if (cqe->res != -EINTR)
+	  outputWriteFailed(files[k], -cqe->res, &nRetries);
+	outputPWrite(files[k], iov[k], nIov[k]);
+      } else {
+	struct iovec *rest = iov[k];
+
+	/* Finish off a short write synchronously */
+	outputIovecAdvance(files[k], &rest, &nIov[k], cqe->res);
+	outputPWrite(files[k], rest, nIov[k]);
+      }
+      io_uring_cqe_seen(&ring, cqe);
+      nSubmitted--;
+    }
+#else
+    for (k = 0; k < nFiles; k++)
+      outputPWrite(files[k], iov[k], nIov[k]);
+#endif
+    if (outputSyncEvery > 0) {
+      for (k = 0; k < nFiles; k++)
+	files[k]->dirty = TRUE;
+      scansSinceSync += nBatches;
+      if (scansSinceSync >= outputSyncEvery) {
+	for (i = 0; i < MAX_OUTPUT_FILES; i++)
+	  if (outputFiles[i].dirty && (outputFiles[i].owner == me)) {
+	    if (fdatasync(outputFiles[i].fd) != 0)
+	      perror("outputWriter: fdatasync");
+	    outputFiles[i].dirty = FALSE;
+	  }
+	scansSinceSync = 0;
+      }
+    }
+
+    /*
+      Wait until every OUTPUT thread has written (and, if the policy
+      calls for it, synced) the rest of these batches before writing
+      their trailers.   A thread only waits after it has finished with
+      all of the batches it holds, so the threads cannot wait for each
+      other.
+    */
+    pthread_mutex_lock(&outputMutex);
+    for (i = 0; i < nBatches; i++)
+      batches[i]->nDataWriters--;
+    if (nTrailerFiles > 0) {
+      pthread_cond_broadcast(&outputDoneCond);
+      for (i = 0; i < nBatches; i++)
+	while (batches[i]->nDataWriters > 0)
+	  pthread_cond_wait(&outputDoneCond, &outputMutex);
+      pthread_mutex_unlock(&outputMutex);
+      for (k = 0; k < nTrailerFiles; k++) {
+	outputPWrite(trailerFiles[k], trailerIov[k], nTrailerIov[k]);
+	if (outputSyncEvery > 0)
+	  trailerFiles[k]->dirty = TRUE;
+      }
+      pthread_mutex_lock(&outputMutex);
+    }
+    for (i = 0; i < nBatches; i++) {
+      batch = batches[i];
+      queue->head = (queue->head + 1) % OUTPUT_QUEUE_DEPTH;
+      queue->count--;
+      if (--batch->nWriters == 0) {
+	double now = latencyNow();
+
+	latencyRecord(&stageLatency[LATENCY_IO], now - batch->submitTime);
+	latencyRecord(&stageLatency[LATENCY_TOTAL], now - batch->birthTime);
+	for (j = 0; j < batch->nStreams; j++)
+	  free(batch->streams[j].buffer);
+	free(batch);
+	nOutputBatches--;
+      }
+    }
+    pthread_cond_broadcast(&outputDoneCond);
+    pthread_mutex_unlock(&outputMutex);
+  }
+} /* End of outputWriter */
+
+/*
+
+   P A C K  J O B  A D D
+
+   packJobAdd lists a spectrum to be packed by packJobsRun.   A single point
+   spectrum (the pseudo continuum channel) is copied, so real and imag may be
+   local variables.
+
+*/
+void packJobAdd(int nChan, float intTime, float *real, float *imag, short *slot,
+		int rx, int sb, int bl, int band, int set, int crate)
+{
+  packJob *job;
+
+  if (nPackJobs >= maxPackJobs) {
+    packJob *newJobs;
+
+    newJobs = (packJob *)realloc(packJobs, (maxPackJobs + 1024)*sizeof(packJob));
+    if (newJobs == NULL) {
+      perror("packJobAdd: realloc");
+      exit(ERROR);
+    }
+    packJobs = newJobs;
+    maxPackJobs += 1024;
+  }
+  job = &packJobs[nPackJobs++];
+  job->nChan = nChan;
+  job->intTime = intTime;
+  if (nChan == 1) {
+    job->contReal = real[0];
+    job->contImag = imag[0];
+    job->real = job->imag = NULL;
+  } else {
+    job->real = real;
+    job->imag = imag;
+  }
+  job->slot = slot;
+  job->rx = rx; job->sb = sb; job->bl = bl; job->band = band;
+  job->set = set; job->crate = crate;
+} /* End of packJobAdd */
 
-void *copier(void *arg) {
-  /* int dSMStatus; */
-  /* long scansRemaining, lastScansRemaining = 0; */
-  /* time_t timestamp; */
+/*
+  packJobsWork runs packJobs, PACK_GRAIN at a time, until none are left
+  unclaimed.   It is called by the WRITER and the PACKER threads.
+*/
+void packJobsWork(void)
+{
+  int i, first, last;
 
   while (TRUE) {
-    /*
-    dSMStatus = dsm_read("hal9000", "DSM_AS_SCANS_REMAINING_L", (char *)&scansRemaining,
-                         &timestamp);
-    if (dSMStatus != DSM_SUCCESS)
-      dsm_error_message(dSMStatus, "dsm_read (copier)");
-    if (scansRemaining != lastScansRemaining) {
-      dSMStatus = dsm_write("obscon", "DSM_AS_SCANS_REMAINING_L", (char *)&scansRemaining);
-      if (dSMStatus != DSM_SUCCESS)
-        dsm_error_message(dSMStatus, "dsm_write_notify (copier)");
-      lastScansRemaining = scansRemaining;
+    pthread_mutex_lock(&packMutex);
+    if (!packing || (nextPackJob >= nPackJobs)) {
+      pthread_mutex_unlock(&packMutex);
+      return;
     }
-    */
-    sleep(1);
+    first = nextPackJob;
+    last = first + PACK_GRAIN;
+    if (last > nPackJobs)
+      last = nPackJobs;
+    nextPackJob = last;
+    pthread_mutex_unlock(&packMutex);
+    for (i = first; i < last; i++) {
+      packJob *job = &packJobs[i];
+
+      if (job->real == NULL) {
+	if ((packData(1, job->intTime, &job->contReal, &job->contImag, job->slot) == -1) &&
+	    (reportAllErrors))
+	  fprintf(stderr, "packdata returned error for cont channel rx: %d sb: %d bl: %d band: %d\n",
+		  job->rx, job->sb, job->bl, job->band);
+      } else if ((packData(job->nChan, job->intTime, job->real, job->imag, job->slot) == -1) &&
+		 (reportAllErrors))
+	fprintf(stderr,
+		"packdata returned error for set: %d crate: %d rx: %d sb: %d bl: %d band: %d\n",
+		job->set, job->crate, job->rx, job->sb, job->bl, job->band);
+    }
+    pthread_mutex_lock(&packMutex);
+    nPackJobsDone += last - first;
+    if (nPackJobsDone >= nPackJobs)
+      pthread_cond_broadcast(&packDoneCond);
+    pthread_mutex_unlock(&packMutex);
   }
-}
+} /* End of packJobsWork */
+
+/*
+
+   P A C K  J O B S  R U N
+
+   packJobsRun packs all the spectra listed by packJobAdd, using the PACKER
+   threads as well as the calling thread, and returns when they are all done.
+   The list is then emptied.
+
+*/
+void packJobsRun(void)
+{
+  pthread_mutex_lock(&packMutex);
+  nextPackJob = nPackJobsDone = 0;
+  packing = TRUE;
+  pthread_cond_broadcast(&packCond);
+  pthread_mutex_unlock(&packMutex);
+  packJobsWork();
+  pthread_mutex_lock(&packMutex);
+  while (nPackJobsDone < nPackJobs)
+    pthread_cond_wait(&packDoneCond, &packMutex);
+  packing = FALSE;
+  nPackJobs = 0;
+  pthread_mutex_unlock(&packMutex);
+} /* End of packJobsRun */
+
+void *packer(void *arg)
+{
+  printf("Thread PACKER %d starting\n", (int)((long)arg));
+  while (TRUE) {
+    pthread_mutex_lock(&packMutex);
+    while (!packing || (nextPackJob >= nPackJobs))
+      pthread_cond_wait(&packCond, &packMutex);
+    pthread_mutex_unlock(&packMutex);
+    packJobsWork();
+  }
+} /* End of packer */
+
+/*
+
+   D A T A  D I R E C T O R Y  N A M E
+
+   dataDirectoryName puts the name of the directory, under /data, which
+   new data sets should be stored in, into directory.
+
+*/
+void dataDirectoryName(char *directory)
+{
+  int dirCode;
+
+  /*
+  ds = dsm_read("hal9000", "DSM_AS_CORRDATATYPE_L",
+		&dirCode, &timestamp);
+  if (ds != DSM_SUCCESS) {
+    dsm_error_message(ds, "dsm_read (5)");
+    perror("writer: dsm read of DSM_AS_CORRDATATYPE_L");
+    dirCode = DD_SCIENCE;
+  }
+  */
+  dirCode = DD_ENGINEERING;
+
+  switch (dirCode) {
+  case DD_GARBAGE:
+    sprintf(directory, "garbage");
+    break;
+  case DD_PRIMING:
+    sprintf(directory, "priming");
+    break;
+  case DD_ENGINEERING:
+    sprintf(directory, "engineering");
+    break;
+  case DD_POINTING:
+    sprintf(directory, "pointing");
+    break;
+  case DD_BASELINE:
+    sprintf(directory, "baseline");
+    break;
+  case DD_FLUX:
+    sprintf(directory, "flux");
+    break;
+  default:
+    sprintf(directory, "science");
+  }
+} /* End of dataDirectoryName */
+
+/*
+  prepareOpen opens the file name in the staging directory path for
+  writing, and exits if it can't.
+*/
+FILE *prepareOpen(char *path, char *name)
+{
+  char fileName[100+MAX_SITE_ROOT];
+  FILE *file;
+
+  sprintf(fileName, "%s%s", path, name);
+  file = fopen(fileName, "w");
+  if (file == NULL) {
+    fprintf(stderr, "preparer: Problem opening \"%s\"\n", fileName);
+    perror("preparer: fopen");
+    exit(ERROR);
+  }
+  return(file);
+} /* End of prepareOpen */
+
+/*
+  removeStagingDirectory deletes the files in the staging directory path,
+  which holds no subdirectories, and then the directory itself.
+*/
+void removeStagingDirectory(char *path)
+{
+  char fileName[400+MAX_SITE_ROOT];
+  DIR *dir;
+  struct dirent *entry;
+
+  dir = opendir(path);
+  if (dir == NULL) {
+    perror("removeStagingDirectory: opendir");
+    return;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      continue;
+    sprintf(fileName, "%s/%s", path, entry->d_name);
+    if (unlink(fileName) != 0)
+      perror("removeStagingDirectory: unlink");
+  }
+  closedir(dir);
+  if (rmdir(path) != 0)
+    perror("removeStagingDirectory: rmdir");
+} /* End of removeStagingDirectory */
+
+/*
+  sweepStagingDirectories removes the staging directories, in the
+  mir_data directory under directory, which were left behind by
+  dataCatchers which are no longer running - the spare set each one had
+  prepared, or one it could not rename.   Each mir_data directory is
+  swept the first time a set is prepared in it.
+*/
+void sweepStagingDirectories(char *directory)
+{
+  static int nSwept = 0;
+  static char swept[16][50];       /* One for each kind of data directory */
+  int i, pid, n;
+  char path[400+MAX_SITE_ROOT];
+  DIR *dir;
+  struct dirent *entry;
+
+  for (i = 0; i < nSwept; i++)
+    if (!strcmp(swept[i], directory))
+      return;
+  if (nSwept < 16)
+    strcpy(swept[nSwept++], directory);
+  sprintf(path, "%s/data/%s/mir_data", siteRoot, directory);
+  dir = opendir(path);
+  if (dir == NULL)
+    return;
+  while ((entry = readdir(dir)) != NULL)
+    if ((sscanf(entry->d_name, ".staging_%d_%d", &pid, &n) == 2) &&
+	(pid != (int)getpid()) && (kill((pid_t)pid, 0) != 0) && (errno == ESRCH)) {
+      sprintf(path, "%s/data/%s/mir_data/%s", siteRoot, directory, entry->d_name);
+      ringLog(LOG_INFO, "preparer: removing stale staging directory %s\n", path);
+      removeStagingDirectory(path);
+    }
+  closedir(dir);
+} /* End of sweepStagingDirectories */
+
+/*
+
+   P R E P A R E  D A T A  F I L E  S E T
+
+   prepareDataFileSet creates a staging directory, next to where the next
+   data set will go, and opens all the MIR files in it.   Those files
+   which have a fixed header get it written now.
+
+*/
+void prepareDataFileSet(dataFileSet *set)
+{
+  static int nPrepared = 0;
+  static int codeVersionFileWritten = TRUE;
+  int rx, rCode;
+  char fileName[100+MAX_SITE_ROOT];
+
+  dataDirectoryName(set->directory);
+  sweepStagingDirectories(set->directory);
+  sprintf(set->stagingPath, "%s/data/%s/mir_data/.staging_%d_%d/",
+	  siteRoot, set->directory, (int)getpid(), nPrepared++);
+  rCode = mkdir(set->stagingPath, 0777);
+  if (rCode < 0) {
+    fprintf(stderr, "preparer: Problem creating \"%s\", rCode = %d, errno = %d\n",
+	    set->stagingPath, rCode, errno);
+    perror("preparer: creating staging directory");
+    exit(-1);
+  }
+  if (!codeVersionFileWritten) {
+    FILE *src, *dst;
+
+    src = siteFopen("/common/configFiles/codeVersions", "r");
+    if (src == NULL) {
+      fprintf(stderr, "Could not open source codeVersions file\n");
+    } else {
+      sprintf(fileName, "%scodeVersions", set->stagingPath);
+      dst = fopen(fileName, "w");
+      if (dst == NULL) {
+	fprintf(stderr, "Could not open destination codeVersions file\n");
+      } else {
+	while (TRUE) {
+	  char ch;
+
+	  ch= getc(src);
+	  if (ch == EOF)
+	    break;
+	  else
+	    putc(ch, dst);
+	}
+	fclose(dst);
+      }
+      fclose(src);
+    }
+  }
+  for (rx = 0; rx < MAX_RX; rx++)
+    if (receiverActive[rx] && (!((rx != doubleBandwidthRx) && doubleBandwidth))) {
+      sprintf(fileName, "plot_me_5_rx%d", rx);
+      set->plotFile[rx] = prepareOpen(set->stagingPath, fileName);
+    } else
+      set->plotFile[rx] = NULL;
+  set->baselineFile = prepareOpen(set->stagingPath, "bl_read");
+  set->weFile       = prepareOpen(set->stagingPath, "we_read");
+  set->tsysFile     = prepareOpen(set->stagingPath, "tsys_read");
+  set->codesFile    = prepareOpen(set->stagingPath, "codes_read");
+  fixedCodes(set->codesFile);
+  fflush(set->codesFile);
+  set->engFile      = prepareOpen(set->stagingPath, "eng_read");
+  set->inFile       = prepareOpen(set->stagingPath, "in_read");
+  set->spFile       = prepareOpen(set->stagingPath, "sp_read");
+  set->schFile      = prepareOpen(set->stagingPath, schCodec ? "sch_read.z" : "sch_read");
+  set->indexFile    = prepareOpen(set->stagingPath, "sch_index");
+  set->dataoffFile  = prepareOpen(set->stagingPath, "sch_dataoff");
+} /* End of prepareDataFileSet */
+
+/*
+
+   P R E P A R E R
+
+   This function executes as a separate thread, which keeps one dataFileSet
+   ready for the WRITER, so that starting a new data set doesn't hold up
+   the WRITER while a directory is made and files are opened on the (often
+   slow, network mounted) data disk.
+
+*/
+void *preparer(void *arg)
+{
+  dataFileSet set;
+
+  printf("Thread PREPARER starting\n");
+  while (TRUE) {
+    pthread_mutex_lock(&prepareMutex);
+    while (spareFileSet.ready)
+      pthread_cond_wait(&prepareCond, &prepareMutex);
+    pthread_mutex_unlock(&prepareMutex);
+    prepareDataFileSet(&set);
+    dprintf("preparer: %s is ready\n", set.stagingPath);
+    pthread_mutex_lock(&prepareMutex);
+    spareFileSet = set;
+    spareFileSet.ready = TRUE;
+    pthread_cond_broadcast(&preparedCond);
+    pthread_mutex_unlock(&prepareMutex);
+  }
+} /* End of preparer */
+
+/*
+
+   D A T A  F I L E  S E T  T A K E
+
+   dataFileSetTake hands the WRITER the spare dataFileSet, waiting for the
+   PREPARER to finish it if need be, and sets the PREPARER to work on the
+   next one.
+
+*/
+void dataFileSetTake(dataFileSet *set)
+{
+  pthread_mutex_lock(&prepareMutex);
+  while (!spareFileSet.ready) {
+    printf("dataFileSetTake: Waiting for the PREPARER\n");
+    pthread_cond_wait(&preparedCond, &prepareMutex);
+  }
+  *set = spareFileSet;
+  spareFileSet.ready = FALSE;
+  pthread_cond_broadcast(&prepareCond);
+  pthread_mutex_unlock(&prepareMutex);
+} /* End of dataFileSetTake */
 
 /*
 
@@ -2405,9 +5027,10 @@ void *copier(void *arg) {
 
 */
 
-void writeAutoData(int scan) {
+void writeAutoData(int scan, outputBatch *batch) {
   static int autoFileOpen = FALSE;
   static FILE *autoFile;
+  FILE *autoOut;
   sWARMAutoRec *ptr, *tptr;
 
   if (!autoFileOpen) {
@@ -2421,22 +5044,246 @@ void writeAutoData(int scan) {
     }
     autoFileOpen = TRUE;
   }
+  autoOut = outputBatchStream(batch, autoFile);
   pthread_mutex_lock(&autoMutex);
   ptr = sWARMAutoRoot;
-  printf("Looking for autocorrelations to store...\n");
+  dprintf("Looking for autocorrelations to store...\n");
   while (ptr != NULL) {
     ptr->autoData.scan = scan;
-    printf("Writing autocorrelation scan %d for ant %d\n", ptr->autoData.scan, ptr->autoData.antenna);
-    fwrite_unlocked(&(ptr->autoData), sizeof(autoCorrDef), 1, autoFile);
+    dprintf("Writing autocorrelation scan %d for ant %d\n", ptr->autoData.scan, ptr->autoData.antenna);
+    fwrite_unlocked(&(ptr->autoData), sizeof(autoCorrDef), 1, autoOut);
     tptr = ptr;
     ptr = ptr->next;
     free(tptr);
   }
   sWARMAutoRoot = NULL;
   pthread_mutex_unlock(&autoMutex);
-  fflush_unlocked(autoFile);
 } /* End of writeAutoData */
 
+/*
+
+   L A T E N C Y  S C A N  D E Q U E U E D
+
+   latencyScanDequeued records the latencies of the stages scan went
+   through before the WRITER took it off the queue, at time now.
+
+*/
+void latencyScanDequeued(pendingScan *scan, double now)
+{
+  int crate;
+  double lastArrival, ready;
+
+  lastArrival = scan->birthTime;
+  for (crate = 1; crate <= MAX_CRATE; crate++)
+    if (scan->received[crate]) {
+      latencyRecord(&crateLatency[crate], scan->arrivalTime[crate] - scan->birthTime);
+      if (scan->arrivalTime[crate] > lastArrival)
+	lastArrival = scan->arrivalTime[crate];
+    }
+  ready = (scan->headerTime > lastArrival) ? scan->headerTime : lastArrival;
+  latencyRecord(&stageLatency[LATENCY_ARRIVAL], lastArrival - scan->birthTime);
+  latencyRecord(&stageLatency[LATENCY_HEADER], scan->headerTime - scan->birthTime);
+  latencyRecord(&stageLatency[LATENCY_QUEUE], now - ready);
+} /* End of latencyScanDequeued */
+
+/*
+  latencyReport writes a dump of the latency histograms to out, with a
+  line for each stage and for each crate heard from.
+*/
+void latencyReport(FILE *out)
+{
+  int i;
+  char name[20];
+
+  fprintf(out, "%-16s %10s %10s %10s %10s %10s %10s %10s\n", "stage (ms)", "scans",
+	  "mean", "50%", "90%", "99%", "99.9%", "max");
+  for (i = 0; i < LATENCY_STAGES; i++)
+    latencyDump(out, stageNames[i], &stageLatency[i]);
+  for (i = 1; i <= MAX_CRATE; i++)
+    if (crateLatency[i].n > 0) {
+      sprintf(name, "crate %d", i);
+      latencyDump(out, name, &crateLatency[i]);
+    }
+} /* End of latencyReport */
+
+/*
+
+   L A T E N C Y  S E R V E R
+
+   latencyServer is the main function of the LATENCY thread.   It listens
+   on the Unix socket LATENCY_SOCKET, and writes a dump of the latency
+   histograms to anything which connects to it, for example with
+   "socat - UNIX-CONNECT:/tmp/dataCatcherLatency".
+
+*/
+void *latencyServer(void *arg)
+{
+  int listenFd, fd;
+  char socketName[sizeof(LATENCY_SOCKET)+MAX_SITE_ROOT];
+  struct sockaddr_un address;
+  FILE *out;
+
+  printf("Thread LATENCY starting\n");
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0) {
+    perror("latencyServer: socket");
+    return(NULL);
+  }
+  bzero((char *)&address, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, sitePath(LATENCY_SOCKET, socketName));
+  unlink(socketName);
+  if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    perror("latencyServer: bind");
+    close(listenFd);
+    return(NULL);
+  }
+  if (listen(listenFd, 4) < 0) {
+    perror("latencyServer: listen");
+    close(listenFd);
+    return(NULL);
+  }
+  while (TRUE) {
+    fd = accept(listenFd, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EINTR)
+	perror("latencyServer: accept");
+      continue;
+    }
+    out = fdopen(fd, "w");
+    if (out == NULL) {
+      perror("latencyServer: fdopen");
+      close(fd);
+      continue;
+    }
+    latencyReport(out);
+    fclose(out);
+  }
+  return(NULL);
+} /* End of latencyServer */
+
+/*
+
+   S O U R C E  C A T A L O G  R E S E T
+
+   sourceCatalogReset empties catalog.
+
+*/
+void sourceCatalogReset(sourceCatalog *catalog)
+{
+  free(catalog->entries);
+  free(catalog->buckets);
+  memset(catalog, 0, sizeof(sourceCatalog));
+} /* End of sourceCatalogReset */
+
+/*
+  sourceCatalogHash hashes (FNV-1a) the part of name which must match for
+  two sources to be the same.
+*/
+unsigned int sourceCatalogHash(const char *name)
+{
+  int i;
+  unsigned int hash = 2166136261U;
+
+  for (i = 0; (i < SOURCE_NAME_MATCH) && (name[i] != (char)0); i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 16777619U;
+  }
+  return(hash);
+} /* End of sourceCatalogHash */
+
+/*
+  sourceCatalogGrow doubles the room for entries in catalog, and rebuilds
+  its hash table with twice as many buckets as entries.
+*/
+void sourceCatalogGrow(sourceCatalog *catalog)
+{
+  int i, bucket;
+
+  catalog->maxEntries = (catalog->maxEntries == 0) ? 256 : 2*catalog->maxEntries;
+  catalog->entries = (catalogEntry *)realloc(catalog->entries,
+					     catalog->maxEntries*sizeof(catalogEntry));
+  catalog->nBuckets = 2*catalog->maxEntries;
+  free(catalog->buckets);
+  catalog->buckets = (int *)malloc(catalog->nBuckets*sizeof(int));
+  if ((catalog->entries == NULL) || (catalog->buckets == NULL)) {
+    perror("sourceCatalogGrow: allocating the source catalog");
+    exit(ERROR);
+  }
+  for (i = 0; i < catalog->nBuckets; i++)
+    catalog->buckets[i] = -1;
+  for (i = 0; i < catalog->nEntries; i++) {
+    bucket = catalog->entries[i].hash % catalog->nBuckets;
+    catalog->entries[i].next = catalog->buckets[bucket];
+    catalog->buckets[bucket] = i;
+  }
+} /* End of sourceCatalogGrow */
+
+/*
+
+   S O U R C E  C A T A L O G  S O U R C E
+
+   sourceCatalogSource returns the id of the source called name, adding it
+   to catalog if it has not been seen before.   When a source is added,
+   its "source" code is written to codesOut, if that is not NULL, using
+   codeh.
+
+*/
+int sourceCatalogSource(sourceCatalog *catalog, const char *name, codehDef *codeh, FILE *codesOut)
+{
+  int i;
+  unsigned int hash;
+  catalogEntry *entry;
+
+  hash = sourceCatalogHash(name);
+  if (catalog->nBuckets > 0)
+    for (i = catalog->buckets[hash % catalog->nBuckets]; i >= 0; i = catalog->entries[i].next)
+      if ((catalog->entries[i].hash == hash) &&
+	  (strncmp(catalog->entries[i].name, name, SOURCE_NAME_MATCH) == 0))
+	return(i+1);
+
+  /* There was no match, so add the source and write its code header */
+  if (catalog->nEntries >= catalog->maxEntries)
+    sourceCatalogGrow(catalog);
+  i = catalog->nEntries++;
+  entry = &catalog->entries[i];
+  strncpy(entry->name, name, sizeof(entry->name)-1);
+  entry->name[sizeof(entry->name)-1] = (char)0;
+  entry->hash = hash;
+  entry->next = catalog->buckets[hash % catalog->nBuckets];
+  catalog->buckets[hash % catalog->nBuckets] = i;
+  strcpy(codeh->v_name, "source");
+  codeh->icode = i+1;
+  strncpy(codeh->code, name, 25);
+  dprintf("...---... Writing source name \"%s\"\n", codeh->code);
+  if (codesOut != NULL)
+    fwrite_unlocked(codeh, sizeof(codehDef), 1, codesOut);
+  return(i+1);
+} /* End of sourceCatalogSource */
+
+/*
+
+   S O U R C E  C A T A L O G  V R A D
+
+   sourceCatalogVRad writes a "vrad" code for the radial velocity vRadial
+   to codesOut, if that is not NULL, using codeh, and returns its id.
+
+*/
+int sourceCatalogVRad(sourceCatalog *catalog, int scanNumber, double vRadial,
+		      codehDef *codeh, FILE *codesOut)
+{
+  strcpy(codeh->v_name, "vrad");
+  codeh->icode = scanNumber;
+  if (fabs(vRadial) <= 100000000.0)
+    sprintf(codeh->code, "%12.1f", vRadial);
+  else
+    sprintf(codeh->code, "%21.14e", vRadial);
+  codeh->ncode = strlen(codeh->code);
+  if (codesOut != NULL)
+    fwrite_unlocked(codeh, sizeof(codehDef), 1, codesOut);
+  return(catalog->nVRad++);
+} /* End of sourceCatalogVRad */
+
 /*
   
   W R I T E R
@@ -2466,13 +5313,15 @@ void *writer(void *arg)
   int modeFileWritten = FALSE;
   int antFileWritten = FALSE;
   int pIFileWritten = FALSE;
-  int codeVersionFileWritten = TRUE;
   int baselineFileOpen = FALSE;
   int codesFileOpen = FALSE;
   int engFileOpen = FALSE;
   int inFileOpen = FALSE; /* despite its name, we only do output with it */
   int spFileOpen = FALSE;
   int schFileOpen = FALSE;
+  int indexFileOpen = FALSE;
+  int indexNSpectra, indexMaxSpectra = 0; /* sp_read records in this scan */
+  int *indexDataOff = NULL;               /* and their dataoff values     */
   int ind1, ind2, ind3, ind4, i1Stop, i2Stop, i3Stop, i4Stop;
   unsigned int polarInt;
   int numberOfBaselines, numberOfSidebands, numberOfReceivers;
@@ -2487,7 +5336,7 @@ void *writer(void *arg)
   int nChannels[MAX_RX+1][2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK + 1];
   int obsType, ant1, ant2, tempScanNumber;
   int thisSourceId;
-  int thisVRadId = -1;
+  int thisVRadId;
   int specOffset[MAX_RX][MAX_SIDEBAND][MAX_POLARIZATION][MAX_BASELINE][2*MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK + 1];
   /* int pathNameChanged = FALSE; */
   int ant1N = 0, ant2N = 0, rxN = 0;
@@ -2506,8 +5355,7 @@ void *writer(void *arg)
   double averageTime, vRadial;
   char antOnline[11];
   char utstring[30];      /* storage for UT time in ascii */
-  char sourceList[MAX_SOURCES][34]; /* List of source names already used */
-  pendingScan scanCopy;
+  pendingScan *scan;   /* The scan being written, owned by the WRITER */
   codehDef codeh;
   inhDef inh;
   sphDef sph;
@@ -2525,7 +5373,11 @@ void *writer(void *arg)
   struct timespec startTime, stopTime;
   FILE *plotFile[MAX_RX], *baselineFile = NULL, *codesFile = NULL , *engFile = NULL,
     *inFile = NULL, *spFile = NULL, *schFile = NULL, *antFile, *pIFile, *weFile = NULL;
-  FILE *modeFile, *tsysFile = NULL;
+  FILE *modeFile, *tsysFile = NULL, *indexFile = NULL, *dataoffFile = NULL;
+  FILE *plotOut[MAX_RX], *baselineOut, *codesOut, *engOut, *inOut, *spOut, *schOut,
+    *weOut, *tsysOut, *indexOut, *dataoffOut; /* This scan's output, in the outputBatch */
+  outputBatch *batch;
+  mirIndexRecord indexRecord;
 
   printf("Thread WRITER starting\n");
   { /* Assemble the LO frequency information */
@@ -2653,21 +5505,16 @@ void *writer(void *arg)
      have set data within the time window, and header data is available).
   */
   while (TRUE) {
-    pthread_mutex_lock(&writeScanMutex);
-    while (!needWrite) {
-      printf("writer thread sleeping, awaiting a signal\n");
-      rCode = pthread_cond_wait(&writeScanCond, &writeScanMutex);
-      if (rCode) {
-	fprintf(stderr,
-		"writer: Error %d returned by pthread_cond_wait\n",
-		rCode);
-	perror("pthread_cond_wait");
-      }
-      printf("writer thread re-awakened ");
-    }
+    /*
+      Take the next completed scan off the queue.   It has already been
+      taken off the pending list, so the SERVER thread can carry on
+      without waiting for us, and the WRITER owns it until it is written.
+    */
+    scan = scanQueueGet();
     thisScanWasGood = TRUE;
     clock_gettime(CLOCK_REALTIME, &startTime);
     startTimeDouble = ((double)startTime.tv_sec) + ((double)startTime.tv_nsec)*1.0e-9;
+    latencyScanDequeued(scan, startTimeDouble);
     /* The following dsm_write enables operator messages for bad scans */
     /*
     dSMStatus = dsm_write("hal9000", "DSM_AS_CORRELATOR_RESTARTING_S", (char *)&shortZero);
@@ -2677,20 +5524,7 @@ void *writer(void *arg)
     }
     */
     sendOperatorMessages = TRUE;
-    printf("and proceeding to write scan %d\n", globalScanNumber);
-    /*
-      Make a temporary copy of the scan for processing, so that
-      we won't hold the SERVER thread waiting for the scanMutex.
-    */
-    pthread_mutex_lock(&scanMutex);
-    bcopy((char *)writableScan, (char *)(&scanCopy), sizeof(scanCopy));
-    for (i = 0; i <= MAX_CRATE; i++)
-      if (writableScan->received[i])
-	bundleCopy(writableScan->data[i], &(scanCopy.data[i]), FALSE,
-		   &(writableScan->hiRes[i]), &(writableScan->nDaisyChained[i]),
-		   &(writableScan->nInDaisyChain[i]));
-    deleteScan(writableScan, TRUE);
-    pthread_mutex_unlock(&scanMutex);
+    dprintf("and proceeding to write scan %d\n", globalScanNumber);
     /*
       Sum the Hi-Res mode partial chunks!
 
@@ -2700,19 +5534,19 @@ void *writer(void *arg)
       final chunk.   Here's where that is done.
     */
     for (i = 0; i <= MAX_CRATE; i++)
-      if (scanCopy.received[i])
-	if (scanCopy.hiRes[i] && (scanCopy.nInDaisyChain[i] == 1)) {
+      if (scan->received[i])
+	if (scan->hiRes[i] && (scan->nInDaisyChain[i] == 1)) {
 	  int jj, set, sb, kk;
 
-	  for (jj = i+1; jj < i+scanCopy.nDaisyChained[i]; jj++) {
-	    for (set = 0; set < scanCopy.data[jj]->set.set_len; set++) {
-	      if (scanCopy.data[i]->set.set_val[set].chunkNumber == 1) {
-		for (sb = 0; sb < scanCopy.data[i]->set.set_val[set].real.real_len; sb++) {
-		  for (kk = 0; kk < scanCopy.data[i]->set.set_val[set].real.real_val[sb].channel.channel_len; kk++) {
-		    scanCopy.data[i]->set.set_val[set].real.real_val[sb].channel.channel_val[kk] +=
-		      scanCopy.data[jj]->set.set_val[set].real.real_val[sb].channel.channel_val[kk];
-		    scanCopy.data[i]->set.set_val[set].imag.imag_val[sb].channel.channel_val[kk] +=
-		      scanCopy.data[jj]->set.set_val[set].imag.imag_val[sb].channel.channel_val[kk];
+	  for (jj = i+1; jj < i+scan->nDaisyChained[i]; jj++) {
+	    for (set = 0; set < scan->data[jj]->set.set_len; set++) {
+	      if (scan->data[i]->set.set_val[set].chunkNumber == 1) {
+		for (sb = 0; sb < scan->data[i]->set.set_val[set].real.real_len; sb++) {
+		  for (kk = 0; kk < scan->data[i]->set.set_val[set].real.real_val[sb].channel.channel_len; kk++) {
+		    scan->data[i]->set.set_val[set].real.real_val[sb].channel.channel_val[kk] +=
+		      scan->data[jj]->set.set_val[set].real.real_val[sb].channel.channel_val[kk];
+		    scan->data[i]->set.set_val[set].imag.imag_val[sb].channel.channel_val[kk] +=
+		      scan->data[jj]->set.set_val[set].imag.imag_val[sb].channel.channel_val[kk];
 		  }
 		}
 	      }
@@ -2720,28 +5554,27 @@ void *writer(void *arg)
 	  }
 
 	  /* Normalize the summed chunk by the number of crates in the Daisy-chain */
-	  if (scanCopy.nDaisyChained[i] > 0) {
+	  if (scan->nDaisyChained[i] > 0) {
 	    float normalizer;
 	    
-	    normalizer = 1.0 / scanCopy.nDaisyChained[i];
-	    for (set = 0; set < scanCopy.data[i]->set.set_len; set++)
-	      for (sb = 0; sb < scanCopy.data[i]->set.set_val[set].real.real_len; sb++)
-		for (kk = 0; kk < scanCopy.data[i]->set.set_val[set].real.real_val[sb].channel.channel_len; kk++) {
-		  scanCopy.data[i]->set.set_val[set].real.real_val[sb].channel.channel_val[kk] *= normalizer;
-		  scanCopy.data[i]->set.set_val[set].imag.imag_val[sb].channel.channel_val[kk] *= normalizer;
+	    normalizer = 1.0 / scan->nDaisyChained[i];
+	    for (set = 0; set < scan->data[i]->set.set_len; set++)
+	      for (sb = 0; sb < scan->data[i]->set.set_val[set].real.real_len; sb++)
+		for (kk = 0; kk < scan->data[i]->set.set_val[set].real.real_val[sb].channel.channel_len; kk++) {
+		  scan->data[i]->set.set_val[set].real.real_val[sb].channel.channel_val[kk] *= normalizer;
+		  scan->data[i]->set.set_val[set].imag.imag_val[sb].channel.channel_val[kk] *= normalizer;
 		}
 	  }
-	} /* if (scanCopy.hiRes[i] && (scanCopy.nInDaisyChain[i] == 1)) */
+	} /* if (scan->hiRes[i] && (scan->nInDaisyChain[i] == 1)) */
     /* End of HiRes summing loop */
 
     /* Find lowest antenna active for this scan */
     lowestAntennaNumber = getAntennaList(&antennaInArray[0]);
     antennaInArrayInitialized = TRUE;
-    printf("...---... lowestAntennaNumber = %d\n", lowestAntennaNumber);
+    dprintf("...---... lowestAntennaNumber = %d\n", lowestAntennaNumber);
     if (lowestAntennaNumber > 0) {
-      short startChannel, endChannel;
       int rx, set, sb, pol, chunk, crate, bl, flag, ira, idec;
-      int effRx = 0, mon, day, yr, hr, min, sec, source;
+      int effRx = 0, mon, day, yr, hr, min, sec;
       long jD;
       double lambda = 1.0;
       double rar, decr, az, el, hAMidpoint;
@@ -2752,12 +5585,12 @@ void *writer(void *arg)
       */
       dprintf("writer:\tlowest active antenna is %d\n", lowestAntennaNumber);
       if (needNewDataFile) {
-	int dirCode;
 	/* int ii, jj, kk, ds; */
 	/* double dSMChunkFreqs[2][2][24], dSMChunkVelos[2][2][24]; */
-	char directory[50], fileName[100];
+	char fileName[100+MAX_SITE_ROOT];
 	time_t now;
 	struct tm *nowValues;
+	dataFileSet next;
 	/* dsm_structure plotInfo; */
 
 	/* Write out some frequency information for corrPlotter */
@@ -2766,8 +5599,8 @@ void *writer(void *arg)
 	for (ii = 0; ii < 2; ii++)
 	  for (jj = 0; jj < 2; jj++)
 	    for (kk = 0; kk < 24; kk++) {
-	      dSMChunkFreqs[ii][jj][kk] = scanCopy.chunkFreq[ii][jj][kk+1];
-	      dSMChunkVelos[ii][jj][kk] = scanCopy.header.loData.vRadial = 0.0;
+	      dSMChunkFreqs[ii][jj][kk] = scan->chunkFreq[ii][jj][kk+1];
+	      dSMChunkVelos[ii][jj][kk] = scan->header.loData.vRadial = 0.0;
 	    }
 	*/
 	/*
@@ -2783,22 +5616,6 @@ void *writer(void *arg)
 	if (dSMStatus != DSM_SUCCESS)
 	  dsm_error_message(dSMStatus, "dsm_write()");
 	*/
-	/*
-	  Create the directory
-	*/
-	time(&now);
-	nowValues = gmtime(&now);
-	/*
-	ds = dsm_read("hal9000", "DSM_AS_CORRDATATYPE_L",
-		      &dirCode, &timestamp);
-	if (ds != DSM_SUCCESS) {
-	  dsm_error_message(ds, "dsm_read (5)");
-	  perror("writer: dsm read of DSM_AS_CORRDATATYPE_L");
-	  dirCode = DD_SCIENCE;
-	}
-	*/
-	dirCode = DD_ENGINEERING;
-
 	/*
 	ds = dsm_read("hal9000", "DSM_AS_C1_SOURCE_S",
 		      &doubleBandwidthContinuum, &timestamp);
@@ -2810,30 +5627,15 @@ void *writer(void *arg)
 	if (doubleBandwidthContinuum != 1)
 	  doubleBandwidthContinuum = FALSE;
 	dprintf("doubleBandwidthContinuum = %d\n", doubleBandwidthContinuum);
-	switch (dirCode) {
-	case DD_GARBAGE:
-	  sprintf(directory, "garbage");
-	  break;
-	case DD_PRIMING:
-	  sprintf(directory, "priming");
-	  break;
-	case DD_ENGINEERING:
-	  sprintf(directory, "engineering");
-	  break;
-	case DD_POINTING:
-	  sprintf(directory, "pointing");
-	  break;
-	case DD_BASELINE:
-	  sprintf(directory, "baseline");
-	  break;
-	case DD_FLUX:
-	  sprintf(directory, "flux");
-	  break;
-	default:
-	  sprintf(directory, "science");
-	}
-	sprintf(pathName, "/data/%s/mir_data/%02d%02d%02d_%02d:%02d:%02d/",
-		directory,
+	/*
+	  Take the directory, and open files, which the PREPARER thread has
+	  made ready ahead of time, and give the directory its real name.
+	*/
+	dataFileSetTake(&next);
+	time(&now);
+	nowValues = gmtime(&now);
+	sprintf(pathName, "%s/data/%s/mir_data/%02d%02d%02d_%02d:%02d:%02d/",
+		siteRoot, next.directory,
 		nowValues->tm_year - 100,
 		nowValues->tm_mon + 1,
 		nowValues->tm_mday,
@@ -2841,36 +5643,43 @@ void *writer(void *arg)
 		nowValues->tm_min,
 		nowValues->tm_sec);
 	/* pathNameChanged = TRUE; */
-	rCode = mkdir(pathName, 0777);
+	rCode = rename(next.stagingPath, pathName);
 	if (rCode < 0) {
-	  fprintf(stderr, "writer: Problem creating \"%s\", rCode = %d, errno = %d\n",
-		  pathName, rCode, errno);
-	  perror("writer: creating data directory");
+	  fprintf(stderr, "writer: Problem renaming \"%s\" to \"%s\", rCode = %d, errno = %d\n",
+		  next.stagingPath, pathName, rCode, errno);
+	  perror("writer: naming data directory");
+	  removeStagingDirectory(next.stagingPath);
 	  exit(-1);
 	}
 	inhid = sphid = blhid = 0;
 	/*
-	  (re)Open the data files
+	  Close the old data files, once OUTPUT has finished with them
 	*/
+	outputDrain();
 	if (plotFileOpen)
 	  for (rx = 0; rx < MAX_RX; rx++)
-	    fclose(plotFile[rx]);
+	    if (plotFile[rx] != NULL)
+	      outputFileClose(plotFile[rx]);
 	if (baselineFileOpen)
-	  fclose(baselineFile);
+	  outputFileClose(baselineFile);
 	if (weFileOpen)
-	  fclose(weFile);
+	  outputFileClose(weFile);
 	if (tsysFileOpen)
-	  fclose(tsysFile);
+	  outputFileClose(tsysFile);
 	if (codesFileOpen)
-	  fclose(codesFile);
+	  outputFileClose(codesFile);
 	if (engFileOpen)
-	  fclose(engFile);
+	  outputFileClose(engFile);
 	if (inFileOpen)
-	  fclose(inFile);
+	  outputFileClose(inFile);
 	if (spFileOpen)
-	  fclose(spFile);
+	  outputFileClose(spFile);
 	if (schFileOpen)
-	  fclose(schFile);
+	  outputFileClose(schFile);
+	if (indexFileOpen) {
+	  outputFileClose(indexFile);
+	  outputFileClose(dataoffFile);
+	}
 	if (!antFileWritten) {
 	  sprintf(fileName, "%santennas", pathName);
 	  antFile = fopen(fileName, "w");
@@ -2879,9 +5688,9 @@ void *writer(void *arg)
 
 	    for (ii = 1; ii <= 10; ii++)
 	      fprintf(antFile, "%d\t%16.9e\t%16.9e\t%16.9e\n", ii,
-		      scanCopy.header.DDSdata.x[ii],
-		      scanCopy.header.DDSdata.y[ii],
-		      scanCopy.header.DDSdata.z[ii]);
+		      scan->header.DDSdata.x[ii],
+		      scan->header.DDSdata.y[ii],
+		      scan->header.DDSdata.z[ii]);
 	    fclose(antFile);
 	  } else {
 	    fprintf(stderr, "Error opening antenna positions file\n");
@@ -2916,44 +5725,6 @@ void *writer(void *arg)
 	  }
 	  pIFileWritten = TRUE;
 	}
-	if (!codeVersionFileWritten) {
-	  FILE *src, *dst;
-
-	  src = fopen("/common/configFiles/codeVersions", "r");
-	  if (src == NULL) {
-	    fprintf(stderr, "Could not open source codeVersions file\n");
-	  } else {
-	    sprintf(fileName, "%scodeVersions", pathName);
-	    dst = fopen(fileName, "w");
-	    if (dst == NULL) {
-	      fprintf(stderr, "Could not open destination codeVersions file\n");
-	    } else {
-	      while (TRUE) {
-		char ch;
-
-		ch= getc(src);
-		if (ch == EOF)
-		  break;
-		else
-		  putc(ch, dst);
-	      }
-	      fclose(dst);
-	    }
-	    fclose(src);
-	  }
-	}
-	for (rx = 0; rx < MAX_RX; rx++)
-	  if (receiverActive[rx]) {
-	    if (!((rx != doubleBandwidthRx) && doubleBandwidth)) {
-	      sprintf(fileName, "%splot_me_5_rx%d", pathName, rx);
-	      plotFile[rx] = fopen(fileName, "w");
-	      if (plotFile[rx] == NULL) {
-		perror("writer: plotFile fopen");
-		exit(ERROR);
-	      } else
-		plotFileOpen = TRUE;
-	    }
-	  }
 	if (!modeFileWritten) {
 	  sprintf(fileName, "%smodeInfo", pathName);
 	  modeFile = fopen(fileName, "w");
@@ -2973,67 +5744,54 @@ void *writer(void *arg)
 	  }
 	  modeFileWritten = TRUE;
 	}
-	sprintf(fileName, "%sbl_read", pathName);
-	baselineFile = fopen(fileName, "w");
-	if (baselineFile == NULL) {
-	  perror("writer: baselineFile fopen");
-	  exit(ERROR);
-	} else
-	  baselineFileOpen = TRUE;
-	sprintf(fileName, "%swe_read", pathName);
-	weFile = fopen(fileName, "w");
-	if (weFile == NULL) {
-	  perror("writer: weFile fopen");
-	  exit(ERROR);
-	} else
-	  weFileOpen = TRUE;
-	sprintf(fileName, "%stsys_read", pathName);
-	tsysFile = fopen(fileName, "w");
-	if (tsysFile == NULL) {
-	  perror("writer: tsysFile fopen");
-	  exit(ERROR);
-	} else
-	  tsysFileOpen = TRUE;
-	sprintf(fileName, "%scodes_read", pathName);
-	codesFile = fopen(fileName, "w");
-	if (codesFile == NULL) {
-	  perror("writer: codesFile fopen");
-	  exit(ERROR);
-	} else
-	  codesFileOpen = TRUE;
-	fixedCodes(codesFile);
-	sprintf(fileName, "%seng_read", pathName);
-	engFile = fopen(fileName, "w");
-	if (engFile == NULL) {
-	  perror("writer: engFile fopen");
-	  exit(ERROR);
-	} else
-	  engFileOpen = TRUE;
-	sprintf(fileName, "%sin_read", pathName);
-	inFile = fopen(fileName, "w");
-	if (inFile == NULL) {
-	  perror("writer: inFile fopen");
-	  exit(ERROR);
-	} else
-	  inFileOpen = TRUE;
-	sprintf(fileName, "%ssp_read", pathName);
-	spFile = fopen(fileName, "w");
-	if (spFile == NULL) {
-	  perror("writer: spFile fopen");
-	  exit(ERROR);
-	} else
-	  spFileOpen = TRUE;
-	sprintf(fileName, "%ssch_read", pathName);
-	schFile = fopen(fileName, "w");
-	if (schFile == NULL) {
-	  perror("writer: schFile fopen");
-	  exit(ERROR);
-	} else
-	  schFileOpen = TRUE;
+	for (rx = 0; rx < MAX_RX; rx++)
+	  plotFile[rx] = next.plotFile[rx];
+	baselineFile = next.baselineFile;
+	weFile       = next.weFile;
+	tsysFile     = next.tsysFile;
+	codesFile    = next.codesFile;
+	engFile      = next.engFile;
+	inFile       = next.inFile;
+	spFile       = next.spFile;
+	schFile      = next.schFile;
+	indexFile    = next.indexFile;
+	dataoffFile  = next.dataoffFile;
+	plotFileOpen = baselineFileOpen = weFileOpen = tsysFileOpen = codesFileOpen =
+	  engFileOpen = inFileOpen = spFileOpen = schFileOpen = indexFileOpen = TRUE;
 
 	needNewDataFile = FALSE;
       } /* end of if (needNewDataFile) */
 
+      /*
+	Everything written for this scan goes into an outputBatch, which the
+	OUTPUT threads copy to the data files while the next scan is processed.
+      */
+      batch = outputBatchNew(globalScanNumber);
+      batch->birthTime = scan->birthTime;
+      for (rx = 0; rx < MAX_RX; rx++)
+	if (receiverActive[rx] && (!((rx != doubleBandwidthRx) && doubleBandwidth)))
+	  plotOut[rx] = outputBatchStream(batch, plotFile[rx]);
+	else
+	  plotOut[rx] = NULL;
+      baselineOut = outputBatchStream(batch, baselineFile);
+      weOut       = outputBatchStream(batch, weFile);
+      tsysOut     = outputBatchStream(batch, tsysFile);
+      codesOut    = outputBatchStream(batch, codesFile);
+      engOut      = outputBatchStream(batch, engFile);
+      inOut       = outputBatchStream(batch, inFile);
+      spOut       = outputBatchStream(batch, spFile);
+      schOut      = outputBatchStream(batch, schFile);
+      indexOut    = outputBatchTrailer(batch, indexFile);
+      dataoffOut  = outputBatchStream(batch, dataoffFile);
+      memset(&indexRecord, 0, sizeof(indexRecord));
+      indexRecord.magic     = MIR_INDEX_MAGIC;
+      indexRecord.inOffset  = outputFileQueued(inFile);
+      indexRecord.blOffset  = outputFileQueued(baselineFile);
+      indexRecord.spOffset  = outputFileQueued(spFile);
+      indexRecord.schOffset = outputFileQueued(schFile);
+      indexRecord.dataoffOffset = outputFileQueued(dataoffFile);
+      indexNSpectra = 0;
+
       numberOfSidebands = UNINITIALIZED;
       nCrates = nCratesReportingTime = 0;
       averageTime = 0.0;
@@ -3067,18 +5825,18 @@ void *writer(void *arg)
 	  if (antennaInArray[ant]) {
 	    antTsysByteOffset[ant] = tsysByteOffset;
 	    if (receiverActive[0])
-	      tsysh.data[2] = tsysh.data[3] = 2.0*scanCopy.header.antavg[ant].tsys;
+	      tsysh.data[2] = tsysh.data[3] = 2.0*scan->header.antavg[ant].tsys;
 	    else
-	      tsysh.data[2] = tsysh.data[3] = 2.0*scanCopy.header.antavg[ant].tsys_rx2;
+	      tsysh.data[2] = tsysh.data[3] = 2.0*scan->header.antavg[ant].tsys_rx2;
 	    tsysh.data[2] = tsysh.data[3] = 50.0;
 	    if (doubleBandwidth || (receiverActive[0] && receiverActive[1]))
-	      tsysh.data[6] = tsysh.data[7] = 2.0*scanCopy.header.antavg[ant].tsys_rx2;
+	      tsysh.data[6] = tsysh.data[7] = 2.0*scan->header.antavg[ant].tsys_rx2;
 	    tsysh.data[6] = tsysh.data[7] = 50.0;
-	    printf("...---... Ant %d Tsys: n: %d %f %f %f %f %f %f %f %f\n", ant, tsysh.nMeasurements,
-		   tsysh.data[0], tsysh.data[1], tsysh.data[2], tsysh.data[3], tsysh.data[4], tsysh.data[5],
-		   tsysh.data[6], tsysh.data[7]);
-	    fwrite_unlocked(&tsysh.nMeasurements, 4, 1, tsysFile);
-	    fwrite_unlocked(tsysh.data, tsysh.nMeasurements*16, 1, tsysFile);
+	    dprintf("...---... Ant %d Tsys: n: %d %f %f %f %f %f %f %f %f\n", ant, tsysh.nMeasurements,
+		    tsysh.data[0], tsysh.data[1], tsysh.data[2], tsysh.data[3], tsysh.data[4], tsysh.data[5],
+		    tsysh.data[6], tsysh.data[7]);
+	    fwrite_unlocked(&tsysh.nMeasurements, 4, 1, tsysOut);
+	    fwrite_unlocked(tsysh.data, tsysh.nMeasurements*16, 1, tsysOut);
 	    tsysByteOffset += 4+tsysh.nMeasurements*16;
 	  }
 	}
@@ -3124,7 +5882,7 @@ void *writer(void *arg)
       inhid = globalScanNumber;
       lowestCrateNumber = UNINITIALIZED;
       for (crate = 1; crate <= MAX_CRATE; crate++) {
-	if (scanCopy.received[crate]) {
+	if (scan->received[crate]) {
 	  int block;
 
 	  if (lowestCrateNumber == UNINITIALIZED) {
@@ -3135,20 +5893,20 @@ void *writer(void *arg)
 	      going to assume that all baselines have the same number of
 	      spectral chunks
 	    */
-	    ant1N = scanCopy.data[lowestCrateNumber]->set.set_val[0].antennaNumber[1];
-	    ant2N = scanCopy.data[lowestCrateNumber]->set.set_val[0].antennaNumber[2];
-	    rxN   = 1 - scanCopy.data[lowestCrateNumber]->set.set_val[0].rxBoardHalf;
+	    ant1N = scan->data[lowestCrateNumber]->set.set_val[0].antennaNumber[1];
+	    ant2N = scan->data[lowestCrateNumber]->set.set_val[0].antennaNumber[2];
+	    rxN   = 1 - scan->data[lowestCrateNumber]->set.set_val[0].rxBoardHalf;
 	  }
 	  nCrates++;
 	  if (crate < 12) {
-	    averageTime += scanCopy.data[crate]->UTCtime;
+	    averageTime += scan->data[crate]->UTCtime;
 	    nCratesReportingTime++;
 	  }
 	  
-	  if (scanCopy.data[crate]->blockNumber < 4) {
-	    setStart = 0; setStop = scanCopy.data[crate]->set.set_len; setInc = 1;
+	  if (scan->data[crate]->blockNumber < 4) {
+	    setStart = 0; setStop = scan->data[crate]->set.set_len; setInc = 1;
 	  } else {
-	    setStart = scanCopy.data[crate]->set.set_len - 1; setStop = -1; setInc = -1;
+	    setStart = scan->data[crate]->set.set_len - 1; setStop = -1; setInc = -1;
 	  }
 	  
 	  /*
@@ -3160,14 +5918,14 @@ void *writer(void *arg)
 	    for (set = setStart; set != setStop; set += setInc) {
 	      int state1, state2, pol;
 
-	      state1 = scanCopy.data[crate]->set.set_val[set].antPolState[1];
-	      state2 = scanCopy.data[crate]->set.set_val[set].antPolState[2];
-	      if ((ant1N == scanCopy.data[crate]->set.set_val[set].antennaNumber[1]) &&
-		  (ant2N == scanCopy.data[crate]->set.set_val[set].antennaNumber[2]) &&
-		  (rxN == (1 - scanCopy.data[crate]->set.set_val[set].rxBoardHalf))) {
+	      state1 = scan->data[crate]->set.set_val[set].antPolState[1];
+	      state2 = scan->data[crate]->set.set_val[set].antPolState[2];
+	      if ((ant1N == scan->data[crate]->set.set_val[set].antennaNumber[1]) &&
+		  (ant2N == scan->data[crate]->set.set_val[set].antennaNumber[2]) &&
+		  (rxN == (1 - scan->data[crate]->set.set_val[set].rxBoardHalf))) {
 		if ((!fullPolarization) || ((state1 == 1) && (state2 == 1))) {
-		  chunk = scanCopy.data[crate]->set.set_val[set].chunkNumber;
-		  block = scanCopy.data[crate]->blockNumber;
+		  chunk = scan->data[crate]->set.set_val[set].chunkNumber;
+		  block = scan->data[crate]->blockNumber;
 		  bandIndx[rxN][nBands[rxN]] = sChunk(block, chunk);
 		  if (chunkSName[rxN][nBands[rxN]] == UNINITIALIZED) {
 		    if ((rxN == 0) || (!doubleBandwidth))
@@ -3176,21 +5934,21 @@ void *writer(void *arg)
 		      chunkSName[rxN][nBands[rxN]] = highSChunk(block, chunk);
 		  }
 		  nBands[rxN]++;
-		  printf("nBands[%d] = %d\n", rxN, nBands[rxN]);
+		  dprintf("nBands[%d] = %d\n", rxN, nBands[rxN]);
 		}
 	      }
 	      if (numberOfSidebands == UNINITIALIZED)
-		numberOfSidebands = scanCopy.data[crate]->set.set_val[set].real.real_len;
-	      ant1 = scanCopy.data[crate]->set.set_val[set].antennaNumber[1];
-	      ant2 = scanCopy.data[crate]->set.set_val[set].antennaNumber[2];
-	      chunk = scanCopy.data[crate]->set.set_val[set].chunkNumber;
-	      block = scanCopy.data[crate]->blockNumber;
-	      rx = 1 - scanCopy.data[crate]->set.set_val[set].rxBoardHalf;
+		numberOfSidebands = scan->data[crate]->set.set_val[set].real.real_len;
+	      ant1 = scan->data[crate]->set.set_val[set].antennaNumber[1];
+	      ant2 = scan->data[crate]->set.set_val[set].antennaNumber[2];
+	      chunk = scan->data[crate]->set.set_val[set].chunkNumber;
+	      block = scan->data[crate]->blockNumber;
+	      rx = 1 - scan->data[crate]->set.set_val[set].rxBoardHalf;
 	      nChannels[rx][sChunk(block, chunk)] = 
-		scanCopy.data[crate]->set.set_val[set].real.real_val[0].channel.channel_len;
+		scan->data[crate]->set.set_val[set].real.real_val[0].channel.channel_len;
 	      if (fullPolarization) {
-		chunk = scanCopy.data[crate]->set.set_val[set].chunkNumber;
-		block = scanCopy.data[crate]->blockNumber;
+		chunk = scan->data[crate]->set.set_val[set].chunkNumber;
+		block = scan->data[crate]->blockNumber;
 		if (state1 == 0) {
 		  if (state2 == 0)
 		    pol = 0;
@@ -3221,12 +5979,12 @@ void *writer(void *arg)
 	    for (set = setStart; set != setStop; set += setInc) {
 	      int state1, state2;
 
-	      ant1 = scanCopy.data[crate]->set.set_val[set].antennaNumber[1];
-	      ant2 = scanCopy.data[crate]->set.set_val[set].antennaNumber[2];
-	      state1 = scanCopy.data[crate]->set.set_val[set].antPolState[1];
-	      state2 = scanCopy.data[crate]->set.set_val[set].antPolState[2];
-	      chunk = scanCopy.data[crate]->set.set_val[set].chunkNumber;
-	      block = scanCopy.data[crate]->blockNumber;
+	      ant1 = scan->data[crate]->set.set_val[set].antennaNumber[1];
+	      ant2 = scan->data[crate]->set.set_val[set].antennaNumber[2];
+	      state1 = scan->data[crate]->set.set_val[set].antPolState[1];
+	      state2 = scan->data[crate]->set.set_val[set].antPolState[2];
+	      chunk = scan->data[crate]->set.set_val[set].chunkNumber;
+	      block = scan->data[crate]->blockNumber;
 	      if (fullPolarization) {
 		if (state1 == 0)
 		  if (state2 == 0)
@@ -3240,14 +5998,12 @@ void *writer(void *arg)
 		    pol = 1;
 	      } else
 		pol = 0;
-	      for (sb = 0; sb < scanCopy.data[crate]->set.set_val[set].real.real_len; sb++) {
-		int channel;
-		float ampSum, realSum, imagSum, edgeWidth;
+	      for (sb = 0; sb < scan->data[crate]->set.set_val[set].real.real_len; sb++) {
+		float ampSum, realSum, imagSum;
+		pCPartial partial;
 
 		ampSum = realSum = imagSum = 0.0;
-		if (rx == 1 - scanCopy.data[crate]->set.set_val[set].rxBoardHalf) {
-		  float channelWeight;
-		  
+		if (rx == 1 - scan->data[crate]->set.set_val[set].rxBoardHalf) {
 		  /*
 		    Make the pseudo-continuum from the entire available bandwidth
 		  */
@@ -3262,62 +6018,49 @@ void *writer(void *arg)
 		  if (goodChunk[rx][ant1][ant2][sChunk(block, chunk)] &&
 		      ((rx == effRx) || (doubleBandwidth && doubleBandwidthContinuum) ||
 		       ((rx == 1) && (!doubleBandwidth)))) {
-		    pCFreqSum[effRx][sb][pol] += scanCopy.chunkFreq[rx][sb][sChunk(block, chunk)];
-		    pCVeloSum[effRx][sb][pol] += scanCopy.chunkVelo[rx][sb][sChunk(block, chunk)];
-		    pCFreqNPoints[effRx][sb][pol]++;
-		    if (sChunk(block, chunk) < 49)
-		      edgeWidth = (CHUNK_FULL_BANDWIDTH - CHUNK_USABLE_BANDWIDTH) / (2.0 * CHUNK_FULL_BANDWIDTH);
-		    else
-		      edgeWidth = (SWARM_CHUNK_FULL_BANDWIDTH - SWARM_CHUNK_USABLE_BANDWIDTH) / (2.0 * SWARM_CHUNK_FULL_BANDWIDTH);
-		    startChannel =
-		      (int)((float)scanCopy.data[crate]->set.set_val[set].real.real_val[sb].channel.channel_len
-			    * edgeWidth);
-		    endChannel =
-		      (int)((float)scanCopy.data[crate]->set.set_val[set].real.real_val[sb].channel.channel_len
-			    * (1.0 - edgeWidth));
 		    /*
-		      Calculate the weight each channel should have, to account
-		      for differing numbers of channels in different chunks.
+		      The sums were normally made as the bundle arrived, but the
+		      first crate of a Hi-Res daisy chain has been changed since.
 		    */
-		    channelWeight = (float)(1 + endChannel - startChannel);
-		    if (channelWeight < 1.0)
-		      channelWeight = 1.0;
-		    channelWeight = 1.0 / channelWeight;
+		    if ((scan->pCSums[crate] != NULL) &&
+			!(scan->hiRes[crate] && (scan->nInDaisyChain[crate] == 1)))
+		      partial = scan->pCSums[crate][set*MAX_SB + sb];
+		    else
+		      pCChunkSum(scan->data[crate]->set.set_val[set].real.real_val[sb].channel.channel_val,
+				 scan->data[crate]->set.set_val[set].imag.imag_val[sb].channel.channel_val,
+				 scan->data[crate]->set.set_val[set].real.real_val[sb].channel.channel_len,
+				 sChunk(block, chunk), &partial);
 		    dprintf("For chunk s%02d, start, %d, end %d, channelWeight = %f\n",
-			    sChunk(block, chunk),startChannel, endChannel, channelWeight);
-		    for (channel = startChannel; channel <= endChannel; channel++) {
-		      float real, imag, amp;
-		      
-		      real = scanCopy.data[crate]->set.set_val[set].real.real_val[sb].channel.channel_val[channel];
-		      if (isnan(real)) {
-			/* printf("___ real is NAN at chan %d sb %d crate %d set %d\n", */
-			/*        channel, sb, crate, set); */
-			exit(-1);
-		      } else
-			/* printf("___ real is OK at chan %d sb %d crate %d set %d\n", */
-			/*        channel, sb, crate, set); */
-		      realSum += real * channelWeight;
-		      imag = scanCopy.data[crate]->set.set_val[set].imag.imag_val[sb].channel.channel_val[channel];
-		      imagSum += imag * channelWeight;
-		      amp = sqrt(real*real + imag*imag) * channelWeight;
-		      ampSum += amp;
+			    sChunk(block, chunk), partial.startChannel, partial.endChannel,
+			    partial.channelWeight);
+		    if (partial.sawNaN)
+		      /* The chunks missing from a partial SWARM integration are all NaNs */
+		      dprintf("Ignoring chunk s%d on baseline %d-%d for pc - it holds NaNs\n",
+			      sChunk(block, chunk), ant1, ant2);
+		    else {
+		      pCFreqSum[effRx][sb][pol] += scan->chunkFreq[rx][sb][sChunk(block, chunk)];
+		      pCVeloSum[effRx][sb][pol] += scan->chunkVelo[rx][sb][sChunk(block, chunk)];
+		      pCFreqNPoints[effRx][sb][pol]++;
+		      realSum = partial.realSum;
+		      imagSum = partial.imagSum;
+		      ampSum  = partial.ampSum;
+		      pCRealSum[effRx][ant1][ant2][sb][pol] += realSum;
+		      pCImagSum[effRx][ant1][ant2][sb][pol] += imagSum;
+		      pCAmpSum[effRx][ant1][ant2][sb][pol]  += ampSum;
+		      nPCCohPoints[effRx][ant1][ant2][sb][pol]  += 1.0;
+		      /*
+			pCNPoints[effRx][ant1][ant2][sb][pol] += endChannel - startChannel + 1;
+		      */
+		      pCNPoints[effRx][ant1][ant2][sb][pol]++; /* Just normalize by the number of chunks summed */
 		    }
-		    pCRealSum[effRx][ant1][ant2][sb][pol] += realSum;
-		    pCImagSum[effRx][ant1][ant2][sb][pol] += imagSum;
-		    pCAmpSum[effRx][ant1][ant2][sb][pol]  += ampSum;
-		    nPCCohPoints[effRx][ant1][ant2][sb][pol]  += 1.0;
-		    /*
-		      pCNPoints[effRx][ant1][ant2][sb][pol] += endChannel - startChannel + 1;
-		    */
-		    pCNPoints[effRx][ant1][ant2][sb][pol]++; /* Just normalize by the number of chunks summed */
 		  } else
-		    printf("Ignoring chunk s%d on baseline %d-%d for pc\n",
+		    dprintf("Ignoring chunk s%d on baseline %d-%d for pc\n",
 			    sChunk(block, chunk), ant1, ant2);
 		  dprintf("pCFreqSum[%d][%d][%d] = %f\n", rx, sb, pol, pCFreqSum[effRx][sb][pol]);
 		} /* if rx == 1 - blah blah blah  */
 	      } /* For sb ... */
 	    } /* for set ... */
-	} /* if scanCopy.received[crate] */
+	} /* if scan->received[crate] */
       } /* for crate... */
       averageTime /= (3600.0*(float)nCratesReportingTime);
       averageTime = 0.0;
@@ -3363,25 +6106,25 @@ void *writer(void *arg)
 
       weh.scanNumber   = globalScanNumber;
       weh.flags[0]     = 0;
-      weh.N[0]         = scanCopy.header.antavg[lowestAntennaNumber].N = 1.0;
-      weh.Tamb[0]      = scanCopy.header.antavg[lowestAntennaNumber].Tamb = 20.0;;
-      weh.pressure[0]  = scanCopy.header.antavg[lowestAntennaNumber].pressure = 800.0;
-      weh.humid[0]     = scanCopy.header.antavg[lowestAntennaNumber].humid = 10.0;
-      weh.windSpeed[0] = scanCopy.header.antavg[lowestAntennaNumber].windSpeed = 0.0;
-      weh.windDir[0]   = scanCopy.header.antavg[lowestAntennaNumber].windDir = 0.0;
+      weh.N[0]         = scan->header.antavg[lowestAntennaNumber].N = 1.0;
+      weh.Tamb[0]      = scan->header.antavg[lowestAntennaNumber].Tamb = 20.0;;
+      weh.pressure[0]  = scan->header.antavg[lowestAntennaNumber].pressure = 800.0;
+      weh.humid[0]     = scan->header.antavg[lowestAntennaNumber].humid = 10.0;
+      weh.windSpeed[0] = scan->header.antavg[lowestAntennaNumber].windSpeed = 0.0;
+      weh.windDir[0]   = scan->header.antavg[lowestAntennaNumber].windDir = 0.0;
       for (i = 1; i <= MAX_ANT; i++) {
-	weh.flags[i]     = scanCopy.header.antavg[i].isvalid[1];
-	weh.N[i]         = scanCopy.header.antavg[i].N = 1.0;
+	weh.flags[i]     = scan->header.antavg[i].isvalid[1];
+	weh.N[i]         = scan->header.antavg[i].N = 1.0;
 	weh.windSpeed[i] = weh.windDir[i] = weh.h2o[i] =
 	  weh.Tamb[i] = weh.pressure[i] =
 	  weh.humid[i] = -1.0;
       }
       if (store)
-	fwrite_unlocked(&weh, sizeof(weh), 1, weFile);
+	fwrite_unlocked(&weh, sizeof(weh), 1, weOut);
       /*
 	Write stuff to codes file
       */
-      jD = scanCopy.header.antavg[lowestAntennaNumber].tjd + 0.5;
+      jD = scan->header.antavg[lowestAntennaNumber].tjd + 0.5;
       {
 	int year, mon, day, hh, mm, ss;
 	time_t now;
@@ -3415,7 +6158,7 @@ void *writer(void *arg)
 	codeh.ncode = 0;
 	refTimeStr(mon, day, yr, codeh.code);
 	if (store)
-	  fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+	  fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
 	dprintf("The new reference day is %s\n", codeh.code);
       }
       /* Write the UTS time to the code file */
@@ -3423,47 +6166,21 @@ void *writer(void *arg)
       codeh.icode = globalScanNumber;
       uTTimeStr(mon, day, yr, hr, min, sec, codeh.code);
       if (store)
-	fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+	fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
       strcpy(utstring, codeh.code);
 
       /* Write "vrad" string to the code file */
-      strcpy(codeh.v_name, "vrad");
-      codeh.icode = globalScanNumber;
-      vRadial = scanCopy.header.loData.vRadial = 0.0;
-      if (fabs(vRadial) <= 100000000.0)
-	sprintf(codeh.code, "%12.1f", vRadial);
-      else
-	sprintf(codeh.code, "%21.14e", vRadial);
-      codeh.ncode = strlen(codeh.code);
-      if (store)
-	fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
-      thisVRadId++;
+      vRadial = scan->header.loData.vRadial = 0.0;
+      thisVRadId = sourceCatalogVRad(&sources, globalScanNumber, vRadial, &codeh,
+				     store ? codesOut : NULL);
 
       /*
-	Go through the source list to see if we already have written
-	the source name in this data set
+	Look the source up in the catalog, which writes its name to the
+	code file if it has not been seen before
       */
-      strcpy(scanCopy.header.antavg[lowestAntennaNumber].sourceName, globalSourceName);
-      for (source = 0; source < nSources; source++)
-	if (strncmp(sourceList[source],
-		    scanCopy.header.antavg[lowestAntennaNumber].sourceName, 25) == 0)
-	  break;
-
-      /* If there was no match, 
-	 update source list and write new code header */
-      if ((source == nSources) || (nSources == 0)) {
-	strcpy(sourceList[nSources],
-	       scanCopy.header.antavg[lowestAntennaNumber].sourceName);
-	nSources++;
-	strcpy(codeh.v_name, "source");
-	codeh.icode = nSources;
-	strncpy(codeh.code,
-		scanCopy.header.antavg[lowestAntennaNumber].sourceName, 25);
-	printf("...---... Writing source name \"%s\" (\"%s\")\n", codeh.code, globalSourceName);
-	if (store)
-	  fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
-      }
-      thisSourceId = source+1;
+      strcpy(scan->header.antavg[lowestAntennaNumber].sourceName, scan->extra.sourceName);
+      thisSourceId = sourceCatalogSource(&sources, scan->header.antavg[lowestAntennaNumber].sourceName,
+					 &codeh, store ? codesOut : NULL);
       /* 
 	 Put in a new ascii code RA and Dec for each integration. 
 	 If it is not a planet, RA and Dec will not
@@ -3471,23 +6188,23 @@ void *writer(void *arg)
       */
       
       ira = idec = globalScanNumber;
-      rar = scanCopy.header.antavg[lowestAntennaNumber].ra_j2000 * HOURS_TO_RADIANS;
+      rar = scan->header.antavg[lowestAntennaNumber].ra_j2000 * HOURS_TO_RADIANS;
       rar = 1.0;
-      decr = scanCopy.header.antavg[lowestAntennaNumber].dec_j2000 * DEGREES_TO_RADIANS;
+      decr = scan->header.antavg[lowestAntennaNumber].dec_j2000 * DEGREES_TO_RADIANS;
       decr = 0.5;
       codeh.icode = globalScanNumber;
       strcpy(codeh.v_name, "ra");
       coordStr(rar, codeh.code, 0);
       if (store)
-	fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+	fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
       strcpy(codeh.v_name, "dec");
       coordStr(decr, codeh.code, 1);
       if (store)
-	fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+	fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
 
-      strncpy(currentSource, scanCopy.header.antavg[lowestAntennaNumber].sourceName, 23);
+      strncpy(currentSource, scan->header.antavg[lowestAntennaNumber].sourceName, 23);
       currentSource[23] = (char)0;
-      hAMidpoint = calculateUVW(&scanCopy, averageTime, jD) * RADIANS_TO_HOURS;
+      hAMidpoint = calculateUVW(scan, averageTime, jD) * RADIANS_TO_HOURS;
       /*
 	Write plot file stuff - this is the stuff corrPlotter reads, and it has
 	nothing to do with the mir date files.
@@ -3503,9 +6220,9 @@ void *writer(void *arg)
 	else
 	  ePol = 0;
 	polarInt = 0;
-	if (scanCopy.dSMStuff.polarMode == 1)
+	if (scan->dSMStuff.polarMode == 1)
 	  for (ii = 1; ii <= 10; ii++)
-	    switch(scanCopy.dSMStuff.polarStates[ii]) {
+	    switch(scan->dSMStuff.polarStates[ii]) {
 	    case 'R':
 	      polarInt += 1 << (3*ii);
 	      break;
@@ -3530,26 +6247,26 @@ void *writer(void *arg)
 	  int ii;
 
 	  for (ii = 1; ii < 5; ii++)
-	    scanCopy.header.antavg[ii].isvalid[0] = 1;
+	    scan->header.antavg[ii].isvalid[0] = 1;
 	}
 	if (receiverActive[rx]) {
 	  if (store && (!((rx != effRx) && doubleBandwidth))) {
-	    fprintf(plotFile[rx], "%s ", scanCopy.header.antavg[lowestAntennaNumber].sourceName);
-	    fprintf(plotFile[rx], "%f %f %f %f %d ", averageTime, hAMidpoint, decr,
+	    fprintf(plotOut[rx], "%s ", scan->header.antavg[lowestAntennaNumber].sourceName);
+	    fprintf(plotOut[rx], "%f %f %f %f %d ", averageTime, hAMidpoint, decr,
 		    (pCFreq[effRx][0][ePol]+pCFreq[effRx][1][ePol])/bDAIFSep,
-		    scanCopy.header.antavg[lowestAntennaNumber].obstype);
+		    scan->header.antavg[lowestAntennaNumber].obstype);
 	  }
 	  for (sb = 0; sb < numberOfSidebands; sb++) {
 	    for (ant1 = 1; ant1 < MAX_ANT+1; ant1++) {
 	      for (ant2 = 1; ant2 < MAX_ANT+1; ant2++) {
-		printf("...---... isvalid test %d %d %d %d\n", ant1, ant2, scanCopy.header.antavg[ant1].isvalid[0], (scanCopy.header.antavg[ant2].isvalid[0]));
-		if ((scanCopy.header.antavg[ant1].isvalid[0] != 1) ||
-		    (scanCopy.header.antavg[ant2].isvalid[0] != 1))
+		dprintf("...---... isvalid test %d %d %d %d\n", ant1, ant2, scan->header.antavg[ant1].isvalid[0], (scan->header.antavg[ant2].isvalid[0]));
+		if ((scan->header.antavg[ant1].isvalid[0] != 1) ||
+		    (scan->header.antavg[ant2].isvalid[0] != 1))
 		  flag = -1;
 		else
 		  flag = 1;
-		printf("...---... Amp check: pCAmp[%d][%d][%d][%d][%d] = %f\n",
-		       effRx, ant1, ant2, sb, ePol, pCAmp[effRx][ant1][ant2][sb][ePol]);
+		dprintf("...---... Amp check: pCAmp[%d][%d][%d][%d][%d] = %f\n",
+			effRx, ant1, ant2, sb, ePol, pCAmp[effRx][ant1][ant2][sb][ePol]);
 		if ((ant1 < ant2) &&
 		    (pCAmp[effRx][ant1][ant2][sb][ePol] == pCAmp[effRx][ant1][ant2][sb][ePol])) {
 		  /*
@@ -3570,10 +6287,10 @@ void *writer(void *arg)
 		    pCAmp[0][ant1][ant2][sb][ePol] = sqrt((rt*rt) + (it*it));
 		    pCPhase[0][ant1][ant2][sb][ePol] = atan2(it, rt);
 		  }
-		  printf("...---... Before test %d %d %d %d   %d \n", store, rx, effRx, doubleBandwidth,
-			 store && (!((rx != effRx) && doubleBandwidth)));
+		  dprintf("...---... Before test %d %d %d %d   %d \n", store, rx, effRx, doubleBandwidth,
+			  store && (!((rx != effRx) && doubleBandwidth)));
 		  if (store && (!((rx != effRx) && doubleBandwidth)))
-		    fprintf(plotFile[rx], "%d %d %d %e %e %e ",
+		    fprintf(plotOut[rx], "%d %d %d %e %e %e ",
 			    ant1, ant2, flag,
 			    pCAmp[effRx][ant1][ant2][sb][ePol],
 			    pCPhase[effRx][ant1][ant2][sb][ePol],
@@ -3584,7 +6301,7 @@ void *writer(void *arg)
 	    } /* for (ant1 = 1; ant1 < MAX_ANT+1; ant1++) */
 	  } /* for (sb = 0; sb < numberOfSidebands; sb++) */
 	  if (store && (!((rx != effRx) && doubleBandwidth)))
-	    fprintf(plotFile[rx], " %08x\n", polarInt);
+	    fprintf(plotOut[rx], " %08x\n", polarInt);
 	}
       } /* End of loop over rx */
       /*
@@ -3597,16 +6314,16 @@ void *writer(void *arg)
 	Write the engineering data file stuff
       */
       for (crate = 0; crate <= MAX_CRATE; crate++) {
-	if (scanCopy.received[crate]) {
-	  if (scanCopy.data[crate]->blockNumber < 4) {
-	    setStart = 0; setStop = scanCopy.data[crate]->set.set_len; setInc = 1;
+	if (scan->received[crate]) {
+	  if (scan->data[crate]->blockNumber < 4) {
+	    setStart = 0; setStop = scan->data[crate]->set.set_len; setInc = 1;
 	  } else {
-	    setStart = scanCopy.data[crate]->set.set_len - 1; setStop = -1; setInc = -1;
+	    setStart = scan->data[crate]->set.set_len - 1; setStop = -1; setInc = -1;
 	  }
 	  for (set = setStart; set != setStop; set += setInc) {
 	    int found;
 	    
-	    ant1 = scanCopy.data[crate]->set.set_val[set].antennaNumber[1];
+	    ant1 = scan->data[crate]->set.set_val[set].antennaNumber[1];
 	    found = FALSE;
 	    i = 0;
 	    while ((i < nAntennas) && (!found)) {
@@ -3617,7 +6334,7 @@ void *writer(void *arg)
 	    }
 	    if (!found)
 	      foundAntennaList[nAntennas++] = ant1;
-	    ant2 = scanCopy.data[crate]->set.set_val[set].antennaNumber[2];
+	    ant2 = scan->data[crate]->set.set_val[set].antennaNumber[2];
 	    found = FALSE;
 	    i = 0;
 	    while ((i < nAntennas) && (!found)) {
@@ -3634,9 +6351,9 @@ void *writer(void *arg)
       if (store)
 	for (ant1 = 0; ant1 < nAntennas; ant1++)
 	  writeEngData(foundAntennaList[ant1],
-		       scanCopy.padList[foundAntennaList[ant1]],
-		       scanCopy.header.antavg[foundAntennaList[ant1]],
-		       engFile);
+		       scan->padList[foundAntennaList[ant1]],
+		       scan->header.antavg[foundAntennaList[ant1]],
+		       engOut);
       
       /*
 	Write the baseline file stuff - this is a mir file.
@@ -3665,18 +6382,18 @@ void *writer(void *arg)
 	  strcpy(codeh.v_name, "blcd"); 
 	  sprintf(codeh.code, "%d-%d", bslnIndx[bl].ant1, bslnIndx[bl].ant2);
 	  if (store)
-	    fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+	    fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
 	}
       
       /* Write our any new spectral chunk codes we need to */
       for (crate = 0; crate <= MAX_CRATE; crate++) {
-	if (scanCopy.received[crate]) {
+	if (scan->received[crate]) {
 	  int sch;
 
-	  if (scanCopy.data[crate]->blockNumber < 4) {
-	    setStart = 0; setStop = scanCopy.data[crate]->set.set_len; setInc = 1;
+	  if (scan->data[crate]->blockNumber < 4) {
+	    setStart = 0; setStop = scan->data[crate]->set.set_len; setInc = 1;
 	  } else {
-	    setStart = scanCopy.data[crate]->set.set_len - 1; setStop = -1; setInc = -1;
+	    setStart = scan->data[crate]->set.set_len - 1; setStop = -1; setInc = -1;
 	  }
 	  for (sch = 1; sch <= 24; sch++) {
 	    if (chunkCodes[0][sch] == UNINITIALIZED) {
@@ -3687,7 +6404,7 @@ void *writer(void *arg)
 	      codeh.icode = codeh.ncode = chunkCodes[0][sch];
 	      sprintf(codeh.code, "s%02d", sch);
 	      if (store)
-		fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+		fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
 	      dprintf("Setting chunkCodes[%d][%d] = %d, code = \"%s\"\n", 0, sch, chunkCodes[0][sch], codeh.code);
 	    }
 	  }
@@ -3701,7 +6418,7 @@ void *writer(void *arg)
 		codeh.icode = codeh.ncode = chunkCodes[1][sch];
 		sprintf(codeh.code, "s%02d", sch);
 		if (store)
-		  fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+		  fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
 		dprintf("Setting chunkCodes[%d][%d] = %d, code = \"%s\"\n", 0, sch, chunkCodes[1][sch], codeh.code);
 	      }
 	    }
@@ -3713,7 +6430,7 @@ void *writer(void *arg)
 	      codeh.icode = codeh.ncode = chunkCodes[1][sch];
 	      sprintf(codeh.code, "s%02d", sch);
 	      if (store)
-		fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesFile);
+		fwrite_unlocked(&codeh, sizeof(codehDef), 1, codesOut);
 	    }
 	  }
 	}
@@ -3805,7 +6522,7 @@ void *writer(void *arg)
 		for (band = 0; band < nBands[rx]; band++)
 		  if (!((rx == 1) && (band == 0) && doubleBandwidth)) {
 		    specOffset[rx][sb][pol][bl][band] = sch.nbyt / sizeof(short);
-		    if ((nChannels[rx][bandIndx[rx][band]] < 0) || (nChannels[rx][bandIndx[rx][band]] > N_SWARM_CHUNK_POINTS))
+		    if ((nChannels[rx][bandIndx[rx][band]] < 0) || (nChannels[rx][bandIndx[rx][band]] > MAX_SWARM_CHUNK_POINTS))
 		      fprintf(stderr, "nChannels[%d][%d] = %d - nothing good will come from that!\n",
 			      rx, band, nChannels[rx][bandIndx[rx][band]]);
 		    sch.nbyt += sizeof(short)*(2*nChannels[rx][bandIndx[rx][band]] + 1);
@@ -3839,19 +6556,19 @@ void *writer(void *arg)
       sph.nrec     = 1;                      /*  # of records w/i inh#     */
 
       if (doubleBandwidth) {
-	printf("Double bandwidth\n");
+	dprintf("Double bandwidth\n");
 	i1Stop = numberOfSidebands;
 	i2Stop = numberOfPolarizations;
 	i3Stop = numberOfBaselines;
 	i4Stop = MAX_RX;
       } else {
-	printf("NOT double bandwidth\n");
+	dprintf("NOT double bandwidth\n");
 	i1Stop = MAX_RX;
 	i2Stop = numberOfSidebands;
 	i3Stop = numberOfPolarizations;
 	i4Stop = numberOfBaselines;
       }
-      printf("*********** %d, %d, %d, %d\n", i1Stop, i2Stop, i3Stop, i4Stop);
+      dprintf("*********** %d, %d, %d, %d\n", i1Stop, i2Stop, i3Stop, i4Stop);
       for (ind1 = 0; ind1 < i1Stop; ind1++) {
 	int effectiveRx, firstBand, stopBand, bandInc;
 	float u, v, baselineTsys;
@@ -3886,8 +6603,8 @@ void *writer(void *arg)
 		blh[rx][sb][bl].blhid     = blhid; /*    proj. baseline id #       */
 		blh[rx][sb][bl].inhid     = inhid; /*    integration id #          */
 		blh[rx][sb][bl].isb       = sb;    /*    sideband int code         */
-		blh[rx][sb][bl].ipol      = polarStateCode(pol, scanCopy.dSMStuff, ant1, ant2);
-		if ((!fullPolarization) && ((scanCopy.header.antavg[ant1].obstype &
+		blh[rx][sb][bl].ipol      = polarStateCode(pol, scan->dSMStuff, ant1, ant2);
+		if ((!fullPolarization) && ((scan->header.antavg[ant1].obstype &
 					     SRC_TYPE_FLUX_CALIBRATOR)))
 		  blh[rx][sb][bl].ant1rx  = 1;
 		if (fullPolarization) {
@@ -3915,7 +6632,7 @@ void *writer(void *arg)
 		  }
 		} else
 		  blh[rx][sb][bl].ant2rx = 0;
-		if (scanCopy.dSMStuff.pointingMode == 0)
+		if (scan->dSMStuff.pointingMode == 0)
 		  blh[rx][sb][bl].pointing = 1;     /* ipoint offset flag */
 		else
 		  blh[rx][sb][bl].pointing = 0;
@@ -3923,7 +6640,7 @@ void *writer(void *arg)
 		if (fullPolarization)
 		  blh[rx][sb][bl].irec = 1; /* 345 GHz */
 		else {
-		  switch (scanCopy.header.antavg[ant1].rx[effectiveRx]) {
+		  switch (scan->header.antavg[ant1].rx[effectiveRx]) {
 		  case 1: case 2:
 		    blh[rx][sb][bl].irec = 0; /* 230 GHz */
 		    break;
@@ -3940,11 +6657,11 @@ void *writer(void *arg)
 		    blh[rx][sb][bl].irec = 0;
 		  }
 		}
-		u = scanCopy.u[ant1][ant2]/lambda/1000.0;
-		v = scanCopy.v[ant1][ant2]/lambda/1000.0;
-		blh[rx][sb][bl].u = scanCopy.u[ant1][ant2]/lambda/1000.0;
-		blh[rx][sb][bl].v = scanCopy.v[ant1][ant2]/lambda/1000.0;
-		blh[rx][sb][bl].w = scanCopy.w[ant1][ant2]/lambda/1000.0;
+		u = scan->u[ant1][ant2]/lambda/1000.0;
+		v = scan->v[ant1][ant2]/lambda/1000.0;
+		blh[rx][sb][bl].u = scan->u[ant1][ant2]/lambda/1000.0;
+		blh[rx][sb][bl].v = scan->v[ant1][ant2]/lambda/1000.0;
+		blh[rx][sb][bl].w = scan->w[ant1][ant2]/lambda/1000.0;
 		/*    projected baseline        */
 		blh[rx][sb][bl].prbl = sqrtf(u*u + v*v);
 		blh[rx][sb][bl].avedhrs = averageTime; /*    hrs offset from ref-time  */
@@ -3971,11 +6688,13 @@ void *writer(void *arg)
 		blh[rx][sb][bl].iblcd   = reverseBslnIndx[ant1][ant2][0];
 		/*    baseline int code         */
 		/* Use local coords for MIR instead of geocentric from SMA */
-		blh[rx][sb][bl].ble     = scanCopy.padE[ant1] - scanCopy.padE[ant2]; /*    bsl east vector  */
-		blh[rx][sb][bl].bln     = scanCopy.padN[ant1] - scanCopy.padN[ant2]; /*    bsl north vector */
-		blh[rx][sb][bl].blu     = scanCopy.padU[ant1] - scanCopy.padU[ant2]; /*    bsl up vector    */
-    		if (store && (!doubleBandwidth || (rx == doubleBandwidthRx)))
-		  fwrite_unlocked(&blh[rx][sb][bl], sizeof(blhDef), 1, baselineFile);
+		blh[rx][sb][bl].ble     = scan->padE[ant1] - scan->padE[ant2]; /*    bsl east vector  */
+		blh[rx][sb][bl].bln     = scan->padN[ant1] - scan->padN[ant2]; /*    bsl north vector */
+		blh[rx][sb][bl].blu     = scan->padU[ant1] - scan->padU[ant2]; /*    bsl up vector    */
+    		if (store && (!doubleBandwidth || (rx == doubleBandwidthRx))) {
+		  fwrite_unlocked(&blh[rx][sb][bl], sizeof(blhDef), 1, baselineOut);
+		  indexRecord.nBaselines++;
+		}
 		
 		if (doubleBandwidth) {
 		  if (rx == 0) {
@@ -3997,14 +6716,14 @@ void *writer(void *arg)
 		for (band = firstBand; band != stopBand; band += bandInc) {
 		  crate = cSIndx[rx][ant1][ant2][pol][bandIndx[rx][band]].crate;
 		  if ((crate >= 1) && (crate <= 12)) {
-		    sph.corrblock = scanCopy.data[crate]->blockNumber; /* Correlator block number */
-		    sph.corrchunk = scanCopy.data[crate]->crateNumber; /* Correlator chunk number */
+		    sph.corrblock = scan->data[crate]->blockNumber; /* Correlator block number */
+		    sph.corrchunk = scan->data[crate]->crateNumber; /* Correlator chunk number */
                                                                        /* (NOT sxx chunk number)  */
 		  } else
 		    sph.corrblock = sph.corrchunk = 0;
 		  set   = cSIndx[rx][ant1][ant2][pol][bandIndx[rx][band]].set;
 		  if (set > -1)
-		    sph.corrblock = scanCopy.data[crate]->set.set_val[set].chunkNumber;
+		    sph.corrblock = scan->data[crate]->set.set_val[set].chunkNumber;
 		  else
 		    sph.corrchunk = 0; /* Indicates pseudo-continuum data */
 		  if (band == 0) {
@@ -4014,40 +6733,31 @@ void *writer(void *arg)
 		    phase = pCPhase[0][ant1][ant2][sb][0] * DEGREES_TO_RADIANS;
 		    pCReal = amp*cos(phase);
 		    pCImag = amp*sin(phase);
-		    if (!((rx == 1) && doubleBandwidth)) {
-		      if ((packData(1,
-				    scanCopy.data[lowestCrateNumber]->intTime,
-				    &pCReal,
-				    &pCImag,
-				    &sch.packdata[specOffset[rx][sb][0][bl][band]]) == -1) &&
-			  (reportAllErrors)) {
-			fprintf(stderr, "packdata returned error for cont channel rx: %d sb: %d bl: %d band: %d\n",
-				rx, sb, bl, band);
-		      }
-		    }
+		    if (!((rx == 1) && doubleBandwidth))
+		      packJobAdd(1,
+				 scan->data[lowestCrateNumber]->intTime,
+				 &pCReal,
+				 &pCImag,
+				 &sch.packdata[specOffset[rx][sb][0][bl][band]],
+				 rx, sb, bl, band, set, crate);
 		  } else {
-		    if ((crate >= 0) && (set >= 0)) {
-		      if ((packData(nChannels[rx][bandIndx[rx][band]],
-				    scanCopy.data[lowestCrateNumber]->intTime,
-				    &scanCopy.data[crate]->set.set_val[set].real.real_val[sb].channel.channel_val[0],
-				    &scanCopy.data[crate]->set.set_val[set].imag.imag_val[sb].channel.channel_val[0],
-				    &sch.packdata[specOffset[rx][sb][pol][bl][band]]) == -1) &&
-			  (reportAllErrors)) {
-			fprintf(stderr,
-				"packdata returned error for set: %d crate: %d rx: %d sb: %d bl: %d band: %d\n",
-				set, crate, rx, sb, bl, band);
-		      }
-		    }
+		    if ((crate >= 0) && (set >= 0))
+		      packJobAdd(nChannels[rx][bandIndx[rx][band]],
+				 scan->data[lowestCrateNumber]->intTime,
+				 &scan->data[crate]->set.set_val[set].real.real_val[sb].channel.channel_val[0],
+				 &scan->data[crate]->set.set_val[set].imag.imag_val[sb].channel.channel_val[0],
+				 &sch.packdata[specOffset[rx][sb][pol][bl][band]],
+				 rx, sb, bl, band, set, crate);
 		  }
 		  sphid++;
 		  sph.sphid   = sphid;             /*  spectrum id #             */
 		  sph.blhid   = blh[rx][sb][bl].blhid; /*  proj. baseline id # (already in network order)      */
-		  if (scanCopy.header.antavg[lowestAntennaNumber].obstype &
+		  if (scan->header.antavg[lowestAntennaNumber].obstype &
 		      SRC_TYPE_GAIN_CALIBRATOR)  
 		    sph.igq   = 1;
 		  else
 		    sph.igq   = 0;
-		  if (scanCopy.header.antavg[lowestAntennaNumber].obstype &
+		  if (scan->header.antavg[lowestAntennaNumber].obstype &
 		      SRC_TYPE_BANDPASS_CALIBRATOR)  
 		    sph.ipq   = 1;
 		  else
@@ -4070,16 +6780,17 @@ void *writer(void *arg)
 		    sph.fsky  = pCFreq[effectiveRx][sb][pol]/1.0e9;
 		    sph.vel   = 0.0;
 		  } else {
-		    if (nChannels[rx][bandIndx[rx][band]] == N_SWARM_CHUNK_POINTS) {
-		      sph.fsky  = scanCopy.sWARMFreq[sb][bandIndx[rx][band]-49];
+		    /* s chunks 49 and up are SWARM's, whatever their number of channels */
+		    if (bandIndx[rx][band] >= 49) {
+		      sph.fsky  = scan->sWARMFreq[sb][bandIndx[rx][band]-49];
 		      sph.vel   = 0.0;
 		    } else {
-		      sph.fsky  = scanCopy.chunkFreq[rx][sb][bandIndx[rx][band]]/1.0e9;
+		      sph.fsky  = scan->chunkFreq[rx][sb][bandIndx[rx][band]]/1.0e9;
 		      sph.vel   = 0.0;
 		    }
 		  }
 		  /*  center sky freq. GHz */
-		  if (nChannels[rx][bandIndx[rx][band]] == N_SWARM_CHUNK_POINTS) {
+		  if ((band != 0) && (bandIndx[rx][band] >= 49)) {
 		    sph.vres = (-SPEED_OF_LIGHT * (SWARM_CHUNK_FULL_BANDWIDTH)/(float)nChannels[rx][bandIndx[rx][band]]
 				* 1.0e-12) / sph.fsky;
 		    sph.fres = (SWARM_CHUNK_FULL_BANDWIDTH * 1.0E-6)/(float)nChannels[rx][bandIndx[rx][band]];
@@ -4107,7 +6818,7 @@ void *writer(void *arg)
 		    sph.fres *= -1.0;
 		    sph.vres *= -1.0;
 		  }
-		  sph.integ  = scanCopy.data[lowestCrateNumber]->intTime; /*  integration time          */
+		  sph.integ  = scan->data[lowestCrateNumber]->intTime; /*  integration time          */
 		  /*
 		    K L U D G E
 		    
@@ -4123,44 +6834,44 @@ void *writer(void *arg)
                   if (fullPolarization) {
                     switch (pol) {
                     case 0: /* hh */
-                      baselineTsys = sqrt(scanCopy.header.antavg[ant1].tsys_rx2 *
-					  scanCopy.header.antavg[ant2].tsys_rx2);
+                      baselineTsys = sqrt(scan->header.antavg[ant1].tsys_rx2 *
+					  scan->header.antavg[ant2].tsys_rx2);
                       break;
                     case 1: /* vv */
-                      baselineTsys = sqrt(scanCopy.header.antavg[ant1].tsys *
-					  scanCopy.header.antavg[ant2].tsys);
+                      baselineTsys = sqrt(scan->header.antavg[ant1].tsys *
+					  scan->header.antavg[ant2].tsys);
                       break;
                     case 2: /* hv */
-                      baselineTsys = sqrt(scanCopy.header.antavg[ant1].tsys_rx2 *
-					  scanCopy.header.antavg[ant2].tsys);
+                      baselineTsys = sqrt(scan->header.antavg[ant1].tsys_rx2 *
+					  scan->header.antavg[ant2].tsys);
                       break;
                     default: /* better be vh */
-                      baselineTsys = sqrt(scanCopy.header.antavg[ant1].tsys *
-					  scanCopy.header.antavg[ant2].tsys_rx2);
+                      baselineTsys = sqrt(scan->header.antavg[ant1].tsys *
+					  scan->header.antavg[ant2].tsys_rx2);
                     }
                   } else {
                     if (rx == 0) {
-                      if ((scanCopy.header.antavg[ant1].tsys <= 0.0) &&
-                          (scanCopy.header.antavg[ant2].tsys <= 0.0))
+                      if ((scan->header.antavg[ant1].tsys <= 0.0) &&
+                          (scan->header.antavg[ant2].tsys <= 0.0))
                         baselineTsys = 1000.0;
-                      else if (scanCopy.header.antavg[ant1].tsys <= 0.0)
-                        baselineTsys = scanCopy.header.antavg[ant2].tsys;
-                      else if (scanCopy.header.antavg[ant2].tsys <= 0.0)
-                        baselineTsys = scanCopy.header.antavg[ant1].tsys;
+                      else if (scan->header.antavg[ant1].tsys <= 0.0)
+                        baselineTsys = scan->header.antavg[ant2].tsys;
+                      else if (scan->header.antavg[ant2].tsys <= 0.0)
+                        baselineTsys = scan->header.antavg[ant1].tsys;
                       else
-                        baselineTsys = sqrt(scanCopy.header.antavg[ant1].tsys *
-					    scanCopy.header.antavg[ant2].tsys);
+                        baselineTsys = sqrt(scan->header.antavg[ant1].tsys *
+					    scan->header.antavg[ant2].tsys);
                     } else {
-                      if ((scanCopy.header.antavg[ant1].tsys_rx2 <= 0.0) &&
-                          (scanCopy.header.antavg[ant2].tsys_rx2 <= 0.0))
+                      if ((scan->header.antavg[ant1].tsys_rx2 <= 0.0) &&
+                          (scan->header.antavg[ant2].tsys_rx2 <= 0.0))
                         baselineTsys = 1000.0;
-                      else if (scanCopy.header.antavg[ant1].tsys_rx2 <= 0.0)
-                        baselineTsys = scanCopy.header.antavg[ant2].tsys_rx2;
-                      else if (scanCopy.header.antavg[ant2].tsys_rx2 <= 0.0)
-                        baselineTsys = scanCopy.header.antavg[ant1].tsys_rx2;
+                      else if (scan->header.antavg[ant1].tsys_rx2 <= 0.0)
+                        baselineTsys = scan->header.antavg[ant2].tsys_rx2;
+                      else if (scan->header.antavg[ant2].tsys_rx2 <= 0.0)
+                        baselineTsys = scan->header.antavg[ant1].tsys_rx2;
                       else
-                        baselineTsys = sqrt(scanCopy.header.antavg[ant1].tsys_rx2 *
-					    scanCopy.header.antavg[ant2].tsys_rx2);
+                        baselineTsys = sqrt(scan->header.antavg[ant1].tsys_rx2 *
+					    scan->header.antavg[ant2].tsys_rx2);
                     }
                   }
 		  if (isnan(baselineTsys))
@@ -4169,8 +6880,8 @@ void *writer(void *arg)
                   if ((baselineTsys < 1.0) || (baselineTsys > 99999.9))
                     baselineTsys = 99999.9;
 		  
-                  if ((scanCopy.header.antavg[ant1].isvalid[0] != 1) ||
-                      (scanCopy.header.antavg[ant2].isvalid[0] != 1) || spoilScanFlag) {
+                  if ((scan->header.antavg[ant1].isvalid[0] != 1) ||
+                      (scan->header.antavg[ant2].isvalid[0] != 1) || scan->extra.spoilScan) {
                     flag = -1;
                     if (antOnline[ant1] && antOnline[ant2])
                       thisScanWasGood = FALSE;
@@ -4178,23 +6889,36 @@ void *writer(void *arg)
                     flag = 1;
 
 		  sph.wt        = 1.0;
+		  /* A chunk missing from a partial SWARM integration is all NaNs */
+		  if ((band != 0) && (crate >= 0) && (set >= 0) &&
+		      isnan(scan->data[crate]->set.set_val[set].real.real_val[sb].channel.channel_val[0]))
+		    sph.wt = 0.0;
 		  sph.flags     = weh.flags[bslnIndx[bl].ant1] | weh.flags[bslnIndx[bl].ant2];
-		  if (spoilScanFlag)
+		  if (scan->extra.spoilScan)
 		    sph.flags |= SFLAG_SOURCE_CHANGE;
 		  sph.flags = 0; /* All lab data flagged good */
 		  sph.integ     = 30.0;
-		  sph.vradcat   = scanCopy.header.loData.vCatalog;
+		  sph.vradcat   = scan->header.loData.vCatalog;
 		  sph.nch       = nChannels[rx][bandIndx[rx][band]]; /* # channels in spectrum */
 		  sph.dataoff   = specOffset[rx][sb][pol][bl][band] * sizeof(short); /* byte offset for data   */
 		  if (doubleBandwidth && (isnan(sph.rfreq) || (sph.rfreq == 0.0))) {
 		    if (rx == 0)
-		      sph.rfreq     = scanCopy.header.loData.restFrequency[1]/1.0e9;
+		      sph.rfreq     = scan->header.loData.restFrequency[1]/1.0e9;
 		    else
-		      sph.rfreq     = scanCopy.header.loData.restFrequency[0]/1.0e9;
+		      sph.rfreq     = scan->header.loData.restFrequency[0]/1.0e9;
 		  }
 		  sph.rfreq     = 230.538;
 		  if (store && ((!((rx == 1) && (band == 0))) || (!doubleBandwidth)) ) {
-		    fwrite_unlocked(&sph, sizeof(sphDef), 1, spFile);
+		    fwrite_unlocked(&sph, sizeof(sphDef), 1, spOut);
+		    if (indexNSpectra >= indexMaxSpectra) {
+		      indexMaxSpectra = 2*indexMaxSpectra + 1024;
+		      indexDataOff = (int *)realloc(indexDataOff, indexMaxSpectra*sizeof(int));
+		      if (indexDataOff == NULL) {
+			perror("writer: realloc of indexDataOff");
+			exit(ERROR);
+		      }
+		    }
+		    indexDataOff[indexNSpectra++] = sph.dataoff;
 		  }
 		} /* End loop over bands */
 	      } /* End of loop over baselines */
@@ -4226,8 +6950,8 @@ void *writer(void *arg)
 	antenna.
       */
   
-      az = scanCopy.header.antavg[lowestAntennaNumber].actual_az;
-      el = scanCopy.header.antavg[lowestAntennaNumber].actual_el;
+      az = scan->header.antavg[lowestAntennaNumber].actual_az;
+      el = scan->header.antavg[lowestAntennaNumber].actual_el;
   
       /*
 	Keto Komment:
@@ -4239,7 +6963,7 @@ void *writer(void *arg)
       
       /* Keto Komment: integration header initialization */
 
-      inh.traid     = scanCopy.header.antavg[lowestAntennaNumber].project_id; /* track id # */
+      inh.traid     = scan->header.antavg[lowestAntennaNumber].project_id; /* track id # */
       inh.inhid     = globalScanNumber; /* integration id #          */
       inh.ints      = globalScanNumber; /* integration               */
       inh.az        = az;               /* azimuth                   */
@@ -4248,17 +6972,17 @@ void *writer(void *arg)
       inh.iut       = globalScanNumber; /* ut int code               */
       inh.iref_time = iRefTime;         /* ref_time int code         */
       inh.dhrs      = averageTime;      /* hrs from ref_time         */
-      inh.vc        = (scanCopy.header.loData.vRadial - scanCopy.header.loData.vCatalog)/1.e3; /* vcorr for vctype          */
+      inh.vc        = (scan->header.loData.vRadial - scan->header.loData.vCatalog)/1.e3; /* vcorr for vctype          */
       inh.sx        = cos(decr)*cos(hAMidpoint * 15.0 * DEGREES_TO_RADIANS);  /* x vec. for bsl.           */
       inh.sy        = -cos(decr)*sin(hAMidpoint * 15.0 * DEGREES_TO_RADIANS); /* y vec. for bsl.           */
       inh.sz        = sin(decr);                                              /* z vec. for bsl.           */
-      inh.rinteg    = scanCopy.data[lowestCrateNumber]->intTime; /* actual int time */
+      inh.rinteg    = scan->data[lowestCrateNumber]->intTime; /* actual int time */
       inh.proid     = inh.traid;        /* project id #              */
       inh.souid     = thisSourceId;     /* source id #               */
       inh.isource   = thisSourceId;     /* source int code           */
       inh.ivrad     = thisVRadId;       /* position int code         */
-      inh.offx      = scanCopy.header.antavg[lowestAntennaNumber].delta_ra;  /* offset in x */
-      inh.offy      = scanCopy.header.antavg[lowestAntennaNumber].delta_dec; /* offset in y */
+      inh.offx      = scan->header.antavg[lowestAntennaNumber].delta_ra;  /* offset in x */
+      inh.offy      = scan->header.antavg[lowestAntennaNumber].delta_dec; /* offset in y */
       inh.ira       = ira;                          /* ra int code               */
       inh.idec      = idec;                         /* dec int code              */
       inh.rar       = rar;                          /* ra (radians)              */
@@ -4269,20 +6993,31 @@ void *writer(void *arg)
 	inh.spareint4 = inh.spareint5 = inh.spareint6 = 0; /* Spare ints for later expansion */
       inh.sparedbl1 = inh.sparedbl2 = inh.sparedbl3 = 
 	inh.sparedbl4 = inh.sparedbl5 = inh.sparedbl6 = 0.0; /* Spare doubles for later expansion */
-      obsType = scanCopy.header.antavg[lowestAntennaNumber].obstype;
+      obsType = scan->header.antavg[lowestAntennaNumber].obstype;
 	dprintf("obstype = 0x%x\n", obsType);
       if ((obsType & SRC_TYPE_PLANET) ||
-	  (scanCopy.header.antavg[lowestAntennaNumber].sol_sys_flag != 0)) {
-	inh.size    = scanCopy.header.antavg[lowestAntennaNumber].planet_size;
+	  (scan->header.antavg[lowestAntennaNumber].sol_sys_flag != 0)) {
+	inh.size    = scan->header.antavg[lowestAntennaNumber].planet_size;
 	dprintf("Setting source size to %f\n", inh.size);
       }                                    /* source size               */
       if (store)
-	fwrite_unlocked(&inh, sizeof(inhDef), 1, inFile);
+	fwrite_unlocked(&inh, sizeof(inhDef), 1, inOut);
 
       dprintf("Number of receivers: %d Number of sidebands: %d  numberOfBaselines: %d   averageTime %f\n",
 	      numberOfReceivers, numberOfSidebands, numberOfBaselines, averageTime);
-      if (store)
-	schWrite(&sch, schFile);
+      /* Pack all the spectra listed above, with the help of the PACKER threads */
+      packJobsRun();
+      latencyRecord(&stageLatency[LATENCY_PACK], latencyNow() - startTimeDouble);
+      if (store) {
+	if (schCodec)
+	  schWriteFrame(&sch, schOut);
+	else
+	  schWrite(&sch, schOut);
+	indexRecord.inhid      = inhid;
+	indexRecord.nSpectra   = indexNSpectra;
+	fwrite_unlocked(indexDataOff, sizeof(int), indexNSpectra, dataoffOut);
+	fwrite_unlocked(&indexRecord, sizeof(indexRecord), 1, indexOut);
+      }
       free(sch.packdata);
       if (doDSMWrite) {
 #ifdef dadadaadada
@@ -4308,9 +7043,9 @@ void *writer(void *arg)
 	  pathNameChanged = FALSE;
 	}
 	for (ii = 0; ii < MAX_ANT+1; ii++) {
-	  dSMTsys[ii][0] = scanCopy.header.antavg[ii].tsys;
-	  dSMTsys[ii][1] = scanCopy.header.antavg[ii].tsys_rx2;
-	  dSMAntStatus[ii] = scanCopy.header.antavg[ii].isvalid[0];
+	  dSMTsys[ii][0] = scan->header.antavg[ii].tsys;
+	  dSMTsys[ii][1] = scan->header.antavg[ii].tsys_rx2;
+	  dSMAntStatus[ii] = scan->header.antavg[ii].isvalid[0];
 	  for (jj = 0; jj < MAX_ANT+1; jj++)
 	    for (kk = 0; kk < MAX_SB; kk++) {
 	      if (fullPolarization) {
@@ -4372,32 +7107,23 @@ void *writer(void *arg)
 	  perror("writer: dsm write time to Hal failed");
 	}
 	dSMStatus = dsm_write("hal9000", "DSM_AS_SCAN_CORNUM_L",
-			      (char *)&(scanCopy.data[lowestCrateNumber]->scanNumber));
+			      (char *)&(scan->data[lowestCrateNumber]->scanNumber));
 	if (dSMStatus != DSM_SUCCESS) {
 	  dsm_error_message(dSMStatus, "dsm_write");
 	  perror("writer: dsm write c num to Hal failed");
 	}
 	*/
       } /* End of if (doDSMWrite) */
-      if (store)
-	for (rx = 0; rx < MAX_RX; rx++)
-	  if (receiverActive[rx] && (!((rx != doubleBandwidthRx) && doubleBandwidth)))
-	    fflush_unlocked(plotFile[rx]);
-      fflush_unlocked(baselineFile);
-      fflush_unlocked(weFile);
-      fflush_unlocked(tsysFile);
-      fflush_unlocked(codesFile);
-      fflush_unlocked(engFile);
-      fflush_unlocked(inFile);
-      fflush_unlocked(spFile);
-      fflush_unlocked(schFile);
-      writeAutoData(globalScanNumber);
+      writeAutoData(globalScanNumber, batch);
+      outputBatchSubmit(batch);
     } else /* End of if (lowestAntennaNumber > 0) */
       fprintf(stderr, "writer: No active antennas in scan - will not write anything\n");
     tempScanNumber = globalScanNumber++;
-    deleteScan(&scanCopy, FALSE);
-    needWrite = FALSE;
-    pthread_mutex_unlock(&writeScanMutex);
+    /* Return the scan's slot to the scan table */
+    pthread_mutex_lock(&scanMutex);
+    releaseScan(scan, TRUE);
+    pthread_cond_broadcast(&copyDoneCond);
+    pthread_mutex_unlock(&scanMutex);
     clock_gettime(CLOCK_REALTIME, &stopTime);
     stopTimeDouble = ((double)stopTime.tv_sec) + ((double)stopTime.tv_nsec)*1.0e-9;
     thisTime = stopTimeDouble-startTimeDouble;
@@ -4417,13 +7143,15 @@ void *writer(void *arg)
   R E A D  C O N F I G  F I L E S
 
   readConfigFiles reads the files used to establish the state of the server.
-  At this moment, the only configuration file is the one which specifies
-  which chunks should be ignored when calculating the pseudo-continuum
-  channel.
+  The main configuration file is the one which specifies which chunks
+  should be ignored when calculating the pseudo-continuum channel.
+  The existence of the file dataCatcherHugePages turns on the use of
+  huge pages for the scan arenas.
 */
 void readConfigFiles(void)
 {
   int rx, ant1, ant2, chunk, line;
+  char fileName[100+MAX_SITE_ROOT];
   FILE *badChunks;
 
   for (rx = 0; rx < MAX_RX+1; rx++)
@@ -4432,7 +7160,14 @@ void readConfigFiles(void)
 	for (chunk = 0; chunk < MAX_BLOCK*MAX_CHUNK + MAX_INTERIM_CHUNK + 1; chunk++)
 	  goodChunk[rx][ant1][ant2][chunk] = TRUE;
 
-  badChunks = fopen("/global/configFiles/badChunks.txt", "r");
+  useHugePages = (access(sitePath("/global/configFiles/dataCatcherHugePages", fileName), F_OK) == 0);
+  if (useHugePages)
+    printf("readConfigFiles: scan arenas will use huge pages\n");
+  congestionCodes = (access(sitePath("/global/configFiles/dataCatcherCongestion", fileName), F_OK) == 0);
+  if (congestionCodes)
+    printf("readConfigFiles: replies will carry congestion codes\n");
+
+  badChunks = siteFopen("/global/configFiles/badChunks.txt", "r");
   if (badChunks == NULL) {
     fprintf(stderr, "readConfigFiles: no badChunks file seen - all chunks will be considered good\n");
   } else {
@@ -4498,18 +7233,32 @@ void signalHandler(int signum)
 	    signum);
 } /* End of signalHandler */
 
+/*
+  S T A R T   T H R E A D S
+
+  startThreads reads the configuration and starts the threads, the first
+  time it is called.   The RPC calls, and storeStreamFrame(), call it, so
+  by default the threads start with the first call.   The receiver set up
+  below depends on doubleBandwidth and fullPolarization, which are set
+  outside this file, so it must not run before they are.   A site whose
+  SWARM data all come over the STREAM port gets no RPC call to start the
+  STREAM listener, so main() in dataCatcher_svc_modified.c must call
+  startThreads() itself, once its own initialization, including any
+  fork(), is done.
+*/
 void startThreads(void)
 {
   static int firstCall = TRUE;
 
+  pthread_mutex_lock(&startMutex);
   if (firstCall) {
-    int rx1, rx2, nRx, rCode;
+    int i, rx1, rx2, nRx, rCode;
     pthread_attr_t attr;
     struct sched_param fifo_param;
     struct sigaction action, oldAction;
     FILE *scratchFile;
     
-    scratchFile = fopen("/global/projects/receiversInArray", "r");
+    scratchFile = siteFopen("/global/projects/receiversInArray", "r");
     if (scratchFile == NULL) {
       perror("receiversInArray");
       exit(-1);
@@ -4554,9 +7303,52 @@ void startThreads(void)
     */
 
     readConfigFiles();
+    scanTableInit();
+    swarmGeometryInit();
+    swarmKernelsInit();
+    outputDurabilityInit();
+    schCompressionInit();
+    packKernelsInit();
+    captureInit();
+
+    /*
+      A SWARM sender or latency client which resets its connection would
+      otherwise kill dataCatcher with SIGPIPE when the reply is written.
+      The write fails with EPIPE instead, and the connection is dropped.
+    */
+    signal(SIGPIPE, SIG_IGN);
     
     /*   C R E A T E   T H R E A D S   */
 
+    /*
+      L O G G E R   T H R E A D
+
+      The LOGGER thread alone writes to the console, so it gets ordinary
+      time sharing scheduling, below all the FIFO threads, and is started
+      first, so that their messages all go through their log rings.
+    */
+    if (pthread_attr_init(&attr) == ERROR) {
+      perror("catch_visibilities_1: pthread_attr_init logger attr");
+      exit(ERROR);
+    }
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    fifo_param.sched_priority = 0;
+    pthread_attr_setschedparam(&attr, &fifo_param);
+    if (pthread_create(&loggerTId, &attr, ringLogDrain,
+		       (void *) 12) == ERROR) {
+      perror("catch_visibilities_1: pthread_create logger");
+      fprintf(stderr, "thread create failure\n");
+    }
+
+    /*   C A P T U R E R   T H R E A D   */
+    if ((captureFile != NULL) &&
+	(pthread_create(&capturerTId, &attr, capturer, (void *) 12) == ERROR)) {
+      perror("catch_visibilities_1: pthread_create capturer");
+      fprintf(stderr, "thread create failure\n");
+    }
+    pthread_attr_destroy(&attr);
+
     if (pthread_attr_init(&attr) == ERROR) {
       perror("catch_visibilities_1: pthread_attr_init attr");
       exit(ERROR);
@@ -4573,6 +7365,15 @@ void startThreads(void)
       fprintf(stderr, "thread create failure\n");
     }
     
+    /*   F E T C H E R   T H R E A D   */
+    fifo_param.sched_priority = FETCHER_PRIORITY;
+    pthread_attr_setschedparam(&attr, &fifo_param);
+    if (pthread_create(&fetcherTId, &attr, headerFetcher,
+		       (void *) 12) == ERROR) {
+      perror("catch_visibilities_1: pthread_create fetcher");
+      fprintf(stderr, "thread create failure\n");
+    }
+    
     /*   W R I T E R   T H R E A D   */
     fifo_param.sched_priority = WRITER_PRIORITY;
     pthread_attr_setschedparam(&attr, &fifo_param);
@@ -4591,6 +7392,53 @@ void startThreads(void)
       fprintf(stderr, "thread create failure\n");
     }
 
+    /*   P R E P A R E R   T H R E A D   */
+    fifo_param.sched_priority = PREPARER_PRIORITY;
+    pthread_attr_setschedparam(&attr, &fifo_param);
+    if (pthread_create(&preparerTId, &attr, preparer,
+		       (void *) 12) == ERROR) {
+      perror("catch_visibilities_1: pthread_create preparer");
+      fprintf(stderr, "thread create failure\n");
+    }
+
+    /*   O U T P U T   T H R E A D S   */
+    fifo_param.sched_priority = OUTPUT_PRIORITY;
+    pthread_attr_setschedparam(&attr, &fifo_param);
+    for (i = 0; i < OUTPUT_THREADS; i++)
+      if (pthread_create(&outputTId[i], &attr, outputWriter,
+			 (void *)((long)i)) == ERROR) {
+	perror("catch_visibilities_1: pthread_create outputWriter");
+	fprintf(stderr, "thread create failure\n");
+      }
+
+    /*   P A C K E R   T H R E A D S   */
+    fifo_param.sched_priority = PACKER_PRIORITY;
+    pthread_attr_setschedparam(&attr, &fifo_param);
+    for (i = 0; i < PACKER_THREADS; i++)
+      if (pthread_create(&packerTId[i], &attr, packer,
+			 (void *)((long)i)) == ERROR) {
+	perror("catch_visibilities_1: pthread_create packer");
+	fprintf(stderr, "thread create failure\n");
+      }
+
+    /*   S T R E A M   T H R E A D   */
+    fifo_param.sched_priority = STREAM_PRIORITY;
+    pthread_attr_setschedparam(&attr, &fifo_param);
+    if (pthread_create(&streamTId, &attr, streamServer,
+                       (void *) 12) == ERROR) {
+      perror("catch_visibilities_1: pthread_create streamServer");
+      fprintf(stderr, "thread create failure\n");
+    }
+
+    /*   L A T E N C Y   T H R E A D   */
+    fifo_param.sched_priority = LATENCY_PRIORITY;
+    pthread_attr_setschedparam(&attr, &fifo_param);
+    if (pthread_create(&latencyTId, &attr, latencyServer,
+                       (void *) 12) == ERROR) {
+      perror("catch_visibilities_1: pthread_create latencyServer");
+      fprintf(stderr, "thread create failure\n");
+    }
+
     /*   E S T A B L I S H   S I G N A L   H A N D L E R  */
     action.sa_flags = 0;
     sigemptyset(&action.sa_mask);
@@ -4599,30 +7447,26 @@ void startThreads(void)
     
     firstCall = FALSE;
   }
+  pthread_mutex_unlock(&startMutex);
 }
 
 /*
   The following is the main RPC service function.
   The first call launches the threads HEADER and WRITER.
+  Each thread calling it gets its own result structure, so that
+  the RPC service may dispatch calls from several threads at once.
 */
-dStatusStructure *result;
 dStatusStructure *catch_visibilities_1(dCrateUVBlock *bundle, CLIENT *cl)
 {
   /* short restarting; */
   /* int rCode; */
   /* int dSMStatus; */
-  static int firstCall = TRUE;
+  static __thread dStatusStructure threadResult;
+  dStatusStructure *result = &threadResult;
   /* time_t timestamp; */
   
-  if (firstCall) {
-    result = (dStatusStructure *)malloc(sizeof(*result));
-    if (result == NULL) {
-      perror("catch_visibilities_1: malloc of result structure");
-      exit(ERROR);
-    }
-    firstCall = FALSE;
-  }
   startThreads();
+  capturePayload(CAPTURE_VISIBILITIES, (xdrproc_t)xdr_dCrateUVBlock, bundle);
   dprintf("catch_visibilities_1:\tGot a bundle from crate %d, time: %f, string: %s\n",
 	  bundle->crateNumber, bundle->UTCtime,
 	  bundle->sourceName); fflush(stdout);
@@ -4638,7 +7482,8 @@ dStatusStructure *catch_visibilities_1(dCrateUVBlock *bundle, CLIENT *cl)
   }
   */
   fflush(stdout);
-  processBundle(bundle);
+  processBundle(bundle, NULL);
+  result->rt_code = congestionCode(result->rt_code);
   return(result);
 } /* End of catch_visibilities_1 */
 
@@ -4651,12 +7496,9 @@ dStatusStructure *catch_visibilities_1_svc(dCrateUVBlock *block, struct svc_req
 {
   CLIENT *cl = NULL;
 
-    result = catch_visibilities_1(block, cl);
-    return result;
+    return catch_visibilities_1(block, cl);
 } /* End of catch_visibilities_1_svc */
 
-dStatusStructure *result2, *result3;
-
 /*
 
   C A T C H _ P O W E R S _ 1
@@ -4667,28 +7509,22 @@ dStatusStructure *result2, *result3;
  */
 dStatusStructure *catch_powers_1(dPowerSet *cratePower, CLIENT *cl)
 {
-  static int firstCall = TRUE;
   static int headerWritten = FALSE;
+  static __thread dStatusStructure threadResult;
+  dStatusStructure *result = &threadResult;
   int nAdjustments[3][9];
   float power[9][2][5], controlVoltages[3][9];
-  char fileName[100];
+  char fileName[100+MAX_SITE_ROOT];
   /* static dsm_structure c1DCStructure; */
   /* time_t timestamp; */
   FILE *powerLog;
 
-  if (firstCall) {
-    result2 = (dStatusStructure *)malloc(sizeof(*result2));
-    if (result2 == NULL) {
-      perror("malloc of result2");
-      exit(-1);
-    }
-    /*
-    dSMStatus = dsm_structure_init(&c1DCStructure, "C1DC_STATUS_X");
-    if (dSMStatus != DSM_SUCCESS)
-      perror("dsm_structure_init(&c1DCStructure, C1DC_STATUS_X)");
-    */
-    firstCall = FALSE;
-  }
+  capturePayload(CAPTURE_POWERS, (xdrproc_t)xdr_dPowerSet, cratePower);
+  /*
+  dSMStatus = dsm_structure_init(&c1DCStructure, "C1DC_STATUS_X");
+  if (dSMStatus != DSM_SUCCESS)
+    perror("dsm_structure_init(&c1DCStructure, C1DC_STATUS_X)");
+  */
   if (haveLOData) {
     if (!headerWritten) {
       sprintf(fileName,"%s/c2DCPowerDetectors.txt", pathName);
@@ -4734,7 +7570,7 @@ dStatusStructure *catch_powers_1(dPowerSet *cratePower, CLIENT *cl)
     if (dSMStatus != DSM_SUCCESS)
       perror("get_element N_ADJUSTMENTS");
     */
-    printf("Crate %d called catch_powers_1\n", cratePower->crate);
+    dprintf("Crate %d called catch_powers_1\n", cratePower->crate);
     bcopy((char *)&(cratePower->data[0]), (char *)&power[0][0][0], 9*2*5*sizeof(float));
     sprintf(fileName,"%s/c2DCPowerDetectors.txt", pathName);
     powerLog = fopen(fileName, "a");
@@ -4760,8 +7596,8 @@ dStatusStructure *catch_powers_1(dPowerSet *cratePower, CLIENT *cl)
       fclose(powerLog);
     }
   }
-  result2->rt_code = OK;
-  return(result2);
+  result->rt_code = OK;
+  return(result);
 } /* End of catch_powers_1 */
 
 /*
@@ -4775,33 +7611,129 @@ dStatusStructure *catch_powers_1_svc(dPowerSet *powerSet, struct svc_req *dummy)
 {
   CLIENT *cl = NULL;
 
-  result2 = catch_powers_1(powerSet, cl);
-  return result2;
+  return catch_powers_1(powerSet, cl);
 } /* End of catch_powers_1_svc */
 
 typedef struct sWARMChunk {
   int filled;
-  float lSBReal[N_SWARM_CHUNK_POINTS];
-  float lSBImag[N_SWARM_CHUNK_POINTS];
-  float uSBReal[N_SWARM_CHUNK_POINTS];
-  float uSBImag[N_SWARM_CHUNK_POINTS];
+  float *lSBReal;
+  float *lSBImag;
+  float *uSBReal;
+  float *uSBImag;
 } sWARMChunk;
 
+/*
+  All the chunks for a SWARM scan are carved out of a single visBuffer,
+  so that the completed scan can be passed on to processBundle() without
+  copying the spectra.   Each scan keeps the geometry it was built with,
+  so that a change to the swarmGeometry can't confuse a scan in progress.
+
+  Up to SWARM_SLOTS integrations may be assembled at once, in the
+  preallocated sWARMSlots, so that data from the next integration
+  can arrive before the current one is complete.
+*/
 typedef struct sWARMSScan {
+  int active;                          /* TRUE if this slot holds an integration */
+  int flushing;                        /* TRUE while a finished integration is   */
+                                       /* being passed on, outside the sWARMMutex */
+  unsigned int serial;                 /* Order in which the slots were started  */
   double uT;
   double duration;
-  sWARMChunk *data[9][9][2];
+  double deadline;                     /* Wall clock time after which the scan   */
+                                       /* is flushed, even if incomplete         */
+  int nExpected;                       /* Number of chunks the scan needs        */
+  int nFilled;                         /* Number of chunks received so far       */
+  int nAntennas, nChunks, nChannels;
+  visBuffer *storage;
+  sWARMChunk *data[MAX_ANT+1][MAX_ANT+1][MAX_SWARM_CHUNK];
 } sWARMScan;
 
-void destroySWARMScan(sWARMScan *scan) {
+sWARMScan sWARMSlots[SWARM_SLOTS];
+unsigned int nextSWARMSerial = 0;
+double flushedSWARMUT[SWARM_FLUSHED_MEMORY]; /* uTs of the integrations most recently flushed */
+int nFlushedSWARMUT = 0;                    /* Number of them, ever, so far                 */
+
+/*
+  S W A R M   U T   F L U S H E D
+
+  sWARMUTFlushed returns TRUE if uT is the time of one of the last
+  SWARM_FLUSHED_MEMORY integrations to be flushed, so that late data
+  for any of them is discarded, rather than starting a new integration.
+  The sWARMMutex must be held.
+*/
+int sWARMUTFlushed(double uT)
+{
+  int i, n;
+
+  n = (nFlushedSWARMUT < SWARM_FLUSHED_MEMORY) ? nFlushedSWARMUT : SWARM_FLUSHED_MEMORY;
+  for (i = 0; i < n; i++)
+    if (fabs(flushedSWARMUT[i] - uT) <= SWARM_SLOP)
+      return(TRUE);
+  return(FALSE);
+} /* End of sWARMUTFlushed */
+
+/*
+  S T A R T   S W A R M   S C A N
+
+  startSWARMScan sets up a free slot for the integration at uT, for the
+  current swarmGeometry.   Only those baselines whose antennas are both
+  in the array get spectra.   The storage comes from the sWARMBufferPool,
+  so normally nothing is allocated.
+*/
+void startSWARMScan(sWARMScan *scan, double uT, double duration)
+{
   int a1, a2, ch;
+  size_t spectrumSize;
+  char *nextSpectrum;
+  sWARMChunk *nextChunk;
+  struct timespec now;
+
+  scan->nAntennas = swarm.nAntennas;
+  scan->nChunks = swarm.nChunks;
+  scan->nChannels = swarm.nChannels;
+  scan->nExpected = scan->nFilled = 0;
+  for (a1 = 1; a1 < scan->nAntennas; a1++)
+    for (a2 = a1+1; a2 <= scan->nAntennas; a2++)
+      if (antennaInArray[a1] && antennaInArray[a2])
+	scan->nExpected += scan->nChunks;
+  spectrumSize = scan->nChannels*sizeof(float);
+  scan->storage = sWARMBufferGet(scan->nExpected*(4*spectrumSize + sizeof(sWARMChunk)));
+  nextSpectrum = scan->storage->data;
+  nextChunk = (sWARMChunk *)(scan->storage->data + scan->nExpected*4*spectrumSize);
+  bzero((char *)scan->data, sizeof(scan->data));
+  for (a1 = 1; a1 < scan->nAntennas; a1++)
+    for (a2 = a1+1; a2 <= scan->nAntennas; a2++)
+      if (antennaInArray[a1] && antennaInArray[a2])
+	for (ch = 0; ch < scan->nChunks; ch++) {
+	  scan->data[a1][a2][ch] = nextChunk++;
+	  scan->data[a1][a2][ch]->filled = FALSE;
+	  scan->data[a1][a2][ch]->lSBReal = (float *)nextSpectrum;
+	  scan->data[a1][a2][ch]->lSBImag = (float *)(nextSpectrum + spectrumSize);
+	  scan->data[a1][a2][ch]->uSBReal = (float *)(nextSpectrum + 2*spectrumSize);
+	  scan->data[a1][a2][ch]->uSBImag = (float *)(nextSpectrum + 3*spectrumSize);
+	  nextSpectrum += 4*spectrumSize;
+	}
+  clock_gettime(CLOCK_REALTIME, &now);
+  scan->uT = uT;
+  scan->duration = duration;
+  scan->serial = nextSWARMSerial++;
+  scan->deadline = ((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9 +
+    duration + SWARM_FLUSH_DELAY;
+  scan->active = TRUE;
+} /* End of startSWARMScan */
 
-  for (a1 = 1; a1 < 8; a1++)
-    for (a2 = a1+1; a2 <= 8; a2++)
-      for (ch = 0; ch < 2; ch++)
-	if (scan->data[a1][a2][ch])
-	  free(scan->data[a1][a2][ch]);
-  free(scan);
+/*
+  D E S T R O Y   S W A R M   S C A N
+
+  destroySWARMScan frees up a slot.   The storage goes back to the
+  sWARMBufferPool once the pending scan list and the WRITER are
+  done with it.
+*/
+void destroySWARMScan(sWARMScan *scan) {
+  visBufferRelease(scan->storage);
+  scan->storage = NULL;
+  scan->active = FALSE;
+  scan->flushing = FALSE;
 }
 
 dCrateUVBlock *sWARMBundle;
@@ -4815,12 +7747,14 @@ about the SWARM correlator data.
 
  */
 void sWARM2Bundle(sWARMScan *scan) {
-  int a1, a2, set, ch, sb, i;
+  int a1, a2, set, ch, sb;
   int nBaselines = 0;
   static int firstCall = TRUE;
+  static int nSetsAllocated = 0;
+  static dVarArray *varArrays = NULL;
   dVisibilitySet *vis;
 
-  printf("I'm in sWARM2Bundle\n");
+  dprintf("I'm in sWARM2Bundle\n");
   if (firstCall) {
     sWARMBundle = (dCrateUVBlock *)malloc(sizeof(*sWARMBundle));
     if (sWARMBundle == NULL) {
@@ -4829,8 +7763,8 @@ void sWARM2Bundle(sWARMScan *scan) {
     }
     firstCall = FALSE;
   }
-  for (a1 = 1; a1 < 8; a1++)
-    for (a2 = a1+1; a2 <= 8; a2++)
+  for (a1 = 1; a1 < scan->nAntennas; a1++)
+    for (a2 = a1+1; a2 <= scan->nAntennas; a2++)
       if (scan->data[a1][a2][0])
 	nBaselines++;
   sprintf(sWARMBundle->sourceName, "SWARM Data");
@@ -4841,19 +7775,32 @@ void sWARM2Bundle(sWARMScan *scan) {
   sWARMBundle->intTime     = scan->duration;
   if (sWARMBundle->intTime <= 0.0)
     sWARMBundle->intTime = 29.6827667;
-  sWARMBundle->set.set_len = 2*nBaselines;
-  sWARMBundle->set.set_val = (dVisibilitySet *)malloc(sWARMBundle->set.set_len*sizeof(dVisibilitySet));
-  if (sWARMBundle->set.set_val == NULL) {
-    perror("malloc of SWARM sWARMBundle->set.set_val");
-    exit(ERROR);
+  sWARMBundle->set.set_len = scan->nChunks*nBaselines;
+  /* The sets are kept from one scan to the next, and only grown if need be */
+  if (sWARMBundle->set.set_len > nSetsAllocated) {
+    if (nSetsAllocated > 0) {
+      free(sWARMBundle->set.set_val);
+      free(varArrays);
+    }
+    sWARMBundle->set.set_val = (dVisibilitySet *)malloc(sWARMBundle->set.set_len*sizeof(dVisibilitySet));
+    if (sWARMBundle->set.set_val == NULL) {
+      perror("malloc of SWARM sWARMBundle->set.set_val");
+      exit(ERROR);
+    }
+    varArrays = (dVarArray *)malloc(4*sWARMBundle->set.set_len*sizeof(dVarArray));
+    if (varArrays == NULL) {
+      perror("malloc of SWARM varArrays");
+      exit(ERROR);
+    }
+    nSetsAllocated = sWARMBundle->set.set_len;
   }
   set = 0;
-  for (a1 = 1; a1 < 8; a1++)
-    for (a2 = a1+1; a2 <= 8; a2++)
+  for (a1 = 1; a1 < scan->nAntennas; a1++)
+    for (a2 = a1+1; a2 <= scan->nAntennas; a2++)
       if (scan->data[a1][a2][0]) {
-	for (ch = 0; ch < 2; ch++) {
+	for (ch = 0; ch < scan->nChunks; ch++) {
 	  vis = &sWARMBundle->set.set_val[set];
-	  vis->nPoints = N_SWARM_CHUNK_POINTS;
+	  vis->nPoints = scan->nChannels;
 	  vis->lags.channel.channel_len = 0;
 	  vis->lags.channel.channel_val = NULL;
 	  vis->chunkNumber = ch+1;
@@ -4862,128 +7809,209 @@ void sWARM2Bundle(sWARMScan *scan) {
 	  vis->antennaNumber[1] = a1;
 	  vis->antennaNumber[2] = a2;
 	  vis->real.real_len = 2;
-	  vis->real.real_val = (dVarArray *)malloc(2*sizeof(dVarArray));
-	  if (vis->real.real_val == NULL) {
-	    perror("vis->real.real_val");
-	    exit(-1);
-	  }
+	  vis->real.real_val = &varArrays[4*set];
 	  vis->imag.imag_len = 2;
-	  vis->imag.imag_val = (dVarArray *)malloc(2*sizeof(dVarArray));
-	  if (vis->imag.imag_val == NULL) {
-	    perror("vis->imag.imag_val");
-	    exit(-1);
-	  }	  
+	  vis->imag.imag_val = &varArrays[4*set + 2];
+	  /* Point at the spectra in the scan's visBuffer, rather than copying them */
 	  for (sb = 0; sb < 2; sb++) {
-	    vis->real.real_val[sb].channel.channel_len = N_SWARM_CHUNK_POINTS;
-	    vis->real.real_val[sb].channel.channel_val = (float *)malloc(N_SWARM_CHUNK_POINTS*sizeof(float));
-	    if (vis->real.real_val[sb].channel.channel_val == NULL) {
-	      perror("vis->real.real_val[sb].channel.channel_val");
-	      exit(-1);
-	    }
-	    vis->imag.imag_val[sb].channel.channel_len = N_SWARM_CHUNK_POINTS;
-	    vis->imag.imag_val[sb].channel.channel_val = (float *)malloc(N_SWARM_CHUNK_POINTS*sizeof(float));
-	    if (vis->imag.imag_val[sb].channel.channel_val == NULL) {
-	      perror("vis->imag.imag_val[sb].channel.channel_val");
-	      exit(-1);
-	    }
-	    /* Copy over the actual data */
-	    for (i = 0; i < N_SWARM_CHUNK_POINTS; i++) {
-	      if (sb == 0) {
-		vis->real.real_val[sb].channel.channel_val[i] =
-		  scan->data[vis->antennaNumber[1]][vis->antennaNumber[2]][ch]->lSBReal[i];
-		vis->imag.imag_val[sb].channel.channel_val[i] =
-		  scan->data[vis->antennaNumber[1]][vis->antennaNumber[2]][ch]->lSBImag[i];
-	      } else {
-		vis->real.real_val[sb].channel.channel_val[i] =
-		  scan->data[vis->antennaNumber[1]][vis->antennaNumber[2]][ch]->uSBReal[i];
-		vis->imag.imag_val[sb].channel.channel_val[i] =
-		  scan->data[vis->antennaNumber[1]][vis->antennaNumber[2]][ch]->uSBImag[i];
-	      }
+	    vis->real.real_val[sb].channel.channel_len = scan->nChannels;
+	    vis->imag.imag_val[sb].channel.channel_len = scan->nChannels;
+	    if (sb == 0) {
+	      vis->real.real_val[sb].channel.channel_val = scan->data[a1][a2][ch]->lSBReal;
+	      vis->imag.imag_val[sb].channel.channel_val = scan->data[a1][a2][ch]->lSBImag;
+	    } else {
+	      vis->real.real_val[sb].channel.channel_val = scan->data[a1][a2][ch]->uSBReal;
+	      vis->imag.imag_val[sb].channel.channel_val = scan->data[a1][a2][ch]->uSBImag;
 	    }
 	  }
 	  set++;
 	}
       }
   /* printBundleInfo(sWARMBundle); */
-  printf("Calling processBundle(sWARMBundle)\n");
-  processBundle(sWARMBundle);
-  printf("Returned from processBundle(sWARMBundle)\n");
-
-  /* Now clean up all the malloc'd storage, except what never changes.  */
-  set = 0;
-  for (a1 = 1; a1 < 8; a1++)
-    for (a2 = a1+1; a2 <= 8; a2++)
-      if (scan->data[a1][a2][0]) {
-	for (ch = 0; ch < 2; ch++) {
-	  vis = &sWARMBundle->set.set_val[set];
-	  for (sb = 0; sb < 2; sb++) {
-	    free(vis->real.real_val[sb].channel.channel_val);
-	    free(vis->imag.imag_val[sb].channel.channel_val);
-	  }
-	  free(vis->real.real_val);
-	  free(vis->imag.imag_val);
-	  set++;
-	}
-      }
-  free(sWARMBundle->set.set_val);
+  dprintf("Calling processBundle(sWARMBundle)\n");
+  processBundle(sWARMBundle, scan->storage);
+  dprintf("Returned from processBundle(sWARMBundle)\n");
 }
 
 /*
-  C A T C H _ S W A R M _ D A T A _ 1
+  C O L L E C T   S W A R M   S L O T S
+
+  collectSWARMSlots finds the SWARM integrations which are finished, and
+  puts them in ready, oldest first, for passOnSWARMScans().   An
+  integration is finished when all its chunks have arrived, or when its
+  deadline has passed, in which case the missing chunks are filled with
+  NaNs, SWARM's own mark for data it could not produce.   That keeps them
+  out of the pseudo-continuum, and the WRITER gives them zero weight.   A
+  complete integration waits for any older one still being assembled, so
+  that the SWARM bundles reach the pending scan list in time order.
+  The slots found are marked as flushing, so that they are neither
+  matched nor reused until passOnSWARMScans() frees them.   Returns the
+  number of integrations found.   The sWARMMutex must be held.
+*/
+int collectSWARMSlots(sWARMScan **ready)
+{
+  int i, a1, a2, ch, nReady = 0;
+  double nowDouble;
+  struct timespec now;
+  sWARMScan *oldest;
 
-  The following routine receives the data packages from the SWARM
-  correlator.
+  clock_gettime(CLOCK_REALTIME, &now);
+  nowDouble = ((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9;
+  while (TRUE) {
+    oldest = NULL;
+    for (i = 0; i < SWARM_SLOTS; i++)
+      if (sWARMSlots[i].active && ((oldest == NULL) || (sWARMSlots[i].serial < oldest->serial)))
+	oldest = &sWARMSlots[i];
+    if (oldest == NULL)
+      return(nReady);
+    if (oldest->nFilled < oldest->nExpected) {
+      if (nowDouble < oldest->deadline)
+	return(nReady);
+      ringLog(LOG_WARN, "collectSWARMSlots: SWARM integration at %f has only %d of %d chunks - flushing it\n",
+	        oldest->uT, oldest->nFilled, oldest->nExpected);
+      for (a1 = 1; a1 < oldest->nAntennas; a1++)
+	for (a2 = a1+1; a2 <= oldest->nAntennas; a2++)
+	  for (ch = 0; ch < oldest->nChunks; ch++)
+	    if (oldest->data[a1][a2][ch] && !oldest->data[a1][a2][ch]->filled)
+	      for (i = 0; i < oldest->nChannels; i++)
+		oldest->data[a1][a2][ch]->lSBReal[i] = oldest->data[a1][a2][ch]->lSBImag[i] =
+		  oldest->data[a1][a2][ch]->uSBReal[i] = oldest->data[a1][a2][ch]->uSBImag[i] = NAN;
+    } else
+      dprintf("w00t - I've got a complete SWARM scan to process\n");
+    flushedSWARMUT[(nFlushedSWARMUT++) % SWARM_FLUSHED_MEMORY] = oldest->uT;
+    oldest->active = FALSE;
+    oldest->flushing = TRUE;
+    ready[nReady++] = oldest;
+  }
+} /* End of collectSWARMSlots */
 
- */
-dStatusStructure *catch_swarm_data_1(dSWARMUVBlock *data, CLIENT *cl)
+/*
+  P A S S   O N   S W A R M   S C A N S
+
+  passOnSWARMScans hands the nReady integrations collectSWARMSlots() found
+  to sWARM2Bundle(), and then frees their slots.   It is called with the
+  sWARMMutex held, and releases it, so that more SWARM data can be stored
+  while the bundles go through processBundle().   The sWARMFlushMutex is
+  taken before the sWARMMutex is released, so the bundles stay in time
+  order, and only one thread at a time uses sWARMBundle.
+*/
+void passOnSWARMScans(sWARMScan **ready, int nReady)
 {
-  int i, ant1, ant2, chunk, nChannels;
-  int missingA1 = 0, missingA2 = 0, missingCh = 0;
-  int dataStillMissing = FALSE;
-  static int nANPattern[8];
-  static int gotSomeNANs = FALSE;
-  double uT, duration;
-  static int firstCall = TRUE;
-  static int shouldInit = TRUE;
-  static sWARMScan *scan;
+  int i;
 
-  startThreads();
-  if (firstCall) {
-    result3 = (dStatusStructure *)malloc(sizeof(*result3));
-    if (result3 == NULL) {
-      perror("malloc of result3");
-      exit(-1);
+  if (nReady == 0) {
+    pthread_mutex_unlock(&sWARMMutex);
+    return;
+  }
+  pthread_mutex_lock(&sWARMFlushMutex);
+  pthread_mutex_unlock(&sWARMMutex);
+  for (i = 0; i < nReady; i++)
+    sWARM2Bundle(ready[i]);
+  pthread_mutex_unlock(&sWARMFlushMutex);
+  pthread_mutex_lock(&sWARMMutex);
+  for (i = 0; i < nReady; i++)
+    destroySWARMScan(ready[i]);
+  pthread_cond_broadcast(&sWARMSlotFreeCond);
+  pthread_mutex_unlock(&sWARMMutex);
+} /* End of passOnSWARMScans */
+
+/*
+  F L U S H   S T A L E   S W A R M   S C A N S
+
+  Called once a second by the COPIER thread, so that partial SWARM
+  integrations are flushed at their deadlines even if no more SWARM
+  data arrive.
+*/
+void flushStaleSWARMScans(void)
+{
+  int nReady;
+  sWARMScan *ready[SWARM_SLOTS];
+
+  pthread_mutex_lock(&sWARMMutex);
+  nReady = collectSWARMSlots(ready);
+  passOnSWARMScans(ready, nReady);
+} /* End of flushStaleSWARMScans */
+
+/*
+  F I N D   S W A R M   S C A N
+
+  findSWARMScan returns the slot holding the integration at uT, starting
+  one if need be.   NULL is returned, with *late set TRUE, for late data
+  from an integration which has already been flushed.   If every slot is
+  busy, NULL is returned with *late FALSE, and the oldest integration
+  being assembled has its deadline brought forward, so that
+  collectSWARMSlots() will flush it early to make room.   The sWARMMutex
+  must be held.
+*/
+sWARMScan *findSWARMScan(double uT, double duration, int *late)
+{
+  int i;
+  sWARMScan *freeSlot = NULL, *oldest = NULL;
+
+  *late = FALSE;
+  for (i = 0; i < SWARM_SLOTS; i++)
+    if (sWARMSlots[i].active) {
+      if (fabs(sWARMSlots[i].uT - uT) <= SWARM_SLOP)
+	return(&sWARMSlots[i]);
+      if ((oldest == NULL) || (sWARMSlots[i].serial < oldest->serial))
+	oldest = &sWARMSlots[i];
+    } else if ((freeSlot == NULL) && !sWARMSlots[i].flushing)
+      freeSlot = &sWARMSlots[i];
+  if (sWARMUTFlushed(uT)) {
+    *late = TRUE;
+    return(NULL);
+  }
+  if (freeSlot == NULL) {
+    if (oldest != NULL) {
+      ringLog(LOG_WARN, "findSWARMScan: all %d SWARM slots are busy - flushing the integration at %f\n",
+	      SWARM_SLOTS, oldest->uT);
+      oldest->deadline = 0.0;
     }
-    firstCall = FALSE;
+    return(NULL);
   }
+  startSWARMScan(freeSlot, uT, duration);
+  return(freeSlot);
+} /* End of findSWARMScan */
+
+/*
+  S T O R E   S W A R M   D A T A
+
+  storeSWARMData stores the spectra for one baseline and chunk of a SWARM
+  integration (or one autocorrelation) in the SWARM scan being assembled.
+  When the scan is complete, it is passed on to sWARM2Bundle().   It is
+  used both by catch_swarm_data_1() and by the SWARM stream server, so the
+  sWARMMutex serializes access to the scan under construction.   It is
+  released while completed scans are passed on.
+*/
+int storeSWARMData(int ant1, int ant2, int chunk, int nChannels, double uT,
+		   double duration, float *lSB, float *uSB)
+{
+  int i, late, nReady = 0;
+  static swarmMask nANMask;
+  static int nANMaskInitialized = FALSE;
+  sWARMScan *scan, *ready[SWARM_SLOTS];
+
+  pthread_mutex_lock(&sWARMMutex);
   if (!antennaInArrayInitialized) {
     getAntennaList(&antennaInArray[0]);
     antennaInArrayInitialized = TRUE;
   }
-  if (shouldInit) {
-    scan = (sWARMScan *)malloc(sizeof(sWARMScan));
-    if (scan == NULL) {
-      perror("Malloc failed for SWARM scan\n");
-      exit(ERROR);
-    }
-    for (ant1 = 1; ant1 < 8; ant1++)
-      for (ant2 = ant1+1; ant2 <= 8; ant2++)
-	for (chunk = 0; chunk < 2; chunk++) {
-	  if (antennaInArray[ant1] && antennaInArray[ant2]) {
-	    scan->data[ant1][ant2][chunk] = (sWARMChunk *)malloc(sizeof(sWARMChunk));
-	    if (scan->data[ant1][ant2][chunk] == NULL) {
-	      perror("Malloc failed for SWARM chunk\n");
-	      exit(ERROR);
-	    }
-	    scan->data[ant1][ant2][chunk]->filled = FALSE;
-	  } else
-	    scan->data[ant1][ant2][chunk] = NULL;
-	}
-    scan->uT = -1.0;
-    shouldInit = FALSE;
+  if (!nANMaskInitialized) {
+    int good[SWARM_FID_BLOCK];
+
+    /* Until an autocorrelation shows otherwise, assume all channels are good */
+    for (i = 0; i < SWARM_FID_BLOCK; i++)
+      good[i] = TRUE;
+    swarmMaskSet(good, &nANMask);
+    nANMaskInitialized = TRUE;
+  }
+  if ((ant1 < 1) || (ant1 > swarm.nAntennas) || (ant2 < 1) || (ant2 > swarm.nAntennas) ||
+      (nChannels != swarm.nChannels)) {
+    ringLog(LOG_WARN, "storeSWARMData: unexpected SWARM data (baseline %d-%d, %d channels) - discarding it\n",
+	      ant1, ant2, nChannels);
+    pthread_mutex_unlock(&sWARMMutex);
+    return(ERROR);
   }
-  ant1       = data->ant1;
-  ant2       = data->ant2;
   if (ant1 > ant2) {
     int swapMe;
 
@@ -4991,68 +8019,46 @@ dStatusStructure *catch_swarm_data_1(dSWARMUVBlock *data, CLIENT *cl)
     ant1 = ant2;
     ant2 = swapMe;
   }
-  chunk      = data->chunk;
   if (chunk < 0)
     chunk = 0;
-  if (chunk > 1)
-    chunk = 1;
-  nChannels  = data->nChannels;
-  uT         = data->uT;
-  duration   = data->duration;
-  printf("I got %d points from %d-%d:%d taken at UT %f over %f seconds\n", nChannels, ant1, ant2, chunk, uT, duration);
+  if (chunk > swarm.nChunks-1)
+    chunk = swarm.nChunks-1;
+  dprintf("I got %d points from %d-%d:%d taken at UT %f over %f seconds\n", nChannels, ant1, ant2, chunk, uT, duration);
   if (antennaInArray[ant1] && antennaInArray[ant2]) {
     if (ant1 == ant2) {
       /* It's an autocorrelation */
       sWARMAutoRec *newRec;
       
-      printf("Got an autocorrelation from antenna %d\n", ant1);
+      dprintf("Got an autocorrelation from antenna %d\n", ant1);
+      newRec = (sWARMAutoRec *)malloc(sizeof(sWARMAutoRec));
+      if (newRec == NULL) {
+	perror("new SWARM autocorrelation record");
+	pthread_mutex_unlock(&sWARMMutex);
+	return(ERROR);
+      }
       {
-	int i, j;
-	char sWARMNANPatternString[9];
+	char sWARMNANPatternString[SWARM_FID_BLOCK+1];
 	
-	/* Derive the NAN pattern */
-	gotSomeNANs = FALSE;
-	for (i = 0; i < 8; i++)
-	  if (isnan(data->lSB[i*8])) {
-	    nANPattern[i] = FALSE;
-	    gotSomeNANs = TRUE;
-	  } else
-	    nANPattern[i] = TRUE;
-	for (i = 0; i < 8; i++)
-	  if (nANPattern[i])
+	/*
+	  Derive the NAN pattern, which is used for this and the following
+	  cross-correlations, and copy the spectrum into the new record
+	  with the NANs replaced by the average of the good channels.
+	*/
+	swarmMaskFromAuto(lSB, &nANMask);
+	for (i = 0; i < SWARM_FID_BLOCK; i++)
+	  if (nANMask.good[i])
 	    sWARMNANPatternString[i] = 'D';
 	  else
 	    sWARMNANPatternString[i] = 'N';
-	sWARMNANPatternString[8] = (char)0;
-	printf("NAN pattern is %s\n", sWARMNANPatternString);
-	if (gotSomeNANs) {
-	  /* Now replace the NANs with the average of the good channels */
-	  for (i = 0; i < 256; i++) {
-	    int nGoodData = 0;
-	    float goodDataSum = 0.0;
-	    
-	    for (j = 0; j < 64; j++)
-	      if (nANPattern[j/8]) {
-		goodDataSum += data->lSB[i*64 + j];
-		nGoodData++;
-	      }
-	    goodDataSum /= (float)nGoodData;
-	    for (j = 0; j < 64; j++)
-	      if (!nANPattern[j/8])
-		data->lSB[i*64 + j] = goodDataSum;
-	  }
-	}
-      }
-      newRec = (sWARMAutoRec *)malloc(sizeof(sWARMAutoRec));
-      if (newRec == NULL) {
-	perror("new SWARM autocorrelation record");
-	result3->rt_code = ERROR;
-	return(result3);
+	sWARMNANPatternString[SWARM_FID_BLOCK] = (char)0;
+	dprintf("NAN pattern is %s\n", sWARMNANPatternString);
+	swarmRepairAuto(lSB, newRec->autoData.amp[chunk], nChannels, &nANMask);
+	if (nChannels < MAX_SWARM_CHUNK_POINTS)
+	  bzero((char *)&newRec->autoData.amp[chunk][nChannels],
+		(MAX_SWARM_CHUNK_POINTS - nChannels)*sizeof(float));
       }
       newRec->next = NULL;
       newRec->autoData.antenna = ant1;
-      for (i = 0; i < N_SWARM_CHUNK_POINTS; i++)
-	newRec->autoData.amp[chunk][i] = data->lSB[i];
       pthread_mutex_lock(&autoMutex);
       if (sWARMAutoRoot == NULL) {
 	sWARMAutoRoot = newRec;
@@ -5069,86 +8075,63 @@ dStatusStructure *catch_swarm_data_1(dSWARMUVBlock *data, CLIENT *cl)
       pthread_mutex_unlock(&autoMutex);
     } else {
       dprintf("OK, I need this baseline's data\n");
-      if (gotSomeNANs) {
-	int i, j;
-
-	/* Replace any NANs with the average of the nearby good values */
-	/* printf("___ Doing NAN replacement %d %d %d %d %d %d %d %d\n", */
-	/*        nANPattern[0],nANPattern[1],nANPattern[2],nANPattern[3],nANPattern[4],nANPattern[5],nANPattern[6],nANPattern[7] ); */
-	
-	for (i = 0; i < 256; i++) {
-	  int nGoodData = 0;
-	  float goodLSBReal, goodLSBImag, goodUSBReal, goodUSBImag;
-
-	  goodLSBReal = goodLSBImag = goodUSBReal = goodUSBImag = 0.0;
-	  for (j = 0; j < 64; j++)
-	    if (nANPattern[j/8]) {
-	      goodUSBReal += data->uSB[(i*64 + j)*2];
-	      goodUSBImag += data->uSB[(i*64 + j)*2 + 1];
-	      goodLSBReal += data->lSB[(i*64 + j)*2];
-	      goodLSBImag += data->lSB[(i*64 + j)*2 + 1];
-	      nGoodData++;
-	    }
-	  goodUSBReal /= (float)nGoodData;
-	  goodUSBImag /= (float)nGoodData;
-	  goodLSBReal /= (float)nGoodData;
-	  goodLSBImag /= (float)nGoodData;
-	  for (j = 0; j < 64; j++)
-	    if (!nANPattern[j/8]) {
-	      /* printf("\t___ ch %d, %d  %f %f %f %f\n", (i*64 + j)*2, (i*64 + j)*2 + 1, */
-	      /* 	     goodUSBReal, goodUSBImag, goodLSBReal, goodLSBImag); */
-	      data->uSB[(i*64 + j)*2]     = goodUSBReal;
-	      data->uSB[(i*64 + j)*2 + 1] = goodUSBImag;
-	      data->lSB[(i*64 + j)*2]     = goodLSBReal;
-	      data->lSB[(i*64 + j)*2 + 1] = goodLSBImag;
-	    }
+      while ((scan = findSWARMScan(uT, duration, &late)) == NULL) {
+	if (late) {
+	  ringLog(LOG_WARN, "Late SWARM data received for %d-%d:%d at UT %f - discarding it\n",
+		  ant1, ant2, chunk, uT);
+	  pthread_mutex_unlock(&sWARMMutex);
+	  return(ERROR);
 	}
-      }
-      if (scan->uT == -1.0) {
-	scan->uT = uT;
-      } else {
-	if (fabs(scan->uT - uT) > 1.0)
-	  fprintf(stderr, "SWARM scan times differ by more than 1 second\n");
+	/* Every slot is busy - pass on the oldest, or wait for another thread to */
+	nReady = collectSWARMSlots(ready);
+	if (nReady > 0) {
+	  passOnSWARMScans(ready, nReady);
+	  pthread_mutex_lock(&sWARMMutex);
+	  nReady = 0;
+	} else
+	  pthread_cond_wait(&sWARMSlotFreeCond, &sWARMMutex);
       }
       if (scan->data[ant1][ant2][chunk]->filled) {
-	fprintf(stderr, "Duplicate SWARM scan received - will abort\n");
-	result3->rt_code = ERROR;
-	return(result3);
-      }
-      for (i = 0; i < N_SWARM_CHUNK_POINTS; i++) {
-	scan->data[ant1][ant2][chunk]->lSBReal[i] = data->lSB[2*i];
-	scan->data[ant1][ant2][chunk]->lSBImag[i] = data->lSB[2*i + 1];
-	scan->data[ant1][ant2][chunk]->uSBReal[i] = data->uSB[2*i];
-	scan->data[ant1][ant2][chunk]->uSBImag[i] = data->uSB[2*i + 1];
+	ringLog(LOG_WARN, "Duplicate SWARM data received for %d-%d:%d at UT %f - discarding it\n",
+		  ant1, ant2, chunk, uT);
+	pthread_mutex_unlock(&sWARMMutex);
+	return(ERROR);
       }
+      /* Split out the real and imaginary parts, replacing any NANs as we go */
+      swarmRepairDeinterleave(lSB, scan->data[ant1][ant2][chunk]->lSBReal,
+			      scan->data[ant1][ant2][chunk]->lSBImag, scan->nChannels, &nANMask);
+      swarmRepairDeinterleave(uSB, scan->data[ant1][ant2][chunk]->uSBReal,
+			      scan->data[ant1][ant2][chunk]->uSBImag, scan->nChannels, &nANMask);
       scan->data[ant1][ant2][chunk]->filled = TRUE;
+      scan->nFilled++;
+      dprintf("SWARM integration at %f now has %d of %d chunks\n", scan->uT, scan->nFilled, scan->nExpected);
+      /* Pass on any integrations this completed */
+      if (scan->nFilled == scan->nExpected)
+	nReady = collectSWARMSlots(ready);
     }
   } else
-    printf("Discarding unneeded %d-%d baseline data\n", ant1, ant2);
-  /* Now check to see if we have a complete SWARM scan yet */
-  for (ant1 = 1; ant1 < 8; ant1++)
-    for (ant2 = ant1+1; ant2 <= 8; ant2++)
-      for (chunk = 0; chunk < 2; chunk++)
-	if (scan->data[ant1][ant2][chunk])
-	  if (!scan->data[ant1][ant2][chunk]->filled) {
-	    if (!dataStillMissing) {
-	      missingA1 = ant1;
-	      missingA2 = ant2;
-	      missingCh = chunk;
-	      dataStillMissing = TRUE;
-	    }
-	  }
-  if (dataStillMissing) {
-    dprintf("We're still missing some SWARM data for this scan (%d-%d: %d)\n",
-	   missingA1, missingA2, missingCh);
-  } else {
-    printf("w00t - I've got a complete SWARM scan to process\n");
-    sWARM2Bundle(scan);
-    destroySWARMScan(scan);
-    shouldInit = TRUE;
-  }
-  result3->rt_code = OK;
-  return(result3);
+    dprintf("Discarding unneeded %d-%d baseline data\n", ant1, ant2);
+  passOnSWARMScans(ready, nReady);
+  return(OK);
+} /* End of storeSWARMData */
+
+/*
+  C A T C H _ S W A R M _ D A T A _ 1
+
+  The following routine receives the data packages from the SWARM
+  correlator.
+
+ */
+dStatusStructure *catch_swarm_data_1(dSWARMUVBlock *data, CLIENT *cl)
+{
+  static __thread dStatusStructure threadResult;
+  dStatusStructure *result = &threadResult;
+
+  startThreads();
+  capturePayload(CAPTURE_SWARM_DATA, (xdrproc_t)xdr_dSWARMUVBlock, data);
+  result->rt_code = congestionCode(storeSWARMData(data->ant1, data->ant2, data->chunk, data->nChannels,
+						  data->uT, data->duration, data->lSB, data->uSB));
+  return(result);
 } /* End of catch_swarm_data_1 */
 
 /*
@@ -5161,7 +8144,217 @@ dStatusStructure *catch_swarm_data_1_svc(dSWARMUVBlock *data, struct svc_req *du
 {
   CLIENT *cl = NULL;
 
-  result3 = catch_swarm_data_1(data, cl);
-  return result3;
+  return catch_swarm_data_1(data, cl);
 } /* End of catch_swarm_data_1_svc */
 
+/*
+  R E A D   F U L L Y
+
+  readFully reads exactly nBytes from a socket, returning OK, or ERROR
+  if the connection closed or failed first.
+*/
+int readFully(int fd, void *buffer, size_t nBytes)
+{
+  ssize_t nRead;
+  char *ptr = (char *)buffer;
+
+  while (nBytes > 0) {
+    nRead = read(fd, ptr, nBytes);
+    if (nRead < 0) {
+      if (errno == EINTR)
+	continue;
+      perror("readFully: read");
+      return(ERROR);
+    } else if (nRead == 0)
+      return(ERROR);
+    ptr += nRead;
+    nBytes -= nRead;
+  }
+  return(OK);
+} /* End of readFully */
+
+/*
+  S T O R E   S T R E A M   F R A M E
+
+  storeStreamFrame hands every record of a checked SWARM integration frame
+  to storeSWARMData(), straight out of payload.   The autocorrelations are
+  stored first, because the NaN pattern used to repair the
+  cross-correlations is derived from them.   It returns the rt_code for
+  the frame's swarmStreamReply.   dataCatcherReplay calls it directly.
+*/
+int storeStreamFrame(swarmStreamHeader *header, swarmStreamRecord *table, float *payload)
+{
+  int rec, pass, rCode = OK;
+  float *ptr;
+
+  startThreads();
+  for (pass = 0; pass < 2; pass++) {
+    ptr = payload;
+    for (rec = 0; rec < header->nRecords; rec++) {
+      if (table[rec].ant1 == table[rec].ant2) {
+	if (pass == 0)
+	  if (storeSWARMData(table[rec].ant1, table[rec].ant2, table[rec].chunk, header->nChannels,
+			     header->uT, header->duration, ptr, NULL) != OK)
+	    rCode = ERROR;
+	ptr += header->nChannels;
+      } else {
+	if (pass == 1)
+	  if (storeSWARMData(table[rec].ant1, table[rec].ant2, table[rec].chunk, header->nChannels,
+			     header->uT, header->duration, ptr, ptr + 2*header->nChannels) != OK)
+	    rCode = ERROR;
+	ptr += 4*header->nChannels;
+      }
+    }
+  }
+  return(congestionCode(rCode));
+} /* End of storeStreamFrame */
+
+/*
+  H A N D L E   S T R E A M   F R A M E S
+
+  handleStreamFrames reads SWARM integration frames (see swarmStream.h) from
+  a connected socket, until the sender closes the connection, checks them,
+  and stores them with storeStreamFrame().
+*/
+void handleStreamFrames(int fd)
+{
+  int rec;
+  size_t payloadSize, bufferSize = 0;
+  float *payload = NULL;
+  swarmStreamHeader header;
+  swarmStreamRecord table[SWARM_STREAM_MAX_RECORDS];
+  swarmStreamReply reply;
+
+  reply.magic = SWARM_STREAM_MAGIC;
+  while (readFully(fd, &header, sizeof(header)) == OK) {
+    if ((header.magic != SWARM_STREAM_MAGIC) || (header.version != SWARM_STREAM_VERSION) ||
+	(header.nRecords > SWARM_STREAM_MAX_RECORDS) || (header.nChannels != swarm.nChannels)) {
+      fprintf(stderr,
+	      "handleStreamFrames: bad frame header (magic 0x%x, version %d, %d records, %d channels) - closing connection\n",
+	      header.magic, header.version, header.nRecords, header.nChannels);
+      break;
+    }
+    if (readFully(fd, table, header.nRecords*sizeof(swarmStreamRecord)) != OK)
+      break;
+    payloadSize = 0;
+    for (rec = 0; rec < header.nRecords; rec++) {
+      if ((table[rec].ant1 < 1) || (table[rec].ant1 > swarm.nAntennas) ||
+	  (table[rec].ant2 < 1) || (table[rec].ant2 > swarm.nAntennas)) {
+	fprintf(stderr, "handleStreamFrames: illegal baseline %d-%d in frame - closing connection\n",
+		table[rec].ant1, table[rec].ant2);
+	break;
+      }
+      if (table[rec].ant1 == table[rec].ant2)
+	payloadSize += header.nChannels*sizeof(float);
+      else
+	payloadSize += 4*header.nChannels*sizeof(float);
+    }
+    if (rec < header.nRecords)
+      break;
+    if (payloadSize > bufferSize) {
+      free(payload);
+      payload = (float *)malloc(payloadSize);
+      if (payload == NULL) {
+	perror("handleStreamFrames: malloc of payload");
+	exit(ERROR);
+      }
+      bufferSize = payloadSize;
+    }
+    if (readFully(fd, payload, payloadSize) != OK)
+      break;
+    dprintf("handleStreamFrames: got a frame of %d records for UT %f\n", header.nRecords, header.uT);
+    captureStreamFrame(&header, table, payload, payloadSize);
+    reply.rt_code = storeStreamFrame(&header, table, payload);
+    if (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+      perror("handleStreamFrames: write of reply");
+      break;
+    }
+  }
+  free(payload);
+} /* End of handleStreamFrames */
+
+/*
+  S T R E A M   C O N N E C T I O N
+
+  streamConnection is the main function of a STREAM worker thread,
+  which serves one connection accepted by streamServer().
+*/
+void *streamConnection(void *arg)
+{
+  int fd = (int)((long)arg);
+
+  handleStreamFrames(fd);
+  close(fd);
+  pthread_mutex_lock(&streamMutex);
+  nStreamConnections--;
+  pthread_mutex_unlock(&streamMutex);
+  return(NULL);
+} /* End of streamConnection */
+
+/*
+  S T R E A M   S E R V E R
+
+  streamServer is the main function of the STREAM thread.   It accepts
+  connections on SWARM_STREAM_PORT from SWARM correlator processes which
+  send whole integrations at a time (see swarmStream.h).   Each connection
+  is served by its own worker thread, so a slow sender doesn't hold up
+  the others.
+*/
+void *streamServer(void *arg)
+{
+  int listenFd, fd, on = 1;
+  struct sockaddr_in address;
+  pthread_t workerTId;
+  pthread_attr_t attr;
+
+  printf("Thread STREAM starting\n");
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd < 0) {
+    perror("streamServer: socket");
+    return(NULL);
+  }
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  bzero((char *)&address, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(SWARM_STREAM_PORT);
+  if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    perror("streamServer: bind");
+    close(listenFd);
+    return(NULL);
+  }
+  if (listen(listenFd, 8) < 0) {
+    perror("streamServer: listen");
+    close(listenFd);
+    return(NULL);
+  }
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  while (TRUE) {
+    fd = accept(listenFd, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EINTR)
+	perror("streamServer: accept");
+      continue;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    pthread_mutex_lock(&streamMutex);
+    if (nStreamConnections >= MAX_STREAM_CONNECTIONS) {
+      pthread_mutex_unlock(&streamMutex);
+      fprintf(stderr, "streamServer: already serving %d connections - refusing another\n",
+	      MAX_STREAM_CONNECTIONS);
+      close(fd);
+      continue;
+    }
+    nStreamConnections++;
+    pthread_mutex_unlock(&streamMutex);
+    if (pthread_create(&workerTId, &attr, streamConnection, (void *)((long)fd)) != 0) {
+      perror("streamServer: pthread_create streamConnection");
+      pthread_mutex_lock(&streamMutex);
+      nStreamConnections--;
+      pthread_mutex_unlock(&streamMutex);
+      close(fd);
+    }
+  }
+  return(NULL);
+} /* End of streamServer */
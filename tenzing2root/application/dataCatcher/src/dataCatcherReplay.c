@@ -0,0 +1,264 @@
+/*
+  D A T A C A T C H E R   R E P L A Y
+
+  dataCatcherReplay plays a capture file, recorded by dataCatcher (see
+  captureFile.h), back into a copy of dataCatcher running in the same
+  process, so that production loads can be reproduced offline.   It is
+  linked with dataCatcher.c in place of the RPC service code, and calls
+  catch_visibilities_1(), catch_powers_1() and catch_swarm_data_1()
+  directly, with each call's argument decoded by the same XDR routines
+  the RPC service uses.   Frames captured from the SWARM stream are
+  handed to storeStreamFrame(), as the STREAM thread would.
+
+  Usage: dataCatcherReplay [-r root] [-s speed] [-w seconds] captureFile
+
+  -r root     Look for /global, /common, /data and /tmp under root, so
+              that the replay uses its own configuration files and does
+              not write into the real data directories.   root must hold
+              global/configFiles, global/projects/receiversInArray, and
+              the data/<directory>/mir_data directories the data will go in.
+  -s speed    Replay speed: 1 (the default) replays the calls with the
+              spacing they arrived with, N replays them N times as fast,
+              and "max" (or 0) replays them as fast as dataCatcher takes
+              them.
+  -w seconds  How long to wait, after the last call, for dataCatcher to
+              finish writing, before printing the latency histograms and
+              exiting (default 10).
+
+  In this version of dataCatcher, the statusServer and setLO calls in
+  headerFetchStatusServer() are stood in for by fixed lab values, so the
+  replay needs neither service running.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <rpc/rpc.h>
+#include "dataCatcher.h"
+#include "captureFile.h"
+#include "swarmStream.h"
+
+#define OK (0)
+#define ERROR (-1)
+#define DEFAULT_SETTLE_TIME (10)
+
+/* Functions in dataCatcher.c */
+extern int setSiteRoot(const char *root);
+extern void latencyReport(FILE *out);
+extern int storeStreamFrame(swarmStreamHeader *header, swarmStreamRecord *table, float *payload);
+
+/* replayNow returns the time in seconds since 1970 */
+double replayNow(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return(((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9);
+} /* End of replayNow */
+
+/*
+  replaySleepUntil sleeps until the time when, in seconds since 1970.
+  clock_nanosleep() returns an error number, rather than setting errno,
+  and only EINTR means the sleep should be tried again.
+*/
+void replaySleepUntil(double when)
+{
+  int rCode;
+  struct timespec due;
+
+  due.tv_sec = (time_t)when;
+  due.tv_nsec = (long)((when - (double)due.tv_sec)*1.0e9);
+  while ((rCode = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &due, NULL)) == EINTR);
+  if (rCode != 0)
+    fprintf(stderr, "replaySleepUntil: clock_nanosleep: %s\n", strerror(rCode));
+} /* End of replaySleepUntil */
+
+/*
+  streamFrameSize returns the size of the SWARM stream frame at the start
+  of the length bytes in buffer, as its header and baseline table give
+  it, or 0 if the header or table do not fit in length bytes.
+*/
+unsigned int streamFrameSize(char *buffer, unsigned int length)
+{
+  int rec;
+  unsigned int size;
+  swarmStreamHeader *frame = (swarmStreamHeader *)buffer;
+  swarmStreamRecord *table = (swarmStreamRecord *)(buffer + sizeof(*frame));
+
+  if ((length < sizeof(*frame)) || (frame->nRecords > SWARM_STREAM_MAX_RECORDS) ||
+      (length < sizeof(*frame) + frame->nRecords*sizeof(swarmStreamRecord)))
+    return(0);
+  size = sizeof(*frame) + frame->nRecords*sizeof(swarmStreamRecord);
+  for (rec = 0; rec < frame->nRecords; rec++)
+    size += ((table[rec].ant1 == table[rec].ant2) ? 1 : 4)*frame->nChannels*sizeof(float);
+  return(size);
+} /* End of streamFrameSize */
+
+void usage(char *name)
+{
+  fprintf(stderr, "Usage: %s [-r root] [-s speed|max] [-w seconds] captureFile\n", name);
+  exit(ERROR);
+} /* End of usage */
+
+int main(int argc, char **argv)
+{
+  int option, settleTime = DEFAULT_SETTLE_TIME;
+  int nCalls[CAPTURE_SWARM_STREAM+1], nErrors = 0;
+  unsigned int bufferSize = 0;
+  double speed = 1.0, firstArrival = 0.0, replayStart = 0.0, due, lag, maxLag = 0.0;
+  double lastArrival = 0.0, elapsed;
+  char *buffer = NULL;
+  captureFileHeader header;
+  captureRecordHeader record;
+  dCrateUVBlock bundle;
+  dPowerSet powers;
+  dSWARMUVBlock *sWARMData;
+  dStatusStructure *result, streamResult;
+  swarmStreamHeader *frame;
+  XDR xdrs;
+  FILE *capture;
+
+  while ((option = getopt(argc, argv, "r:s:w:")) != -1)
+    switch (option) {
+    case 'r':
+      if (setSiteRoot(optarg) == ERROR) {
+	fprintf(stderr, "%s: root directory name \"%s\" is too long\n", argv[0], optarg);
+	exit(ERROR);
+      }
+      break;
+    case 's':
+      if (!strcmp(optarg, "max"))
+	speed = 0.0;
+      else if ((sscanf(optarg, "%lf", &speed) != 1) || (speed < 0.0))
+	usage(argv[0]);
+      break;
+    case 'w':
+      if ((sscanf(optarg, "%d", &settleTime) != 1) || (settleTime < 0))
+	usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  if (optind != argc-1)
+    usage(argv[0]);
+  capture = fopen(argv[optind], "r");
+  if (capture == NULL) {
+    perror(argv[optind]);
+    exit(ERROR);
+  }
+  if ((fread(&header, sizeof(header), 1, capture) != 1) ||
+      (header.magic != CAPTURE_FILE_MAGIC) || (header.version != CAPTURE_VERSION)) {
+    fprintf(stderr, "%s: %s is not a dataCatcher capture file\n", argv[0], argv[optind]);
+    exit(ERROR);
+  }
+  /* A dSWARMUVBlock is too big to keep on the stack */
+  sWARMData = (dSWARMUVBlock *)malloc(sizeof(*sWARMData));
+  if (sWARMData == NULL) {
+    perror("malloc of sWARMData");
+    exit(ERROR);
+  }
+  bzero((char *)nCalls, sizeof(nCalls));
+  while (fread(&record, sizeof(record), 1, capture) == 1) {
+    if (record.magic != CAPTURE_RECORD_MAGIC) {
+      fprintf(stderr, "%s: damaged record after %d calls - stopping\n", argv[0],
+	      nCalls[CAPTURE_VISIBILITIES] + nCalls[CAPTURE_POWERS] + nCalls[CAPTURE_SWARM_DATA] +
+	      nCalls[CAPTURE_SWARM_STREAM]);
+      break;
+    }
+    if (record.length > bufferSize) {
+      free(buffer);
+      bufferSize = record.length;
+      buffer = (char *)malloc(bufferSize);
+      if (buffer == NULL) {
+	perror("malloc of buffer");
+	exit(ERROR);
+      }
+    }
+    if (fread(buffer, 1, record.length, capture) != record.length) {
+      fprintf(stderr, "%s: capture file ends in the middle of a record\n", argv[0]);
+      break;
+    }
+
+    /* Hold the call until its time comes, at the speed asked for */
+    if (replayStart == 0.0) {
+      firstArrival = record.arrival;
+      replayStart = replayNow();
+    }
+    lastArrival = record.arrival;
+    if (speed > 0.0) {
+      due = replayStart + (record.arrival - firstArrival)/speed;
+      lag = replayNow() - due;
+      if (lag < 0.0)
+	replaySleepUntil(due);
+      else if (lag > maxLag)
+	maxLag = lag;
+    }
+
+    xdrmem_create(&xdrs, buffer, record.length, XDR_DECODE);
+    result = NULL;
+    switch (record.procedure) {
+    case CAPTURE_VISIBILITIES:
+      bzero((char *)&bundle, sizeof(bundle));
+      if (xdr_dCrateUVBlock(&xdrs, &bundle)) {
+	result = catch_visibilities_1(&bundle, NULL);
+	xdr_free((xdrproc_t)xdr_dCrateUVBlock, (char *)&bundle);
+      }
+      break;
+    case CAPTURE_POWERS:
+      bzero((char *)&powers, sizeof(powers));
+      if (xdr_dPowerSet(&xdrs, &powers)) {
+	result = catch_powers_1(&powers, NULL);
+	xdr_free((xdrproc_t)xdr_dPowerSet, (char *)&powers);
+      }
+      break;
+    case CAPTURE_SWARM_DATA:
+      bzero((char *)sWARMData, sizeof(*sWARMData));
+      if (xdr_dSWARMUVBlock(&xdrs, sWARMData)) {
+	result = catch_swarm_data_1(sWARMData, NULL);
+	xdr_free((xdrproc_t)xdr_dSWARMUVBlock, (char *)sWARMData);
+      }
+      break;
+    case CAPTURE_SWARM_STREAM:
+      /* dataCatcher checked the frame before capturing it, so only its size is checked here */
+      if (streamFrameSize(buffer, record.length) == record.length) {
+	frame = (swarmStreamHeader *)buffer;
+	streamResult.rt_code =
+	  storeStreamFrame(frame, (swarmStreamRecord *)(buffer + sizeof(*frame)),
+			   (float *)(buffer + sizeof(*frame) + frame->nRecords*sizeof(swarmStreamRecord)));
+	result = &streamResult;
+      }
+      break;
+    default:
+      fprintf(stderr, "%s: skipping a call of unknown type %d\n", argv[0], record.procedure);
+      xdr_destroy(&xdrs);
+      continue;
+    }
+    xdr_destroy(&xdrs);
+    if (result == NULL) {
+      fprintf(stderr, "%s: could not decode a call of type %d\n", argv[0], record.procedure);
+      nErrors++;
+    } else {
+      nCalls[record.procedure]++;
+      /* Congestion codes (see congestion.h) are positive, and mean the data were taken */
+      if (result->rt_code < 0)
+	nErrors++;
+    }
+  }
+  fclose(capture);
+  elapsed = replayNow() - replayStart;
+
+  printf("dataCatcherReplay: replayed %d visibility, %d power and %d SWARM calls, %d SWARM frames, %d errors\n",
+	 nCalls[CAPTURE_VISIBILITIES], nCalls[CAPTURE_POWERS], nCalls[CAPTURE_SWARM_DATA],
+	 nCalls[CAPTURE_SWARM_STREAM], nErrors);
+  printf("dataCatcherReplay: %.3f seconds of capture took %.3f seconds (%.2fx), fell up to %.3f seconds behind\n",
+	 lastArrival - firstArrival, elapsed,
+	 (elapsed > 0.0) ? (lastArrival - firstArrival)/elapsed : 0.0, maxLag);
+  printf("dataCatcherReplay: waiting %d seconds for dataCatcher to finish writing\n", settleTime);
+  fflush(stdout);
+  sleep(settleTime);
+  latencyReport(stdout);
+  exit(OK);
+} /* End of main */
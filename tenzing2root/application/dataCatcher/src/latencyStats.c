@@ -0,0 +1,92 @@
+/*
+  L A T E N C Y   S T A T S
+
+  Lock free latency histograms.   See latencyStats.h.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "latencyStats.h"
+
+/* bucketOf returns the bucket for a latency of micros microseconds */
+static int bucketOf(unsigned long long micros)
+{
+  int exponent;
+
+  if (micros < LATENCY_SUB_BUCKETS)
+    return((int)micros);
+  exponent = 63 - __builtin_clzll(micros);
+  if (exponent >= LATENCY_MAX_BITS)
+    return(LATENCY_BUCKETS - 1);
+  return(LATENCY_SUB_BUCKETS*(exponent - LATENCY_SUB_BITS + 1) +
+	 (int)((micros >> (exponent - LATENCY_SUB_BITS)) - LATENCY_SUB_BUCKETS));
+} /* End of bucketOf */
+
+/* bucketValue returns the latency, in microseconds, in the middle of bucket */
+static double bucketValue(int bucket)
+{
+  int shift;
+  unsigned long long low;
+
+  if (bucket < LATENCY_SUB_BUCKETS)
+    return((double)bucket);
+  shift = bucket/LATENCY_SUB_BUCKETS - 1;
+  low = ((unsigned long long)(LATENCY_SUB_BUCKETS + bucket%LATENCY_SUB_BUCKETS)) << shift;
+  return((double)low + 0.5*((double)(1ULL << shift)));
+} /* End of bucketValue */
+
+double latencyNow(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return(((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9);
+} /* End of latencyNow */
+
+void latencyRecord(latencyHistogram *histogram, double seconds)
+{
+  unsigned long long micros, max;
+
+  if (seconds < 0.0)
+    return;
+  if (seconds >= LATENCY_MAX_SECONDS)
+    micros = (unsigned long long)(LATENCY_MAX_SECONDS*1.0e6);
+  else
+    micros = (unsigned long long)(seconds*1.0e6);
+  __atomic_fetch_add(&histogram->counts[bucketOf(micros)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&histogram->sum, micros, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+  while ((micros > max) &&
+	 !__atomic_compare_exchange_n(&histogram->max, &max, micros, 1,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  __atomic_fetch_add(&histogram->n, 1, __ATOMIC_RELEASE);
+} /* End of latencyRecord */
+
+void latencyDump(FILE *out, const char *name, latencyHistogram *histogram)
+{
+  static const double fractions[4] = {0.5, 0.9, 0.99, 0.999};
+  int i, bucket;
+  unsigned long long n, seen, target;
+  double percentiles[4];
+
+  n = __atomic_load_n(&histogram->n, __ATOMIC_ACQUIRE);
+  if (n == 0) {
+    fprintf(out, "%-16s %10d\n", name, 0);
+    return;
+  }
+  for (i = 0; i < 4; i++) {
+    target = (unsigned long long)(fractions[i]*(double)n + 0.999999);
+    seen = 0;
+    for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+      seen += __atomic_load_n(&histogram->counts[bucket], __ATOMIC_RELAXED);
+      if (seen >= target)
+	break;
+    }
+    percentiles[i] = bucketValue(bucket);
+  }
+  fprintf(out, "%-16s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name, n,
+	  ((double)__atomic_load_n(&histogram->sum, __ATOMIC_RELAXED))/((double)n)*1.0e-3,
+	  percentiles[0]*1.0e-3, percentiles[1]*1.0e-3, percentiles[2]*1.0e-3,
+	  percentiles[3]*1.0e-3,
+	  ((double)__atomic_load_n(&histogram->max, __ATOMIC_RELAXED))*1.0e-3);
+} /* End of latencyDump */
@@ -0,0 +1,50 @@
+/*
+  L A T E N C Y   S T A T S
+
+  Histograms of the time scans spend in each stage of dataCatcher.
+
+  Each latencyHistogram counts latencies, in microseconds, in log-linear
+  buckets, as an HDR histogram does: values below LATENCY_SUB_BUCKETS
+  microseconds get a bucket each, and every power of two above that is
+  split into LATENCY_SUB_BUCKETS equal buckets, so any latency is known to
+  within about 6%.   Latencies of LATENCY_MAX_SECONDS or more all go into
+  the last bucket.
+
+  latencyRecord() only uses atomic increments, so any thread may record
+  into a histogram while any other dumps it, without locks.   A dump
+  taken while latencies are being recorded may be off by the latencies
+  recorded during the dump.
+*/
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdio.h>
+
+#define LATENCY_SUB_BITS    (4)
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS    (36)          /* 2^36 microseconds is about 19 hours */
+#define LATENCY_MAX_SECONDS (68719.476736)
+#define LATENCY_BUCKETS     (LATENCY_SUB_BUCKETS*(LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1))
+
+typedef struct latencyHistogram {
+  unsigned long long counts[LATENCY_BUCKETS];
+  unsigned long long n;                 /* Number of latencies recorded           */
+  unsigned long long sum;               /* Their total, in microseconds           */
+  unsigned long long max;               /* The longest, in microseconds           */
+} latencyHistogram;
+
+/* latencyNow returns the time, in seconds, on the clock latencies are measured with */
+double latencyNow(void);
+
+/* latencyRecord adds a latency of seconds to histogram.   Negative ones are ignored */
+void latencyRecord(latencyHistogram *histogram, double seconds);
+
+/*
+  latencyDump writes one line to out, describing histogram: the number
+  of latencies, their mean, median, 90th, 99th and 99.9th percentiles and
+  maximum, in milliseconds.   The line starts with name.
+*/
+void latencyDump(FILE *out, const char *name, latencyHistogram *histogram);
+
+#endif
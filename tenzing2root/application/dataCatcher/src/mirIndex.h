@@ -0,0 +1,51 @@
+/*
+  mirIndex.h
+
+  Definitions for the sidecar index file, sch_index, which dataCatcher
+  writes alongside the MIR files in each data directory.   It lets a
+  reader find the data for any integration without scanning sch_read,
+  sp_read and bl_read from the beginning.
+
+  One mirIndexRecord is appended to sch_index for each integration, so
+  every record is the same size, and the records are in increasing order
+  of inhid.   A reader can therefore find an integration's record by
+  binary search, or, if no integrations are missing, directly as record
+  inhid - (the first record's inhid).
+
+  The dataoff value of each sp_read record written for the integration,
+  in the order the records were written, is kept in a second file,
+  sch_dataoff, as nSpectra ints starting dataoffOffset bytes into it.
+  dataoff is the byte offset of the spectrum's data within the
+  integration's packed data, which starts schOffset + 2*sizeof(int)
+  bytes into sch_read.   If the packed data are being compressed,
+  schOffset is the offset of the integration's frame in sch_read.z
+  instead (see schCodec.h), and dataoff refers to the decoded data.
+
+  A record is appended only after the MIR data it describes, and its
+  dataoff values, have been written, so every offset in the index points
+  at data already in the files.   If dataCatcher stops while appending a
+  record, sch_index ends with a partial record, which a reader can
+  recognize because the file's size is not a multiple of
+  sizeof(mirIndexRecord).   The records are written in native byte
+  order, and a reader should reject the file if magic does not match
+  MIR_INDEX_MAGIC.
+*/
+
+#ifndef MIR_INDEX_H
+#define MIR_INDEX_H
+
+#define MIR_INDEX_MAGIC (0x4d495232) /* "MIR2" */
+
+typedef struct mirIndexRecord {
+  int       magic;
+  int       inhid;
+  int       nSpectra;     /* sp_read records written for this integration      */
+  int       nBaselines;   /* bl_read records written for this integration      */
+  long long inOffset;     /* Byte offsets of the integration's first record in */
+  long long blOffset;     /* in_read, bl_read, sp_read and sch_read            */
+  long long spOffset;
+  long long schOffset;
+  long long dataoffOffset; /* Byte offset of its dataoff values in sch_dataoff */
+} mirIndexRecord;
+
+#endif
@@ -0,0 +1,200 @@
+/*
+  P A C K   K E R N E L S
+
+  Scalar, SSE and AVX2 versions of the routines packData() uses to find
+  the range of a spectrum and to scale it into short integers.   See
+  packKernels.h.
+
+  The vector range finders keep NaNs out of the running min and max by
+  passing the new data as the first operand of minps/maxps, which then
+  return the second operand, just as a failed "<" does in the scalar
+  code.   The vector scalers convert to 32 bit integers and keep the low
+  16 bits of each, with the imaginary part shifted into the high half, so
+  each 32 bit lane is one real, imaginary pair in MIR order.
+*/
+
+#include <stdio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+#include "packKernels.h"
+
+static void rangeScalar(const float *real, const float *imag, int nChan, float *min, float *max);
+static void scaleScalar(const float *real, const float *imag, int nChan, float scale, short *slot);
+
+/* The versions of the kernels chosen by packKernelsInit() */
+static void (*rangeKernel)(const float *real, const float *imag, int nChan,
+			   float *min, float *max) = rangeScalar;
+static void (*scaleKernel)(const float *real, const float *imag, int nChan,
+			   float scale, short *slot) = scaleScalar;
+
+/*   S C A L A R   K E R N E L S   */
+
+static void rangeScalar(const float *real, const float *imag, int nChan, float *min, float *max)
+{
+  int i;
+  float dataMin = *min;
+  float dataMax = *max;
+
+  for (i = 0; i < nChan; i++) {
+    if (real[i] < dataMin)
+      dataMin = real[i];
+    if (real[i] > dataMax)
+      dataMax = real[i];
+    if (imag[i] < dataMin)
+      dataMin = imag[i];
+    if (imag[i] > dataMax)
+      dataMax = imag[i];
+  }
+  *min = dataMin;
+  *max = dataMax;
+} /* End of rangeScalar */
+
+static void scaleScalar(const float *real, const float *imag, int nChan, float scale, short *slot)
+{
+  int i;
+
+  for (i = 0; i < nChan; i++) {
+    slot[2*i]     = (int)(real[i]*scale);
+    slot[2*i + 1] = (int)(imag[i]*scale);
+  }
+} /* End of scaleScalar */
+
+#ifdef HAVE_X86_KERNELS
+
+/* Combine the lanes of the vector range finders' min and max */
+static void reduceLanes(const float *minLanes, const float *maxLanes, int nLanes,
+			float *min, float *max)
+{
+  int i;
+
+  for (i = 0; i < nLanes; i++) {
+    if (minLanes[i] < *min)
+      *min = minLanes[i];
+    if (maxLanes[i] > *max)
+      *max = maxLanes[i];
+  }
+} /* End of reduceLanes */
+
+/*   S S E   K E R N E L S   */
+
+__attribute__((target("sse2")))
+static void rangeSSE(const float *real, const float *imag, int nChan, float *min, float *max)
+{
+  int i;
+  float minLanes[4], maxLanes[4];
+  __m128 re, im, dataMin, dataMax;
+
+  dataMin = _mm_set1_ps(*min);
+  dataMax = _mm_set1_ps(*max);
+  for (i = 0; i + 4 <= nChan; i += 4) {
+    re = _mm_loadu_ps(&real[i]);
+    im = _mm_loadu_ps(&imag[i]);
+    dataMin = _mm_min_ps(re, dataMin);
+    dataMax = _mm_max_ps(re, dataMax);
+    dataMin = _mm_min_ps(im, dataMin);
+    dataMax = _mm_max_ps(im, dataMax);
+  }
+  _mm_storeu_ps(minLanes, dataMin);
+  _mm_storeu_ps(maxLanes, dataMax);
+  reduceLanes(minLanes, maxLanes, 4, min, max);
+  rangeScalar(&real[i], &imag[i], nChan - i, min, max);
+} /* End of rangeSSE */
+
+__attribute__((target("sse2")))
+static void scaleSSE(const float *real, const float *imag, int nChan, float scale, short *slot)
+{
+  int i;
+  __m128 factor;
+  __m128i re, im, low;
+
+  factor = _mm_set1_ps(scale);
+  low = _mm_set1_epi32(0xffff);
+  for (i = 0; i + 4 <= nChan; i += 4) {
+    re = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&real[i]), factor));
+    im = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&imag[i]), factor));
+    _mm_storeu_si128((__m128i *)&slot[2*i],
+		     _mm_or_si128(_mm_and_si128(re, low), _mm_slli_epi32(im, 16)));
+  }
+  scaleScalar(&real[i], &imag[i], nChan - i, scale, &slot[2*i]);
+} /* End of scaleSSE */
+
+/*   A V X 2   K E R N E L S   */
+
+__attribute__((target("avx2")))
+static void rangeAVX2(const float *real, const float *imag, int nChan, float *min, float *max)
+{
+  int i;
+  float minLanes[8], maxLanes[8];
+  __m256 re, im, dataMin, dataMax;
+
+  dataMin = _mm256_set1_ps(*min);
+  dataMax = _mm256_set1_ps(*max);
+  for (i = 0; i + 8 <= nChan; i += 8) {
+    re = _mm256_loadu_ps(&real[i]);
+    im = _mm256_loadu_ps(&imag[i]);
+    dataMin = _mm256_min_ps(re, dataMin);
+    dataMax = _mm256_max_ps(re, dataMax);
+    dataMin = _mm256_min_ps(im, dataMin);
+    dataMax = _mm256_max_ps(im, dataMax);
+  }
+  _mm256_storeu_ps(minLanes, dataMin);
+  _mm256_storeu_ps(maxLanes, dataMax);
+  reduceLanes(minLanes, maxLanes, 8, min, max);
+  rangeScalar(&real[i], &imag[i], nChan - i, min, max);
+} /* End of rangeAVX2 */
+
+__attribute__((target("avx2")))
+static void scaleAVX2(const float *real, const float *imag, int nChan, float scale, short *slot)
+{
+  int i;
+  __m256 factor;
+  __m256i re, im, low;
+
+  factor = _mm256_set1_ps(scale);
+  low = _mm256_set1_epi32(0xffff);
+  for (i = 0; i + 8 <= nChan; i += 8) {
+    re = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(&real[i]), factor));
+    im = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(&imag[i]), factor));
+    _mm256_storeu_si256((__m256i *)&slot[2*i],
+			_mm256_or_si256(_mm256_and_si256(re, low), _mm256_slli_epi32(im, 16)));
+  }
+  scaleScalar(&real[i], &imag[i], nChan - i, scale, &slot[2*i]);
+} /* End of scaleAVX2 */
+
+#endif /* HAVE_X86_KERNELS */
+
+/*
+  P A C K   K E R N E L S   I N I T
+
+  Pick the fastest version of the kernels this CPU can run.
+*/
+void packKernelsInit(void)
+{
+  char *version = "scalar";
+
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    rangeKernel = rangeAVX2;
+    scaleKernel = scaleAVX2;
+    version = "AVX2";
+  } else if (__builtin_cpu_supports("sse2")) {
+    rangeKernel = rangeSSE;
+    scaleKernel = scaleSSE;
+    version = "SSE";
+  }
+#endif
+  printf("packKernelsInit: using %s pack kernels\n", version);
+} /* End of packKernelsInit */
+
+void packRange(const float *real, const float *imag, int nChan, float *min, float *max)
+{
+  (*rangeKernel)(real, imag, nChan, min, max);
+} /* End of packRange */
+
+void packScale(const float *real, const float *imag, int nChan, float scale, short *slot)
+{
+  (*scaleKernel)(real, imag, nChan, scale, slot);
+} /* End of packScale */
@@ -0,0 +1,31 @@
+/*
+  P A C K   K E R N E L S
+
+  Routines used by packData() to scale spectra into the short integers
+  stored in the MIR sch_read file.
+
+  The kernels come in scalar, SSE and AVX2 versions.   packKernelsInit()
+  picks the fastest one the CPU supports, and must be called before any
+  of the others are used.   Every version gives exactly the same result.
+*/
+
+#ifndef PACK_KERNELS_H
+#define PACK_KERNELS_H
+
+void packKernelsInit(void);
+
+/*
+  packRange widens *min and *max to cover the nChan points in each of
+  real and imag.   NaNs are ignored.
+*/
+void packRange(const float *real, const float *imag, int nChan, float *min, float *max);
+
+/*
+  packScale multiplies each point by scale, truncates it to a short, and
+  stores the real and imaginary parts alternately in slot.   Values too
+  large for a short are truncated to their low 16 bits, as a C cast
+  through int does on x86.
+*/
+void packScale(const float *real, const float *imag, int nChan, float scale, short *slot);
+
+#endif
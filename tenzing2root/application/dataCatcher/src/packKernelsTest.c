@@ -0,0 +1,197 @@
+/*
+  P A C K   K E R N E L S   T E S T
+
+  Checks the scalar, SSE and AVX2 pack kernels against a short golden
+  spectrum, worked out by hand from the rules in packKernels.h, and then
+  checks the SSE and AVX2 versions against the scalar one on random
+  spectra.   packKernels.h promises that every version gives exactly the
+  same result, so every comparison is exact.   The spectra have lengths
+  which are not multiples of the vector width, so that the scalar tails
+  of the vector kernels are exercised, and some NaNs, which the range
+  finders must ignore.   packKernels.c is included, rather than linked,
+  so that each version of the kernels can be called directly.
+
+  Run by "make check".   Exits with status 0 if every case passes.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "packKernels.c"
+
+#define OK (0)
+#define ERROR (-1)
+#define TRUE (1)
+#define FALSE (0)
+
+#define MAX_CHANNELS (16387)
+
+static int nFailed = 0;
+
+/* supported returns TRUE if the CPU can run the kernels which need feature */
+static int supported(const char *feature)
+{
+#ifdef HAVE_X86_KERNELS
+  if (feature == NULL)
+    return(TRUE);
+  if (!strcmp(feature, "sse2"))
+    return(__builtin_cpu_supports("sse2"));
+  if (!strcmp(feature, "avx2"))
+    return(__builtin_cpu_supports("avx2"));
+  return(FALSE);
+#else
+  return(feature == NULL);
+#endif
+} /* End of supported */
+
+typedef struct kernelVersion {
+  char *name;
+  char *cpuFeature;
+  void (*range)(const float *real, const float *imag, int nChan, float *min, float *max);
+  void (*scale)(const float *real, const float *imag, int nChan, float scale, short *slot);
+} kernelVersion;
+
+static kernelVersion versions[] = {
+  {"scalar", NULL, rangeScalar, scaleScalar},
+#ifdef HAVE_X86_KERNELS
+  {"SSE", "sse2", rangeSSE, scaleSSE},
+  {"AVX2", "avx2", rangeAVX2, scaleAVX2},
+#endif
+};
+#define N_VERSIONS ((int)(sizeof(versions)/sizeof(versions[0])))
+
+/*
+  The golden spectrum - 11 channels, so that the vector kernels handle
+  some in vector registers and the rest in their scalar tails.   With a
+  scale of 0.5, 70000.0 becomes 35000, which does not fit in a short and
+  keeps its low 16 bits, -30536.   Values truncate towards zero.
+*/
+#define N_GOLDEN (11)
+#define GOLDEN_SCALE (0.5)
+static const float goldenReal[N_GOLDEN] =
+  {1.0, -1.0, 3.0, -3.0, 100.5, -100.5, 0.0, 70000.0, 2.9, -2.9, 65535.0};
+static const float goldenImag[N_GOLDEN] =
+  {0.0, 2.0, -4.0, 5.0, NAN, 7.0, -8.0, 9.0, -60000.0, 11.0, 12.0};
+static const short goldenSlot[2*N_GOLDEN] =
+  {0, 0,   0, 1,   1, -2,   -1, 2,   50, 0,   -50, 3,   0, -4,
+   -30536, 4,   1, -30000,   -1, 5,   32767, 6};
+#define GOLDEN_MIN (-60000.0)
+#define GOLDEN_MAX (70000.0)
+
+/* goldenCase checks every version of the kernels against the golden spectrum */
+static void goldenCase(void)
+{
+  int i, v;
+  float min, max;
+  short slot[2*N_GOLDEN];
+  float imag[N_GOLDEN];
+
+  /* The NaN can not be scaled portably, so it is only seen by the range finders */
+  memcpy(imag, goldenImag, sizeof(imag));
+  for (v = 0; v < N_VERSIONS; v++) {
+    if (!supported(versions[v].cpuFeature)) {
+      printf("SKIP golden %s: the CPU lacks %s\n", versions[v].name, versions[v].cpuFeature);
+      continue;
+    }
+    min = max = 0.0;
+    (*versions[v].range)(goldenReal, goldenImag, N_GOLDEN, &min, &max);
+    if ((min != GOLDEN_MIN) || (max != GOLDEN_MAX)) {
+      printf("FAIL golden %s range: %g to %g, should be %g to %g\n",
+	     versions[v].name, min, max, GOLDEN_MIN, GOLDEN_MAX);
+      nFailed++;
+      continue;
+    }
+    imag[4] = 0.0;
+    (*versions[v].scale)(goldenReal, imag, N_GOLDEN, GOLDEN_SCALE, slot);
+    imag[4] = goldenImag[4];
+    for (i = 0; i < 2*N_GOLDEN; i++)
+      if (slot[i] != goldenSlot[i])
+	break;
+    if (i < 2*N_GOLDEN) {
+      printf("FAIL golden %s scale: short %d is %d, should be %d\n",
+	     versions[v].name, i, slot[i], goldenSlot[i]);
+      nFailed++;
+      continue;
+    }
+    printf("PASS golden %s\n", versions[v].name);
+  }
+} /* End of goldenCase */
+
+/*
+  randomCase fills a spectrum of nChan channels with random values of up
+  to amplitude, with a NaN in every nanStride'th channel if nanStride is
+  not 0, and checks every version of the kernels against the scalar one.
+  The range finders see the NaNs, the scalers a copy with 0 in their place.
+*/
+static void randomCase(const char *name, int nChan, float amplitude, int nanStride)
+{
+  int i, v;
+  float scale, min, max, refMin, refMax;
+  float *real, *imag, *clean;
+  short *slot, *refSlot;
+
+  real = (float *)malloc(nChan*sizeof(float));
+  imag = (float *)malloc(nChan*sizeof(float));
+  clean = (float *)malloc(nChan*sizeof(float));
+  slot = (short *)malloc(2*nChan*sizeof(short));
+  refSlot = (short *)malloc(2*nChan*sizeof(short));
+  if ((real == NULL) || (imag == NULL) || (clean == NULL) || (slot == NULL) || (refSlot == NULL)) {
+    perror("randomCase: malloc");
+    exit(ERROR);
+  }
+  for (i = 0; i < nChan; i++) {
+    real[i] = amplitude*(2.0*((float)rand())/((float)RAND_MAX) - 1.0);
+    imag[i] = amplitude*(2.0*((float)rand())/((float)RAND_MAX) - 1.0);
+    clean[i] = real[i];
+    if (nanStride && ((i % nanStride) == (nanStride - 1)))
+      real[i] = NAN;
+  }
+  refMin = refMax = 0.0;
+  rangeScalar(real, imag, nChan, &refMin, &refMax);
+  scale = ldexpf(1.0, -((int)ceil(log2(((-refMin > refMax) ? -refMin : refMax)/32767.0)) - 1));
+  scaleScalar(clean, imag, nChan, scale, refSlot);
+
+  for (v = 1; v < N_VERSIONS; v++) {
+    if (!supported(versions[v].cpuFeature)) {
+      printf("SKIP %s %s: the CPU lacks %s\n", name, versions[v].name, versions[v].cpuFeature);
+      continue;
+    }
+    min = max = 0.0;
+    (*versions[v].range)(real, imag, nChan, &min, &max);
+    if ((min != refMin) || (max != refMax)) {
+      printf("FAIL %s %s range: %g to %g, should be %g to %g\n",
+	     name, versions[v].name, min, max, refMin, refMax);
+      nFailed++;
+      continue;
+    }
+    (*versions[v].scale)(clean, imag, nChan, scale, slot);
+    if (memcmp(slot, refSlot, 2*nChan*sizeof(short))) {
+      for (i = 0; slot[i] == refSlot[i]; i++);
+      printf("FAIL %s %s scale: short %d is %d, should be %d\n",
+	     name, versions[v].name, i, slot[i], refSlot[i]);
+      nFailed++;
+      continue;
+    }
+    printf("PASS %s %s\n", name, versions[v].name);
+  }
+  free(real); free(imag); free(clean); free(slot); free(refSlot);
+} /* End of randomCase */
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+#endif
+  srand(1);
+  goldenCase();
+  randomCase("16384 channels", 16384, 1.0, 0);
+  randomCase("16387 channels with NaNs", MAX_CHANNELS, 1.0e6, 7);
+  randomCase("3 channels", 3, 1.0e-3, 0);
+  randomCase("13 channels with NaNs", 13, 50.0, 2);
+  if (nFailed) {
+    printf("packKernelsTest: %d checks failed\n", nFailed);
+    exit(ERROR);
+  }
+  printf("packKernelsTest: all checks passed\n");
+  exit(OK);
+} /* End of main */
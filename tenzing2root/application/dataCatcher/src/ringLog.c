@@ -0,0 +1,210 @@
+/*
+  R I N G   L O G
+
+  Per thread, lock free log rings.   See ringLog.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include "ringLog.h"
+
+#define RING_FREE   (0) /* Available for a new thread                        */
+#define RING_ACTIVE (1) /* Owned by a running thread                         */
+#define RING_CLOSED (2) /* Owner has exited, freed once its records are out  */
+
+#define LOG_DRAIN_NANOSECONDS (10000000) /* LOGGER sleeps this long when idle */
+
+typedef struct logRecord {
+  double time;
+  int level;
+  int length;
+  char text[LOG_RECORD_TEXT];
+} logRecord;
+
+typedef struct logRing {
+  unsigned int head __attribute__ ((aligned (64))); /* Written only by the owner  */
+  unsigned int tail __attribute__ ((aligned (64))); /* Written only by LOGGER    */
+  int state;
+  logRecord records[LOG_RING_RECORDS];
+} logRing;
+
+static logRing *rings[MAX_LOG_RINGS];
+static int nRings = 0;
+static int draining = 0;
+static unsigned long long dropped = 0;
+static pthread_mutex_t ringMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t drainMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t ringKey;
+static __thread logRing *myRing = NULL;
+
+/* closeRing runs as a thread exits, and hands its ring back to LOGGER */
+static void closeRing(void *ring)
+{
+  __atomic_store_n(&((logRing *)ring)->state, RING_CLOSED, __ATOMIC_RELEASE);
+} /* End of closeRing */
+
+static void makeKey(void)
+{
+  pthread_key_create(&ringKey, closeRing);
+} /* End of makeKey */
+
+/*
+  threadRing returns the calling thread's ring, giving it one the first
+  time it is called.   It returns NULL if all MAX_LOG_RINGS are in use.
+*/
+static logRing *threadRing(void)
+{
+  int i;
+  logRing *ring = NULL;
+
+  if (myRing != NULL)
+    return(myRing);
+  pthread_once(&keyOnce, makeKey);
+  pthread_mutex_lock(&ringMutex);
+  for (i = 0; i < nRings; i++)
+    if (__atomic_load_n(&rings[i]->state, __ATOMIC_ACQUIRE) == RING_FREE) {
+      ring = rings[i];
+      break;
+    }
+  if ((ring == NULL) && (nRings < MAX_LOG_RINGS) &&
+      (posix_memalign((void **)&ring, 64, sizeof(logRing)) == 0)) {
+    ring->head = ring->tail = 0;
+    rings[nRings] = ring;
+    __atomic_store_n(&nRings, nRings+1, __ATOMIC_RELEASE);
+  }
+  if (ring != NULL) {
+    __atomic_store_n(&ring->state, RING_ACTIVE, __ATOMIC_RELEASE);
+    pthread_setspecific(ringKey, ring);
+  }
+  pthread_mutex_unlock(&ringMutex);
+  myRing = ring;
+  return(ring);
+} /* End of threadRing */
+
+void ringLogWrite(int level, const char *format, ...)
+{
+  int length;
+  unsigned int head;
+  struct timespec now;
+  va_list args;
+  logRing *ring;
+  logRecord *record;
+
+  va_start(args, format);
+  if (!__atomic_load_n(&draining, __ATOMIC_ACQUIRE)) {
+    vfprintf((level <= LOG_WARN) ? stderr : stdout, format, args);
+    va_end(args);
+    return;
+  }
+  ring = threadRing();
+  if (ring == NULL) {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    va_end(args);
+    return;
+  }
+  head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_RECORDS) {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    va_end(args);
+    return;
+  }
+  record = &ring->records[head & (LOG_RING_RECORDS-1)];
+  clock_gettime(CLOCK_REALTIME, &now);
+  record->time = ((double)now.tv_sec) + ((double)now.tv_nsec)*1.0e-9;
+  record->level = level;
+  length = vsnprintf(record->text, LOG_RECORD_TEXT, format, args);
+  va_end(args);
+  if (length < 0)
+    length = 0;
+  else if (length >= LOG_RECORD_TEXT) {
+    /* Truncated - keep the line ending, so the next message starts a new line */
+    length = LOG_RECORD_TEXT-1;
+    record->text[length-1] = '\n';
+  }
+  record->length = length;
+  __atomic_store_n(&ring->head, head+1, __ATOMIC_RELEASE);
+} /* End of ringLogWrite */
+
+unsigned long long ringLogDropped(void)
+{
+  return(__atomic_load_n(&dropped, __ATOMIC_RELAXED));
+} /* End of ringLogDropped */
+
+/*
+  drainRings writes every record now in the rings, oldest first, and
+  returns the number written.   Rings whose threads have exited are freed
+  once they are empty.
+*/
+static int drainRings(void)
+{
+  int i, n, oldest, state, nWritten = 0;
+  unsigned int tail;
+  logRing *ring;
+  logRecord *record, *next;
+
+  pthread_mutex_lock(&drainMutex);
+  while (1) {
+    n = __atomic_load_n(&nRings, __ATOMIC_ACQUIRE);
+    oldest = -1;
+    record = NULL;
+    for (i = 0; i < n; i++) {
+      ring = rings[i];
+      state = __atomic_load_n(&ring->state, __ATOMIC_ACQUIRE);
+      tail = ring->tail;
+      if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+	if (state == RING_CLOSED)
+	  __atomic_compare_exchange_n(&ring->state, &state, RING_FREE, 0,
+				      __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	continue;
+      }
+      next = &ring->records[tail & (LOG_RING_RECORDS-1)];
+      if ((record == NULL) || (next->time < record->time)) {
+	record = next;
+	oldest = i;
+      }
+    }
+    if (oldest < 0)
+      break;
+    fwrite(record->text, 1, record->length, (record->level <= LOG_WARN) ? stderr : stdout);
+    __atomic_store_n(&rings[oldest]->tail, rings[oldest]->tail+1, __ATOMIC_RELEASE);
+    nWritten++;
+  }
+  if (nWritten > 0) {
+    fflush(stdout);
+    fflush(stderr);
+  }
+  pthread_mutex_unlock(&drainMutex);
+  return(nWritten);
+} /* End of drainRings */
+
+/* flushAtExit gets out whatever was logged just before an exit() */
+static void flushAtExit(void)
+{
+  drainRings();
+} /* End of flushAtExit */
+
+void *ringLogDrain(void *arg)
+{
+  unsigned long long lost, reported = 0;
+  struct timespec pause;
+
+  pause.tv_sec = 0;
+  pause.tv_nsec = LOG_DRAIN_NANOSECONDS;
+  atexit(flushAtExit);
+  __atomic_store_n(&draining, 1, __ATOMIC_RELEASE);
+  while (1) {
+    drainRings();
+    lost = ringLogDropped();
+    if (lost != reported) {
+      fprintf(stderr, "ringLog: %llu messages dropped because a log ring was full\n",
+	      lost - reported);
+      reported = lost;
+    }
+    nanosleep(&pause, NULL);
+  }
+  return(NULL);
+} /* End of ringLogDrain */
@@ -0,0 +1,68 @@
+/*
+  R I N G   L O G
+
+  Leveled logging which never blocks the thread doing the logging.
+
+  Each thread which logs gets its own ring of fixed size records.   The
+  thread formats its message into the next free record, and the LOGGER
+  thread, which runs ringLogDrain(), copies the records from all the rings
+  to stdout (or, for LOG_ERROR and LOG_WARN records, stderr) in time
+  order.   Only the LOGGER thread ever writes to the console, so a slow
+  terminal or a stalled journald holds up nothing but the LOGGER thread.
+  If a ring fills up, further records from its thread are dropped and
+  counted, and the LOGGER thread reports how many were lost.
+
+  A ring has exactly one producer and one consumer, so it needs no lock.
+  The only lock is taken the first time a thread logs, to give it a ring.
+  Messages longer than LOG_RECORD_TEXT-1 characters are truncated.
+
+  The message is formatted by the thread which logs it, not by LOGGER.
+  A va_list can not be handed to another thread, and the strings it
+  points to may be gone by the time LOGGER gets to them, so deferring the
+  formatting would mean decoding the format and copying every argument
+  - nearly as much work as vsnprintf() into a record, which is bounded
+  by LOG_RECORD_TEXT and never waits for anything.   Per scan and per
+  baseline messages should be at LOG_DEBUG, so that builds and runs
+  without debugging skip the formatting altogether.
+
+  Records above LOG_MAX_LEVEL are compiled out entirely, so building with
+  -DLOG_MAX_LEVEL=LOG_INFO removes every debugging message.
+*/
+
+#ifndef RING_LOG_H
+#define RING_LOG_H
+
+#define LOG_ERROR (0)
+#define LOG_WARN  (1)
+#define LOG_INFO  (2)
+#define LOG_DEBUG (3)
+
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_DEBUG
+#endif
+
+#define LOG_RECORD_TEXT  (240)  /* Bytes of text in one record                 */
+#define LOG_RING_RECORDS (1024) /* Records in one thread's ring - power of two */
+#define MAX_LOG_RINGS    (64)   /* Threads which may have rings at once        */
+
+#define ringLog(level, ...) do {                   \
+    if ((level) <= LOG_MAX_LEVEL)                  \
+      ringLogWrite((level), __VA_ARGS__);          \
+  } while (0)
+
+/*
+  ringLogWrite formats a message, printf style, into the calling thread's
+  ring.   Until ringLogDrain() is running, it prints the message directly.
+  Use it through the ringLog() macro, so that the level test is done at
+  compile time.
+*/
+void ringLogWrite(int level, const char *format, ...)
+  __attribute__ ((format (printf, 2, 3)));
+
+/* ringLogDropped returns the number of records dropped so far because rings were full */
+unsigned long long ringLogDropped(void);
+
+/* ringLogDrain is the LOGGER thread.   It never returns */
+void *ringLogDrain(void *arg);
+
+#endif
@@ -0,0 +1,244 @@
+/*
+  S C H   C O D E C
+
+  Encoder and decoder for the compressed sch_read.z frames.   See
+  schCodec.h for the frame layout.
+
+  The ZRLE codec is a byte stream of runs, each starting with a control
+  byte c.   If c < 128, the next c+1 bytes are copied literally.
+  Otherwise c stands for c-126 zero bytes (2 to 129 of them).   After the
+  delta and shuffle filters, the high bytes of a spectrum are almost all
+  0x00 or 0xff, and flagged chunks are entirely zero, so even this simple
+  codec recovers much of the space.   LZ4 does better, when it is there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#include "schCodec.h"
+
+#define ZRLE_MAX_LITERAL (128)
+#define ZRLE_MAX_ZEROS   (129)
+
+/*
+  filter applies the delta and shuffle filters to the rawSize bytes in
+  data, leaving the result in out.   A trailing odd byte is copied as is.
+*/
+static void filter(const short *data, int rawSize, unsigned char *out)
+{
+  int i, nShorts = rawSize/2;
+  const unsigned short *in = (const unsigned short *)data;
+  unsigned short delta;
+
+  for (i = 0; i < nShorts; i++) {
+    delta = (i < 2) ? in[i] : (unsigned short)(in[i] - in[i-2]);
+    out[i]         = delta & 0xff;
+    out[nShorts+i] = delta >> 8;
+  }
+  if (rawSize & 1)
+    out[rawSize-1] = ((const unsigned char *)data)[rawSize-1];
+} /* End of filter */
+
+/* unfilter undoes filter */
+static void unfilter(const unsigned char *in, int rawSize, short *data)
+{
+  int i, nShorts = rawSize/2;
+  unsigned short *out = (unsigned short *)data;
+
+  for (i = 0; i < nShorts; i++) {
+    out[i] = in[i] | (in[nShorts+i] << 8);
+    if (i >= 2)
+      out[i] += out[i-2];
+  }
+  if (rawSize & 1)
+    ((unsigned char *)data)[rawSize-1] = in[rawSize-1];
+} /* End of unfilter */
+
+/* zrleEncode compresses n bytes from in into out, returning the size */
+static int zrleEncode(const unsigned char *in, int n, unsigned char *out)
+{
+  int i = 0, j, nOut = 0, zeros, literals;
+
+  while (i < n) {
+    for (zeros = 0; (i+zeros < n) && (in[i+zeros] == 0) && (zeros < ZRLE_MAX_ZEROS); zeros++);
+    if (zeros >= 2) {
+      out[nOut++] = zeros + 126;
+      i += zeros;
+    } else {
+      /* Gather literals until the next pair of zeros */
+      for (literals = 0; (i+literals < n) && (literals < ZRLE_MAX_LITERAL); literals++)
+	if ((in[i+literals] == 0) && (i+literals+1 < n) && (in[i+literals+1] == 0))
+	  break;
+      out[nOut++] = literals - 1;
+      for (j = 0; j < literals; j++)
+	out[nOut++] = in[i++];
+    }
+  }
+  return(nOut);
+} /* End of zrleEncode */
+
+/*
+  zrleDecode expands n bytes from in into exactly rawSize bytes in out,
+  returning -1 if they do not fit exactly.
+*/
+static int zrleDecode(const unsigned char *in, int n, unsigned char *out, int rawSize)
+{
+  int i = 0, nOut = 0, count;
+
+  while (i < n) {
+    if (in[i] < 128) {
+      count = in[i++] + 1;
+      if ((i+count > n) || (nOut+count > rawSize))
+	return(-1);
+      memcpy(&out[nOut], &in[i], count);
+      i += count;
+    } else {
+      count = in[i++] - 126;
+      if (nOut+count > rawSize)
+	return(-1);
+      memset(&out[nOut], 0, count);
+    }
+    nOut += count;
+  }
+  return((nOut == rawSize) ? 0 : -1);
+} /* End of zrleDecode */
+
+int schCodecAvailable(int codec)
+{
+  switch (codec) {
+  case SCH_CODEC_ZRLE:
+    return(1);
+#ifdef HAVE_LZ4
+  case SCH_CODEC_LZ4:
+    return(1);
+#endif
+  default:
+    return(0);
+  }
+} /* End of schCodecAvailable */
+
+int schFrameBound(int rawSize)
+{
+  int bound;
+
+  bound = rawSize + rawSize/(ZRLE_MAX_LITERAL) + 1;
+#ifdef HAVE_LZ4
+  if (LZ4_compressBound(rawSize) > bound)
+    bound = LZ4_compressBound(rawSize);
+#endif
+  return(sizeof(schFrameHeader) + bound);
+} /* End of schFrameBound */
+
+int schFrameEncode(const short *data, int rawSize, int inhid, int codec, void *frame)
+{
+  int size = -1;
+  unsigned char *filtered;
+  unsigned char *payload = (unsigned char *)frame + sizeof(schFrameHeader);
+  schFrameHeader header;
+
+  if (!schCodecAvailable(codec))
+    return(-1);
+  filtered = (unsigned char *)malloc(rawSize > 0 ? rawSize : 1);
+  if (filtered == NULL)
+    return(-1);
+  filter(data, rawSize, filtered);
+  switch (codec) {
+  case SCH_CODEC_ZRLE:
+    size = zrleEncode(filtered, rawSize, payload);
+    break;
+#ifdef HAVE_LZ4
+  case SCH_CODEC_LZ4:
+    size = LZ4_compress_default((const char *)filtered, (char *)payload, rawSize,
+				schFrameBound(rawSize) - sizeof(schFrameHeader));
+    if (size <= 0)
+      size = -1;
+    break;
+#endif
+  }
+  free(filtered);
+  if (size < 0)
+    return(-1);
+  header.magic     = SCH_FRAME_MAGIC;
+  header.version   = SCH_FRAME_VERSION;
+  header.codec     = codec;
+  header.filters   = SCH_FILTER_DELTA | SCH_FILTER_SHUFFLE;
+  header.inhid     = inhid;
+  header.rawSize   = rawSize;
+  header.frameSize = size;
+  memcpy(frame, &header, sizeof(header));
+  return(sizeof(header) + size);
+} /* End of schFrameEncode */
+
+int schFrameDecode(const void *frame, int frameBytes, short *data, int maxRaw, int *inhid)
+{
+  int status = -1;
+  unsigned char *filtered;
+  const unsigned char *payload = (const unsigned char *)frame + sizeof(schFrameHeader);
+  schFrameHeader header;
+
+  if (frameBytes < (int)sizeof(header))
+    return(-1);
+  memcpy(&header, frame, sizeof(header));
+  if ((header.magic != SCH_FRAME_MAGIC) || (header.version != SCH_FRAME_VERSION) ||
+      (header.filters != (SCH_FILTER_DELTA | SCH_FILTER_SHUFFLE)) ||
+      (header.frameSize > frameBytes - sizeof(header)) || (header.rawSize > (uint32_t)maxRaw) ||
+      !schCodecAvailable(header.codec))
+    return(-1);
+  filtered = (unsigned char *)malloc(header.rawSize > 0 ? header.rawSize : 1);
+  if (filtered == NULL)
+    return(-1);
+  switch (header.codec) {
+  case SCH_CODEC_ZRLE:
+    status = zrleDecode(payload, header.frameSize, filtered, header.rawSize);
+    break;
+#ifdef HAVE_LZ4
+  case SCH_CODEC_LZ4:
+    if (LZ4_decompress_safe((const char *)payload, (char *)filtered, header.frameSize,
+			    header.rawSize) == (int)header.rawSize)
+      status = 0;
+    break;
+#endif
+  }
+  if (status == 0) {
+    unfilter(filtered, header.rawSize, data);
+    *inhid = header.inhid;
+  }
+  free(filtered);
+  return((status == 0) ? (int)header.rawSize : -1);
+} /* End of schFrameDecode */
+
+int schFrameRead(FILE *fp, int *inhid, short **data)
+{
+  int rawSize;
+  unsigned char *frame;
+  schFrameHeader header;
+
+  *data = NULL;
+  if (fread(&header, sizeof(header), 1, fp) != 1)
+    return(feof(fp) ? 0 : -1);
+  if ((header.magic != SCH_FRAME_MAGIC) || (header.frameSize > 0x7fffffff - sizeof(header)))
+    return(-1);
+  frame = (unsigned char *)malloc(sizeof(header) + header.frameSize);
+  *data = (short *)malloc(header.rawSize > 0 ? header.rawSize : 1);
+  if ((frame == NULL) || (*data == NULL)) {
+    free(frame);
+    free(*data);
+    *data = NULL;
+    return(-1);
+  }
+  memcpy(frame, &header, sizeof(header));
+  if (fread(frame + sizeof(header), 1, header.frameSize, fp) != header.frameSize)
+    rawSize = -1;
+  else
+    rawSize = schFrameDecode(frame, sizeof(header) + header.frameSize, *data,
+			     header.rawSize, inhid);
+  free(frame);
+  if (rawSize < 0) {
+    free(*data);
+    *data = NULL;
+  }
+  return(rawSize);
+} /* End of schFrameRead */
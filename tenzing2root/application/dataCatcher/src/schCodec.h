@@ -0,0 +1,87 @@
+/*
+  schCodec.h
+
+  Lossless compression of the packed spectra which dataCatcher writes to
+  sch_read.   This is built into libschCodec.a, so that programs reading
+  the data can decode it with the same code dataCatcher used to encode it.
+
+  When compression is turned on, dataCatcher writes sch_read.z instead of
+  sch_read.   Each integration's record is one frame:
+  1) An schFrameHeader.
+  2) header.frameSize bytes of compressed data.
+  Decoding a frame gives back exactly the header.rawSize bytes which
+  would have followed the inhid and nbyt words in sch_read.
+
+  Before compression, the data are filtered:
+  SCH_FILTER_DELTA   - each short is replaced by its difference from the
+                       short two before it, so real parts are differenced
+                       with real parts and imaginary with imaginary.
+  SCH_FILTER_SHUFFLE - the low bytes of all the shorts are put first,
+                       followed by all the high bytes.
+  The filtered data are then compressed with one of the codecs:
+  SCH_CODEC_ZRLE - runs of zero bytes are squeezed out.   Always available.
+  SCH_CODEC_LZ4  - LZ4 block compression.   Only available if the library
+                   was built with HAVE_LZ4 ("make LZ4=1").
+
+  Frames are written in the writer's native byte order.   A reader should
+  reject a frame whose magic number does not match SCH_FRAME_MAGIC.
+*/
+
+#ifndef SCH_CODEC_H
+#define SCH_CODEC_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SCH_FRAME_MAGIC   (0x5343485a) /* "SCHZ" */
+#define SCH_FRAME_VERSION (1)
+
+#define SCH_CODEC_ZRLE    (1)
+#define SCH_CODEC_LZ4     (2)
+
+#define SCH_FILTER_DELTA   (1)
+#define SCH_FILTER_SHUFFLE (2)
+
+typedef struct schFrameHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t codec;
+  uint32_t filters;   /* SCH_FILTER_ bits applied before compression */
+  int32_t  inhid;
+  uint32_t rawSize;   /* Bytes of packed data once decoded           */
+  uint32_t frameSize; /* Bytes of compressed data after this header  */
+} schFrameHeader;
+
+/* schCodecAvailable returns 1 if codec was built into the library, else 0 */
+int schCodecAvailable(int codec);
+
+/*
+  schFrameBound returns the largest frame, header included, which
+  schFrameEncode can produce from rawSize bytes of packed data.
+*/
+int schFrameBound(int rawSize);
+
+/*
+  schFrameEncode filters and compresses the rawSize bytes in data into
+  frame, which must hold schFrameBound(rawSize) bytes.   It returns the
+  number of bytes in the frame, or -1 if codec is unavailable.
+*/
+int schFrameEncode(const short *data, int rawSize, int inhid, int codec, void *frame);
+
+/*
+  schFrameDecode decodes the frameBytes long frame into data, which holds
+  maxRaw bytes, and sets *inhid.   It returns the number of bytes of
+  packed data, or -1 if the frame is damaged, too big for data or uses a
+  codec which is unavailable.
+*/
+int schFrameDecode(const void *frame, int frameBytes, short *data, int maxRaw, int *inhid);
+
+/*
+  schFrameRead reads the next frame from fp, decodes it into a buffer it
+  allocates with malloc(), which the caller must free(), and sets *inhid.
+  It returns the number of bytes of packed data, 0 at the end of the file
+  or -1 on error.
+*/
+int schFrameRead(FILE *fp, int *inhid, short **data);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+  S C H   C O D E C   T E S T
+
+  Encodes packed spectra with each codec built into libschCodec.a, and
+  checks that they decode to exactly the original bytes - both one frame
+  at a time with schFrameDecode(), and as a reader would, with
+  schFrameRead() working through an sch_read.z file holding a frame for
+  every case in turn.   The test is linked with the library, rather than
+  including schCodec.c, so that it exercises the same decoder the data
+  readers use.   It also checks that damaged frames, and frames too big
+  for the caller's buffer, are rejected.
+
+  The LZ4 cases only run if the library was built with "make LZ4=1".
+
+  Run by "make check".   Exits with status 0 if every case passes.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "schCodec.h"
+
+#define OK (0)
+#define ERROR (-1)
+
+#define MAX_RAW (2*2*16384+1)
+#define N_CASES (7)
+
+static int nFailed = 0;
+
+typedef struct codecCase {
+  char *name;
+  int  rawSize;  /* Bytes of packed data */
+} codecCase;
+
+static codecCase cases[N_CASES] = {
+  {"empty", 0},
+  {"one byte", 1},
+  {"smooth spectrum", 2*2*16384},
+  {"noise", 2*2*4096},
+  {"flagged chunk", 2*2*16384},
+  {"partly flagged", 2*2*16384},
+  {"odd length", MAX_RAW}
+};
+
+/* fillCase fills data with the packed data for case number n */
+static void fillCase(int n, short *data)
+{
+  int i, nShorts = (cases[n].rawSize + 1)/2;
+
+  for (i = 0; i < nShorts; i++)
+    switch (n) {
+    case 2:
+    case 6:
+      data[i] = (short)(10000.0*sin(((double)(i/2))/300.0) + (rand() % 7) - 3);
+      break;
+    case 3:
+      data[i] = (short)rand();
+      break;
+    case 4:
+      data[i] = 0;
+      break;
+    default:
+      /* Half the spectrum zero, in runs both shorter and longer than a ZRLE run */
+      data[i] = ((i % 1000) < 500) ? 0 : (short)(rand() % 200 - 100);
+    }
+  if (nShorts > 0)
+    ((unsigned char *)data)[cases[n].rawSize] = 0xa5; /* Must not be decoded */
+} /* End of fillCase */
+
+/* check counts a failure, and prints message, if ok is 0 */
+static int check(int ok, const char *codecName, const char *caseName, const char *message)
+{
+  if (!ok) {
+    printf("FAIL %s %s: %s\n", codecName, caseName, message);
+    nFailed++;
+    return(ERROR);
+  }
+  return(OK);
+} /* End of check */
+
+/*
+  runCodec encodes every case with codec, checks each frame decodes, and
+  writes the frames to fp for readBack().
+*/
+static void runCodec(int codec, const char *codecName, FILE *fp)
+{
+  int n, size, rawSize, inhid;
+  short *data, *decoded;
+  unsigned char *frame;
+
+  data = (short *)malloc(MAX_RAW + 2);
+  decoded = (short *)malloc(MAX_RAW + 2);
+  frame = (unsigned char *)malloc(schFrameBound(MAX_RAW));
+  if ((data == NULL) || (decoded == NULL) || (frame == NULL)) {
+    perror("runCodec: malloc");
+    exit(ERROR);
+  }
+  for (n = 0; n < N_CASES; n++) {
+    srand(n + 1);
+    fillCase(n, data);
+    size = schFrameEncode(data, cases[n].rawSize, 1000 + n, codec, frame);
+    if (check((size > 0) && (size <= schFrameBound(cases[n].rawSize)),
+	      codecName, cases[n].name, "schFrameEncode failed or overran the bound") != OK)
+      continue;
+    memset(decoded, 0, MAX_RAW + 2);
+    inhid = -1;
+    rawSize = schFrameDecode(frame, size, decoded, MAX_RAW, &inhid);
+    if ((check(rawSize == cases[n].rawSize, codecName, cases[n].name, "decoded to the wrong size") != OK) ||
+	(check(inhid == 1000 + n, codecName, cases[n].name, "decoded the wrong inhid") != OK) ||
+	(check(!memcmp(decoded, data, rawSize), codecName, cases[n].name, "decoded the wrong data") != OK) ||
+	(check((rawSize < 1) || (((unsigned char *)decoded)[rawSize] == 0),
+	       codecName, cases[n].name, "decoded past the end of the data") != OK))
+      continue;
+    if (cases[n].rawSize > 1) {
+      if ((check(schFrameDecode(frame, size, decoded, cases[n].rawSize - 1, &inhid) < 0,
+		 codecName, cases[n].name, "decoded into too small a buffer") != OK) ||
+	  (check(schFrameDecode(frame, size - 1, decoded, MAX_RAW, &inhid) < 0,
+		 codecName, cases[n].name, "decoded a truncated frame") != OK))
+	continue;
+      frame[0] ^= 0xff;
+      if (check(schFrameDecode(frame, size, decoded, MAX_RAW, &inhid) < 0,
+		codecName, cases[n].name, "decoded a frame with a bad magic number") != OK)
+	continue;
+      frame[0] ^= 0xff;
+    }
+    if (fwrite(frame, 1, size, fp) != (size_t)size) {
+      perror("runCodec: fwrite");
+      exit(ERROR);
+    }
+    printf("PASS %s %s: %d bytes in %d\n", codecName, cases[n].name, cases[n].rawSize, size);
+  }
+  free(data); free(decoded); free(frame);
+} /* End of runCodec */
+
+/* readBack reads back every frame runCodec wrote, as a reader of sch_read.z would */
+static void readBack(FILE *fp, const char *codecName)
+{
+  int n, rawSize, inhid;
+  short *data, *decoded;
+
+  data = (short *)malloc(MAX_RAW + 2);
+  if (data == NULL) {
+    perror("readBack: malloc");
+    exit(ERROR);
+  }
+  rewind(fp);
+  for (n = 0; n < N_CASES; n++) {
+    srand(n + 1);
+    fillCase(n, data);
+    rawSize = schFrameRead(fp, &inhid, &decoded);
+    if ((check(rawSize == cases[n].rawSize, codecName, cases[n].name, "schFrameRead got the wrong size") == OK) &&
+	(check(inhid == 1000 + n, codecName, cases[n].name, "schFrameRead got the wrong inhid") == OK) &&
+	(check(!memcmp(decoded, data, rawSize), codecName, cases[n].name, "schFrameRead got the wrong data") == OK))
+      printf("PASS %s %s read back\n", codecName, cases[n].name);
+    free(decoded);
+  }
+  check(schFrameRead(fp, &inhid, &decoded) == 0, codecName, "end of file", "schFrameRead did not return 0");
+  free(data);
+} /* End of readBack */
+
+int main(int argc, char **argv)
+{
+  int c;
+  FILE *fp;
+  struct {
+    int codec;
+    char *name;
+  } codecs[] = {{SCH_CODEC_ZRLE, "ZRLE"}, {SCH_CODEC_LZ4, "LZ4"}};
+
+  for (c = 0; c < 2; c++) {
+    if (!schCodecAvailable(codecs[c].codec)) {
+      printf("SKIP %s: not built into libschCodec.a\n", codecs[c].name);
+      continue;
+    }
+    fp = tmpfile();
+    if (fp == NULL) {
+      perror("tmpfile");
+      exit(ERROR);
+    }
+    runCodec(codecs[c].codec, codecs[c].name, fp);
+    readBack(fp, codecs[c].name);
+    fclose(fp);
+  }
+  if (nFailed) {
+    printf("schCodecTest: %d checks failed\n", nFailed);
+    exit(ERROR);
+  }
+  printf("schCodecTest: all checks passed\n");
+  exit(OK);
+} /* End of main */
@@ -0,0 +1,301 @@
+/*
+  S W A R M   K E R N E L S
+
+  Scalar, SSE and AVX2 versions of the routines dataCatcher uses to
+  repair NaN flagged channels in SWARM spectra, and to split the
+  complex spectra into real and imaginary parts.   See swarmKernels.h.
+
+  Every routine works a block of SWARM_FID_BLOCK channels at a time.
+  The good channels of a block are summed by ANDing the data with the
+  mask, which zeros the NaNs, so no branches are needed on the data.
+  nChannels must be a multiple of SWARM_FID_BLOCK.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+#include "swarmKernels.h"
+
+#define TRUE (1)
+#define FALSE (0)
+
+static void repairAutoScalar(const float *in, float *out, int nChannels, const swarmMask *mask);
+static void repairDeinterleaveScalar(const float *in, float *real, float *imag,
+				     int nChannels, const swarmMask *mask);
+
+/* The versions of the kernels chosen by swarmKernelsInit() */
+static void (*repairAuto)(const float *in, float *out, int nChannels,
+			  const swarmMask *mask) = repairAutoScalar;
+static void (*repairDeinterleave)(const float *in, float *real, float *imag,
+				  int nChannels, const swarmMask *mask) = repairDeinterleaveScalar;
+
+/*
+  S W A R M   M A S K   S E T
+*/
+void swarmMaskSet(const int *good, swarmMask *mask)
+{
+  int j;
+
+  mask->nGood = 0;
+  for (j = 0; j < SWARM_FID_BLOCK; j++)
+    if (good[j]) {
+      mask->good[j] = ~0U;
+      mask->nGood++;
+    } else
+      mask->good[j] = 0;
+} /* End of swarmMaskSet */
+
+/*
+  S W A R M   M A S K   F R O M   A U T O
+*/
+void swarmMaskFromAuto(const float *spectrum, swarmMask *mask)
+{
+  int j, good[SWARM_FID_BLOCK];
+
+  for (j = 0; j < SWARM_FID_BLOCK; j++)
+    good[j] = !isnan(spectrum[j]);
+  swarmMaskSet(good, mask);
+} /* End of swarmMaskFromAuto */
+
+/*   S C A L A R   K E R N E L S   */
+
+static void repairAutoScalar(const float *in, float *out, int nChannels, const swarmMask *mask)
+{
+  int i, j;
+  float goodSum;
+
+  for (i = 0; i < nChannels; i += SWARM_FID_BLOCK) {
+    if (mask->nGood == SWARM_FID_BLOCK) {
+      if (out != in)
+	memcpy(&out[i], &in[i], SWARM_FID_BLOCK*sizeof(float));
+      continue;
+    }
+    goodSum = 0.0;
+    for (j = 0; j < SWARM_FID_BLOCK; j++)
+      if (mask->good[j])
+	goodSum += in[i+j];
+    goodSum /= (float)mask->nGood;
+    for (j = 0; j < SWARM_FID_BLOCK; j++)
+      out[i+j] = mask->good[j] ? in[i+j] : goodSum;
+  }
+} /* End of repairAutoScalar */
+
+static void repairDeinterleaveScalar(const float *in, float *real, float *imag,
+				     int nChannels, const swarmMask *mask)
+{
+  int i, j;
+  float goodReal, goodImag;
+
+  for (i = 0; i < nChannels; i += SWARM_FID_BLOCK) {
+    goodReal = goodImag = 0.0;
+    for (j = 0; j < SWARM_FID_BLOCK; j++) {
+      real[i+j] = in[2*(i+j)];
+      imag[i+j] = in[2*(i+j) + 1];
+      if (mask->good[j]) {
+	goodReal += real[i+j];
+	goodImag += imag[i+j];
+      }
+    }
+    if (mask->nGood == SWARM_FID_BLOCK)
+      continue;
+    goodReal /= (float)mask->nGood;
+    goodImag /= (float)mask->nGood;
+    for (j = 0; j < SWARM_FID_BLOCK; j++)
+      if (!mask->good[j]) {
+	real[i+j] = goodReal;
+	imag[i+j] = goodImag;
+      }
+  }
+} /* End of repairDeinterleaveScalar */
+
+#ifdef HAVE_X86_KERNELS
+
+/*   S S E   K E R N E L S   */
+
+__attribute__((target("sse2")))
+static float sumSSE(__m128 sum)
+{
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return(_mm_cvtss_f32(sum));
+} /* End of sumSSE */
+
+__attribute__((target("sse2")))
+static void repairAutoSSE(const float *in, float *out, int nChannels, const swarmMask *mask)
+{
+  int i, j;
+  __m128 sum, data, good, average;
+
+  for (i = 0; i < nChannels; i += SWARM_FID_BLOCK) {
+    if (mask->nGood == SWARM_FID_BLOCK) {
+      if (out != in)
+	memcpy(&out[i], &in[i], SWARM_FID_BLOCK*sizeof(float));
+      continue;
+    }
+    sum = _mm_setzero_ps();
+    for (j = 0; j < SWARM_FID_BLOCK; j += 4) {
+      good = _mm_castsi128_ps(_mm_loadu_si128((__m128i *)&mask->good[j]));
+      sum = _mm_add_ps(sum, _mm_and_ps(good, _mm_loadu_ps(&in[i+j])));
+    }
+    average = _mm_set1_ps(sumSSE(sum) / (float)mask->nGood);
+    for (j = 0; j < SWARM_FID_BLOCK; j += 4) {
+      good = _mm_castsi128_ps(_mm_loadu_si128((__m128i *)&mask->good[j]));
+      data = _mm_loadu_ps(&in[i+j]);
+      _mm_storeu_ps(&out[i+j], _mm_or_ps(_mm_and_ps(good, data), _mm_andnot_ps(good, average)));
+    }
+  }
+} /* End of repairAutoSSE */
+
+__attribute__((target("sse2")))
+static void repairDeinterleaveSSE(const float *in, float *real, float *imag,
+				  int nChannels, const swarmMask *mask)
+{
+  int i, j;
+  __m128 a, b, re, im, good, sumReal, sumImag, averageReal, averageImag;
+
+  for (i = 0; i < nChannels; i += SWARM_FID_BLOCK) {
+    sumReal = sumImag = _mm_setzero_ps();
+    for (j = 0; j < SWARM_FID_BLOCK; j += 4) {
+      a = _mm_loadu_ps(&in[2*(i+j)]);
+      b = _mm_loadu_ps(&in[2*(i+j) + 4]);
+      re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm_storeu_ps(&real[i+j], re);
+      _mm_storeu_ps(&imag[i+j], im);
+      good = _mm_castsi128_ps(_mm_loadu_si128((__m128i *)&mask->good[j]));
+      sumReal = _mm_add_ps(sumReal, _mm_and_ps(good, re));
+      sumImag = _mm_add_ps(sumImag, _mm_and_ps(good, im));
+    }
+    if (mask->nGood == SWARM_FID_BLOCK)
+      continue;
+    averageReal = _mm_set1_ps(sumSSE(sumReal) / (float)mask->nGood);
+    averageImag = _mm_set1_ps(sumSSE(sumImag) / (float)mask->nGood);
+    for (j = 0; j < SWARM_FID_BLOCK; j += 4) {
+      good = _mm_castsi128_ps(_mm_loadu_si128((__m128i *)&mask->good[j]));
+      re = _mm_loadu_ps(&real[i+j]);
+      im = _mm_loadu_ps(&imag[i+j]);
+      _mm_storeu_ps(&real[i+j], _mm_or_ps(_mm_and_ps(good, re), _mm_andnot_ps(good, averageReal)));
+      _mm_storeu_ps(&imag[i+j], _mm_or_ps(_mm_and_ps(good, im), _mm_andnot_ps(good, averageImag)));
+    }
+  }
+} /* End of repairDeinterleaveSSE */
+
+/*   A V X 2   K E R N E L S   */
+
+__attribute__((target("avx2")))
+static float sumAVX2(__m256 sum)
+{
+  __m128 half;
+
+  half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+  return(_mm_cvtss_f32(half));
+} /* End of sumAVX2 */
+
+__attribute__((target("avx2")))
+static void repairAutoAVX2(const float *in, float *out, int nChannels, const swarmMask *mask)
+{
+  int i, j;
+  __m256 sum, data, good, average;
+
+  for (i = 0; i < nChannels; i += SWARM_FID_BLOCK) {
+    if (mask->nGood == SWARM_FID_BLOCK) {
+      if (out != in)
+	memcpy(&out[i], &in[i], SWARM_FID_BLOCK*sizeof(float));
+      continue;
+    }
+    sum = _mm256_setzero_ps();
+    for (j = 0; j < SWARM_FID_BLOCK; j += 8) {
+      good = _mm256_castsi256_ps(_mm256_loadu_si256((__m256i *)&mask->good[j]));
+      sum = _mm256_add_ps(sum, _mm256_and_ps(good, _mm256_loadu_ps(&in[i+j])));
+    }
+    average = _mm256_set1_ps(sumAVX2(sum) / (float)mask->nGood);
+    for (j = 0; j < SWARM_FID_BLOCK; j += 8) {
+      good = _mm256_castsi256_ps(_mm256_loadu_si256((__m256i *)&mask->good[j]));
+      data = _mm256_loadu_ps(&in[i+j]);
+      _mm256_storeu_ps(&out[i+j], _mm256_blendv_ps(average, data, good));
+    }
+  }
+} /* End of repairAutoAVX2 */
+
+__attribute__((target("avx2")))
+static void repairDeinterleaveAVX2(const float *in, float *real, float *imag,
+				   int nChannels, const swarmMask *mask)
+{
+  int i, j;
+  __m256 a, b, re, im, good, sumReal, sumImag, averageReal, averageImag;
+
+  for (i = 0; i < nChannels; i += SWARM_FID_BLOCK) {
+    sumReal = sumImag = _mm256_setzero_ps();
+    for (j = 0; j < SWARM_FID_BLOCK; j += 8) {
+      a = _mm256_loadu_ps(&in[2*(i+j)]);
+      b = _mm256_loadu_ps(&in[2*(i+j) + 8]);
+      /*
+	The in-lane shuffles leave the 64 bit pairs of channels in the
+	order 0 2 1 3, which the permutes put right.
+      */
+      re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(re), _MM_SHUFFLE(3, 1, 2, 0)));
+      im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(im), _MM_SHUFFLE(3, 1, 2, 0)));
+      _mm256_storeu_ps(&real[i+j], re);
+      _mm256_storeu_ps(&imag[i+j], im);
+      good = _mm256_castsi256_ps(_mm256_loadu_si256((__m256i *)&mask->good[j]));
+      sumReal = _mm256_add_ps(sumReal, _mm256_and_ps(good, re));
+      sumImag = _mm256_add_ps(sumImag, _mm256_and_ps(good, im));
+    }
+    if (mask->nGood == SWARM_FID_BLOCK)
+      continue;
+    averageReal = _mm256_set1_ps(sumAVX2(sumReal) / (float)mask->nGood);
+    averageImag = _mm256_set1_ps(sumAVX2(sumImag) / (float)mask->nGood);
+    for (j = 0; j < SWARM_FID_BLOCK; j += 8) {
+      good = _mm256_castsi256_ps(_mm256_loadu_si256((__m256i *)&mask->good[j]));
+      re = _mm256_loadu_ps(&real[i+j]);
+      im = _mm256_loadu_ps(&imag[i+j]);
+      _mm256_storeu_ps(&real[i+j], _mm256_blendv_ps(averageReal, re, good));
+      _mm256_storeu_ps(&imag[i+j], _mm256_blendv_ps(averageImag, im, good));
+    }
+  }
+} /* End of repairDeinterleaveAVX2 */
+
+#endif /* HAVE_X86_KERNELS */
+
+/*
+  S W A R M   K E R N E L S   I N I T
+
+  Pick the fastest version of the kernels this CPU can run.
+*/
+void swarmKernelsInit(void)
+{
+  char *version = "scalar";
+
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    repairAuto = repairAutoAVX2;
+    repairDeinterleave = repairDeinterleaveAVX2;
+    version = "AVX2";
+  } else if (__builtin_cpu_supports("sse2")) {
+    repairAuto = repairAutoSSE;
+    repairDeinterleave = repairDeinterleaveSSE;
+    version = "SSE";
+  }
+#endif
+  printf("swarmKernelsInit: using %s SWARM kernels\n", version);
+} /* End of swarmKernelsInit */
+
+void swarmRepairAuto(const float *in, float *out, int nChannels, const swarmMask *mask)
+{
+  (*repairAuto)(in, out, nChannels, mask);
+} /* End of swarmRepairAuto */
+
+void swarmRepairDeinterleave(const float *in, float *real, float *imag,
+			     int nChannels, const swarmMask *mask)
+{
+  (*repairDeinterleave)(in, real, imag, nChannels, mask);
+} /* End of swarmRepairDeinterleave */
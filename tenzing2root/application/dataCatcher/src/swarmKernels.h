@@ -0,0 +1,61 @@
+/*
+  S W A R M   K E R N E L S
+
+  Routines used by dataCatcher to clean up SWARM spectra as they arrive.
+
+  SWARM marks the channels it could not compute (FID blocks lost in the
+  correlator) with NaNs.   The same channels are bad in every
+  SWARM_FID_BLOCK channel wide block of a spectrum, so the bad channels
+  are described by a swarmMask covering one block.   A bad channel is
+  replaced by the average of the good channels in its block.
+
+  The mask is taken from the most recent autocorrelation, and has a flag
+  for every channel of the block.   Before these kernels, storeSWARMData()
+  kept 8 flags, each set by testing the first channel of a group of 8
+  (channels 0, 8, ... 56) for a NaN, and treated the whole group alike.
+  When whole groups are bad, as SWARM's lost FID blocks make them, the
+  two give the same result - swarmKernelsTest checks that they do.   A
+  NaN in any other channel used to be missed, and spread through the
+  average into every bad channel of its block; now it is repaired.
+
+  The kernels come in scalar, SSE and AVX2 versions.   swarmKernelsInit()
+  picks the fastest one the CPU supports, and must be called before any
+  of the others are used.
+*/
+
+#ifndef SWARM_KERNELS_H
+#define SWARM_KERNELS_H
+
+#define SWARM_FID_BLOCK (64) /* Channels per NaN replacement block */
+
+typedef struct swarmMask {
+  int nGood;                             /* Number of good channels per block      */
+  unsigned int good[SWARM_FID_BLOCK];    /* ~0 for a good channel, 0 for a bad one */
+} swarmMask;
+
+void swarmKernelsInit(void);
+
+/*
+  swarmMaskFromAuto derives the mask from the first block of an
+  autocorrelation spectrum - a channel is bad if it holds a NaN.
+  swarmMaskSet builds a mask from an arbitrary list of TRUE (good)
+  or FALSE (bad) flags, one per channel of a block.
+*/
+void swarmMaskFromAuto(const float *spectrum, swarmMask *mask);
+void swarmMaskSet(const int *good, swarmMask *mask);
+
+/*
+  swarmRepairAuto copies the nChannels point real spectrum in to out,
+  replacing the bad channels as it goes.   in and out may be the same.
+*/
+void swarmRepairAuto(const float *in, float *out, int nChannels, const swarmMask *mask);
+
+/*
+  swarmRepairDeinterleave splits the nChannels point complex spectrum
+  in, stored as real/imaginary pairs, into real and imag, replacing
+  the bad channels as it goes.
+*/
+void swarmRepairDeinterleave(const float *in, float *real, float *imag,
+			     int nChannels, const swarmMask *mask);
+
+#endif
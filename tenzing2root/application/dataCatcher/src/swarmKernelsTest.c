@@ -0,0 +1,249 @@
+/*
+  S W A R M   K E R N E L S   T E S T
+
+  Checks the scalar, SSE and AVX2 SWARM kernels against the loops which
+  storeSWARMData() used before swarmKernels.c was written, transcribed
+  below as oldRepairAuto() and oldRepairCross().   swarmKernels.c is
+  included, rather than linked, so that each version of the kernels can
+  be called directly.
+
+  Where the bad channels come in whole groups of 8, the old NaN pattern
+  and the swarmMask agree, and the scalar kernels must match the old
+  loops exactly.   The SIMD kernels sum in a different order, so they
+  need only agree to within a rounding error.   The last case has a NaN
+  in a single channel, which the old pattern, looking at one channel in
+  8, missed - the kernels must repair it.
+
+  Run by "make check".   Exits with status 0 if every case passes.
+*/
+
+#include <stdlib.h>
+#include "swarmKernels.c"
+
+#define OK (0)
+#define ERROR (-1)
+
+#define N_CHANNELS (16384) /* The old loops handled 256 blocks of 64 */
+#define TOLERANCE (1.0e-5)
+
+static int nFailed = 0;
+
+/* The NaN pattern and replacement loops from the old storeSWARMData() */
+static int nANPattern[8];
+static int gotSomeNANs;
+
+static void oldPatternFromAuto(const float *lSB)
+{
+  int i;
+
+  gotSomeNANs = FALSE;
+  for (i = 0; i < 8; i++)
+    if (isnan(lSB[i*8])) {
+      nANPattern[i] = FALSE;
+      gotSomeNANs = TRUE;
+    } else
+      nANPattern[i] = TRUE;
+} /* End of oldPatternFromAuto */
+
+static void oldRepairAuto(float *lSB)
+{
+  int i, j;
+
+  if (!gotSomeNANs)
+    return;
+  for (i = 0; i < 256; i++) {
+    int nGoodData = 0;
+    float goodDataSum = 0.0;
+
+    for (j = 0; j < 64; j++)
+      if (nANPattern[j/8]) {
+	goodDataSum += lSB[i*64 + j];
+	nGoodData++;
+      }
+    goodDataSum /= (float)nGoodData;
+    for (j = 0; j < 64; j++)
+      if (!nANPattern[j/8])
+	lSB[i*64 + j] = goodDataSum;
+  }
+} /* End of oldRepairAuto */
+
+static void oldRepairCross(float *sB, float *real, float *imag)
+{
+  int i, j;
+
+  if (gotSomeNANs)
+    for (i = 0; i < 256; i++) {
+      int nGoodData = 0;
+      float goodReal = 0.0, goodImag = 0.0;
+
+      for (j = 0; j < 64; j++)
+	if (nANPattern[j/8]) {
+	  goodReal += sB[(i*64 + j)*2];
+	  goodImag += sB[(i*64 + j)*2 + 1];
+	  nGoodData++;
+	}
+      goodReal /= (float)nGoodData;
+      goodImag /= (float)nGoodData;
+      for (j = 0; j < 64; j++)
+	if (!nANPattern[j/8]) {
+	  sB[(i*64 + j)*2]     = goodReal;
+	  sB[(i*64 + j)*2 + 1] = goodImag;
+	}
+    }
+  for (i = 0; i < N_CHANNELS; i++) {
+    real[i] = sB[2*i];
+    imag[i] = sB[2*i + 1];
+  }
+} /* End of oldRepairCross */
+
+/*
+  compare checks nPoints of got against want, exactly if tolerance is 0,
+  otherwise to within tolerance of the larger of 1 and |want|.
+*/
+static int compare(const char *what, const float *got, const float *want, int nPoints, double tolerance)
+{
+  int i;
+
+  for (i = 0; i < nPoints; i++) {
+    if (isnan(got[i]) || isnan(want[i])) {
+      if (isnan(got[i]) && isnan(want[i]))
+	continue;
+    } else if (tolerance == 0.0) {
+      if (got[i] == want[i])
+	continue;
+    } else if (fabs(got[i] - want[i]) <= tolerance*((fabs(want[i]) > 1.0) ? fabs(want[i]) : 1.0))
+      continue;
+    printf("FAIL %s: channel %d is %g, should be %g\n", what, i, got[i], want[i]);
+    nFailed++;
+    return(ERROR);
+  }
+  return(OK);
+} /* End of compare */
+
+/* supported returns TRUE if the CPU can run the kernels which need feature */
+static int supported(const char *feature)
+{
+#ifdef HAVE_X86_KERNELS
+  if (feature == NULL)
+    return(TRUE);
+  if (!strcmp(feature, "sse2"))
+    return(__builtin_cpu_supports("sse2"));
+  if (!strcmp(feature, "avx2"))
+    return(__builtin_cpu_supports("avx2"));
+  return(FALSE);
+#else
+  return(feature == NULL);
+#endif
+} /* End of supported */
+
+typedef struct kernelVersion {
+  char *name;
+  char *cpuFeature;
+  double tolerance;
+  void (*repairAuto)(const float *in, float *out, int nChannels, const swarmMask *mask);
+  void (*repairDeinterleave)(const float *in, float *real, float *imag,
+			     int nChannels, const swarmMask *mask);
+} kernelVersion;
+
+static kernelVersion versions[] = {
+  {"scalar", NULL, 0.0, repairAutoScalar, repairDeinterleaveScalar},
+#ifdef HAVE_X86_KERNELS
+  {"SSE", "sse2", TOLERANCE, repairAutoSSE, repairDeinterleaveSSE},
+  {"AVX2", "avx2", TOLERANCE, repairAutoAVX2, repairDeinterleaveAVX2},
+#endif
+};
+#define N_VERSIONS ((int)(sizeof(versions)/sizeof(versions[0])))
+
+/*
+  runCase fills an autocorrelation and a cross-correlation with random
+  data, puts NaNs in the channels of every block marked bad in badGroups
+  (one bit per group of 8 channels) and badChannel (-1 for none), and
+  checks every version of the kernels against the old loops.   If
+  oldAgrees is FALSE the old loops are known to get this case wrong, and
+  the kernels are only checked for leaving no NaNs behind.
+*/
+static void runCase(const char *name, int badGroups, int badChannel, int oldAgrees)
+{
+  int i, v;
+  char what[100];
+  float *autoIn, *autoOld, *autoNew, *cross, *crossOld, *realOld, *imagOld, *real, *imag;
+  swarmMask mask;
+
+  autoIn = (float *)malloc(N_CHANNELS*sizeof(float));
+  autoOld = (float *)malloc(N_CHANNELS*sizeof(float));
+  autoNew = (float *)malloc(N_CHANNELS*sizeof(float));
+  cross = (float *)malloc(2*N_CHANNELS*sizeof(float));
+  crossOld = (float *)malloc(2*N_CHANNELS*sizeof(float));
+  realOld = (float *)malloc(N_CHANNELS*sizeof(float));
+  imagOld = (float *)malloc(N_CHANNELS*sizeof(float));
+  real = (float *)malloc(N_CHANNELS*sizeof(float));
+  imag = (float *)malloc(N_CHANNELS*sizeof(float));
+  if ((autoIn == NULL) || (autoOld == NULL) || (autoNew == NULL) || (cross == NULL) ||
+      (crossOld == NULL) || (realOld == NULL) || (imagOld == NULL) || (real == NULL) || (imag == NULL)) {
+    perror("runCase: malloc");
+    exit(ERROR);
+  }
+  for (i = 0; i < N_CHANNELS; i++) {
+    int bad = ((badGroups >> ((i % SWARM_FID_BLOCK)/8)) & 1) || ((i % SWARM_FID_BLOCK) == badChannel);
+
+    autoIn[i] = bad ? NAN : 1.0e6*((float)rand())/((float)RAND_MAX);
+    cross[2*i]     = bad ? NAN : ((float)rand())/((float)RAND_MAX) - 0.5;
+    cross[2*i + 1] = bad ? NAN : ((float)rand())/((float)RAND_MAX) - 0.5;
+  }
+  memcpy(autoOld, autoIn, N_CHANNELS*sizeof(float));
+  memcpy(crossOld, cross, 2*N_CHANNELS*sizeof(float));
+  oldPatternFromAuto(autoOld);
+  oldRepairAuto(autoOld);
+  oldRepairCross(crossOld, realOld, imagOld);
+  swarmMaskFromAuto(autoIn, &mask);
+
+  for (v = 0; v < N_VERSIONS; v++) {
+    if (!supported(versions[v].cpuFeature)) {
+      printf("SKIP %s %s: the CPU lacks %s\n", name, versions[v].name, versions[v].cpuFeature);
+      continue;
+    }
+    (*versions[v].repairAuto)(autoIn, autoNew, N_CHANNELS, &mask);
+    (*versions[v].repairDeinterleave)(cross, real, imag, N_CHANNELS, &mask);
+    if (oldAgrees) {
+      sprintf(what, "%s %s auto", name, versions[v].name);
+      if (compare(what, autoNew, autoOld, N_CHANNELS, versions[v].tolerance) != OK)
+	continue;
+      sprintf(what, "%s %s real", name, versions[v].name);
+      if (compare(what, real, realOld, N_CHANNELS, versions[v].tolerance) != OK)
+	continue;
+      sprintf(what, "%s %s imag", name, versions[v].name);
+      if (compare(what, imag, imagOld, N_CHANNELS, versions[v].tolerance) != OK)
+	continue;
+    } else {
+      for (i = 0; i < N_CHANNELS; i++)
+	if (isnan(autoNew[i]) || isnan(real[i]) || isnan(imag[i]))
+	  break;
+      if (i < N_CHANNELS) {
+	printf("FAIL %s %s: channel %d still holds a NaN\n", name, versions[v].name, i);
+	nFailed++;
+	continue;
+      }
+    }
+    printf("PASS %s %s\n", name, versions[v].name);
+  }
+  free(autoIn); free(autoOld); free(autoNew); free(cross); free(crossOld);
+  free(realOld); free(imagOld); free(real); free(imag);
+} /* End of runCase */
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+#endif
+  srand(1);
+  runCase("no NaNs", 0x00, -1, TRUE);
+  runCase("group 3 bad", 0x08, -1, TRUE);
+  runCase("groups 0, 2 and 7 bad", 0x85, -1, TRUE);
+  runCase("single channel 13 bad", 0x00, 13, FALSE);
+  if (nFailed) {
+    printf("swarmKernelsTest: %d checks failed\n", nFailed);
+    exit(ERROR);
+  }
+  printf("swarmKernelsTest: all checks passed\n");
+  exit(OK);
+} /* End of main */
@@ -0,0 +1,55 @@
+/*
+  swarmStream.h
+
+  Definitions for the framed TCP stream which the SWARM correlator uses
+  to deliver a complete integration to dataCatcher in a single transfer,
+  rather than with one catch_swarm_data_1 RPC call per baseline and chunk.
+
+  Each frame consists of:
+  1) A swarmStreamHeader.
+  2) The baseline table - header.nRecords swarmStreamRecords.
+  3) The payload - the spectra for each record in the table, in table
+     order, packed together without padding.   A cross-correlation
+     record carries 2*nChannels floats of interleaved LSB real/imaginary
+     values followed by 2*nChannels floats of USB values, laid out just
+     as in a dSWARMUVBlock.   An autocorrelation record (ant1 == ant2)
+     carries nChannels floats.
+
+  Everything is sent in the sender's native byte order.   dataCatcher
+  rejects any frame whose magic number shows that the byte order differs
+  from its own.   dataCatcher answers every frame with a swarmStreamReply.
+*/
+
+#ifndef SWARM_STREAM_H
+#define SWARM_STREAM_H
+
+#include <stdint.h>
+
+#define SWARM_STREAM_PORT    (5480)
+#define SWARM_STREAM_MAGIC   (0x53574d49) /* "SWMI" */
+#define SWARM_STREAM_VERSION (1)
+#define SWARM_STREAM_MAX_RECORDS (256)
+
+typedef struct swarmStreamHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nRecords;  /* Number of entries in the baseline table      */
+  uint32_t nChannels; /* Number of channels per sideband, per chunk   */
+  double   uT;        /* Same meaning as in dSWARMUVBlock              */
+  double   duration;
+} swarmStreamHeader;
+
+typedef struct swarmStreamRecord {
+  int32_t ant1;
+  int32_t ant2;
+  int32_t chunk;
+  int32_t spare;
+} swarmStreamRecord;
+
+typedef struct swarmStreamReply {
+  uint32_t magic;
+  int32_t  rt_code;   /* Same meaning as in dStatusStructure, including */
+                      /* the congestion codes in congestion.h          */
+} swarmStreamReply;
+
+#endif
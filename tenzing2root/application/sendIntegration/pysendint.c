@@ -11,6 +11,11 @@ int sendIntegration(int nPoints, double uT, float duration, int chunk,
 /* Function prototype for sendSync */
 int sendSync(void);
 
+/* Function prototypes for sendSWARMIntegration.c */
+int beginSWARMIntegration(double uT, float duration, int nPoints);
+int addSWARMBaseline(int chunk, int ant1, int ant2, float *lsbCross, float *usbCross);
+int sendSWARMIntegration(void);
+
 static PyObject *
 send_sync(PyObject *self, PyObject *args)
 {
@@ -143,12 +148,94 @@ send_integration(PyObject *self, PyObject *args)
 }
 
 
+/* Convert a python sequence of floats into a malloc'd C array */
+static float *
+sequence_to_floats(PyObject *seqObj, int len)
+{
+  int i;
+  float *values;
+  PyObject *item;
+
+  values = (float *) malloc(sizeof(float) * len);
+  if (values == NULL) {
+    PyErr_SetString(PyExc_TypeError, "Problem malloc array data!");
+    return NULL;
+  }
+  for (i=0; i<len; i++) {
+    item = PySequence_GetItem(seqObj, i);
+    if (!PyFloat_Check(item)) {
+      PyErr_SetString(PyExc_TypeError, "Array items must be floats!");
+      Py_DECREF(item);
+      free(values);
+      return NULL;
+    }
+    values[i] = (float) PyFloat_AsDouble(item);
+    Py_DECREF(item);
+  }
+  return values;
+}
+
+static PyObject *
+begin_integration(PyObject *self, PyObject *args)
+{
+  double uT;
+  float duration;
+  int nPoints;
+
+  if (!PyArg_ParseTuple(args, "dfi", &uT, &duration, &nPoints))
+    return NULL;
+  return Py_BuildValue("i", beginSWARMIntegration(uT, duration, nPoints));
+}
+
+static PyObject *
+add_baseline(PyObject *self, PyObject *args)
+{
+  int chunk, ant1, ant2, len, sts;
+  float *lsbCross, *usbCross;
+  PyObject *lsbCrossObj, *usbCrossObj;
+
+  if (!PyArg_ParseTuple(args, "iiiOO", &chunk, &ant1, &ant2,
+			&lsbCrossObj, &usbCrossObj))
+    return NULL;
+  if (!PySequence_Check(lsbCrossObj) || !PySequence_Check(usbCrossObj)) {
+    PyErr_SetString(PyExc_TypeError, "lsbCross and usbCross arguments must be sequences!");
+    return NULL;
+  }
+  len = PySequence_Size(lsbCrossObj);
+  if (len != PySequence_Size(usbCrossObj)) {
+    PyErr_SetString(PyExc_TypeError, "lsbCross and usbCross must be the same length!");
+    return NULL;
+  }
+  if ((lsbCross = sequence_to_floats(lsbCrossObj, len)) == NULL)
+    return NULL;
+  if ((usbCross = sequence_to_floats(usbCrossObj, len)) == NULL) {
+    free(lsbCross);
+    return NULL;
+  }
+  sts = addSWARMBaseline(chunk, ant1, ant2, lsbCross, usbCross);
+  free(lsbCross);
+  free(usbCross);
+  return Py_BuildValue("i", sts);
+}
+
+static PyObject *
+send_batch(PyObject *self, PyObject *args)
+{
+  return Py_BuildValue("i", sendSWARMIntegration());
+}
+
 static PyMethodDef SendIntMethods[] = {
 
   {"send_integration", send_integration, METH_VARARGS,
    "Send an integration."},
   {"send_sync", send_sync, METH_NOARGS,
    "Send a sync-only to dataCatcher."},
+  {"begin_integration", begin_integration, METH_VARARGS,
+   "Start building a whole integration to stream to dataCatcher."},
+  {"add_baseline", add_baseline, METH_VARARGS,
+   "Add one baseline/chunk to the integration being built."},
+  {"send_batch", send_batch, METH_NOARGS,
+   "Stream the integration being built to dataCatcher in one transfer."},
   {NULL, NULL, 0, NULL}
 };
 
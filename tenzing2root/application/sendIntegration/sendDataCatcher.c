@@ -0,0 +1,65 @@
+/*
+  sendDataCatcher.c
+
+    sendDataCatcherIntegration() sends one baseline and chunk of a SWARM
+integration straight to dataCatcher with the catch_swarm_data_1 RPC call,
+bypassing corrSaver.   The spectra are passed in the same form as for
+sendIntegration().   The client handle is kept between calls, and is
+dropped if a call gets no reply, so that the next call reconnects.
+If dataCatcher replies with a congestion code (see congestion.h), the
+code is returned.   The call does not back off itself - the caller should
+do so once per integration, not once per baseline and chunk.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ERROR (-1)
+#define OK    ( 0)
+
+#include "dataCatcher.h"   /* RPC server/client structures */
+
+dSWARMUVBlock dataCatcherData;
+
+int sendDataCatcherIntegration(char *host, int nPoints, double uT, float duration, int chunk,
+			       int ant1, int ant2, float *lsbCross, float *usbCross)
+{
+  int i;
+  dStatusStructure *result;
+  static CLIENT *cl = NULL;
+
+  dataCatcherData.nChannels = nPoints;
+  dataCatcherData.uT = uT;
+  dataCatcherData.duration = duration;
+  dataCatcherData.ant1 = ant1;
+  dataCatcherData.ant2 = ant2;
+  dataCatcherData.chunk = chunk;
+  if (ant1 == ant2)
+    for (i = 0; i < nPoints; i++)
+      dataCatcherData.lSB[i] = lsbCross[2*i];
+  else {
+    for (i = 0; i < 2*nPoints; i++) {
+      dataCatcherData.lSB[i] = lsbCross[i];
+      dataCatcherData.uSB[i] = usbCross[i];
+    }
+  }
+  if (cl == NULL) {
+    cl = clnt_create(host, DATACATCHERPROG, DATACATCHERVERS, "tcp");
+    if (!cl) {
+      fprintf(stderr, "%s", clnt_spcreateerror(host));
+      return ERROR;
+    }
+  }
+  result = catch_swarm_data_1(&dataCatcherData, cl);
+  if (result == NULL) {
+    fprintf(stderr, "NULL returned by catch_swarm_data_1()\n");
+    clnt_destroy(cl);
+    cl = NULL;
+    return ERROR;
+  }
+  if (result->rt_code < 0) {
+    fprintf(stderr, "catch_swarm_data_1() returned %d\n", result->rt_code);
+    return ERROR;
+  }
+  return result->rt_code;
+}
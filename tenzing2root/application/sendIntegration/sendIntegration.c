@@ -39,6 +39,7 @@ int printResults(statusStructure *results)
 }
 
 pSWARMUVBlock sWARMData;
+char *corrSaverHost = "obscon"; /* Load generators may point this elsewhere */
 
 int sendIntegration(int nPoints, double uT, float duration, int chunk,
 		    int ant1, int pol1, int ant2, int pol2,
@@ -72,8 +73,8 @@ int sendIntegration(int nPoints, double uT, float duration, int chunk,
 
     /* Send the data to obscon only */
     if (corrSaverCl == NULL) {
-      if (!(corrSaverCl = clnt_create("obscon", CHUNKPLOTPROG, CHUNKPLOTVERS, "tcp"))) {
-	fprintf(stderr, clnt_spcreateerror("obscon"));
+      if (!(corrSaverCl = clnt_create(corrSaverHost, CHUNKPLOTPROG, CHUNKPLOTVERS, "tcp"))) {
+	fprintf(stderr, "%s", clnt_spcreateerror(corrSaverHost));
 	return(ERROR);
       }
     }
@@ -81,6 +82,7 @@ int sendIntegration(int nPoints, double uT, float duration, int chunk,
       fprintf(stderr, "Error returned from corrPlotter call\n");
       clnt_destroy(corrSaverCl);
       corrSaverCl = NULL;
+      return(ERROR);
     }
   }
   return OK;
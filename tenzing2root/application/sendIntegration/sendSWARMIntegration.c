@@ -0,0 +1,246 @@
+/*
+  sendSWARMIntegration.c
+
+    These functions send a complete SWARM integration to dataCatcher in a
+single transfer, over the framed TCP stream described in swarmStream.h,
+rather than making one RPC call per baseline and chunk.   The caller starts
+an integration with beginSWARMIntegration(), adds each baseline, chunk and
+autocorrelation with addSWARMBaseline(), and then calls sendSWARMIntegration().
+The spectra are passed in the same form as for sendIntegration().   The
+connection to dataCatcher is kept open between integrations.   If
+dataCatcher answers an integration with a congestion code (see
+congestion.h), the next integration is held back, whole, until the
+congestionDelay() has passed since the reply.   The caller is not kept
+waiting in the meantime, and can go on building the next integration.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "swarmStream.h"
+#include "congestion.h"
+
+#define DATACATCHER_HOST "hcn"
+
+#define ERROR (-1)
+#define OK    ( 0)
+
+static int streamFd = -1;
+static swarmStreamHeader header;
+static swarmStreamRecord table[SWARM_STREAM_MAX_RECORDS];
+static float *payload = NULL;
+static size_t payloadSize = 0, payloadUsed = 0;
+static int backoff = 0;
+static struct timespec holdUntil = {0, 0}; /* Send no integration before this */
+
+/*
+  Open the connection to dataCatcher, if it is not already open.
+ */
+static int streamConnect(void)
+{
+  int on = 1, rCode;
+  char port[10];
+  struct addrinfo hints, *addresses, *ptr;
+
+  if (streamFd >= 0)
+    return(OK);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  sprintf(port, "%d", SWARM_STREAM_PORT);
+  rCode = getaddrinfo(DATACATCHER_HOST, port, &hints, &addresses);
+  if (rCode) {
+    fprintf(stderr, "sendSWARMIntegration: getaddrinfo(%s) - %s\n",
+	    DATACATCHER_HOST, gai_strerror(rCode));
+    return(ERROR);
+  }
+  for (ptr = addresses; ptr != NULL; ptr = ptr->ai_next) {
+    streamFd = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+    if (streamFd < 0)
+      continue;
+    if (connect(streamFd, ptr->ai_addr, ptr->ai_addrlen) == 0)
+      break;
+    close(streamFd);
+    streamFd = -1;
+  }
+  freeaddrinfo(addresses);
+  if (streamFd < 0) {
+    perror("sendSWARMIntegration: connect to dataCatcher");
+    return(ERROR);
+  }
+  setsockopt(streamFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return(OK);
+}
+
+static void streamClose(void)
+{
+  if (streamFd >= 0)
+    close(streamFd);
+  streamFd = -1;
+}
+
+int beginSWARMIntegration(double uT, float duration, int nPoints)
+{
+  header.magic = SWARM_STREAM_MAGIC;
+  header.version = SWARM_STREAM_VERSION;
+  header.nRecords = 0;
+  header.nChannels = nPoints;
+  header.uT = uT;
+  header.duration = duration;
+  payloadUsed = 0;
+  return(OK);
+}
+
+/*
+  Add one baseline and chunk to the integration.   If ant1 == ant2 it is
+  an autocorrelation, and only the real parts of lsbCross are used, as in
+  sendIntegration().
+ */
+int addSWARMBaseline(int chunk, int ant1, int ant2, float *lsbCross, float *usbCross)
+{
+  int i;
+  size_t needed, newSize;
+  float *ptr, *newPayload;
+
+  if (header.nRecords >= SWARM_STREAM_MAX_RECORDS) {
+    fprintf(stderr, "addSWARMBaseline: too many records (max %d)\n", SWARM_STREAM_MAX_RECORDS);
+    return(ERROR);
+  }
+  if (ant1 == ant2)
+    needed = payloadUsed + header.nChannels;
+  else
+    needed = payloadUsed + 4*header.nChannels;
+  if (needed > payloadSize) {
+    newSize = (payloadSize == 0) ? 64*header.nChannels : payloadSize;
+    while (needed > newSize)
+      newSize *= 2;
+    /* On failure the old payload, and the baselines already in it, are kept */
+    newPayload = (float *)realloc(payload, newSize*sizeof(float));
+    if (newPayload == NULL) {
+      perror("addSWARMBaseline: realloc of payload");
+      return(ERROR);
+    }
+    payload = newPayload;
+    payloadSize = newSize;
+  }
+  ptr = &payload[payloadUsed];
+  if (ant1 == ant2)
+    for (i = 0; i < header.nChannels; i++)
+      ptr[i] = lsbCross[2*i];
+  else {
+    memcpy(ptr, lsbCross, 2*header.nChannels*sizeof(float));
+    memcpy(ptr + 2*header.nChannels, usbCross, 2*header.nChannels*sizeof(float));
+  }
+  payloadUsed = needed;
+  table[header.nRecords].ant1 = ant1;
+  table[header.nRecords].ant2 = ant2;
+  table[header.nRecords].chunk = chunk;
+  table[header.nRecords].spare = 0;
+  header.nRecords++;
+  return(OK);
+}
+
+/*
+  holdOff waits out any hold set by the last integration's reply.
+ */
+static void holdOff(void)
+{
+  int rCode;
+
+  if (holdUntil.tv_sec == 0)
+    return;
+  while ((rCode = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &holdUntil, NULL)) == EINTR);
+  if (rCode != 0)
+    fprintf(stderr, "sendSWARMIntegration: clock_nanosleep: %s\n", strerror(rCode));
+  holdUntil.tv_sec = holdUntil.tv_nsec = 0;
+}
+
+/*
+  Send the integration built up by addSWARMBaseline() to dataCatcher,
+  and wait for its reply.   If the reply says dataCatcher is congested,
+  the next integration will be held back (see congestion.h).
+ */
+int sendSWARMIntegration(void)
+{
+  int i, delay;
+  ssize_t nDone;
+  size_t total;
+  struct iovec iov[3];
+  struct msghdr message;
+  swarmStreamReply reply;
+  char *replyPtr;
+
+  holdOff();
+  if (streamConnect() != OK)
+    return(ERROR);
+  iov[0].iov_base = &header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = table;
+  iov[1].iov_len = header.nRecords*sizeof(swarmStreamRecord);
+  iov[2].iov_base = payload;
+  iov[2].iov_len = payloadUsed*sizeof(float);
+  total = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+  /*
+    sendmsg() with MSG_NOSIGNAL, rather than writev(), so that a connection
+    reset by a restarting dataCatcher fails with EPIPE instead of killing
+    the caller with SIGPIPE.
+  */
+  memset(&message, 0, sizeof(message));
+  i = 0;
+  while (total > 0) {
+    message.msg_iov = &iov[i];
+    message.msg_iovlen = 3-i;
+    nDone = sendmsg(streamFd, &message, MSG_NOSIGNAL);
+    if (nDone < 0) {
+      perror("sendSWARMIntegration: sendmsg");
+      streamClose();
+      return(ERROR);
+    }
+    total -= nDone;
+    while ((i < 3) && (nDone >= (ssize_t)iov[i].iov_len)) {
+      nDone -= iov[i].iov_len;
+      i++;
+    }
+    if (i < 3) {
+      iov[i].iov_base = (char *)iov[i].iov_base + nDone;
+      iov[i].iov_len -= nDone;
+    }
+  }
+  replyPtr = (char *)&reply;
+  total = sizeof(reply);
+  while (total > 0) {
+    nDone = read(streamFd, replyPtr, total);
+    if (nDone <= 0) {
+      perror("sendSWARMIntegration: read of reply");
+      streamClose();
+      return(ERROR);
+    }
+    replyPtr += nDone;
+    total -= nDone;
+  }
+  if ((reply.magic != SWARM_STREAM_MAGIC) || (reply.rt_code < 0)) {
+    printf("reply.rt_code = %d\n", reply.rt_code);
+    return(ERROR);
+  }
+  /* The integration was taken, but hold off the next one if dataCatcher is congested */
+  delay = congestionDelay(reply.rt_code, &backoff);
+  if (delay > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &holdUntil);
+    holdUntil.tv_sec += delay/1000000;
+    holdUntil.tv_nsec += (delay % 1000000)*1000;
+    if (holdUntil.tv_nsec >= 1000000000) {
+      holdUntil.tv_sec++;
+      holdUntil.tv_nsec -= 1000000000;
+    }
+  }
+  return(OK);
+}
@@ -5,11 +5,13 @@ setup(
     ext_modules = [Extension('pysendint', 
                              ['__wrappers.c',
                               'pysendint.c', 'sendIntegration.c', 'sendSync.c',
+                              'sendSWARMIntegration.c',
                               'chunkPlot_clnt.c', 'chunkPlot_xdr.c',
                               'dataCatcher_clnt.c', 'dataCatcher_xdr.c',
                               '/global/functions/getAntennaList.c',
                               '/global/functions/defaultingEnabled.c',
                               ],
+                             include_dirs=['../dataCatcher/src'],
                              extra_compile_args=['-fno-builtin-printf',
                                                  '-fno-builtin-fprintf',
                                                  '-fno-builtin-perror',
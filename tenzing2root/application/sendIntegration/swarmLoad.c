@@ -0,0 +1,355 @@
+/*
+  swarmLoad.c
+
+    swarmLoad is a load generator for the SWARM RPC data path.   It sends
+fake integrations, one sendIntegration() call per baseline and chunk as
+the SWARM software does, to corrSaver (or, with -d, straight to
+dataCatcher), on a fixed integration period, and reports the throughput
+it achieved and the percentiles of the integrations' end-to-end latency -
+the time from an integration's scheduled start until the last of its calls
+has been answered.   An integration whose latency exceeds the period means
+the receiver can not keep up at that rate.   The calls/s and MB/s are
+averaged over the time some sender was busy with an integration, not over
+the whole schedule, so that they measure what the receiver sustained rather
+than the rate at which the integrations were offered.   With -d, the calls which
+dataCatcher answers with a congestion code (see congestion.h) are counted,
+and the senders back off as a real sender would - once per integration,
+after its last call, using the worst code any of its calls got.
+
+    The calls for each integration are shared out among several sender
+processes, each with its own RPC connection, so that concurrent senders
+can be simulated.   Each sender tells the parent process, through a pipe,
+when it has finished each integration.
+
+Usage: swarmLoad [-h host] [-d] [-a antennas] [-c chunks] [-n channels]
+                 [-p period] [-s senders] [-i integrations]
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "chunkPlot.h"
+#include "congestion.h"
+
+#define MAX_ANTENNAS (10)
+#define N_CHUNKS (6)    /* sendIntegration() accepts no more */
+#define MAX_SENDERS (64)
+#define MIN_FOR_P99 (100) /* Integrations needed for a 99th percentile below the max */
+
+#define ERROR (-1)
+#define OK    ( 0)
+
+/* What a sender reports to the parent for each integration */
+typedef struct senderReport {
+  int integration;
+  int nCalls;
+  int nErrors;
+  int nCongested; /* Calls answered with a congestion code */
+  double started; /* Time the sender began sending the integration */
+  double done;    /* Time the sender's last call for the integration returned */
+} senderReport;
+
+int sendIntegration(int nPoints, double uT, float duration, int chunk,
+		    int ant1, int pol1, int ant2, int pol2,
+		    float *lsbCross, float *usbCross, int forceTransfer);
+int sendDataCatcherIntegration(char *host, int nPoints, double uT, float duration, int chunk,
+			       int ant1, int ant2, float *lsbCross, float *usbCross);
+extern char *corrSaverHost;
+
+char *host = "localhost";
+int toDataCatcher = 0;
+int nAntennas = 8;
+int nChunks = 2;
+int nChannels = P_N_SWARM_CHANNELS;
+int nSenders = 1;
+int nIntegrations = 10;
+double period = 30.0;
+
+double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return(((double)ts.tv_sec) + ((double)ts.tv_nsec)*1.0e-9);
+}
+
+void sleepUntil(double when)
+{
+  int rCode;
+  struct timespec due;
+
+  due.tv_sec = (time_t)when;
+  due.tv_nsec = (long)((when - (double)due.tv_sec)*1.0e9);
+  while ((rCode = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &due, NULL)) == EINTR);
+  if (rCode != 0)
+    fprintf(stderr, "sleepUntil: clock_nanosleep: %s\n", strerror(rCode));
+}
+
+int compareDoubles(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return((x > y) - (x < y));
+}
+
+/*
+  percentile returns the nearest-rank p'th percentile of the n sorted values
+in sorted - the smallest value which at least a fraction p of them do not
+exceed.
+ */
+double percentile(double *sorted, int n, double p)
+{
+  int rank;
+
+  rank = (int)ceil(p*((double)n) - 1.0e-9);
+  if (rank < 1)
+    rank = 1;
+  else if (rank > n)
+    rank = n;
+  return(sorted[rank-1]);
+}
+
+void usage(char *name)
+{
+  fprintf(stderr, "Usage: %s [-h host] [-d] [-a antennas] [-c chunks] [-n channels]\n", name);
+  fprintf(stderr, "       [-p period] [-s senders] [-i integrations]\n");
+  fprintf(stderr, "  -h host         receiving host (default localhost)\n");
+  fprintf(stderr, "  -d              send to dataCatcher rather than corrSaver\n");
+  fprintf(stderr, "  -a antennas     1 to %d (default 8)\n", MAX_ANTENNAS);
+  fprintf(stderr, "  -c chunks       1 to %d (default 2)\n", N_CHUNKS);
+  fprintf(stderr, "  -n channels     1 to %d (default %d)\n", P_N_SWARM_CHANNELS, P_N_SWARM_CHANNELS);
+  fprintf(stderr, "  -p period       integration period in seconds (default 30)\n");
+  fprintf(stderr, "  -s senders      concurrent sender processes, 1 to %d (default 1)\n", MAX_SENDERS);
+  fprintf(stderr, "  -i integrations integrations to send (default 10)\n");
+  exit(ERROR);
+}
+
+/*
+  sender sends its share of every integration - every nSenders'th call,
+starting with call number senderNumber - and writes a senderReport for each
+integration to fd.   Every integration starts period seconds after the last,
+the first at start, unless the sender is still busy with the one before.
+ */
+void sender(int senderNumber, double start, int fd)
+{
+  int i, ant1, ant2, chunk, chan, call, rCode, worst, backoff = 0;
+  float *lower, *upper;
+  double uT;
+  senderReport report;
+  time_t startTime;
+  struct tm *gm;
+
+  lower = (float *)malloc(2*P_N_SWARM_CHANNELS*sizeof(float));
+  upper = (float *)malloc(2*P_N_SWARM_CHANNELS*sizeof(float));
+  if ((lower == NULL) || (upper == NULL)) {
+    perror("sender: malloc");
+    exit(ERROR);
+  }
+  srand((unsigned int)(senderNumber+1));
+  for (chan = 0; chan < 2*P_N_SWARM_CHANNELS; chan++) {
+    lower[chan] = ((float)rand())/((float)RAND_MAX) - 0.5;
+    upper[chan] = ((float)rand())/((float)RAND_MAX) - 0.5;
+  }
+  startTime = (time_t)start;
+  gm = gmtime(&startTime);
+  for (i = 0; i < nIntegrations; i++) {
+    sleepUntil(start + ((double)i)*period);
+    uT = (double)gm->tm_hour + ((double)gm->tm_min)/60.0 +
+      ((double)gm->tm_sec + ((double)i)*period)/3600.0;
+    report.integration = i;
+    report.nCalls = report.nErrors = report.nCongested = 0;
+    report.started = now();
+    call = 0;
+    worst = 0;
+    for (ant1 = 1; ant1 <= nAntennas; ant1++)
+      for (ant2 = ant1; ant2 <= nAntennas; ant2++)
+	for (chunk = 0; chunk < ((ant1 == ant2) ? 1 : nChunks); chunk++) {
+	  if ((call++ % nSenders) != senderNumber)
+	    continue;
+	  if (toDataCatcher)
+	    rCode = sendDataCatcherIntegration(host, nChannels, uT, (float)period, chunk,
+					       ant1, ant2, lower, upper);
+	  else
+	    rCode = sendIntegration(nChannels, uT, (float)period, chunk,
+				    ant1, 0, ant2, 0, lower, upper, TRUE);
+	  report.nCalls++;
+	  if (rCode < 0)
+	    report.nErrors++;
+	  else if (rCode > 0) {
+	    report.nCongested++;
+	    if (rCode > worst)
+	      worst = rCode;
+	  }
+	}
+    report.done = now();
+    if (write(fd, &report, sizeof(report)) != sizeof(report)) {
+      perror("sender: write");
+      exit(ERROR);
+    }
+    congestionBackoff(worst, &backoff);
+  }
+  exit(OK);
+}
+
+int main(int argc, char **argv)
+{
+  int i, option, nOpen, nCalls = 0, nErrors = 0, nCongested = 0, nLate = 0, nDone = 0;
+  int fds[MAX_SENDERS];
+  double start, busyEnd, busy = 0.0, *started, *done, *latency, sum = 0.0, p99;
+  double bytesPerCall, nCrossCalls, nAutoCalls;
+  struct pollfd polls[MAX_SENDERS];
+  senderReport report;
+  pid_t pid;
+
+  while ((option = getopt(argc, argv, "h:da:c:n:p:s:i:")) != -1)
+    switch (option) {
+    case 'h':
+      host = optarg;
+      break;
+    case 'd':
+      toDataCatcher = 1;
+      break;
+    case 'a':
+      nAntennas = atoi(optarg);
+      break;
+    case 'c':
+      nChunks = atoi(optarg);
+      break;
+    case 'n':
+      nChannels = atoi(optarg);
+      break;
+    case 'p':
+      period = atof(optarg);
+      break;
+    case 's':
+      nSenders = atoi(optarg);
+      break;
+    case 'i':
+      nIntegrations = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  if ((optind != argc) || (nAntennas < 1) || (nAntennas > MAX_ANTENNAS) ||
+      (nChunks < 1) || (nChunks > N_CHUNKS) ||
+      (nChannels < 1) || (nChannels > P_N_SWARM_CHANNELS) || (period <= 0.0) ||
+      (nSenders < 1) || (nSenders > MAX_SENDERS) || (nIntegrations < 1))
+    usage(argv[0]);
+  corrSaverHost = host;
+  started = (double *)malloc(nIntegrations*sizeof(double));
+  done = (double *)malloc(nIntegrations*sizeof(double));
+  latency = (double *)malloc(nIntegrations*sizeof(double));
+  if ((started == NULL) || (done == NULL) || (latency == NULL)) {
+    perror("malloc");
+    exit(ERROR);
+  }
+  for (i = 0; i < nIntegrations; i++)
+    started[i] = done[i] = 0.0;
+
+  /* Give the senders a moment to start before the first integration */
+  start = now() + 1.0;
+  for (i = 0; i < nSenders; i++) {
+    int pipeFds[2];
+
+    if (pipe(pipeFds) < 0) {
+      perror("pipe");
+      exit(ERROR);
+    }
+    pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      exit(ERROR);
+    }
+    if (pid == 0) {
+      close(pipeFds[0]);
+      sender(i, start, pipeFds[1]);
+    }
+    close(pipeFds[1]);
+    fds[i] = pipeFds[0];
+    polls[i].fd = fds[i];
+    polls[i].events = POLLIN;
+  }
+
+  /* An integration is done when every sender has reported it done */
+  nOpen = nSenders;
+  while (nOpen > 0) {
+    if (poll(polls, nSenders, -1) < 0) {
+      perror("poll");
+      exit(ERROR);
+    }
+    for (i = 0; i < nSenders; i++) {
+      if (polls[i].revents == 0)
+	continue;
+      if (read(polls[i].fd, &report, sizeof(report)) != sizeof(report)) {
+	close(polls[i].fd);
+	polls[i].fd = -1;
+	nOpen--;
+	continue;
+      }
+      nCalls += report.nCalls;
+      nErrors += report.nErrors;
+      nCongested += report.nCongested;
+      if ((report.integration >= 0) && (report.integration < nIntegrations)) {
+	if ((started[report.integration] == 0.0) || (report.started < started[report.integration]))
+	  started[report.integration] = report.started;
+	if (report.done > done[report.integration])
+	  done[report.integration] = report.done;
+      }
+    }
+  }
+  while (wait(NULL) > 0);
+
+  /*
+    Integrations a sender never finished, because it died, are left out.
+    The busy time is the union of the spans from the first sender starting
+    an integration to the last finishing it - a late integration overlaps
+    the next one, and that time is only counted once.
+  */
+  busyEnd = start;
+  for (i = 0; i < nIntegrations; i++) {
+    if (done[i] == 0.0)
+      continue;
+    latency[nDone] = done[i] - (start + ((double)i)*period);
+    sum += latency[nDone];
+    if (latency[nDone] > period)
+      nLate++;
+    if (done[i] > busyEnd) {
+      busy += done[i] - ((started[i] > busyEnd) ? started[i] : busyEnd);
+      busyEnd = done[i];
+    }
+    nDone++;
+  }
+  if (nDone == 0) {
+    fprintf(stderr, "No integrations were completed\n");
+    exit(ERROR);
+  }
+  qsort(latency, nDone, sizeof(double), compareDoubles);
+  p99 = percentile(latency, nDone, 0.99);
+  if (busy <= 0.0)
+    busy = 1.0e-9;
+  nAutoCalls = (double)(nAntennas*nDone);
+  nCrossCalls = (double)(nAntennas*(nAntennas-1)/2*nChunks*nDone);
+  bytesPerCall = 4.0*nChannels;
+  printf("%d integrations of %d antennas, %d chunks, %d channels every %.3f s, %d senders, to %s on %s\n",
+	 nIntegrations, nAntennas, nChunks, nChannels, period, nSenders,
+	 toDataCatcher ? "dataCatcher" : "corrSaver", host);
+  printf("%d calls, %d errors, %d congested, busy %.3f s: %.1f calls/s, %.2f MB/s of spectra\n",
+	 nCalls, nErrors, nCongested, busy, ((double)nCalls)/busy,
+	 (nAutoCalls*bytesPerCall + nCrossCalls*4.0*bytesPerCall)/busy*1.0e-6);
+  printf("Latency (s) of %d integrations: mean %.3f  50%% %.3f  90%% %.3f  99%% %.3f  max %.3f\n",
+	 nDone, sum/((double)nDone), percentile(latency, nDone, 0.5),
+	 percentile(latency, nDone, 0.9), p99, latency[nDone-1]);
+  if (nDone < MIN_FOR_P99)
+    fprintf(stderr, "Warning: only %d integrations completed - with fewer than %d the 99%% latency is the max\n",
+	    nDone, MIN_FOR_P99);
+  printf("%d of %d integrations took longer than the period - headroom %.1f%%\n", nLate,
+	 nDone, 100.0*(1.0 - p99/period));
+  return((nErrors || (nDone < nIntegrations)) ? ERROR : OK);
+}